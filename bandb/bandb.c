@@ -52,6 +52,10 @@ static char bandb_letter[LAST_BANDB_TYPE] = {
     'K', 'D', 'X', 'R'
 };
 
+static char bandb_unletter[LAST_BANDB_TYPE] = {
+    'k', 'd', 'x', 'r'
+};
+
 static const char *bandb_table[LAST_BANDB_TYPE] = {
     "kline", "dline", "xline", "resv"
 };
@@ -60,7 +64,11 @@ static const char *bandb_table[LAST_BANDB_TYPE] = {
 static rb_helper *bandb_helper;
 static int in_transaction;
 
+static struct rsdb_stmt *add_stmt[LAST_BANDB_TYPE];
+static struct rsdb_stmt *del_stmt[LAST_BANDB_TYPE];
+
 static void check_schema(void);
+static void prepare_statements(void);
 
 static void
 bandb_commit(void *unused)
@@ -103,9 +111,13 @@ parse_ban(bandb_type type, char *parv[], int parc)
                          COMMIT_INTERVAL);
     }
 
-    rsdb_exec(NULL,
-              "INSERT INTO %s (mask1, mask2, oper, time, perm, reason) VALUES('%Q', '%Q', '%Q', %s, %s, '%Q')",
-              bandb_table[type], mask1, mask2 ? mask2 : "", oper, curtime, perm, reason);
+    rsdb_bind(add_stmt[type], 1, mask1);
+    rsdb_bind(add_stmt[type], 2, mask2 ? mask2 : "");
+    rsdb_bind(add_stmt[type], 3, oper);
+    rsdb_bind(add_stmt[type], 4, curtime);
+    rsdb_bind(add_stmt[type], 5, perm);
+    rsdb_bind(add_stmt[type], 6, reason);
+    rsdb_step(add_stmt[type]);
 }
 
 static void
@@ -132,41 +144,138 @@ parse_unban(bandb_type type, char *parv[], int parc)
                          COMMIT_INTERVAL);
     }
 
-    rsdb_exec(NULL, "DELETE FROM %s WHERE mask1='%Q' AND mask2='%Q'",
-              bandb_table[type], mask1, mask2 ? mask2 : "");
+    rsdb_bind(del_stmt[type], 1, mask1);
+    rsdb_bind(del_stmt[type], 2, mask2 ? mask2 : "");
+    rsdb_step(del_stmt[type]);
+}
+
+/* send_bans()
+ *
+ * inputs	- type of ban, generation to list from (0 for all of them)
+ * outputs	-
+ * side effects - every ban of the type added after the generation is
+ *		  queued to the ircd
+ */
+static void
+send_bans(bandb_type type, unsigned long since)
+{
+    struct rsdb_stmt *stmt;
+
+    /* rows from before generations were kept have none, and only ever
+     * go out in a full listing
+     */
+    if(since == 0)
+        stmt = rsdb_prepare("SELECT mask1,mask2,oper,reason FROM %s", bandb_table[type]);
+    else
+        stmt = rsdb_prepare("SELECT mask1,mask2,oper,reason FROM %s WHERE gen > %lu",
+                            bandb_table[type], since);
+
+    while(rsdb_step(stmt)) {
+        if(type == BANDB_KLINE)
+            rb_helper_write_queue(bandb_helper, "%c %s %s %s :%s",
+                                  bandb_letter[type], rsdb_column(stmt, 0),
+                                  rsdb_column(stmt, 1), rsdb_column(stmt, 2),
+                                  rsdb_column(stmt, 3));
+        else
+            rb_helper_write_queue(bandb_helper, "%c %s %s :%s",
+                                  bandb_letter[type], rsdb_column(stmt, 0),
+                                  rsdb_column(stmt, 2), rsdb_column(stmt, 3));
+    }
+
+    rsdb_finalize(stmt);
+}
+
+/* send_removals()
+ *
+ * inputs	- generation to list from
+ * outputs	-
+ * side effects - every ban removed after the generation is queued to
+ *		  the ircd as an unban
+ */
+static void
+send_removals(unsigned long since)
+{
+    struct rsdb_stmt *stmt;
+    int type;
+
+    stmt = rsdb_prepare("SELECT type,mask1,mask2 FROM bandb_deleted WHERE gen > %lu ORDER BY gen",
+                        since);
+
+    while(rsdb_step(stmt)) {
+        type = atoi(rsdb_column(stmt, 0));
+
+        if(type < 0 || type >= LAST_BANDB_TYPE)
+            continue;
+
+        if(type == BANDB_KLINE)
+            rb_helper_write_queue(bandb_helper, "%c %s %s",
+                                  bandb_unletter[type],
+                                  rsdb_column(stmt, 1), rsdb_column(stmt, 2));
+        else
+            rb_helper_write_queue(bandb_helper, "%c %s",
+                                  bandb_unletter[type], rsdb_column(stmt, 1));
+    }
+
+    rsdb_finalize(stmt);
 }
 
+/* list_bans()
+ *
+ * inputs	- epoch and generation the ircd last synced to, 0 if never
+ * outputs	-
+ * side effects - if the ircd is on the current epoch, it is sent only
+ *		  what changed since its generation:
+ *
+ *		    S, unbans, bans, G <epoch> <generation>
+ *
+ *		  otherwise it is sent every ban:
+ *
+ *		    C, bans, F <epoch> <generation>
+ */
 static void
-list_bans(void)
+list_bans(unsigned long epoch, unsigned long since)
 {
-    static char buf[512];
     struct rsdb_table table;
-    int i, j;
+    unsigned long cur_epoch = 0, cur_gen = 0;
+    int i;
 
-    /* schedule a clear of anything already pending */
-    rb_helper_write_queue(bandb_helper, "C");
+    /* bantool may have been at the tables since we last looked */
+    check_schema();
 
-    for(i = 0; i < LAST_BANDB_TYPE; i++) {
-        rsdb_exec_fetch(&table, "SELECT mask1,mask2,oper,reason FROM %s WHERE 1",
-                        bandb_table[i]);
-
-        for(j = 0; j < table.row_count; j++) {
-            if(i == BANDB_KLINE)
-                rb_snprintf(buf, sizeof(buf), "%c %s %s %s :%s",
-                            bandb_letter[i], table.row[j][0],
-                            table.row[j][1], table.row[j][2], table.row[j][3]);
-            else
-                rb_snprintf(buf, sizeof(buf), "%c %s %s :%s",
-                            bandb_letter[i], table.row[j][0],
-                            table.row[j][2], table.row[j][3]);
+    rsdb_exec_fetch(&table, "SELECT epoch,gen FROM bandb_sync");
 
-            rb_helper_write_queue(bandb_helper, "%s", buf);
-        }
+    if(table.row_count) {
+        cur_epoch = strtoul(table.row[0][0], NULL, 10);
+        cur_gen = strtoul(table.row[0][1], NULL, 10);
+    }
+
+    rsdb_exec_fetch_end(&table);
+
+    if(since == 0 || epoch != cur_epoch || since > cur_gen) {
+        /* schedule a clear of anything already pending */
+        rb_helper_write_queue(bandb_helper, "C");
 
-        rsdb_exec_fetch_end(&table);
+        for(i = 0; i < LAST_BANDB_TYPE; i++)
+            send_bans(i, 0);
+
+        /* nothing removed so far matters to the ircd any more */
+        rsdb_exec(NULL, "DELETE FROM bandb_deleted WHERE gen <= %lu", cur_gen);
+        rb_helper_write(bandb_helper, "F %lu %lu", cur_epoch, cur_gen);
+        return;
     }
 
-    rb_helper_write(bandb_helper, "F");
+    rb_helper_write_queue(bandb_helper, "S");
+
+    /* removals go first, so a ban removed and added again stays */
+    send_removals(since);
+
+    for(i = 0; i < LAST_BANDB_TYPE; i++)
+        send_bans(i, since);
+
+    /* the ircd asking from since means it has everything before it */
+    rsdb_exec(NULL, "DELETE FROM bandb_deleted WHERE gen <= %lu", since);
+
+    rb_helper_write(bandb_helper, "G %lu %lu", cur_epoch, cur_gen);
 }
 
 static void
@@ -218,7 +327,10 @@ parse_request(rb_helper *helper)
             break;
 
         case 'L':
-            list_bans();
+            if(parc >= 3)
+                list_bans(strtoul(parv[1], NULL, 10), strtoul(parv[2], NULL, 10));
+            else
+                list_bans(0, 0);
             break;
         default:
             break;
@@ -298,27 +410,119 @@ main(int argc, char *argv[])
     }
     rsdb_init(db_error_cb);
     check_schema();
+    prepare_statements();
     rb_helper_loop(bandb_helper, 0);
 
     return 0;
 }
 
+static int
+schema_has(const char *type, const char *name)
+{
+    struct rsdb_table table;
+
+    rsdb_exec_fetch(&table,
+                    "SELECT name FROM sqlite_master WHERE type='%s' AND name='%s'",
+                    type, name);
+    rsdb_exec_fetch_end(&table);
+
+    return table.row_count;
+}
+
+static int
+table_has_column(const char *name, const char *column)
+{
+    struct rsdb_table table;
+    int i, found = 0;
+
+    rsdb_exec_fetch(&table, "PRAGMA table_info(%s)", name);
+
+    for(i = 0; i < table.row_count; i++)
+        if(!strcmp(table.row[i][1], column))
+            found = 1;
+
+    rsdb_exec_fetch_end(&table);
+    return found;
+}
+
+/* check_schema()
+ *
+ * every change to a ban table bumps bandb_sync.gen, stamping an added
+ * row with the new generation or leaving a bandb_deleted row behind for
+ * a removed one.  this is done by triggers, so changes made by bantool
+ * are seen too.  if a table turns up without its triggers (new, from an
+ * older bandb, or recreated by bantool) changes may have gone unseen,
+ * so the epoch is moved on and the ircd's next sync is a full one.
+ */
 static void
 check_schema(void)
 {
-    struct rsdb_table table;
-    int i;
+    char name[64];
+    int i, changed = 0;
 
-    for(i = 0; i < LAST_BANDB_TYPE; i++) {
-        rsdb_exec_fetch(&table,
-                        "SELECT name FROM sqlite_master WHERE type='table' AND name='%s'",
-                        bandb_table[i]);
+    if(!schema_has("table", "bandb_sync")) {
+        rsdb_exec(NULL, "CREATE TABLE bandb_sync (epoch INTEGER, gen INTEGER)");
+        rsdb_exec(NULL, "INSERT INTO bandb_sync (epoch, gen) VALUES(%lu, 0)",
+                  (unsigned long) time(NULL));
+    }
 
-        rsdb_exec_fetch_end(&table);
+    if(!schema_has("table", "bandb_deleted")) {
+        rsdb_exec(NULL,
+                  "CREATE TABLE bandb_deleted (type INTEGER, mask1 TEXT, mask2 TEXT, gen INTEGER)");
+        rsdb_exec(NULL, "CREATE INDEX bandb_deleted_gen ON bandb_deleted (gen)");
+    }
 
-        if(!table.row_count)
+    for(i = 0; i < LAST_BANDB_TYPE; i++) {
+        if(!schema_has("table", bandb_table[i]))
             rsdb_exec(NULL,
-                      "CREATE TABLE %s (mask1 TEXT, mask2 TEXT, oper TEXT, time INTEGER, perm INTEGER, reason TEXT)",
+                      "CREATE TABLE %s (mask1 TEXT, mask2 TEXT, oper TEXT, time INTEGER, perm INTEGER, reason TEXT, gen INTEGER)",
                       bandb_table[i]);
+        else if(!table_has_column(bandb_table[i], "gen"))
+            rsdb_exec(NULL, "ALTER TABLE %s ADD COLUMN gen INTEGER", bandb_table[i]);
+
+        rb_snprintf(name, sizeof(name), "%s_gen", bandb_table[i]);
+
+        if(!schema_has("index", name))
+            rsdb_exec(NULL, "CREATE INDEX %s ON %s (gen)", name, bandb_table[i]);
+
+        rb_snprintf(name, sizeof(name), "%s_add", bandb_table[i]);
+
+        if(!schema_has("trigger", name)) {
+            rsdb_exec(NULL,
+                      "CREATE TRIGGER %s AFTER INSERT ON %s BEGIN "
+                      "UPDATE bandb_sync SET gen = gen + 1; "
+                      "UPDATE %s SET gen = (SELECT gen FROM bandb_sync) WHERE rowid = NEW.rowid; "
+                      "END", name, bandb_table[i], bandb_table[i]);
+            changed = 1;
+        }
+
+        rb_snprintf(name, sizeof(name), "%s_del", bandb_table[i]);
+
+        if(!schema_has("trigger", name)) {
+            rsdb_exec(NULL,
+                      "CREATE TRIGGER %s AFTER DELETE ON %s BEGIN "
+                      "UPDATE bandb_sync SET gen = gen + 1; "
+                      "INSERT INTO bandb_deleted (type, mask1, mask2, gen) "
+                      "VALUES(%d, OLD.mask1, OLD.mask2, (SELECT gen FROM bandb_sync)); "
+                      "END", name, bandb_table[i], i);
+            changed = 1;
+        }
+    }
+
+    if(changed)
+        rsdb_exec(NULL, "UPDATE bandb_sync SET epoch = epoch + 1");
+}
+
+/* the ircd's adds and removes run these, with its masks bound in */
+static void
+prepare_statements(void)
+{
+    int i;
+
+    for(i = 0; i < LAST_BANDB_TYPE; i++) {
+        add_stmt[i] = rsdb_prepare("INSERT INTO %s (mask1, mask2, oper, time, perm, reason) VALUES(?, ?, ?, ?, ?, ?)",
+                                   bandb_table[i]);
+        del_stmt[i] = rsdb_prepare("DELETE FROM %s WHERE mask1=? AND mask2=?",
+                                   bandb_table[i]);
     }
 }
@@ -19,6 +19,8 @@ struct rsdb_table {
     void *arg;
 };
 
+struct rsdb_stmt;
+
 int rsdb_init(rsdb_error_cb *);
 void rsdb_shutdown(void);
 
@@ -30,6 +32,13 @@ void rsdb_exec_fetch(struct rsdb_table *data, const char *format, ...);
 void rsdb_exec_fetch_end(struct rsdb_table *data);
 
 void rsdb_transaction(rsdb_transtype type);
+
+struct rsdb_stmt *rsdb_prepare(const char *format, ...);
+void rsdb_bind(struct rsdb_stmt *stmt, int param, const char *value);
+int rsdb_step(struct rsdb_stmt *stmt);
+const char *rsdb_column(struct rsdb_stmt *stmt, int col);
+void rsdb_finalize(struct rsdb_stmt *stmt);
+
 /* rsdb_snprintf.c */
 
 int rs_vsnprintf(char *dest, const size_t bytes, const char *format, va_list args);
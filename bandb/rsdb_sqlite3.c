@@ -244,3 +244,89 @@ rsdb_transaction(rsdb_transtype type)
     else if(type == RSDB_TRANS_END)
         rsdb_exec(NULL, "COMMIT TRANSACTION");
 }
+
+/*
+ * Prepared statements.
+ *
+ * The format only ever fills in table names, the values themselves are
+ * bound to the statement's ? parameters, so they need no quoting and the
+ * statement is compiled once however many times it is run.
+ */
+struct rsdb_stmt {
+    sqlite3_stmt *stmt;
+};
+
+struct rsdb_stmt *
+rsdb_prepare(const char *format, ...)
+{
+    static char buf[BUFSIZE * 4];
+    struct rsdb_stmt *stmt;
+    va_list args;
+    unsigned int i;
+
+    va_start(args, format);
+    i = rs_vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+
+    if(i >= sizeof(buf)) {
+        mlog("fatal error: length problem with compiling sql");
+    }
+
+    stmt = rb_malloc(sizeof(struct rsdb_stmt));
+
+    if(sqlite3_prepare_v2(rb_bandb, buf, -1, &stmt->stmt, NULL) != SQLITE_OK)
+        mlog("fatal error: problem with db file: %s", sqlite3_errmsg(rb_bandb));
+
+    return stmt;
+}
+
+/* parameters are numbered from 1, as in the sql */
+void
+rsdb_bind(struct rsdb_stmt *stmt, int param, const char *value)
+{
+    sqlite3_bind_text(stmt->stmt, param, value, -1, SQLITE_TRANSIENT);
+}
+
+/* rsdb_step()
+ *
+ * runs the statement on to its next row, returning 1 if there is one.
+ * once there are none left the statement is reset, ready to be bound
+ * and run again.
+ */
+int
+rsdb_step(struct rsdb_stmt *stmt)
+{
+    int i, j;
+
+    i = sqlite3_step(stmt->stmt);
+
+    for(j = 0; i == SQLITE_BUSY && j < 5; j++) {
+        rb_sleep(0, 500000);
+        i = sqlite3_step(stmt->stmt);
+    }
+
+    if(i == SQLITE_ROW)
+        return 1;
+
+    sqlite3_reset(stmt->stmt);
+
+    if(i != SQLITE_DONE)
+        mlog("fatal error: problem with db file: %s", sqlite3_errmsg(rb_bandb));
+
+    return 0;
+}
+
+const char *
+rsdb_column(struct rsdb_stmt *stmt, int col)
+{
+    const char *value = (const char *) sqlite3_column_text(stmt->stmt, col);
+
+    return value != NULL ? value : "";
+}
+
+void
+rsdb_finalize(struct rsdb_stmt *stmt)
+{
+    sqlite3_finalize(stmt->stmt);
+    rb_free(stmt);
+}
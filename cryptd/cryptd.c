@@ -0,0 +1,125 @@
+/*
+ *  cryptd.c: password hash helper for ircd
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ *  The ircd hands us lines of the form
+ *
+ *	C <id> <hash> <password>
+ *
+ *  and we answer each, in order, with
+ *
+ *	R <id> <1 if the password matches the hash, else 0>
+ *
+ *  so slow crypt() hashes never hold up the ircd's event loop.
+ */
+#include "setup.h"
+#include <ratbox_lib.h>
+#include <stdio.h>
+
+#ifndef READBUF_SIZE
+#define READBUF_SIZE 16384
+#endif
+
+static rb_helper *cryptd_helper;
+
+static void
+parse_request(rb_helper *helper)
+{
+    static char readbuf[READBUF_SIZE];
+    char *id, *hash, *password;
+    const char *encr;
+    int len;
+
+    while((len = rb_helper_read(helper, readbuf, sizeof(readbuf))) > 0) {
+        if(readbuf[0] != 'C' || readbuf[1] != ' ')
+            continue;
+
+        id = readbuf + 2;
+
+        if((hash = strchr(id, ' ')) == NULL)
+            continue;
+        *hash++ = '\0';
+
+        /* the password is the rest of the line, spaces and all */
+        if((password = strchr(hash, ' ')) == NULL)
+            continue;
+        *password++ = '\0';
+
+        encr = rb_crypt(password, hash);
+        rb_helper_write(helper, "R %s %d", id, encr != NULL && !strcmp(encr, hash));
+
+        memset(password, 0, strlen(password));
+    }
+}
+
+static void
+error_cb(rb_helper *helper)
+{
+    exit(1);
+}
+
+#ifndef _WIN32
+static void
+dummy_handler(int sig)
+{
+    return;
+}
+#endif
+
+static void
+setup_signals(void)
+{
+#ifndef _WIN32
+    struct sigaction act;
+
+    act.sa_flags = 0;
+    act.sa_handler = SIG_IGN;
+    sigemptyset(&act.sa_mask);
+    sigaddset(&act.sa_mask, SIGPIPE);
+    sigaddset(&act.sa_mask, SIGALRM);
+#ifdef SIGTRAP
+    sigaddset(&act.sa_mask, SIGTRAP);
+#endif
+
+#ifdef SIGWINCH
+    sigaddset(&act.sa_mask, SIGWINCH);
+    sigaction(SIGWINCH, &act, 0);
+#endif
+    sigaction(SIGPIPE, &act, 0);
+#ifdef SIGTRAP
+    sigaction(SIGTRAP, &act, 0);
+#endif
+
+    act.sa_handler = dummy_handler;
+    sigaction(SIGALRM, &act, 0);
+#endif
+}
+
+int
+main(int argc, char *argv[])
+{
+    setup_signals();
+    cryptd_helper = rb_helper_child(parse_request, error_cb, NULL, NULL, NULL, 256, 256, 256, 256);
+    if(cryptd_helper == NULL) {
+        fprintf(stderr, "This is ircd cryptd.  You aren't supposed to run me directly.\n");
+        fprintf(stderr, "Have a nice day\n");
+        exit(1);
+    }
+    rb_helper_loop(cryptd_helper, 0);
+
+    return 0;
+}
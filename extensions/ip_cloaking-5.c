@@ -19,6 +19,7 @@
 #include "s_serv.h"
 #include "numeric.h"
 #include "newconf.h"
+#include "scache.h"
 
 char *secretsalt = "32qwnqoWI@DpMd&w";
 char *cloakprefix = "net/";
@@ -153,7 +154,7 @@ do_host_cloak_ipv6(const char *inbuf, char *outbuf)
 }
 
 static void
-distribute_hostchange(struct Client *client_p, char *newhost)
+distribute_hostchange(struct Client *client_p, const char *newhost)
 {
     if (newhost != client_p->orighost)
         sendto_one_numeric(client_p, RPL_HOSTHIDDEN, "%s :is now your hidden host",
@@ -290,7 +291,7 @@ check_new_user(void *vdata)
     if (IsDynSpoof(source_p))
         source_p->umodes &= ~user_modes['x'];
     if (source_p->umodes & user_modes['x']) {
-        rb_strlcpy(source_p->host, source_p->localClient->mangledhost, sizeof(source_p->host));
+        scache_set(&source_p->host, source_p->localClient->mangledhost, HOSTLEN + 1);
         if (irccmp(source_p->host, source_p->orighost))
             SetDynSpoof(source_p);
     }
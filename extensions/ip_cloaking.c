@@ -16,6 +16,7 @@
 #include "s_user.h"
 #include "s_serv.h"
 #include "numeric.h"
+#include "scache.h"
 
 static int
 _modinit(void)
@@ -47,7 +48,7 @@ DECLARE_MODULE_AV1(ip_cloaking, _modinit, _moddeinit, NULL, NULL,
                    ip_cloaking_hfnlist, "$Revision: 3526 $");
 
 static void
-distribute_hostchange(struct Client *client_p, char *newhost)
+distribute_hostchange(struct Client *client_p, const char *newhost)
 {
     if (newhost != client_p->orighost)
         sendto_one_numeric(client_p, RPL_HOSTHIDDEN, "%s :is now your hidden host",
@@ -202,7 +203,7 @@ check_new_user(void *vdata)
     if (IsDynSpoof(source_p))
         source_p->umodes &= ~user_modes['x'];
     if (source_p->umodes & user_modes['x']) {
-        rb_strlcpy(source_p->host, source_p->localClient->mangledhost, sizeof(source_p->host));
+        scache_set(&source_p->host, source_p->localClient->mangledhost, HOSTLEN + 1);
         if (irccmp(source_p->host, source_p->orighost))
             SetDynSpoof(source_p);
     }
@@ -228,5 +228,6 @@ mo_omode(struct Client *client_p, struct Client *source_p, int parc, const char
             remove_user_from_channel(msptr);
     }
 #endif
+    invalidate_namescache(chptr);
     return 0;
 }
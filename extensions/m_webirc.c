@@ -53,16 +53,36 @@
 #include "hash.h"
 #include "s_conf.h"
 #include "reject.h"
+#include "s_user.h"
+#include "cryptdi.h"
+#include "scache.h"
 
 static int mr_webirc(struct Client *, struct Client *, int, const char **);
+static void webirc_password_cb(struct Client *, int, void *);
+static void webirc_apply(struct Client *, const char *, const char *);
+
+/* a WEBIRC waiting on cryptd */
+struct webirc_check {
+    char host[HOSTLEN + 1];
+    char ip[HOSTIPLEN + 1];
+};
 
 struct Message webirc_msgtab = {
     "WEBIRC", 0, 0, 0, MFLG_SLOW | MFLG_UNREG,
     {{mr_webirc, 5}, mg_reg, mg_ignore, mg_ignore, mg_ignore, mg_reg}
 };
 
+static void _moddeinit(void);
+
 mapi_clist_av1 webirc_clist[] = { &webirc_msgtab, NULL };
-DECLARE_MODULE_AV1(webirc, NULL, NULL, webirc_clist, NULL, NULL, "$Revision: 20702 $");
+DECLARE_MODULE_AV1(webirc, NULL, _moddeinit, webirc_clist, NULL, NULL, "$Revision: 20702 $");
+
+static void
+_moddeinit(void)
+{
+    /* cryptd must not answer into this module once it is gone */
+    crypt_cancel_callback(webirc_password_cb);
+}
 
 /*
  * mr_webirc - webirc message handler
@@ -99,10 +119,30 @@ mr_webirc(struct Client *client_p, struct Client *source_p, int parc, const char
         return 0;
     }
 
-    if (EmptyString(parv[1]))
+    if (!EmptyString(parv[1]) && IsConfEncrypted(aconf)) {
+        struct webirc_check *check = rb_malloc(sizeof(struct webirc_check));
+        int result;
+
+        if(strlen(parv[3]) <= HOSTLEN)
+            rb_strlcpy(check->host, parv[3], sizeof(check->host));
+        rb_strlcpy(check->ip, parv[4], sizeof(check->ip));
+
+        result = crypt_verify(source_p, parv[1], aconf->passwd, webirc_password_cb, check);
+
+        /* registration waits for webirc_password_cb() */
+        if (result == CRYPT_QUEUED)
+            return 0;
+
+        rb_free(check);
+
+        if (result == CRYPT_BUSY) {
+            sendto_one(source_p, "NOTICE * :CGI:IRC server busy, try again later");
+            return 0;
+        }
+
+        encr = result == CRYPT_MATCH ? aconf->passwd : "";
+    } else if (EmptyString(parv[1]))
         encr = "";
-    else if (IsConfEncrypted(aconf))
-        encr = rb_crypt(parv[1], aconf->passwd);
     else
         encr = parv[1];
 
@@ -111,28 +151,70 @@ mr_webirc(struct Client *client_p, struct Client *source_p, int parc, const char
         return 0;
     }
 
+    webirc_apply(source_p, strlen(parv[3]) <= HOSTLEN ? parv[3] : "", parv[4]);
+    return 0;
+}
 
-    rb_strlcpy(source_p->sockhost, parv[4], sizeof(source_p->sockhost));
+/*
+ * webirc_password_cb - cryptd has checked a WEBIRC password
+ */
+static void
+webirc_password_cb(struct Client *source_p, int result, void *data)
+{
+    struct webirc_check *check = data;
+    char buf[USERLEN + 1];
+
+    if (source_p == NULL) {
+        rb_free(check);
+        return;
+    }
+
+    if (result == CRYPT_BUSY)
+        sendto_one(source_p, "NOTICE * :CGI:IRC server busy, try again later");
+    else if (result != CRYPT_MATCH)
+        sendto_one(source_p, "NOTICE * :CGI:IRC password incorrect");
+    else
+        webirc_apply(source_p, check->host, check->ip);
+
+    rb_free(check);
+
+    if (!IsAnyDead(source_p) && source_p->flags & FLAGS_SENTUSER &&
+        !EmptyString(source_p->name)) {
+        rb_strlcpy(buf, source_p->username, sizeof buf);
+        register_local_user(source_p, source_p, buf);
+    }
+}
 
-    if(strlen(parv[3]) <= HOSTLEN)
-        rb_strlcpy(source_p->host, parv[3], sizeof(source_p->host));
+/*
+ * webirc_apply - the client is now coming from host and ip
+ */
+static void
+webirc_apply(struct Client *source_p, const char *host, const char *ip)
+{
+    struct ConfItem *aconf;
+
+    rb_strlcpy(source_p->sockhost, ip, sizeof(source_p->sockhost));
+
+    if(!EmptyString(host))
+        scache_set(&source_p->host, host, HOSTLEN + 1);
     else
-        rb_strlcpy(source_p->host, source_p->sockhost, sizeof(source_p->host));
+        scache_set(&source_p->host, source_p->sockhost, HOSTLEN + 1);
 
-    rb_inet_pton_sock(parv[4], (struct sockaddr *)&source_p->localClient->ip);
+    del_from_client_ip_index(source_p);
+    rb_inet_pton_sock(ip, (struct sockaddr *)&source_p->localClient->ip);
+    add_to_client_ip_index(source_p);
 
     /* Check dlines now, klines will be checked on registration */
     if((aconf = find_dline((struct sockaddr *)&source_p->localClient->ip,
                            source_p->localClient->ip.ss_family))) {
         if(!(aconf->status & CONF_EXEMPTDLINE)) {
-            exit_client(client_p, source_p, &me, "D-lined");
-            return 0;
+            exit_client(source_p, source_p, &me, "D-lined");
+            return;
         }
     }
 
     /* Set UMODE_WEBCLIENT */
     source_p->umodes = source_p->umodes | UMODE_WEBCLIENT;
 
-    sendto_one(source_p, "NOTICE * :CGI:IRC host/IP set to %s %s", parv[3], parv[4]);
-    return 0;
+    sendto_one(source_p, "NOTICE * :CGI:IRC host/IP set to %s %s", source_p->host, ip);
 }
@@ -33,6 +33,8 @@
 #define MAXMODEPARAMSSERV 10
 
 struct Client;
+struct ChanBanIndex;
+struct NamesCache;
 
 /* mode structure for channels */
 struct Mode {
@@ -73,8 +75,31 @@ struct Channel {
     struct Dictionary *metadata;
 
     unsigned long bants;
+    struct ChanBanIndex *banindex;	/* compiled b/e/q lists, see is_banned() */
     time_t channelts;
     char *chname;
+
+    rb_dlink_node dir_node;	/* see update_channel_dir() */
+    unsigned int dir_bucket;
+    unsigned int dir_slot;
+    char *listbody;		/* cached RPL_LIST text, see channel_list_body() */
+    struct NamesCache *names[4];	/* cached RPL_NAMREPLY lists, see channel_member_names() */
+};
+
+/*
+ * The channel directory files every channel under its member count, the
+ * last list holding everything bigger, so LIST walks from the biggest
+ * channels down and stops at the smallest count asked for.
+ */
+#define CHANNEL_DIR_SIZE	1024
+
+struct ChannelDirCursor {
+    int bucket;			/* list being walked */
+    int last;			/* last list to walk */
+    rb_dlink_node *next;	/* next channel on it */
+    unsigned char *seen;	/* bitmap of dir_slots already given out */
+    unsigned int seenlen;
+    rb_dlink_node node;
 };
 
 struct membership {
@@ -224,6 +249,14 @@ void free_ban(struct Ban *bptr);
 
 extern void destroy_channel(struct Channel *);
 
+extern rb_dlink_list channel_dir[CHANNEL_DIR_SIZE];
+extern void update_channel_dir(struct Channel *);
+extern void channel_dir_cursor_start(struct ChannelDirCursor *cursor,
+                                     unsigned int users_min, unsigned int users_max);
+extern struct Channel *channel_dir_cursor_next(struct ChannelDirCursor *cursor);
+extern void channel_dir_cursor_stop(struct ChannelDirCursor *cursor);
+extern const char *channel_list_body(struct Channel *chptr);
+
 extern int can_send(struct Channel *chptr, struct Client *who,
                     struct membership *);
 extern int flood_attack_channel(int p_or_n, struct Client *source_p,
@@ -246,6 +279,8 @@ extern void add_user_to_channel(struct Channel *, struct Client *, int flags);
 extern void remove_user_from_channel(struct membership *);
 extern void remove_user_from_channels(struct Client *);
 extern void invalidate_bancache_user(struct Client *);
+extern void invalidate_namescache(struct Channel *);
+extern void invalidate_namescache_user(struct Client *);
 
 extern void free_channel_list(rb_dlink_list *);
 
@@ -71,8 +71,24 @@ struct LocalUser;
 struct AuthRequest;
 struct PreClient;
 struct ListClient;
+struct ChannelDirCursor;
+struct ServerBurst;
+struct ClientHostNode;
+struct CryptRequest;
 struct scache_entry;
 
+/*
+ * A nick, username, host or realname in the WHO index, shared by every
+ * user carrying it, see add_to_who_index()
+ */
+struct WhoKey {
+    char *name;
+    char *rname;		/* name reversed, for suffix lookups */
+    rb_dlink_list users;
+};
+
+#define WHO_FIELDS	5	/* nick, username, host, orighost, realname */
+
 /*
  * Client structures
  */
@@ -85,6 +101,11 @@ struct User {
     struct Dictionary *metadata;
 
     char suser[NICKLEN+1];
+
+    struct WhoKey *who_key[WHO_FIELDS];
+    rb_dlink_node who_node[WHO_FIELDS];
+
+    unsigned long serial;	/* when we were introduced, see burst_start() */
 };
 
 struct Server {
@@ -126,6 +147,7 @@ struct Client {
     unsigned short status;	/* Client type */
     unsigned char handler;	/* Handler index */
     unsigned long serial;	/* used to enforce 1 send per nick */
+    unsigned long listserial;	/* order on global_client_list */
 
     /* client->name is the unique name for a client nick or host */
     char name[HOSTLEN + 1];
@@ -142,11 +164,15 @@ struct Client {
     /*
      * client->host contains the resolved name or ip address
      * as a string for the user, it may be fiddled with for oper spoofing etc.
+     *
+     * host, orighost and info repeat a great deal across a network, so
+     * they are shared through scache_intern() and only ever changed
+     * with scache_set().
      */
-    char host[HOSTLEN + 1];	/* client's hostname */
-    char orighost[HOSTLEN + 1]; /* original hostname (before dynamic spoofing) */
+    const char *host;		/* client's hostname */
+    const char *orighost;	/* original hostname (before dynamic spoofing) */
     char sockhost[HOSTIPLEN + 1]; /* clients ip */
-    char info[REALLEN + 1];	/* Free form additional client info */
+    const char *info;		/* Free form additional client info */
 
     char id[IDLEN];	/* UID/SID, unique on the network */
 
@@ -164,10 +190,20 @@ struct Client {
 
     time_t large_ctcp_sent; /* ctcp to large group sent, relax flood checks */
     char *certfp; /* client certificate fingerprint */
+
+    char *prefix;		/* cached ":nick!user@host", see get_client_prefix() */
+    size_t prefixlen;
 };
 
 struct LocalUser {
     rb_dlink_node tnode;	/* This is the node for the local list type the client is on*/
+    rb_timer_t check_timer;	/* next ping or registration timeout check */
+    rb_patricia_node_t *ipnode;	/* our address in the ban check index */
+    rb_dlink_node ipnode_link;
+    struct ClientHostNode *hostnode[2];	/* host and orighost in the ban check index */
+    rb_dlink_node hostnode_link[2];
+    unsigned int ban_check_serial;	/* last targeted ban check that saw us */
+    struct CryptRequest *crypt_req;	/* password check waiting on cryptd */
     /*
      * The following fields are allocated only for local clients
      * (directly connected to *this* server with a socket.
@@ -265,6 +301,8 @@ struct LocalUser {
     time_t target_last;		/* last time we cleared a slot */
 
     struct ListClient *safelist_data;
+    struct ServerBurst *burst;		/* outgoing netburst, servers only */
+    unsigned long netsplit_id;		/* last netsplit batch we were sent */
 
     char *mangledhost; /* non-NULL if host mangling module loaded and
 			      applicable to this client */
@@ -297,7 +335,7 @@ struct PreClient {
 };
 
 struct ListClient {
-    unsigned int hash_indice;
+    struct ChannelDirCursor *cursor;
     unsigned int users_min, users_max;
     time_t created_min, created_max, topic_min, topic_max;
     int operspy;
@@ -388,6 +426,7 @@ struct ListClient {
 #define FLAGS_PING_COOKIE  0x0040	/* has sent ping cookie */
 #define FLAGS_GOTID        0x0080	/* successful ident lookup achieved */
 #define FLAGS_FLOODDONE    0x0100	/* flood grace period over / reported */
+#define FLAGS_SPLITQUIT    0x0200	/* netsplit QUIT already sent locally */
 #define FLAGS_NORMALEX     0x0400	/* Client exited normally */
 #define FLAGS_MARK	   0x10000	/* marked client */
 #define FLAGS_HIDDEN       0x20000	/* hidden server */
@@ -402,6 +441,7 @@ struct ListClient {
 #define LFLAGS_SSL		0x00000001
 #define LFLAGS_FLUSH		0x00000002
 #define LFLAGS_CORK		0x00000004
+#define LFLAGS_KTLS		0x00000008	/* ssld is handing the socket back */
 
 /* umodes, settable flags */
 /* lots of this moved to snomask -- jilles */
@@ -449,6 +489,7 @@ struct ListClient {
 #define CLICAP_ACCOUNT_NOTIFY  0x0004
 #define CLICAP_EXTENDED_JOIN  0x0008
 #define CLICAP_AWAY_NOTIFY  0x0010
+#define CLICAP_BATCH  0x0020
 
 /*
  * flags macros.
@@ -494,6 +535,10 @@ struct ListClient {
 #define SetFlush(x)		((x)->localClient->localflags |= LFLAGS_FLUSH)
 #define ClearFlush(x)		((x)->localClient->localflags &= ~LFLAGS_FLUSH)
 
+#define IsKTLSWait(x)		((x)->localClient->localflags & LFLAGS_KTLS)
+#define SetKTLSWait(x)		((x)->localClient->localflags |= LFLAGS_KTLS)
+#define ClearKTLSWait(x)	((x)->localClient->localflags &= ~LFLAGS_KTLS)
+
 /* oper flags */
 #define MyOper(x)               (MyConnect(x) && IsOper(x))
 
@@ -567,10 +612,25 @@ struct ListClient {
 extern void check_banned_lines(void);
 extern void check_klines_event(void *unused);
 extern void check_klines(void);
+extern void check_kline(const char *user, const char *host);
+extern void queue_kline_check(const char *user, const char *host);
 extern void check_dlines(void);
+extern void check_dline(const char *mask);
 extern void check_xlines(void);
 
+extern void add_to_client_ip_index(struct Client *client_p);
+extern void del_from_client_ip_index(struct Client *client_p);
+extern void add_to_client_host_index(struct Client *client_p);
+extern void del_from_client_host_index(struct Client *client_p);
+extern void add_to_who_index(struct Client *client_p);
+extern void del_from_who_index(struct Client *client_p);
+extern void who_index_walk(const char *lit, int suffix,
+                           void (*cb)(struct Client *, void *), void *data);
+extern void add_client_to_list(struct Client *client_p);
+
 extern const char *get_client_name(struct Client *client, int show_ip);
+extern const char *get_client_prefix(struct Client *client, size_t *len);
+extern void invalidate_client_prefix(struct Client *client);
 extern const char *log_client_name(struct Client *, int);
 extern int is_remote_connect(struct Client *);
 extern void init_client(void);
@@ -105,6 +105,23 @@
  */
 #define MAX_BUFFER      60
 
+/* CRYPTD_COUNT
+ * The number of cryptd helpers to check hashed passwords with.
+ */
+#define CRYPTD_COUNT	2
+
+/* CRYPTD_MAX_PENDING
+ * The number of password checks that may wait on the cryptd helpers
+ * at once.  Beyond this, clients are asked to try again later.
+ */
+#define CRYPTD_MAX_PENDING	1024
+
+/* LOGD_MAX_BACKLOG
+ * The number of bytes of log lines that may wait on the logd helper.
+ * Beyond this, log lines are dropped and counted until it catches up.
+ */
+#define LOGD_MAX_BACKLOG	(1024 * 1024)
+
 /* ----------------------------------------------------------------
  * STOPSTOPSTOPSTOPSTOPSTOPSTOPSTOPSTOPSTOPSTOPSTOPSTOPSTOPSTOPSTOP
  * ----------------------------------------------------------------
@@ -0,0 +1,30 @@
+#ifndef INCLUDED_cryptdi_h
+#define INCLUDED_cryptdi_h
+
+#define CRYPT_NOMATCH	0
+#define CRYPT_MATCH	1
+#define CRYPT_QUEUED	-1	/* the callback gets the answer */
+#define CRYPT_BUSY	-2	/* too many checks waiting, try again later */
+
+/* called once per queued check, with client_p NULL if the client
+ * went away in the meantime, and CRYPT_BUSY if the check was dropped
+ * by crypt_cancel_callback()
+ */
+typedef void CRYPTCB(struct Client *client_p, int result, void *data);
+
+struct CryptStats {
+    unsigned int queued;	/* checks handed to cryptd */
+    unsigned int inline_checks;	/* checks done here, no cryptd to ask */
+    unsigned int busy;	/* checks refused, too many waiting */
+    unsigned int pending;	/* checks waiting on cryptd now */
+    unsigned int peak;	/* most checks ever waiting at once */
+};
+
+extern struct CryptStats crypt_stats;
+
+void init_cryptd(void);
+int crypt_verify(struct Client *, const char *password, const char *hash,
+                 CRYPTCB *, void *data);
+void crypt_cancel(struct Client *);
+void crypt_cancel_callback(CRYPTCB *);
+#endif
@@ -28,11 +28,7 @@
 
 struct Dictionary;
 
-extern rb_dlink_list *clientTable;
-extern rb_dlink_list *channelTable;
-extern rb_dlink_list *idTable;
 extern rb_dlink_list *resvTable;
-extern rb_dlink_list *hostTable;
 extern rb_dlink_list *helpTable;
 
 extern struct Dictionary *nd_dict;
@@ -40,21 +36,9 @@ extern struct Dictionary *nd_dict;
 /* Magic value for FNV hash functions */
 #define FNV1_32_INIT 0x811c9dc5UL
 
-/* Client hash table size, used in hash.c/s_debug.c */
-#define U_MAX_BITS 17
-#define U_MAX 131072 /* 2^17 */
-
 /* Client fd hash table size, used in hash.c */
 #define CLI_FD_MAX 4096
 
-/* Channel hash table size, hash.c/s_debug.c */
-#define CH_MAX_BITS 16
-#define CH_MAX 65536 /* 2^16 */
-
-/* hostname hash table size */
-#define HOST_MAX_BITS 17
-#define HOST_MAX 131072 /* 2^17 */
-
 /* RESV/XLINE hash table size, used in hash.c */
 #define R_MAX_BITS 10
 #define R_MAX 1024 /* 2^10 */
@@ -105,5 +89,7 @@ void del_from_cli_fd_hash(struct Client *client_p);
 struct Client *find_cli_fd_hash(int fd);
 
 extern void hash_stats(struct Client *);
+extern void count_hash_memory(unsigned int *, size_t *, unsigned int *, size_t *,
+                              unsigned int *, size_t *);
 
 #endif /* INCLUDED_hash_h */
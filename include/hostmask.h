@@ -69,6 +69,8 @@ int match_ipv4(struct sockaddr *, struct sockaddr *, int);
 
 extern struct AddressRec *atable[ATABLE_SIZE];
 
+struct HostNode;
+
 struct AddressRec {
     /* masktype: HM_HOST, HM_IPV4, HM_IPV6 -A1kmm */
     int masktype;
@@ -100,6 +102,11 @@ struct AddressRec {
 
     /* The next record in this hash bucket. */
     struct AddressRec *next;
+
+    /* Where a host mask sits in the suffix trie, see hostmask.c */
+    struct HostNode *hnode_owner;
+    rb_dlink_list *hlist;
+    rb_dlink_node hnode;
 };
 
 
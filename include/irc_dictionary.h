@@ -138,6 +138,12 @@ extern struct DictionaryElement *irc_dictionary_add(struct Dictionary *dtree, co
  */
 extern struct DictionaryElement *irc_dictionary_find(struct Dictionary *dtree, const char *key);
 
+/*
+ * irc_dictionary_seek() returns the first element whose key does not sort
+ * before 'key', walk on from it with ->next.
+ */
+extern struct DictionaryElement *irc_dictionary_seek(struct Dictionary *dtree, const char *key);
+
 /*
  * irc_dictionary_find() returns data from a dtree for key 'key'.
  */
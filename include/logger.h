@@ -51,7 +51,17 @@ typedef enum ilogfile {
 
 struct Client;
 
+struct LogStats {
+    unsigned long queued;	/* lines handed to logd */
+    unsigned long inline_lines;	/* lines written here, no logd */
+    unsigned long dropped;	/* lines dropped, logd too far behind */
+    unsigned long dropped_unlogged;	/* dropped count last noted in the logs */
+};
+
+extern struct LogStats log_stats;
+
 extern void init_main_logfile(void);
+extern void init_logd(void);
 extern void open_logfiles(void);
 extern void close_logfiles(void);
 extern void ilog(ilogfile dest, const char *fmt, ...) AFP(2, 3);
@@ -116,7 +116,7 @@ Info MyInformation[] = {
 
     {
         "NICKNAMEHISTORYLENGTH", "", NICKNAMEHISTORYLENGTH,
-        "Size of WHOWAS Array"
+        "Default size of WHOWAS history"
     },
 
 #ifdef OPATH
@@ -44,6 +44,16 @@ extern int match_esc(const char *mask, const char *name);
 extern int match_cidr(const char *mask, const char *name);
 extern int match_ips(const char *mask, const char *name);
 
+/*
+ * escmask_build - compile a list of match_esc() masks
+ * escmask_find - returns the item of the first mask matching name, or NULL
+ */
+struct EscMaskSet;
+extern struct EscMaskSet *escmask_build(rb_dlink_list *list, const char *(*mask_of)(void *));
+extern void escmask_free(struct EscMaskSet *set);
+extern unsigned int escmask_count(struct EscMaskSet *set);
+extern void *escmask_find(struct EscMaskSet *set, const char *name);
+
 /*
  * comp_with_mask - compares to IP address
  */
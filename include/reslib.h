@@ -25,6 +25,7 @@
 #define SERVFAIL 2
 #define NXDOMAIN 3
 #define T_A 1
+#define T_SOA 6
 #define T_AAAA 28
 #define T_PTR 12
 #define T_CNAME 5
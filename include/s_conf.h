@@ -159,6 +159,7 @@ struct config_file_entry {
     char *fname_klinelog;
     char *fname_operspylog;
     char *fname_ioerrorlog;
+    int log_flush_interval;
 
     unsigned char compression_level;
     int disable_fake_channels;
@@ -179,6 +180,7 @@ struct config_file_entry {
     int kline_delay;
     int warn_no_nline;
     int nick_delay;
+    int whowas_length;
     int non_redundant_klines;
     int stats_e_disabled;
     int stats_c_oper_only;
@@ -302,6 +304,7 @@ struct server_info {
     char *ssl_cert;
     char *ssl_dh_params;
     int ssld_count;
+    int ssl_ktls;
 };
 
 struct admin_info {
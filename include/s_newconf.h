@@ -227,6 +227,8 @@ extern void set_server_conf_autoconn(struct Client *source_p, const char *name,
 extern void disable_server_conf_autoconn(const char *name);
 
 
+extern void xline_conf_changed(void);
+extern void resv_conf_changed(void);
 extern struct ConfItem *find_xline(const char *, int);
 extern struct ConfItem *find_xline_mask(const char *);
 extern struct ConfItem *find_nick_resv(const char *name);
@@ -108,6 +108,34 @@ extern int MaxConnectionCount;	/* GLOBAL - highest number of connections */
 
 extern int refresh_user_links;
 
+/*
+ * An outgoing netburst in progress.  The burst is queued to the link a
+ * chunk at a time as its sendq drains, anything else sent to the link in
+ * the meantime is held back in hold and released after the burst.
+ */
+struct ServerBurst {
+    rb_dlink_node node;		/* on burst_list */
+    struct Client *client_p;
+    rb_dlink_node *user_cursor;	/* next client to introduce */
+    rb_dlink_node *user_fence;	/* last client that predates the burst */
+    rb_dlink_node *chan_cursor;	/* next channel to SJOIN */
+    unsigned long serial;	/* last user introduced before the burst */
+    int emitting;		/* set while burst lines are being queued */
+    buf_head_t hold;		/* live traffic queued behind the burst */
+    unsigned long users, users_total;
+    unsigned long channels, channels_total;
+    unsigned long bytes;
+    time_t started;
+};
+
+/* largest amount of burst we queue to a link at a time */
+#define BURST_CHUNK		(64 * 1024)
+/* chunks queued per call, while the link keeps taking them */
+#define BURST_CHUNKS		16
+
+extern rb_dlink_list burst_list;
+extern unsigned long user_serial;
+
 /*
  * return values for hunt_server()
  */
@@ -125,6 +153,10 @@ extern void try_connections(void *unused);
 
 extern int check_server(const char *name, struct Client *server);
 extern int server_estab(struct Client *client_p);
+extern void burst_continue(struct Client *client_p);
+extern void burst_continue_all(void *unused);
+extern void burst_abort(struct Client *client_p);
+extern void burst_list_fixup(rb_dlink_node *ptr);
 
 extern int serv_connect(struct server_conf *, struct Client *);
 
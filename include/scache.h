@@ -36,5 +36,9 @@ extern const char *scache_get_name(struct scache_entry *ptr);
 extern void scache_send_flattened_links(struct Client *source_p);
 extern void scache_send_missing(struct Client *source_p);
 extern void count_scache(size_t *, size_t *);
+extern const char *scache_intern(const char *str);
+extern void scache_release(const char *str);
+extern void scache_set(const char **field, const char *str, size_t size);
+extern void count_scache_strings(size_t *, size_t *, size_t *, size_t *);
 
 #endif
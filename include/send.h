@@ -67,6 +67,7 @@ extern void sendto_channel_local_with_capability(int type, int caps, int negcaps
 
 extern void sendto_common_channels_local(struct Client *, int cap, const char *, ...) AFP(3, 4);
 extern void sendto_common_channels_local_butone(struct Client *, int cap, const char *, ...) AFP(3, 4);
+extern void sendto_netsplit_local(struct Client *, const char *);
 
 
 extern void sendto_match_butone(struct Client *, struct Client *,
@@ -30,34 +30,30 @@
 
 #include "setup.h"
 
-/*
- * Whowas hash table size
- *
- */
-#define WW_MAX_BITS 16
-#define WW_MAX 65536
-
 struct User;
 struct Client;
+struct whowas_top;
 
 /*
   lets speed this up...
   also removed away information. *tough*
   - Dianora
+
+  username, hostname, sockhost and realname come from scache_intern(),
+  so the many entries left by one user share a single copy of each.
  */
 struct Whowas {
-    int hashv;
     char name[NICKLEN + 1];
-    char username[USERLEN + 1];
-    char hostname[HOSTLEN + 1];
-    char sockhost[HOSTIPLEN + 1];
-    char realname[REALLEN + 1];
     char suser[NICKLEN + 1];
+    const char *username;
+    const char *hostname;
+    const char *sockhost;	/* "" if it may not be shown */
+    const char *realname;
     const char *servername;
     time_t logoff;
     struct Client *online;	/* Pointer to new nickname for chasing or NULL */
-    struct Whowas *next;	/* for hash table... */
-    struct Whowas *prev;	/* for hash table... */
+    struct whowas_top *wtop;	/* every entry for this nick */
+    rb_dlink_node wnode;	/* on wtop->list, newest first */
     struct Whowas *cnext;	/* for client struct linked list */
     struct Whowas *cprev;	/* for client struct linked list */
 };
@@ -67,6 +63,13 @@ struct Whowas {
 */
 extern void initwhowas(void);
 
+/*
+** whowas_set_size
+**      Resize the history to hold the given number of entries,
+**      keeping the newest ones.
+*/
+extern void whowas_set_size(int);
+
 /*
 ** add_history
 **      Add the currently defined name of the client to history.
@@ -100,9 +103,11 @@ struct Client *get_history(const char *, time_t);
 */
 void count_whowas_memory(size_t *, size_t *);
 
-/* XXX m_whowas.c in modules needs these */
-extern struct Whowas WHOWAS[];
-extern struct Whowas *WHOWASHASH[];
-extern unsigned int hash_whowas_name(const char *name);
+/*
+** whowas_get_list
+**      Return the entries for the given nickname, newest first,
+**      or NULL if there are none.
+*/
+extern rb_dlink_list *whowas_get_list(const char *);
 
 #endif /* INCLUDED_whowas_h */
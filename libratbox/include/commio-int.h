@@ -92,6 +92,12 @@ struct acceptdata {
 #define SetFDOpen(F)	(F->flags |= FLAG_OPEN)
 #define ClearFDOpen(F)	(F->flags &= ~FLAG_OPEN)
 
+/* io backends that batch interest changes mark queued fds with this */
+#define FLAG_PENDING	0x2
+
+/* plain TCP socket, accepted or connected by us */
+#define FLAG_STREAM	0x4
+
 
 struct _fde {
     /* New-school stuff, again pretty much ripped from squid */
@@ -172,6 +178,18 @@ void rb_epoll_init_event(void);
 int rb_epoll_sched_event(struct ev_entry *event, int when);
 void rb_epoll_unsched_event(struct ev_entry *event);
 int rb_epoll_supports_event(void);
+void rb_epoll_dump_stats(void (*func) (char *, void *), void *ptr);
+
+/* io_uring versions */
+void rb_setselect_uring(rb_fde_t *F, unsigned int type, PF * handler, void *client_data);
+int rb_init_netio_uring(void);
+int rb_select_uring(long);
+int rb_setup_fd_uring(rb_fde_t *F);
+void rb_uring_dump_stats(void (*func) (char *, void *), void *ptr);
+ssize_t rb_read_uring(rb_fde_t *F, void *buf, int count);
+ssize_t rb_writev_uring(rb_fde_t *F, const struct rb_iovec *vector, int count);
+int rb_accept_uring(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t *addrlen);
+int rb_close_uring(rb_fde_t *F);
 
 
 /* poll versions */
@@ -32,5 +32,6 @@ struct ev_entry {
     time_t next;
     void *data;
     void *comm_ptr;
+    rb_timer_t timer;	/* used when the io layer has no native timers */
 };
 void rb_event_io_register_all(void);
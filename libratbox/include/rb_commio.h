@@ -88,6 +88,7 @@ void rb_fdlist_init(int closeall, int maxfds, size_t heapsize);
 rb_fde_t *rb_open(int, uint8_t, const char *);
 void rb_close(rb_fde_t *);
 void rb_dump_fd(DUMPCB *, void *xdata);
+void rb_dump_io_stats(void (*func) (char *, void *), void *ptr);
 void rb_note(rb_fde_t *, const char *);
 
 /* Type of IO */
@@ -167,6 +168,8 @@ int rb_get_pseudo_random(void *buf, size_t len);
 void rb_ssl_start_accepted(rb_fde_t *new_F, ACCB * cb, void *data, int timeout);
 void rb_ssl_start_connected(rb_fde_t *F, CNCB * callback, void *data, int timeout);
 int rb_supports_ssl(void);
+int rb_ssl_set_ktls(int enable);
+int rb_ssl_detach_ktls(rb_fde_t *F);
 
 unsigned int rb_ssl_handshake_count(rb_fde_t *F);
 void rb_ssl_clear_handshake_count(rb_fde_t *F);
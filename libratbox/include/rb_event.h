@@ -33,6 +33,21 @@
 struct ev_entry;
 typedef void EVH(void *);
 
+/*
+ * A timer is embedded in its owner and scheduled on the timer wheel,
+ * so arming, re-arming and cancelling it is O(1).  The wheel has a one
+ * second resolution and timers fire at the first tick at or after when.
+ */
+typedef struct _rb_timer {
+    rb_dlink_node node;
+    rb_dlink_list *slot;	/* wheel slot we are on, NULL when idle */
+    time_t when;
+    EVH *func;
+    void *arg;
+} rb_timer_t;
+
+#define rb_timer_pending(t) ((t)->slot != NULL)
+
 struct ev_entry *rb_event_add(const char *name, EVH * func, void *arg, time_t when);
 struct ev_entry *rb_event_addonce(const char *name, EVH * func, void *arg, time_t when);
 struct ev_entry *rb_event_addish(const char *name, EVH * func, void *arg, time_t delta_ish);
@@ -46,4 +61,8 @@ void rb_dump_events(void (*func) (char *, void *), void *ptr);
 void rb_run_event(struct ev_entry *);
 time_t rb_event_next(void);
 
+void rb_timer_set(rb_timer_t *, time_t when, EVH * func, void *arg);
+void rb_timer_del(rb_timer_t *);
+void rb_timer_run(void);
+
 #endif /* INCLUDED_event_h */
@@ -58,5 +58,6 @@ void rb_helper_write_flush(rb_helper *helper);
 void rb_helper_run(rb_helper *helper);
 void rb_helper_close(rb_helper *helper);
 int rb_helper_read(rb_helper *helper, void *buf, size_t bufsize);
+size_t rb_helper_sendq_len(rb_helper *helper);
 void rb_helper_loop(rb_helper *helper, long delay);
 #endif
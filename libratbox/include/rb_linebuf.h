@@ -41,12 +41,17 @@ struct _buf_head;
 /* How big we want a buffer - 510 data bytes, plus space for a '\0' */
 #define BUF_DATA_SIZE		511
 
+/* Lines are allocated from a few block heaps of different sizes, so
+ * buf only has room for the line it holds.  Only a partial line that
+ * is still being read gets the full BUF_DATA_SIZE + 2 bytes.
+ */
 typedef struct _buf_line {
-    char buf[BUF_DATA_SIZE + 2];
     uint8_t terminated;	/* Whether we've terminated the buffer */
     uint8_t raw;		/* Whether this linebuf may hold 8-bit data */
+    uint8_t sizeclass;	/* which heap the line came from */
     int len;		/* How much data we've got */
     int refcount;		/* how many linked lists are we in? */
+    char buf[];
 } buf_line_t;
 
 typedef struct _buf_head {
@@ -63,16 +68,22 @@ typedef struct _buf_head {
 #define rb_linebuf_len(x)		((x)->len)
 #define rb_linebuf_alloclen(x)	((x)->alloclen)
 #define rb_linebuf_numlines(x)	((x)->numlines)
+#define rb_linebuf_first(x)		((x)->list.head != NULL ? (buf_line_t *)(x)->list.head->data : NULL)
 
 void rb_linebuf_init(size_t heap_size);
 void rb_linebuf_newbuf(buf_head_t *);
 void rb_linebuf_donebuf(buf_head_t *);
 int rb_linebuf_parse(buf_head_t *, char *, int, int);
 int rb_linebuf_get(buf_head_t *, char *, int, int, int);
+buf_line_t *rb_linebuf_take(buf_head_t *, char **, int *, int, int);
+void rb_linebuf_release(buf_line_t *);
 void rb_linebuf_putmsg(buf_head_t *, const char *, va_list *, const char *, ...);
 void rb_linebuf_put(buf_head_t *, const char *, ...);
 void rb_linebuf_putbuf(buf_head_t * bufhead, const char *buffer);
+void rb_linebuf_putprefix(buf_head_t * bufhead, const char *prefix, size_t prefixlen,
+                          const char *buffer, size_t len);
 void rb_linebuf_attach(buf_head_t *, buf_head_t *);
+void rb_linebuf_attach_line(buf_head_t *, buf_line_t *);
 void rb_count_rb_linebuf_memory(size_t *, size_t *);
 int rb_linebuf_flush(rb_fde_t *F, buf_head_t *);
 
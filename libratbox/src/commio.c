@@ -39,8 +39,7 @@
 
 struct timeout_data {
     rb_fde_t *F;
-    rb_dlink_node node;
-    time_t timeout;
+    rb_timer_t timer;
     PF *timeout_handler;
     void *timeout_data;
 };
@@ -48,11 +47,8 @@ struct timeout_data {
 rb_dlink_list *rb_fd_table;
 static rb_bh *fd_heap;
 
-static rb_dlink_list timeout_list;
 static rb_dlink_list closed_list;
 
-static struct ev_entry *rb_timeout_ev;
-
 
 static const char *rb_err_str[] = { "Comm OK", "Error during bind()",
                                     "Error during DNS lookup", "connect timeout",
@@ -66,6 +62,14 @@ int rb_maxconnections = 0;
 
 static PF rb_connect_timeout;
 static PF rb_connect_tryconnect;
+
+/* completion based io backends do their own reads, writes and accepts
+ * on plain TCP sockets (FLAG_STREAM), these are NULL for the others
+ */
+static ssize_t (*io_read_handler) (rb_fde_t *, void *, int);
+static ssize_t (*io_writev_handler) (rb_fde_t *, const struct rb_iovec *, int);
+static int (*io_accept_handler) (rb_fde_t *, struct sockaddr *, rb_socklen_t *);
+static int (*io_close_handler) (rb_fde_t *);
 #ifdef RB_IPV6
 static void mangle_mapped_sockaddr(struct sockaddr *in);
 #endif
@@ -245,6 +249,22 @@ rb_set_nb(rb_fde_t *F)
     return 1;
 }
 
+/*
+ * rb_fd_timeout() - timer callback for a socket timeout
+ */
+static void
+rb_fd_timeout(void *data)
+{
+    struct timeout_data *td = data;
+    rb_fde_t *F = td->F;
+    PF *hdl = td->timeout_handler;
+    void *cbdata = td->timeout_data;
+
+    F->timeout = NULL;
+    rb_free(td);
+    hdl(F, cbdata);
+}
+
 /*
  * rb_settimeout() - set the socket timeout
  *
@@ -263,13 +283,9 @@ rb_settimeout(rb_fde_t *F, time_t timeout, PF * callback, void *cbdata)
     if(callback == NULL) {	/* user wants to remove */
         if(td == NULL)
             return;
-        rb_dlinkDelete(&td->node, &timeout_list);
+        rb_timer_del(&td->timer);
         rb_free(td);
         F->timeout = NULL;
-        if(rb_dlink_list_length(&timeout_list) == 0) {
-            rb_event_delete(rb_timeout_ev);
-            rb_timeout_ev = NULL;
-        }
         return;
     }
 
@@ -277,46 +293,22 @@ rb_settimeout(rb_fde_t *F, time_t timeout, PF * callback, void *cbdata)
         td = F->timeout = rb_malloc(sizeof(struct timeout_data));
 
     td->F = F;
-    td->timeout = rb_current_time() + timeout;
     td->timeout_handler = callback;
     td->timeout_data = cbdata;
-    rb_dlinkAdd(td, &td->node, &timeout_list);
-    if(rb_timeout_ev == NULL) {
-        rb_timeout_ev = rb_event_add("rb_checktimeouts", rb_checktimeouts, NULL, 5);
-    }
+    /* the timeout fires once it has strictly passed */
+    rb_timer_set(&td->timer, rb_current_time() + timeout + 1, rb_fd_timeout, td);
 }
 
 /*
  * rb_checktimeouts() - check the socket timeouts
  *
- * All this routine does is call the given callback/cbdata, without closing
- * down the file descriptor. When close handlers have been implemented,
- * this will happen.
+ * Socket timeouts now run off the timer wheel, this is kept so that
+ * existing callers still link.
  */
 void
 rb_checktimeouts(void *notused)
 {
-    rb_dlink_node *ptr, *next;
-    struct timeout_data *td;
-    rb_fde_t *F;
-    PF *hdl;
-    void *data;
-
-    RB_DLINK_FOREACH_SAFE(ptr, next, timeout_list.head) {
-        td = ptr->data;
-        F = td->F;
-        if(F == NULL || !IsFDOpen(F))
-            continue;
-
-        if(td->timeout < rb_current_time()) {
-            hdl = td->timeout_handler;
-            data = td->timeout_data;
-            rb_dlinkDelete(&td->node, &timeout_list);
-            F->timeout = NULL;
-            rb_free(td);
-            hdl(F, data);
-        }
-    }
+    rb_timer_run();
 }
 
 static void
@@ -328,7 +320,11 @@ rb_accept_tryaccept(rb_fde_t *F, void *data)
     int new_fd;
 
     while(1) {
-        new_fd = accept(F->fd, (struct sockaddr *)&st, &addrlen);
+        addrlen = sizeof(st);
+        if(io_accept_handler != NULL && F->flags & FLAG_STREAM)
+            new_fd = io_accept_handler(F, (struct sockaddr *)&st, &addrlen);
+        else
+            new_fd = accept(F->fd, (struct sockaddr *)&st, &addrlen);
         rb_get_errno();
         if(new_fd < 0) {
             rb_setselect(F, RB_SELECT_ACCEPT, rb_accept_tryaccept, NULL);
@@ -347,6 +343,9 @@ rb_accept_tryaccept(rb_fde_t *F, void *data)
             continue;
         }
 
+        if(!(F->type & RB_FD_SSL))
+            new_F->flags |= FLAG_STREAM;
+
         if(rb_unlikely(!rb_set_nb(new_F))) {
             rb_get_errno();
             rb_lib_log("rb_accept: Couldn't set FD %d non blocking!", new_F->fd);
@@ -386,6 +385,7 @@ rb_accept_tcp(rb_fde_t *F, ACPRE * precb, ACCB * callback, void *data)
     F->accept->callback = callback;
     F->accept->data = data;
     F->accept->precb = precb;
+    F->flags |= FLAG_STREAM;
     rb_accept_tryaccept(F, NULL);
 }
 
@@ -413,6 +413,7 @@ rb_connect_tcp(rb_fde_t *F, struct sockaddr *dest,
     F->connect = rb_malloc(sizeof(struct conndata));
     F->connect->callback = callback;
     F->connect->data = data;
+    F->flags |= FLAG_STREAM;
 
     memcpy(&F->connect->hostaddr, dest, sizeof(F->connect->hostaddr));
 
@@ -814,7 +815,7 @@ rb_open(int fd, uint8_t type, const char *desc)
 void
 rb_close(rb_fde_t *F)
 {
-    int type, fd;
+    int type, fd, kept = 0;
 
     if(F == NULL)
         return;
@@ -838,6 +839,9 @@ rb_close(rb_fde_t *F)
         rb_ssl_shutdown(F);
     }
 #endif /* HAVE_SSL */
+    /* the backend may keep the fd open to finish sending on it */
+    if(io_close_handler != NULL && F->flags & FLAG_STREAM)
+        kept = io_close_handler(F);
     if(IsFDOpen(F)) {
         remove_fd(F);
         ClearFDOpen(F);
@@ -845,6 +849,9 @@ rb_close(rb_fde_t *F)
 
     number_fd--;
 
+    if(kept)
+        return;
+
 #ifdef _WIN32
     if(type & (RB_FD_SOCKET | RB_FD_PIPE)) {
         closesocket(fd);
@@ -953,6 +960,8 @@ rb_read(rb_fde_t *F, void *buf, int count)
     }
 #endif
     if(F->type & RB_FD_SOCKET) {
+        if(io_read_handler != NULL && F->flags & FLAG_STREAM)
+            return io_read_handler(F, buf, count);
         ret = recv(F->fd, buf, count, 0);
         if(ret < 0) {
             rb_get_errno();
@@ -979,6 +988,13 @@ rb_write(rb_fde_t *F, const void *buf, int count)
     }
 #endif
     if(F->type & RB_FD_SOCKET) {
+        if(io_writev_handler != NULL && F->flags & FLAG_STREAM) {
+            struct rb_iovec vec;
+
+            vec.iov_base = (void *)buf;
+            vec.iov_len = count;
+            return io_writev_handler(F, &vec, 1);
+        }
         ret = send(F->fd, buf, count, MSG_NOSIGNAL);
         if(ret < 0) {
             rb_get_errno();
@@ -1031,6 +1047,8 @@ rb_writev(rb_fde_t *F, struct rb_iovec * vector, int count)
         return rb_fake_writev(F, vector, count);
     }
 #endif /* HAVE_SSL */
+    if(io_writev_handler != NULL && F->flags & FLAG_STREAM && F->type & RB_FD_SOCKET)
+        return io_writev_handler(F, vector, count);
 #ifdef HAVE_SENDMSG
     if(F->type & RB_FD_SOCKET) {
         struct msghdr msg;
@@ -1721,6 +1739,7 @@ static int (*io_sched_event) (struct ev_entry *, int);
 static void (*io_unsched_event) (struct ev_entry *);
 static int (*io_supports_event) (void);
 static void (*io_init_event) (void);
+static void (*io_dump_stats) (void (*)(char *, void *), void *);
 static char iotype[25];
 
 const char *
@@ -1729,6 +1748,23 @@ rb_get_iotype(void)
     return iotype;
 }
 
+/*
+ * rb_dump_io_stats
+ *
+ * Report the io backend in use, plus whatever statistics it keeps.
+ */
+void
+rb_dump_io_stats(void (*func) (char *, void *), void *ptr)
+{
+    char buf[512];
+
+    rb_snprintf(buf, sizeof(buf), "I/O engine: %s", iotype);
+    func(buf, ptr);
+
+    if(io_dump_stats != NULL)
+        io_dump_stats(func, ptr);
+}
+
 static int
 rb_unsupported_event(void)
 {
@@ -1763,12 +1799,35 @@ try_epoll(void)
         io_unsched_event = rb_epoll_unsched_event;
         io_supports_event = rb_epoll_supports_event;
         io_init_event = rb_epoll_init_event;
+        io_dump_stats = rb_epoll_dump_stats;
         rb_strlcpy(iotype, "epoll", sizeof(iotype));
         return 0;
     }
     return -1;
 }
 
+static int
+try_uring(void)
+{
+    if(!rb_init_netio_uring()) {
+        setselect_handler = rb_setselect_uring;
+        select_handler = rb_select_uring;
+        setup_fd_handler = rb_setup_fd_uring;
+        io_sched_event = NULL;
+        io_unsched_event = NULL;
+        io_init_event = NULL;
+        io_supports_event = rb_unsupported_event;
+        io_dump_stats = rb_uring_dump_stats;
+        io_read_handler = rb_read_uring;
+        io_writev_handler = rb_writev_uring;
+        io_accept_handler = rb_accept_uring;
+        io_close_handler = rb_close_uring;
+        rb_strlcpy(iotype, "io_uring", sizeof(iotype));
+        return 0;
+    }
+    return -1;
+}
+
 static int
 try_ports(void)
 {
@@ -1917,6 +1976,9 @@ rb_init_netio(void)
         if(!strcmp("epoll", ioenv)) {
             if(!try_epoll())
                 return;
+        } else if(!strcmp("io_uring", ioenv)) {
+            if(!try_uring())
+                return;
         } else if(!strcmp("kqueue", ioenv)) {
             if(!try_kqueue())
                 return;
@@ -1945,6 +2007,8 @@ rb_init_netio(void)
 
     if(!try_kqueue())
         return;
+    if(!try_uring())
+        return;
     if(!try_epoll())
         return;
     if(!try_ports())
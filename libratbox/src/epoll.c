@@ -51,6 +51,22 @@ struct epoll_info {
     int ep;
     struct epoll_event *pfd;
     int pfd_size;
+
+    /* interest changes made while dispatching are collected here and
+     * applied in one sweep once the whole batch has been handled */
+    int dispatching;
+    rb_fde_t **pending;
+    int pending_count;
+    int pending_size;
+
+    /* statistics */
+    unsigned long long loops;
+    unsigned long long events;
+    unsigned long long ctl_calls;
+    unsigned long long deferred;
+    int last_events;
+    int last_ctl_calls;
+    int max_events;
 };
 
 static struct epoll_info *ep_info;
@@ -87,6 +103,94 @@ rb_setup_fd_epoll(rb_fde_t *F)
 }
 
 
+/*
+ * rb_epoll_update
+ *
+ * Bring the interest registered with the kernel (F->pflags) in line
+ * with the handlers currently set on the fd.  Returns the epoll_ctl()
+ * result, or 0 if nothing had to be done.
+ */
+static int
+rb_epoll_update(rb_fde_t *F)
+{
+    struct epoll_event ep_event;
+    int flags = 0;
+    int op;
+
+    if(F->read_handler != NULL)
+        flags |= EPOLLIN;
+    if(F->write_handler != NULL)
+        flags |= EPOLLOUT;
+
+    if(flags == F->pflags)
+        return 0;
+
+    if(flags == 0)
+        op = EPOLL_CTL_DEL;
+    else if(F->pflags == 0)
+        op = EPOLL_CTL_ADD;
+    else
+        op = EPOLL_CTL_MOD;
+
+    F->pflags = ep_event.events = flags;
+    ep_event.data.ptr = F;
+
+    if(op == EPOLL_CTL_ADD || op == EPOLL_CTL_MOD)
+        ep_event.events |= EPOLLET;
+
+    ep_info->ctl_calls++;
+    ep_info->last_ctl_calls++;
+    return epoll_ctl(ep_info->ep, op, F->fd, &ep_event);
+}
+
+/*
+ * rb_epoll_defer
+ *
+ * Queue an fd for the post-dispatch sweep, once.
+ */
+static void
+rb_epoll_defer(rb_fde_t *F)
+{
+    if(F->flags & FLAG_PENDING)
+        return;
+
+    if(ep_info->pending_count == ep_info->pending_size) {
+        ep_info->pending_size = ep_info->pending_size ? ep_info->pending_size * 2 : 64;
+        ep_info->pending = rb_realloc(ep_info->pending,
+                                      sizeof(rb_fde_t *) * ep_info->pending_size);
+    }
+
+    F->flags |= FLAG_PENDING;
+    ep_info->pending[ep_info->pending_count++] = F;
+}
+
+/*
+ * rb_epoll_flush_pending
+ *
+ * Apply all interest changes collected during the dispatch pass.  An fd
+ * that was changed several times only costs one epoll_ctl() for its
+ * final state, and one that ended up back where it started costs none.
+ */
+static void
+rb_epoll_flush_pending(void)
+{
+    rb_fde_t *F;
+    int i;
+
+    for(i = 0; i < ep_info->pending_count; i++) {
+        F = ep_info->pending[i];
+        F->flags &= ~FLAG_PENDING;
+
+        if(!IsFDOpen(F))
+            continue;
+
+        if(rb_epoll_update(F) != 0)
+            rb_lib_log("rb_select_epoll(): epoll_ctl failed: %s", strerror(errno));
+    }
+
+    ep_info->pending_count = 0;
+}
+
 /*
  * rb_setselect
  *
@@ -96,55 +200,33 @@ rb_setup_fd_epoll(rb_fde_t *F)
 void
 rb_setselect_epoll(rb_fde_t *F, unsigned int type, PF * handler, void *client_data)
 {
-    struct epoll_event ep_event;
-    int old_flags = F->pflags;
-    int op = -1;
-
     lrb_assert(IsFDOpen(F));
 
-    /* Update the list, even though we're not using it .. */
     if(type & RB_SELECT_READ) {
-        if(handler != NULL)
-            F->pflags |= EPOLLIN;
-        else
-            F->pflags &= ~EPOLLIN;
         F->read_handler = handler;
         F->read_data = client_data;
     }
 
     if(type & RB_SELECT_WRITE) {
-        if(handler != NULL)
-            F->pflags |= EPOLLOUT;
-        else
-            F->pflags &= ~EPOLLOUT;
         F->write_handler = handler;
         F->write_data = client_data;
     }
 
-    if(old_flags == 0 && F->pflags == 0)
+    /*
+     * While dispatching, just remember the fd and sort it out after the
+     * batch.  Dropping all interest is still done right away, as that is
+     * what rb_close() does before the fd goes away.
+     */
+    if(ep_info->dispatching && (F->read_handler != NULL || F->write_handler != NULL)) {
+        ep_info->deferred++;
+        rb_epoll_defer(F);
         return;
-    else if(F->pflags <= 0)
-        op = EPOLL_CTL_DEL;
-    else if(old_flags == 0 && F->pflags > 0)
-        op = EPOLL_CTL_ADD;
-    else if(F->pflags != old_flags)
-        op = EPOLL_CTL_MOD;
-
-    if(op == -1)
-        return;
-
-    ep_event.events = F->pflags;
-    ep_event.data.ptr = F;
-
-    if(op == EPOLL_CTL_ADD || op == EPOLL_CTL_MOD)
-        ep_event.events |= EPOLLET;
+    }
 
-    if(epoll_ctl(ep_info->ep, op, F->fd, &ep_event) != 0) {
+    if(rb_epoll_update(F) != 0) {
         rb_lib_log("rb_setselect_epoll(): epoll_ctl failed: %s", strerror(errno));
         abort();
     }
-
-
 }
 
 /*
@@ -159,8 +241,7 @@ rb_setselect_epoll(rb_fde_t *F, unsigned int type, PF * handler, void *client_da
 int
 rb_select_epoll(long delay)
 {
-    int num, i, flags, old_flags, op;
-    struct epoll_event ep_event;
+    int num, i;
     int o_errno;
     void *data;
 
@@ -177,10 +258,18 @@ rb_select_epoll(long delay)
     if(num <= 0)
         return RB_OK;
 
+    ep_info->loops++;
+    ep_info->events += num;
+    ep_info->last_events = num;
+    ep_info->last_ctl_calls = 0;
+    if(num > ep_info->max_events)
+        ep_info->max_events = num;
+
+    ep_info->dispatching = 1;
+
     for(i = 0; i < num; i++) {
         PF *hdl;
         rb_fde_t *F = ep_info->pfd[i].data.ptr;
-        old_flags = F->pflags;
         if(ep_info->pfd[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
             hdl = F->read_handler;
             data = F->read_data;
@@ -207,33 +296,41 @@ rb_select_epoll(long delay)
         if(!IsFDOpen(F))
             continue;
 
-        flags = 0;
-
-        if(F->read_handler != NULL)
-            flags |= EPOLLIN;
-        if(F->write_handler != NULL)
-            flags |= EPOLLOUT;
-
-        if(old_flags != flags) {
-            if(flags == 0)
-                op = EPOLL_CTL_DEL;
-            else
-                op = EPOLL_CTL_MOD;
-            F->pflags = ep_event.events = flags;
-            ep_event.data.ptr = F;
-            if(op == EPOLL_CTL_MOD || op == EPOLL_CTL_ADD)
-                ep_event.events |= EPOLLET;
-
-            if(epoll_ctl(ep_info->ep, op, F->fd, &ep_event) != 0) {
-                rb_lib_log("rb_select_epoll(): epoll_ctl failed: %s",
-                           strerror(errno));
-            }
-        }
-
+        /* the handlers were consumed above, so the interest may have
+         * changed even if nothing called rb_setselect() */
+        rb_epoll_defer(F);
     }
+
+    ep_info->dispatching = 0;
+    rb_epoll_flush_pending();
+
     return RB_OK;
 }
 
+/*
+ * rb_epoll_dump_stats
+ *
+ * Report the batching statistics of the epoll loop.
+ */
+void
+rb_epoll_dump_stats(void (*func) (char *, void *), void *ptr)
+{
+    char buf[512];
+    unsigned long long loops = ep_info->loops ? ep_info->loops : 1;
+
+    rb_snprintf(buf, sizeof(buf), "epoll loops %llu, events %llu (%llu.%02llu/loop, max %d, last %d)",
+                ep_info->loops, ep_info->events,
+                ep_info->events / loops, (ep_info->events * 100 / loops) % 100,
+                ep_info->max_events, ep_info->last_events);
+    func(buf, ptr);
+
+    rb_snprintf(buf, sizeof(buf), "epoll_ctl calls %llu (%llu.%02llu/loop, last %d), deferred updates %llu",
+                ep_info->ctl_calls,
+                ep_info->ctl_calls / loops, (ep_info->ctl_calls * 100 / loops) % 100,
+                ep_info->last_ctl_calls, ep_info->deferred);
+    func(buf, ptr);
+}
+
 #ifdef EPOLL_SCHED_EVENT
 int
 rb_epoll_supports_event(void)
@@ -520,6 +617,11 @@ rb_setup_fd_epoll(rb_fde_t *F)
     return -1;
 }
 
+void
+rb_epoll_dump_stats(void (*func) (char *, void *), void *ptr)
+{
+    return;
+}
 
 #endif
 
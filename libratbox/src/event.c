@@ -50,7 +50,206 @@
 static char last_event_ran[EV_NAME_LEN];
 static rb_dlink_list event_list;
 
-static time_t event_time_min = -1;
+/*
+ * Timer wheel.
+ *
+ * The root level has one slot per second for the next 256 seconds, each
+ * level above it has 64 slots each covering a full turn of the level
+ * below.  A timer is hashed into a slot when it is armed and the coarser
+ * levels are cascaded down as the wheel turns, so arming, cancelling and
+ * running a tick are all O(1) plus the number of timers that expire.
+ * This is what drives events on io layers without native timers, as well
+ * as fd timeouts and anything else embedding a rb_timer_t.
+ */
+#define TW_ROOT_BITS	8
+#define TW_LEVEL_BITS	6
+#define TW_LEVELS	3
+#define TW_ROOT_SIZE	(1 << TW_ROOT_BITS)
+#define TW_LEVEL_SIZE	(1 << TW_LEVEL_BITS)
+#define TW_ROOT_MASK	(TW_ROOT_SIZE - 1)
+#define TW_LEVEL_MASK	(TW_LEVEL_SIZE - 1)
+#define TW_SPAN(n)	((time_t)1 << (TW_ROOT_BITS + ((n) + 1) * TW_LEVEL_BITS))
+#define TW_MAX_DELTA	(TW_SPAN(TW_LEVELS - 1) - 1)
+#define TW_INDEX(clk, n)	(((clk) >> (TW_ROOT_BITS + (n) * TW_LEVEL_BITS)) & TW_LEVEL_MASK)
+
+static rb_dlink_list tw_root[TW_ROOT_SIZE];
+static rb_dlink_list tw_level[TW_LEVELS][TW_LEVEL_SIZE];
+static rb_dlink_list tw_expired;	/* timers being run by the current tick */
+static time_t tw_clock;		/* next tick to run, 0 until first use */
+static unsigned long tw_count;
+static struct ev_entry *tw_event;	/* turns the wheel on native timer io */
+
+static void rb_event_timer(void *);
+
+static void
+rb_timer_link(rb_timer_t *timer)
+{
+    rb_dlink_list *slot;
+    time_t expires = timer->when;
+    time_t delta;
+    int n;
+
+    if(expires < tw_clock)
+        expires = tw_clock;
+
+    delta = expires - tw_clock;
+    if(delta > TW_MAX_DELTA) {
+        expires = tw_clock + TW_MAX_DELTA;
+        delta = TW_MAX_DELTA;
+    }
+
+    if(delta < TW_ROOT_SIZE)
+        slot = &tw_root[expires & TW_ROOT_MASK];
+    else {
+        for(n = 0; n < TW_LEVELS - 1; n++) {
+            if(delta < TW_SPAN(n))
+                break;
+        }
+        slot = &tw_level[n][TW_INDEX(expires, n)];
+    }
+
+    timer->slot = slot;
+    rb_dlinkAddTail(timer, &timer->node, slot);
+}
+
+/* moves every timer on slot onto list, leaving slot empty */
+static void
+rb_timer_splice(rb_dlink_list *slot, rb_dlink_list *list)
+{
+    rb_dlink_node *ptr, *next;
+    rb_timer_t *timer;
+
+    RB_DLINK_FOREACH_SAFE(ptr, next, slot->head) {
+        timer = ptr->data;
+        rb_dlinkDelete(ptr, slot);
+        rb_dlinkAddTail(timer, ptr, list);
+        timer->slot = list;
+    }
+}
+
+static int
+rb_timer_cascade(int n)
+{
+    rb_dlink_list pending = { NULL, NULL, 0 };
+    rb_dlink_node *ptr, *next;
+    int idx = TW_INDEX(tw_clock, n);
+
+    rb_timer_splice(&tw_level[n][idx], &pending);
+    RB_DLINK_FOREACH_SAFE(ptr, next, pending.head) {
+        rb_dlinkDelete(ptr, &pending);
+        rb_timer_link(ptr->data);
+    }
+    return idx;
+}
+
+static void
+rb_timer_tick(void *unused)
+{
+    rb_timer_run();
+}
+
+/*
+ * void rb_timer_set(rb_timer_t *timer, time_t when, EVH *func, void *arg)
+ *
+ * Input: Timer, absolute time to fire at, function to call and its argument
+ * Output: None
+ * Side Effects: (Re)arms the timer, it is one shot and func may re-arm it.
+ */
+void
+rb_timer_set(rb_timer_t *timer, time_t when, EVH * func, void *arg)
+{
+    if(rb_timer_pending(timer))
+        rb_timer_del(timer);
+
+    if(tw_clock == 0)
+        tw_clock = rb_current_time();
+
+    timer->when = when;
+    timer->func = func;
+    timer->arg = arg;
+    rb_timer_link(timer);
+    tw_count++;
+
+    if(tw_event == NULL && rb_io_supports_event())
+        tw_event = rb_event_add("rb_timer_run", rb_timer_tick, NULL, 1);
+}
+
+/*
+ * void rb_timer_del(rb_timer_t *timer)
+ *
+ * Input: Timer
+ * Output: None
+ * Side Effects: Cancels the timer if it is armed.
+ */
+void
+rb_timer_del(rb_timer_t *timer)
+{
+    if(!rb_timer_pending(timer))
+        return;
+
+    rb_dlinkDelete(&timer->node, timer->slot);
+    timer->slot = NULL;
+    tw_count--;
+}
+
+/*
+ * void rb_timer_run(void)
+ *
+ * Input: None
+ * Output: None
+ * Side Effects: Turns the wheel up to the current time, running every
+ *               timer that has expired.
+ */
+void
+rb_timer_run(void)
+{
+    rb_dlink_node *ptr;
+    rb_timer_t *timer;
+    time_t now = rb_current_time();
+    int n;
+
+    if(tw_clock == 0)
+        tw_clock = now;
+
+    while(tw_clock <= now) {
+        if((tw_clock & TW_ROOT_MASK) == 0) {
+            for(n = 0; n < TW_LEVELS; n++) {
+                if(rb_timer_cascade(n) != 0)
+                    break;
+            }
+        }
+
+        rb_timer_splice(&tw_root[tw_clock & TW_ROOT_MASK], &tw_expired);
+        tw_clock++;
+
+        /* anything armed from here on lands on a later tick */
+        while((ptr = tw_expired.head) != NULL) {
+            timer = ptr->data;
+            rb_dlinkDelete(ptr, &tw_expired);
+            timer->slot = NULL;
+            tw_count--;
+            timer->func(timer->arg);
+        }
+    }
+}
+
+/* returns the earliest tick that may have work, or -1 */
+static time_t
+rb_timer_next(void)
+{
+    time_t clk;
+
+    if(tw_count == 0)
+        return -1;
+
+    for(clk = tw_clock;; clk++) {
+        /* a cascade is due */
+        if((clk & TW_ROOT_MASK) == 0)
+            return clk;
+        if(tw_root[clk & TW_ROOT_MASK].head != NULL)
+            return clk;
+    }
+}
 
 /*
  * struct ev_entry *
@@ -95,11 +294,11 @@ rb_event_add(const char *name, EVH * func, void *arg, time_t when)
     ev->next = when;
     ev->frequency = when;
 
-    if((ev->when < event_time_min) || (event_time_min == -1)) {
-        event_time_min = ev->when;
-    }
     rb_dlinkAdd(ev, &ev->node, &event_list);
-    rb_io_sched_event(ev, when);
+    if(rb_io_supports_event())
+        rb_io_sched_event(ev, when);
+    else
+        rb_timer_set(&ev->timer, ev->when, rb_event_timer, ev);
     return ev;
 }
 
@@ -115,11 +314,11 @@ rb_event_addonce(const char *name, EVH * func, void *arg, time_t when)
     ev->next = when;
     ev->frequency = 0;
 
-    if((ev->when < event_time_min) || (event_time_min == -1))
-        event_time_min = ev->when;
-
     rb_dlinkAdd(ev, &ev->node, &event_list);
-    rb_io_sched_event(ev, when);
+    if(rb_io_supports_event())
+        rb_io_sched_event(ev, when);
+    else
+        rb_timer_set(&ev->timer, ev->when, rb_event_timer, ev);
     return ev;
 }
 
@@ -138,6 +337,7 @@ rb_event_delete(struct ev_entry *ev)
 
     rb_dlinkDelete(&ev->node, &event_list);
     rb_io_unsched_event(ev);
+    rb_timer_del(&ev->timer);
     rb_free(ev->name);
     rb_free(ev);
 }
@@ -192,8 +392,26 @@ rb_run_event(struct ev_entry *ev)
         return;
     }
     ev->when = rb_current_time() + ev->frequency;
-    if((ev->when < event_time_min) || (event_time_min == -1))
-        event_time_min = ev->when;
+}
+
+/* timer callback for events when the io layer has no native timers */
+static void
+rb_event_timer(void *data)
+{
+    struct ev_entry *ev = data;
+
+    rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
+    ev->func(ev->arg);
+
+    /* event is scheduled more than once */
+    if(ev->frequency) {
+        ev->when = rb_current_time() + ev->frequency;
+        rb_timer_set(&ev->timer, ev->when, rb_event_timer, ev);
+    } else {
+        rb_dlinkDelete(&ev->node, &event_list);
+        rb_free(ev->name);
+        rb_free(ev);
+    }
 }
 
 /*
@@ -206,33 +424,10 @@ rb_run_event(struct ev_entry *ev)
 void
 rb_event_run(void)
 {
-    rb_dlink_node *ptr, *next;
-    struct ev_entry *ev;
-
     if(rb_io_supports_event())
         return;
 
-    event_time_min = -1;
-    RB_DLINK_FOREACH_SAFE(ptr, next, event_list.head) {
-        ev = ptr->data;
-        if(ev->when <= rb_current_time()) {
-            rb_strlcpy(last_event_ran, ev->name, sizeof(last_event_ran));
-            ev->func(ev->arg);
-
-            /* event is scheduled more than once */
-            if(ev->frequency) {
-                ev->when = rb_current_time() + ev->frequency;
-                if((ev->when < event_time_min) || (event_time_min == -1))
-                    event_time_min = ev->when;
-            } else {
-                rb_dlinkDelete(&ev->node, &event_list);
-                rb_free(ev);
-            }
-        } else {
-            if((ev->when < event_time_min) || (event_time_min == -1))
-                event_time_min = ev->when;
-        }
-    }
+    rb_timer_run();
 }
 
 void
@@ -246,6 +441,7 @@ rb_event_io_register_all(void)
 
     RB_DLINK_FOREACH(ptr, event_list.head) {
         ev = ptr->data;
+        rb_timer_del(&ev->timer);
         rb_io_sched_event(ev, ev->next);
     }
 }
@@ -290,13 +486,17 @@ rb_dump_events(void (*func) (char *, void *), void *ptr)
  * void rb_set_back_events(time_t by)
  * Input: Time to set back events by.
  * Output: None.
- * Side-effects: Sets back all events by "by" seconds.
+ * Side-effects: Sets back all events and timers by "by" seconds.
  */
 void
 rb_set_back_events(time_t by)
 {
-    rb_dlink_node *ptr;
+    rb_dlink_list pending = { NULL, NULL, 0 };
+    rb_dlink_node *ptr, *next;
     struct ev_entry *ev;
+    rb_timer_t *timer;
+    int i, n;
+
     RB_DLINK_FOREACH(ptr, event_list.head) {
         ev = ptr->data;
         if(ev->when > by)
@@ -304,6 +504,25 @@ rb_set_back_events(time_t by)
         else
             ev->when = 0;
     }
+
+    if(tw_clock == 0)
+        return;
+
+    /* the slots are keyed on absolute time, so rehash everything */
+    for(i = 0; i < TW_ROOT_SIZE; i++)
+        rb_timer_splice(&tw_root[i], &pending);
+    for(n = 0; n < TW_LEVELS; n++) {
+        for(i = 0; i < TW_LEVEL_SIZE; i++)
+            rb_timer_splice(&tw_level[n][i], &pending);
+    }
+
+    tw_clock = tw_clock > by ? tw_clock - by : 1;
+    RB_DLINK_FOREACH_SAFE(ptr, next, pending.head) {
+        timer = ptr->data;
+        rb_dlinkDelete(ptr, &pending);
+        timer->when = timer->when > by ? timer->when - by : 0;
+        rb_timer_link(timer);
+    }
 }
 
 void
@@ -317,13 +536,20 @@ rb_event_update(struct ev_entry *ev, time_t freq)
     /* update when its scheduled to run if its higher
      * than the new frequency
      */
-    if((rb_current_time() + freq) < ev->when)
+    if((rb_current_time() + freq) < ev->when) {
         ev->when = rb_current_time() + freq;
+        if(rb_timer_pending(&ev->timer))
+            rb_timer_set(&ev->timer, ev->when, rb_event_timer, ev);
+    }
     return;
 }
 
 time_t
 rb_event_next(void)
 {
-    return event_time_min;
+    /* native timers wake the io loop themselves, just poll once a second */
+    if(rb_io_supports_event())
+        return rb_current_time() + 1;
+
+    return rb_timer_next();
 }
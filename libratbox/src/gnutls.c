@@ -526,6 +526,18 @@ rb_supports_ssl(void)
     return 1;
 }
 
+int
+rb_ssl_set_ktls(int enable)
+{
+    return 0;
+}
+
+int
+rb_ssl_detach_ktls(rb_fde_t *F)
+{
+    return 0;
+}
+
 void
 rb_get_ssl_info(char *buf, size_t len)
 {
@@ -276,6 +276,13 @@ rb_helper_read(rb_helper *helper, void *buf, size_t bufsize)
     return rb_linebuf_get(&helper->recvq, buf, bufsize, LINEBUF_COMPLETE, LINEBUF_PARSED);
 }
 
+/* bytes written to the helper that it hasn't taken yet */
+size_t
+rb_helper_sendq_len(rb_helper *helper)
+{
+    return rb_linebuf_len(&helper->sendq);
+}
+
 void
 rb_helper_loop(rb_helper *helper, long delay)
 {
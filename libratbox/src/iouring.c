@@ -0,0 +1,1500 @@
+/*
+ *  ircd-ratbox: A slightly useful ircd.
+ *  iouring.c: Linux io_uring network routines.
+ *
+ *  Copyright (C) 2026 ircd-kaffe development team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ */
+
+/*
+ * Plain TCP sockets (those commio marks FLAG_STREAM: accepted from a
+ * listener or connected with rb_connect_tcp()) are driven by completions
+ * rather than readiness:
+ *
+ *  - a listener with a read handler has a multishot accept in flight, and
+ *    rb_accept_tryaccept() is handed the fds it has already accepted.
+ *  - a socket with a read handler has a multishot recv in flight, which
+ *    fills buffers from a provided buffer ring.  rb_read() copies out of
+ *    those buffers and gives them back to the ring.
+ *  - rb_write()/rb_writev() copy into a per-fd staging queue, and each
+ *    fd gets a single sendmsg covering everything staged during a loop.
+ *    Writes see EAGAIN once URING_SEND_MAX bytes are waiting, and the
+ *    write handler is called as sends complete and make room again.
+ *
+ * All of this is submitted together with the wait in one io_uring_enter()
+ * per loop, so a busy fd costs no syscalls of its own.  A stream socket
+ * closed with data still staged is kept open until it has been sent, or
+ * for URING_LINGER seconds at most.
+ *
+ * Everything else (pipes, socketpairs, SSL sockets, connects in progress)
+ * keeps the readiness model: every rb_setselect() arms a one-shot
+ * IORING_OP_POLL_ADD for the fd, which maps directly onto our one-shot
+ * read/write handlers.
+ *
+ * Completions are tagged with the operation, the fd and a per-fd
+ * sequence number, so completions of operations that were cancelled or
+ * belong to an fd that has since been closed (and possibly reused) are
+ * recognised and dropped.
+ *
+ * Multishot recv needs Linux 6.0 and registered buffer rings 5.19, so we
+ * insist on a kernel that reports IORING_FEAT_REG_REG_RING (6.3) and let
+ * rb_init_netio() fall back to epoll on anything older.
+ */
+
+#include <libratbox_config.h>
+#include <ratbox_lib.h>
+#include <commio-int.h>
+#include <event-int.h>
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_POLL_H)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter) && defined(__NR_io_uring_register) \
+	&& defined(IORING_RECV_MULTISHOT) && defined(IORING_ACCEPT_MULTISHOT)
+#define USING_IO_URING
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+
+/* only the running kernel matters, older headers may not know the bit */
+#ifndef IORING_FEAT_REG_REG_RING
+#define IORING_FEAT_REG_REG_RING	(1U << 13)
+#endif
+
+#define URING_ENTRIES		4096
+#define URING_BUFFERS		2048	/* provided recv buffers, a power of two */
+#define URING_BUFSIZE		2048
+#define URING_BGID		0
+#define URING_NOBUF		0xffff
+#define URING_RECV_MAX		(64 * 1024)	/* unread data before we stop receiving */
+#define URING_SEND_MAX		(64 * 1024)	/* staged data before writes see EAGAIN */
+#define URING_CHUNK		16384
+#define URING_SEND_IOV		16
+#define URING_LINGER		30	/* seconds a closed socket may spend sending */
+
+/* what a completion belongs to, kept in the top byte of its user_data */
+#define URING_OP_INTERNAL	0
+#define URING_OP_POLL		1
+#define URING_OP_RECV		2
+#define URING_OP_SEND		3
+#define URING_OP_ACCEPT		4
+
+#define URING_TAG_INTERNAL	((uint64_t)0)
+#define URING_TAG(op, seq, fd)	(((uint64_t)(op) << 56) | ((uint64_t)((seq) & 0xffffff) << 32) | (uint32_t)(fd))
+#define URING_TAG_OP(tag)	((int)((tag) >> 56))
+#define URING_TAG_SEQ(tag)	((uint32_t)(((tag) >> 32) & 0xffffff))
+#define URING_TAG_FD(tag)	((int)((tag) & 0xffffffff))
+#define URING_SEQ(seq)		((seq) & 0xffffff)
+
+/* uring_fd flags */
+#define URING_RECV		0x001	/* multishot recv in flight */
+#define URING_ACCEPT		0x002	/* multishot accept in flight */
+#define URING_CANCEL		0x004	/* ...and being cancelled */
+#define URING_SEND		0x008	/* sendmsg in flight */
+#define URING_EOF		0x010	/* peer has closed, once the data is read */
+#define URING_READY		0x020	/* on the ready list */
+#define URING_DIRTY		0x040	/* on the send list */
+#define URING_STARVED		0x080	/* recv ran out of buffers */
+#define URING_LINGERING		0x100	/* closed, still sending */
+
+struct uring_chunk {
+    struct uring_chunk *next;
+    unsigned int off;
+    unsigned int len;
+    char data[URING_CHUNK];
+};
+
+struct uring_tx {
+    struct uring_chunk *head;
+    struct uring_chunk *tail;
+    unsigned int queued;	/* bytes staged, including those in flight */
+    time_t linger;
+    struct iovec iov[URING_SEND_IOV];
+    struct msghdr msg;
+};
+
+struct uring_fd {
+    rb_fde_t *F;
+    uint32_t seq;		/* bumped when the fd is closed */
+    uint32_t pseq;		/* bumped for every poll armed on this fd */
+    uint32_t sqe_loop;		/* loop we last queued an sqe for this fd in */
+    short armed;		/* events of the poll in flight, 0 if none */
+    unsigned short flags;
+    int error;			/* handed to the next read or write */
+    uint16_t rx_head;		/* received buffers not read yet */
+    uint16_t rx_tail;
+    unsigned int rx_len;
+    int *accepted;		/* accepted fds not handed out yet */
+    int naccepted;
+    int accepted_size;
+    struct uring_tx *tx;
+};
+
+struct uring_buf {
+    uint16_t next;
+    uint16_t len;
+    uint16_t off;
+};
+
+struct uring_list {
+    int *fd;
+    int count;
+    int size;
+};
+
+struct uring_info {
+    int ring_fd;
+
+    void *sq_ring;
+    size_t sq_ring_sz;
+    void *cq_ring;
+    size_t cq_ring_sz;
+    struct io_uring_sqe *sqes;
+    size_t sqes_sz;
+
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int *sq_mask;
+    unsigned int *sq_entries;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    unsigned int to_submit;
+    uint32_t loop;
+
+    /* provided recv buffers, the data is only allocated once needed */
+    struct io_uring_buf_ring *br;
+    char *bufs;
+    struct uring_buf *binfo;
+    uint16_t br_tail;
+    unsigned int bufs_held;
+
+    struct uring_fd *fds;
+    int fds_size;
+
+    struct uring_list ready;
+    struct uring_list dirty;
+    struct uring_list starved;
+    struct uring_list lingering;
+    time_t linger_check;
+
+    /* statistics */
+    unsigned long long loops;
+    unsigned long long enters;
+    unsigned long long submitted;
+    unsigned long long completions;
+    unsigned long long stale;
+    unsigned long long recvs;
+    unsigned long long recv_bytes;
+    unsigned long long nobufs;
+    unsigned long long writes;
+    unsigned long long sends;
+    unsigned long long send_bytes;
+    unsigned long long accepts;
+    unsigned long long lingers;
+};
+
+static struct uring_info *ur_info;
+static rb_bh *uring_chunk_heap;
+
+static void rb_uring_update(rb_fde_t *F);
+
+static int
+sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int
+sys_io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void
+rb_uring_free(struct uring_info *ur)
+{
+    if(ur->br != NULL && ur->br != MAP_FAILED)
+        munmap(ur->br, URING_BUFFERS * sizeof(struct io_uring_buf));
+    if(ur->sqes != NULL && ur->sqes != MAP_FAILED)
+        munmap(ur->sqes, ur->sqes_sz);
+    if(ur->cq_ring != NULL && ur->cq_ring != MAP_FAILED && ur->cq_ring != ur->sq_ring)
+        munmap(ur->cq_ring, ur->cq_ring_sz);
+    if(ur->sq_ring != NULL && ur->sq_ring != MAP_FAILED)
+        munmap(ur->sq_ring, ur->sq_ring_sz);
+    if(ur->ring_fd >= 0)
+        close(ur->ring_fd);
+    rb_free(ur->fds);
+    rb_free(ur);
+}
+
+static void
+rb_uring_list_add(struct uring_list *list, int fd)
+{
+    if(list->count == list->size) {
+        list->size = list->size ? list->size * 2 : 64;
+        list->fd = rb_realloc(list->fd, sizeof(int) * list->size);
+    }
+    list->fd[list->count++] = fd;
+}
+
+/*
+ * rb_uring_enter
+ *
+ * Hand everything queued so far to the kernel, optionally waiting for
+ * completions.
+ */
+static int
+rb_uring_enter(unsigned int min_complete)
+{
+    unsigned int flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+
+    ur_info->enters++;
+    ur_info->loop++;
+    ret = sys_io_uring_enter(ur_info->ring_fd, ur_info->to_submit, min_complete, flags);
+    if(ret >= 0) {
+        ur_info->submitted += ret;
+        ur_info->to_submit -= ret;
+    }
+    return ret;
+}
+
+/*
+ * rb_uring_get_sqe
+ *
+ * Grab a submission queue entry for fd, pushing the queue to the kernel
+ * first if it is full.
+ */
+static struct io_uring_sqe *
+rb_uring_get_sqe(int fd)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int head, tail, idx;
+
+    tail = *ur_info->sq_tail;
+    head = __atomic_load_n(ur_info->sq_head, __ATOMIC_ACQUIRE);
+
+    if(tail - head >= *ur_info->sq_entries) {
+        if(rb_uring_enter(0) < 0) {
+            rb_lib_log("rb_uring_get_sqe(): io_uring_enter failed: %s", strerror(errno));
+            abort();
+        }
+        head = __atomic_load_n(ur_info->sq_head, __ATOMIC_ACQUIRE);
+    }
+
+    if(fd >= 0)
+        ur_info->fds[fd].sqe_loop = ur_info->loop;
+
+    idx = tail & *ur_info->sq_mask;
+    sqe = &ur_info->sqes[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ur_info->sq_array[idx] = idx;
+
+    return sqe;
+}
+
+static void
+rb_uring_queue_sqe(void)
+{
+    __atomic_store_n(ur_info->sq_tail, *ur_info->sq_tail + 1, __ATOMIC_RELEASE);
+    ur_info->to_submit++;
+}
+
+static void
+rb_uring_cancel(uint64_t tag)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = rb_uring_get_sqe(-1);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = tag;
+    sqe->user_data = URING_TAG_INTERNAL;
+    rb_uring_queue_sqe();
+}
+
+static struct uring_fd *
+rb_uring_fd(int fd)
+{
+    int size;
+
+    if(fd >= ur_info->fds_size) {
+        size = ur_info->fds_size ? ur_info->fds_size : 256;
+        while(fd >= size)
+            size *= 2;
+        ur_info->fds = rb_realloc(ur_info->fds, sizeof(struct uring_fd) * size);
+        memset(&ur_info->fds[ur_info->fds_size], 0,
+               sizeof(struct uring_fd) * (size - ur_info->fds_size));
+        for(; ur_info->fds_size < size; ur_info->fds_size++)
+            ur_info->fds[ur_info->fds_size].rx_head = ur_info->fds[ur_info->fds_size].rx_tail = URING_NOBUF;
+    }
+    return &ur_info->fds[fd];
+}
+
+/* whether reads and writes on F are done with completions */
+static inline int
+rb_uring_stream(rb_fde_t *F)
+{
+    return (F->flags & FLAG_STREAM) && (F->type & RB_FD_SOCKET) && !(F->type & RB_FD_SSL);
+}
+
+static void
+rb_uring_ready(int fd)
+{
+    struct uring_fd *ufd = &ur_info->fds[fd];
+
+    if(ufd->flags & URING_READY)
+        return;
+
+    ufd->flags |= URING_READY;
+    rb_uring_list_add(&ur_info->ready, fd);
+}
+
+/*
+ * provided buffers
+ */
+
+static void
+rb_uring_buf_put(uint16_t bid)
+{
+    struct io_uring_buf *buf;
+
+    buf = &ur_info->br->bufs[ur_info->br_tail & (URING_BUFFERS - 1)];
+    buf->addr = (uintptr_t)(ur_info->bufs + (size_t)bid * URING_BUFSIZE);
+    buf->len = URING_BUFSIZE;
+    buf->bid = bid;
+    ur_info->br_tail++;
+    __atomic_store_n(&ur_info->br->tail, ur_info->br_tail, __ATOMIC_RELEASE);
+}
+
+static void
+rb_uring_buf_recycle(uint16_t bid)
+{
+    ur_info->bufs_held--;
+    rb_uring_buf_put(bid);
+}
+
+static void
+rb_uring_bufs_alloc(void)
+{
+    int i;
+
+    if(ur_info->bufs != NULL)
+        return;
+
+    ur_info->bufs = rb_malloc((size_t)URING_BUFFERS * URING_BUFSIZE);
+    ur_info->binfo = rb_malloc(sizeof(struct uring_buf) * URING_BUFFERS);
+
+    for(i = 0; i < URING_BUFFERS; i++)
+        rb_uring_buf_put(i);
+}
+
+static void
+rb_uring_rx_drop(struct uring_fd *ufd)
+{
+    uint16_t bid;
+
+    while((bid = ufd->rx_head) != URING_NOBUF) {
+        ufd->rx_head = ur_info->binfo[bid].next;
+        rb_uring_buf_recycle(bid);
+    }
+    ufd->rx_tail = URING_NOBUF;
+    ufd->rx_len = 0;
+}
+
+/*
+ * staged sends
+ */
+
+static void
+rb_uring_tx_free(struct uring_fd *ufd)
+{
+    struct uring_chunk *chunk, *next;
+
+    if(ufd->tx == NULL)
+        return;
+
+    for(chunk = ufd->tx->head; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        rb_bh_free(uring_chunk_heap, chunk);
+    }
+    rb_free(ufd->tx);
+    ufd->tx = NULL;
+}
+
+static void
+rb_uring_tx_consume(struct uring_tx *tx, unsigned int len)
+{
+    struct uring_chunk *chunk;
+    unsigned int n;
+
+    tx->queued -= len;
+
+    while(len > 0 && (chunk = tx->head) != NULL) {
+        n = chunk->len - chunk->off;
+        if(n > len)
+            n = len;
+        chunk->off += n;
+        len -= n;
+
+        if(chunk->off == chunk->len) {
+            if(chunk == tx->tail) {
+                chunk->off = chunk->len = 0;
+                break;
+            }
+            tx->head = chunk->next;
+            rb_bh_free(uring_chunk_heap, chunk);
+        }
+    }
+}
+
+static void
+rb_uring_send(int fd)
+{
+    struct uring_fd *ufd = &ur_info->fds[fd];
+    struct uring_tx *tx = ufd->tx;
+    struct uring_chunk *chunk;
+    struct io_uring_sqe *sqe;
+    int i = 0;
+
+    if(tx == NULL || tx->queued == 0 || (ufd->flags & URING_SEND))
+        return;
+
+    for(chunk = tx->head; chunk != NULL && i < URING_SEND_IOV; chunk = chunk->next) {
+        if(chunk->len == chunk->off)
+            continue;
+        tx->iov[i].iov_base = chunk->data + chunk->off;
+        tx->iov[i].iov_len = chunk->len - chunk->off;
+        i++;
+    }
+
+    memset(&tx->msg, 0, sizeof(tx->msg));
+    tx->msg.msg_iov = tx->iov;
+    tx->msg.msg_iovlen = i;
+
+    sqe = rb_uring_get_sqe(fd);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uintptr_t)&tx->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = URING_TAG(URING_OP_SEND, ufd->seq, fd);
+    rb_uring_queue_sqe();
+
+    ufd->flags |= URING_SEND;
+    ur_info->sends++;
+}
+
+/* one sendmsg per fd for whatever was written during the loop */
+static void
+rb_uring_flush_sends(void)
+{
+    struct uring_fd *ufd;
+    int i, fd;
+
+    for(i = 0; i < ur_info->dirty.count; i++) {
+        fd = ur_info->dirty.fd[i];
+        ufd = &ur_info->fds[fd];
+
+        if(!(ufd->flags & URING_DIRTY))
+            continue;
+
+        ufd->flags &= ~URING_DIRTY;
+        rb_uring_send(fd);
+    }
+    ur_info->dirty.count = 0;
+}
+
+/*
+ * closing
+ */
+
+static void
+rb_uring_reset(struct uring_fd *ufd)
+{
+    int i;
+
+    rb_uring_rx_drop(ufd);
+
+    for(i = 0; i < ufd->naccepted; i++)
+        close(ufd->accepted[i]);
+    rb_free(ufd->accepted);
+    ufd->accepted = NULL;
+    ufd->naccepted = ufd->accepted_size = 0;
+
+    rb_uring_tx_free(ufd);
+
+    ufd->F = NULL;
+    ufd->seq++;
+    ufd->flags = 0;
+    ufd->error = 0;
+}
+
+/* a lingering socket is done sending, or has given up on it */
+static void
+rb_uring_linger_done(int fd)
+{
+    rb_uring_reset(&ur_info->fds[fd]);
+    close(fd);
+}
+
+static void
+rb_uring_linger_check(void)
+{
+    struct uring_fd *ufd;
+    int i, j, fd;
+
+    if(ur_info->linger_check == rb_current_time())
+        return;
+    ur_info->linger_check = rb_current_time();
+
+    for(i = 0, j = 0; i < ur_info->lingering.count; i++) {
+        fd = ur_info->lingering.fd[i];
+        ufd = &ur_info->fds[fd];
+
+        if(!(ufd->flags & URING_LINGERING))
+            continue;
+
+        if(ufd->tx->linger + URING_LINGER < rb_current_time()) {
+            if(ufd->flags & URING_SEND)
+                rb_uring_cancel(URING_TAG(URING_OP_SEND, ufd->seq, fd));
+            else {
+                rb_uring_linger_done(fd);
+                continue;
+            }
+        }
+
+        ur_info->lingering.fd[j++] = fd;
+    }
+    ur_info->lingering.count = j;
+}
+
+/*
+ * rb_close_uring
+ *
+ * Called by rb_close() before it closes the fd.  Returns 1 if we keep
+ * the fd open to finish sending what was staged on it.
+ */
+int
+rb_close_uring(rb_fde_t *F)
+{
+    struct uring_fd *ufd;
+    int fd = F->fd;
+
+    if(fd >= ur_info->fds_size || ur_info->fds[fd].F != F)
+        return 0;
+
+    ufd = &ur_info->fds[fd];
+
+    if((ufd->flags & (URING_RECV | URING_ACCEPT)) && !(ufd->flags & URING_CANCEL))
+        rb_uring_cancel(URING_TAG((ufd->flags & URING_RECV) ? URING_OP_RECV : URING_OP_ACCEPT,
+                                  ufd->seq, fd));
+
+    /* a sendmsg in flight still points into the staging queue, so that
+     * has to stay until the send completes, as does the fd to send on
+     */
+    if(ufd->tx != NULL && ufd->tx->queued > 0) {
+        struct uring_tx *tx = ufd->tx;
+        unsigned short sending = ufd->flags & URING_SEND;
+        uint32_t seq = ufd->seq;
+
+        ufd->tx = NULL;
+        rb_uring_reset(ufd);
+        ufd->seq = seq;
+        ufd->tx = tx;
+        ufd->flags = URING_LINGERING | sending;
+
+        tx->linger = rb_current_time();
+        rb_uring_send(fd);
+        rb_uring_list_add(&ur_info->lingering, fd);
+        ur_info->lingers++;
+        return 1;
+    }
+
+    rb_uring_reset(ufd);
+
+    /* anything still queued for the fd has to reach the kernel before the
+     * fd does away, or it could end up applied to whatever reuses it
+     */
+    if(ufd->sqe_loop == ur_info->loop && ur_info->to_submit > 0)
+        rb_uring_enter(0);
+
+    return 0;
+}
+
+/*
+ * rb_uring_update
+ *
+ * Make what is in flight for F match the handlers currently set on it.
+ */
+static void
+rb_uring_update(rb_fde_t *F)
+{
+    struct io_uring_sqe *sqe;
+    struct uring_fd *ufd;
+    int fd = F->fd;
+    short events = 0;
+
+    ufd = rb_uring_fd(fd);
+    ufd->F = F;
+
+    if(rb_uring_stream(F)) {
+        if(F->read_handler != NULL && F->accept != NULL) {
+            if(ufd->naccepted > 0 || ufd->error)
+                rb_uring_ready(fd);
+
+            if(!(ufd->flags & (URING_ACCEPT | URING_CANCEL))) {
+                sqe = rb_uring_get_sqe(fd);
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->fd = fd;
+                sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+                sqe->user_data = URING_TAG(URING_OP_ACCEPT, ufd->seq, fd);
+                rb_uring_queue_sqe();
+                ufd->flags |= URING_ACCEPT;
+            }
+        } else if(F->read_handler != NULL) {
+            if(ufd->rx_len > 0 || ufd->error || (ufd->flags & URING_EOF))
+                rb_uring_ready(fd);
+
+            if(!(ufd->flags & (URING_RECV | URING_CANCEL | URING_EOF | URING_STARVED)) &&
+               ufd->error == 0 && ufd->rx_len < URING_RECV_MAX) {
+                rb_uring_bufs_alloc();
+
+                sqe = rb_uring_get_sqe(fd);
+                sqe->opcode = IORING_OP_RECV;
+                sqe->fd = fd;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = URING_BGID;
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+                sqe->user_data = URING_TAG(URING_OP_RECV, ufd->seq, fd);
+                rb_uring_queue_sqe();
+                ufd->flags |= URING_RECV;
+            }
+        }
+
+        if(F->write_handler != NULL) {
+            /* with sends in flight, their completions say when there is room */
+            if(ufd->tx != NULL && ufd->tx->queued > 0) {
+                if(ufd->tx->queued < URING_SEND_MAX)
+                    rb_uring_ready(fd);
+            } else if(ufd->error)
+                rb_uring_ready(fd);
+            else
+                events |= POLLOUT;
+        }
+    } else {
+        if(F->read_handler != NULL)
+            events |= POLLIN;
+        if(F->write_handler != NULL)
+            events |= POLLOUT;
+    }
+
+    F->pflags = events;
+
+    if(ufd->armed == events)
+        return;
+
+    if(ufd->armed) {
+        rb_uring_cancel(URING_TAG(URING_OP_POLL, ufd->pseq, fd));
+        ufd->armed = 0;
+    }
+
+    if(events == 0)
+        return;
+
+    ufd->pseq++;
+    ufd->armed = events;
+
+    sqe = rb_uring_get_sqe(fd);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll_events = events;
+    sqe->user_data = URING_TAG(URING_OP_POLL, ufd->pseq, fd);
+    rb_uring_queue_sqe();
+}
+
+/*
+ * rb_read_uring
+ *
+ * rb_read() for stream sockets, hands out what recv completions have
+ * already put in our buffers.
+ */
+ssize_t
+rb_read_uring(rb_fde_t *F, void *buf, int count)
+{
+    struct uring_fd *ufd = rb_uring_fd(F->fd);
+    struct uring_buf *b;
+    uint16_t bid;
+    int copied = 0, n;
+
+    while(copied < count && (bid = ufd->rx_head) != URING_NOBUF) {
+        b = &ur_info->binfo[bid];
+        n = b->len - b->off;
+        if(n > count - copied)
+            n = count - copied;
+
+        memcpy((char *)buf + copied, ur_info->bufs + (size_t)bid * URING_BUFSIZE + b->off, n);
+        b->off += n;
+        copied += n;
+        ufd->rx_len -= n;
+
+        if(b->off == b->len) {
+            ufd->rx_head = b->next;
+            if(ufd->rx_head == URING_NOBUF)
+                ufd->rx_tail = URING_NOBUF;
+            rb_uring_buf_recycle(bid);
+        }
+    }
+
+    if(copied > 0)
+        return copied;
+
+    if(ufd->error) {
+        errno = ufd->error;
+        return -1;
+    }
+
+    if(ufd->flags & URING_EOF)
+        return 0;
+
+    errno = EAGAIN;
+    return -1;
+}
+
+/*
+ * rb_writev_uring
+ *
+ * rb_write()/rb_writev() for stream sockets, stages the data to go out
+ * with the fd's next sendmsg.
+ */
+ssize_t
+rb_writev_uring(rb_fde_t *F, const struct rb_iovec *vector, int count)
+{
+    struct uring_fd *ufd = rb_uring_fd(F->fd);
+    struct uring_tx *tx;
+    struct uring_chunk *chunk;
+    const char *data;
+    size_t len, n;
+    ssize_t total = 0;
+    int i;
+
+    ufd->F = F;
+
+    if(ufd->error) {
+        errno = ufd->error;
+        return -1;
+    }
+
+    if(ufd->tx == NULL)
+        ufd->tx = rb_malloc(sizeof(struct uring_tx));
+    tx = ufd->tx;
+
+    if(tx->queued >= URING_SEND_MAX) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    for(i = 0; i < count; i++) {
+        data = vector[i].iov_base;
+        len = vector[i].iov_len;
+
+        while(len > 0) {
+            chunk = tx->tail;
+            if(chunk == NULL || chunk->len == URING_CHUNK) {
+                chunk = rb_bh_alloc(uring_chunk_heap);
+                if(tx->tail != NULL)
+                    tx->tail->next = chunk;
+                else
+                    tx->head = chunk;
+                tx->tail = chunk;
+            }
+
+            n = URING_CHUNK - chunk->len;
+            if(n > len)
+                n = len;
+            memcpy(chunk->data + chunk->len, data, n);
+            chunk->len += n;
+            data += n;
+            len -= n;
+            total += n;
+        }
+    }
+
+    tx->queued += total;
+    ur_info->writes++;
+
+    if(total > 0 && !(ufd->flags & URING_DIRTY)) {
+        ufd->flags |= URING_DIRTY;
+        rb_uring_list_add(&ur_info->dirty, F->fd);
+    }
+
+    return total;
+}
+
+/*
+ * rb_accept_uring
+ *
+ * accept() for stream listeners, hands out what accept completions have
+ * already accepted.
+ */
+int
+rb_accept_uring(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t *addrlen)
+{
+    struct uring_fd *ufd = rb_uring_fd(F->fd);
+    int fd;
+
+    while(ufd->naccepted > 0) {
+        fd = ufd->accepted[--ufd->naccepted];
+
+        /* the address isn't kept per accept with multishot */
+        if(getpeername(fd, addr, addrlen) == 0)
+            return fd;
+
+        close(fd);
+    }
+
+    if(ufd->error) {
+        errno = ufd->error;
+        ufd->error = 0;
+        return -1;
+    }
+
+    errno = EAGAIN;
+    return -1;
+}
+
+/*
+ * completions
+ */
+
+static void
+rb_uring_recv_done(int fd, uint32_t seq, int res, unsigned int cflags)
+{
+    struct uring_fd *ufd = &ur_info->fds[fd];
+    struct uring_buf *b;
+    uint16_t bid = cflags >> IORING_CQE_BUFFER_SHIFT;
+
+    if(cflags & IORING_CQE_F_BUFFER)
+        ur_info->bufs_held++;
+
+    if(URING_SEQ(ufd->seq) != seq || ufd->F == NULL) {
+        ur_info->stale++;
+        if(cflags & IORING_CQE_F_BUFFER)
+            rb_uring_buf_recycle(bid);
+        return;
+    }
+
+    if(!(cflags & IORING_CQE_F_MORE))
+        ufd->flags &= ~(URING_RECV | URING_CANCEL);
+
+    if(res > 0 && (cflags & IORING_CQE_F_BUFFER)) {
+        b = &ur_info->binfo[bid];
+        b->next = URING_NOBUF;
+        b->len = res;
+        b->off = 0;
+
+        if(ufd->rx_tail != URING_NOBUF)
+            ur_info->binfo[ufd->rx_tail].next = bid;
+        else
+            ufd->rx_head = bid;
+        ufd->rx_tail = bid;
+        ufd->rx_len += res;
+
+        ur_info->recvs++;
+        ur_info->recv_bytes += res;
+
+        /* nobody is reading, stop taking buffers from everyone else */
+        if(ufd->rx_len >= URING_RECV_MAX && (ufd->flags & URING_RECV) &&
+           !(ufd->flags & URING_CANCEL)) {
+            rb_uring_cancel(URING_TAG(URING_OP_RECV, ufd->seq, fd));
+            ufd->flags |= URING_CANCEL;
+        }
+    } else if(res == 0)
+        ufd->flags |= URING_EOF;
+    else if(res == -ENOBUFS) {
+        ur_info->nobufs++;
+        if(!(ufd->flags & URING_STARVED)) {
+            ufd->flags |= URING_STARVED;
+            rb_uring_list_add(&ur_info->starved, fd);
+        }
+    } else if(res < 0 && res != -ECANCELED)
+        ufd->error = -res;
+
+    rb_uring_ready(fd);
+}
+
+static void
+rb_uring_send_done(int fd, uint32_t seq, int res)
+{
+    struct uring_fd *ufd = &ur_info->fds[fd];
+    struct uring_tx *tx = ufd->tx;
+
+    if(URING_SEQ(ufd->seq) != seq || tx == NULL || !(ufd->flags & URING_SEND)) {
+        ur_info->stale++;
+        return;
+    }
+
+    ufd->flags &= ~URING_SEND;
+
+    if(res < 0) {
+        if(ufd->error == 0)
+            ufd->error = -res;
+        rb_uring_tx_consume(tx, tx->queued);
+    } else {
+        ur_info->send_bytes += res;
+        rb_uring_tx_consume(tx, res);
+    }
+
+    if(ufd->flags & URING_LINGERING) {
+        if(tx->queued == 0 || ufd->error)
+            rb_uring_linger_done(fd);
+        else
+            rb_uring_send(fd);
+        return;
+    }
+
+    if(tx->queued > 0 && ufd->error == 0)
+        rb_uring_send(fd);
+
+    rb_uring_ready(fd);
+}
+
+static void
+rb_uring_accept_done(int fd, uint32_t seq, int res, unsigned int cflags)
+{
+    struct uring_fd *ufd = &ur_info->fds[fd];
+
+    if(URING_SEQ(ufd->seq) != seq || ufd->F == NULL) {
+        ur_info->stale++;
+        if(res >= 0)
+            close(res);
+        return;
+    }
+
+    if(!(cflags & IORING_CQE_F_MORE))
+        ufd->flags &= ~(URING_ACCEPT | URING_CANCEL);
+
+    if(res >= 0) {
+        if(ufd->naccepted == ufd->accepted_size) {
+            ufd->accepted_size = ufd->accepted_size ? ufd->accepted_size * 2 : 16;
+            ufd->accepted = rb_realloc(ufd->accepted, sizeof(int) * ufd->accepted_size);
+        }
+        ufd->accepted[ufd->naccepted++] = res;
+        ur_info->accepts++;
+    } else if(res != -ECANCELED)
+        ufd->error = -res;
+
+    rb_uring_ready(fd);
+}
+
+static void
+rb_uring_poll_done(int fd, uint32_t seq, int res)
+{
+    struct uring_fd *ufd = &ur_info->fds[fd];
+    rb_fde_t *F;
+    PF *hdl;
+    void *data;
+
+    if(ufd->armed == 0 || URING_SEQ(ufd->pseq) != seq) {
+        ur_info->stale++;
+        return;
+    }
+
+    F = ufd->F;
+    ufd->armed = 0;
+
+    if(F == NULL || !IsFDOpen(F))
+        return;
+
+    if(res < 0)
+        res = POLLERR;
+
+    if(res & (POLLIN | POLLHUP | POLLERR) && !rb_uring_stream(F)) {
+        hdl = F->read_handler;
+        data = F->read_data;
+        F->read_handler = NULL;
+        F->read_data = NULL;
+        if(hdl)
+            hdl(F, data);
+    }
+
+    if(!IsFDOpen(F))
+        return;
+
+    if(res & (POLLOUT | POLLHUP | POLLERR)) {
+        hdl = F->write_handler;
+        data = F->write_data;
+        F->write_handler = NULL;
+        F->write_data = NULL;
+        if(hdl)
+            hdl(F, data);
+    }
+
+    if(!IsFDOpen(F))
+        return;
+
+    /* the poll is one-shot, rearm for whatever is still wanted */
+    rb_uring_update(F);
+}
+
+/*
+ * rb_uring_run_ready
+ *
+ * Call the handlers of the stream sockets that completions have given
+ * something to do.
+ */
+static void
+rb_uring_run_ready(void)
+{
+    struct uring_list list = ur_info->ready;
+    struct uring_fd *ufd;
+    rb_fde_t *F;
+    PF *hdl;
+    void *data;
+    int i, fd, readable, writable;
+
+    /* anything made ready by the handlers waits for the next loop */
+    memset(&ur_info->ready, 0, sizeof(ur_info->ready));
+
+    for(i = 0; i < list.count; i++) {
+        fd = list.fd[i];
+        ufd = &ur_info->fds[fd];
+
+        if(!(ufd->flags & URING_READY))
+            continue;
+        ufd->flags &= ~URING_READY;
+
+        F = ufd->F;
+        if(F == NULL || !IsFDOpen(F))
+            continue;
+
+        if(F->accept != NULL)
+            readable = ufd->naccepted > 0 || ufd->error;
+        else
+            readable = ufd->rx_len > 0 || ufd->error || (ufd->flags & URING_EOF);
+
+        writable = ufd->error || (ufd->tx != NULL && ufd->tx->queued > 0 &&
+                                  ufd->tx->queued < URING_SEND_MAX);
+
+        if(readable && F->read_handler != NULL) {
+            hdl = F->read_handler;
+            data = F->read_data;
+            F->read_handler = NULL;
+            F->read_data = NULL;
+            hdl(F, data);
+
+            if(!IsFDOpen(F))
+                continue;
+            ufd = &ur_info->fds[fd];
+        }
+
+        if(writable && F->write_handler != NULL) {
+            hdl = F->write_handler;
+            data = F->write_data;
+            F->write_handler = NULL;
+            F->write_data = NULL;
+            hdl(F, data);
+
+            if(!IsFDOpen(F))
+                continue;
+        }
+
+        rb_uring_update(F);
+    }
+
+    /* if the handlers have made ready the same list again, keep it */
+    if(ur_info->ready.fd == NULL) {
+        list.count = 0;
+        ur_info->ready = list;
+    } else
+        rb_free(list.fd);
+}
+
+/* give recvs that ran out of buffers another go once some are back */
+static void
+rb_uring_run_starved(void)
+{
+    struct uring_list list = ur_info->starved;
+    struct uring_fd *ufd;
+    int i;
+
+    if(list.count == 0 || ur_info->bufs_held >= URING_BUFFERS)
+        return;
+
+    memset(&ur_info->starved, 0, sizeof(ur_info->starved));
+
+    for(i = 0; i < list.count; i++) {
+        ufd = &ur_info->fds[list.fd[i]];
+
+        if(!(ufd->flags & URING_STARVED))
+            continue;
+        ufd->flags &= ~URING_STARVED;
+
+        if(ufd->F != NULL && IsFDOpen(ufd->F))
+            rb_uring_update(ufd->F);
+    }
+
+    rb_free(list.fd);
+}
+
+/*
+ * rb_init_netio
+ *
+ * This is a needed exported function which will be called to initialise
+ * the network loop code.
+ */
+int
+rb_init_netio_uring(void)
+{
+    struct io_uring_params params;
+    struct io_uring_buf_reg reg;
+    struct uring_info *ur;
+
+    ur = rb_malloc(sizeof(struct uring_info));
+    ur->ring_fd = -1;
+
+    memset(&params, 0, sizeof(params));
+    ur->ring_fd = sys_io_uring_setup(URING_ENTRIES, &params);
+    if(ur->ring_fd < 0) {
+        rb_uring_free(ur);
+        return -1;
+    }
+
+    /* without NODROP, completions could be lost under load, and without
+     * REG_REG_RING the kernel predates multishot recv
+     */
+    if(!(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_REG_REG_RING)) {
+        rb_uring_free(ur);
+        return -1;
+    }
+
+    ur->sq_ring_sz = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ur->cq_ring_sz = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP) {
+        if(ur->cq_ring_sz > ur->sq_ring_sz)
+            ur->sq_ring_sz = ur->cq_ring_sz;
+        ur->cq_ring_sz = ur->sq_ring_sz;
+    }
+
+    ur->sq_ring = mmap(NULL, ur->sq_ring_sz, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQ_RING);
+    if(ur->sq_ring == MAP_FAILED) {
+        rb_uring_free(ur);
+        return -1;
+    }
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+        ur->cq_ring = ur->sq_ring;
+    else {
+        ur->cq_ring = mmap(NULL, ur->cq_ring_sz, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_CQ_RING);
+        if(ur->cq_ring == MAP_FAILED) {
+            rb_uring_free(ur);
+            return -1;
+        }
+    }
+
+    ur->sqes_sz = params.sq_entries * sizeof(struct io_uring_sqe);
+    ur->sqes = mmap(NULL, ur->sqes_sz, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ur->ring_fd, IORING_OFF_SQES);
+    if(ur->sqes == MAP_FAILED) {
+        rb_uring_free(ur);
+        return -1;
+    }
+
+    /* the buffer ring is registered now, but only filled once a stream
+     * socket wants to receive, so helpers never pay for the buffers
+     */
+    ur->br = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(ur->br == MAP_FAILED) {
+        rb_uring_free(ur);
+        return -1;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)ur->br;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = URING_BGID;
+    if(sys_io_uring_register(ur->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        rb_uring_free(ur);
+        return -1;
+    }
+
+    ur->sq_head = (unsigned int *)((char *)ur->sq_ring + params.sq_off.head);
+    ur->sq_tail = (unsigned int *)((char *)ur->sq_ring + params.sq_off.tail);
+    ur->sq_mask = (unsigned int *)((char *)ur->sq_ring + params.sq_off.ring_mask);
+    ur->sq_entries = (unsigned int *)((char *)ur->sq_ring + params.sq_off.ring_entries);
+    ur->sq_array = (unsigned int *)((char *)ur->sq_ring + params.sq_off.array);
+    ur->cq_head = (unsigned int *)((char *)ur->cq_ring + params.cq_off.head);
+    ur->cq_tail = (unsigned int *)((char *)ur->cq_ring + params.cq_off.tail);
+    ur->cq_mask = (unsigned int *)((char *)ur->cq_ring + params.cq_off.ring_mask);
+    ur->cqes = (struct io_uring_cqe *)((char *)ur->cq_ring + params.cq_off.cqes);
+
+    ur_info = ur;
+    rb_uring_fd(0);
+
+    uring_chunk_heap = rb_bh_create(sizeof(struct uring_chunk), 64, "librb_uring_chunk_heap");
+
+    rb_open(ur->ring_fd, RB_FD_UNKNOWN, "io_uring file descriptor");
+
+    return 0;
+}
+
+int
+rb_setup_fd_uring(rb_fde_t *F)
+{
+    return 0;
+}
+
+/*
+ * rb_setselect
+ *
+ * This is a needed exported function which will be called to register
+ * and deregister interest in a pending IO state for a given FD.
+ */
+void
+rb_setselect_uring(rb_fde_t *F, unsigned int type, PF * handler, void *client_data)
+{
+    lrb_assert(IsFDOpen(F));
+
+    if(type & RB_SELECT_READ) {
+        F->read_handler = handler;
+        F->read_data = client_data;
+    }
+
+    if(type & RB_SELECT_WRITE) {
+        F->write_handler = handler;
+        F->write_data = client_data;
+    }
+
+    rb_uring_update(F);
+}
+
+/*
+ * rb_select
+ *
+ * Called to do the new-style IO, courtesy of squid (like most of this
+ * new IO code). This routine handles the stuff we've hidden in
+ * rb_setselect and fd_table[] and calls callbacks for IO ready
+ * events.
+ */
+int
+rb_select_uring(long delay)
+{
+    static struct __kernel_timespec ts;
+    struct io_uring_sqe *sqe;
+    unsigned int head, tail, wait = 0;
+    uint64_t tag;
+    int ret, res, o_errno;
+
+    rb_uring_flush_sends();
+
+    head = *ur_info->cq_head;
+    tail = __atomic_load_n(ur_info->cq_tail, __ATOMIC_ACQUIRE);
+
+    /* only block if there is nothing waiting for us already */
+    if(head == tail && ur_info->ready.count == 0 && delay != 0) {
+        wait = 1;
+        if(delay > 0) {
+            /* completes after the delay, or as soon as anything else does */
+            ts.tv_sec = delay / 1000;
+            ts.tv_nsec = (delay % 1000) * 1000000;
+            sqe = rb_uring_get_sqe(-1);
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->fd = -1;
+            sqe->addr = (uintptr_t)&ts;
+            sqe->len = 1;
+            sqe->off = 1;
+            sqe->user_data = URING_TAG_INTERNAL;
+            rb_uring_queue_sqe();
+        }
+    }
+
+    ret = rb_uring_enter(wait);
+
+    /* save errno as rb_set_time() will likely clobber it */
+    o_errno = errno;
+    rb_set_time();
+    errno = o_errno;
+
+    if(ret < 0 && !rb_ignore_errno(o_errno))
+        return RB_ERROR;
+
+    ur_info->loops++;
+
+    head = *ur_info->cq_head;
+    tail = __atomic_load_n(ur_info->cq_tail, __ATOMIC_ACQUIRE);
+
+    while(head != tail) {
+        struct io_uring_cqe *cqe = &ur_info->cqes[head & *ur_info->cq_mask];
+        unsigned int cflags = cqe->flags;
+        int fd;
+
+        tag = cqe->user_data;
+        res = cqe->res;
+
+        head++;
+        __atomic_store_n(ur_info->cq_head, head, __ATOMIC_RELEASE);
+
+        if(URING_TAG_OP(tag) == URING_OP_INTERNAL)
+            continue;
+
+        ur_info->completions++;
+        fd = URING_TAG_FD(tag);
+
+        if(fd >= ur_info->fds_size) {
+            ur_info->stale++;
+            continue;
+        }
+
+        switch (URING_TAG_OP(tag)) {
+        case URING_OP_POLL:
+            rb_uring_poll_done(fd, URING_TAG_SEQ(tag), res);
+            break;
+        case URING_OP_RECV:
+            rb_uring_recv_done(fd, URING_TAG_SEQ(tag), res, cflags);
+            break;
+        case URING_OP_SEND:
+            rb_uring_send_done(fd, URING_TAG_SEQ(tag), res);
+            break;
+        case URING_OP_ACCEPT:
+            rb_uring_accept_done(fd, URING_TAG_SEQ(tag), res, cflags);
+            break;
+        }
+
+        tail = __atomic_load_n(ur_info->cq_tail, __ATOMIC_ACQUIRE);
+    }
+
+    rb_uring_run_ready();
+    rb_uring_run_starved();
+
+    if(ur_info->lingering.count > 0)
+        rb_uring_linger_check();
+
+    return RB_OK;
+}
+
+/*
+ * rb_uring_dump_stats
+ *
+ * Report the batching statistics of the io_uring loop.
+ */
+void
+rb_uring_dump_stats(void (*func) (char *, void *), void *ptr)
+{
+    char buf[512];
+    unsigned long long loops = ur_info->loops ? ur_info->loops : 1;
+
+    rb_snprintf(buf, sizeof(buf), "io_uring loops %llu, io_uring_enter calls %llu, sqes submitted %llu (%llu.%02llu/loop)",
+                ur_info->loops, ur_info->enters, ur_info->submitted,
+                ur_info->submitted / loops, (ur_info->submitted * 100 / loops) % 100);
+    func(buf, ptr);
+
+    rb_snprintf(buf, sizeof(buf), "io_uring completions %llu (%llu.%02llu/loop), stale %llu",
+                ur_info->completions,
+                ur_info->completions / loops, (ur_info->completions * 100 / loops) % 100,
+                ur_info->stale);
+    func(buf, ptr);
+
+    rb_snprintf(buf, sizeof(buf), "io_uring recvs %llu (%llu bytes), buffers in use %u/%u, out of buffers %llu",
+                ur_info->recvs, ur_info->recv_bytes, ur_info->bufs_held, URING_BUFFERS,
+                ur_info->nobufs);
+    func(buf, ptr);
+
+    rb_snprintf(buf, sizeof(buf), "io_uring writes %llu in %llu sends (%llu bytes), accepts %llu, lingering closes %llu",
+                ur_info->writes, ur_info->sends, ur_info->send_bytes, ur_info->accepts,
+                ur_info->lingers);
+    func(buf, ptr);
+}
+
+#endif /* __NR_io_uring_setup && IORING_RECV_MULTISHOT ... */
+#endif /* HAVE_LINUX_IO_URING_H && HAVE_SYS_POLL_H */
+
+#ifndef USING_IO_URING
+int
+rb_init_netio_uring(void)
+{
+    return ENOSYS;
+}
+
+void
+rb_setselect_uring(rb_fde_t *F, unsigned int type, PF * handler, void *client_data)
+{
+    errno = ENOSYS;
+    return;
+}
+
+int
+rb_select_uring(long delay)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+rb_setup_fd_uring(rb_fde_t *F)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+ssize_t
+rb_read_uring(rb_fde_t *F, void *buf, int count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+ssize_t
+rb_writev_uring(rb_fde_t *F, const struct rb_iovec *vector, int count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+rb_accept_uring(rb_fde_t *F, struct sockaddr *addr, rb_socklen_t *addrlen)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+rb_close_uring(rb_fde_t *F)
+{
+    return 0;
+}
+
+void
+rb_uring_dump_stats(void (*func) (char *, void *), void *ptr)
+{
+    return;
+}
+#endif
@@ -27,10 +27,17 @@
 #include <ratbox_lib.h>
 #include <commio-int.h>
 
-static rb_bh *rb_linebuf_heap;
+/* block sizes of the line heaps, the last one fits any line */
+#define LINEBUF_CLASSES 4
+static const size_t rb_linebuf_class_blocks[LINEBUF_CLASSES - 1] = { 64, 128, 256 };
+static size_t rb_linebuf_class_size[LINEBUF_CLASSES];
+static rb_bh *rb_linebuf_heap[LINEBUF_CLASSES];
 
 static int bufline_count = 0;
 
+/* outgoing lines are formatted here, then copied into a line that fits */
+static char rb_linebuf_stage[BUF_DATA_SIZE + 2];
+
 #ifndef LINEBUF_HEAP_SIZE
 #define LINEBUF_HEAP_SIZE 2048
 #endif
@@ -44,14 +51,40 @@ static int bufline_count = 0;
 void
 rb_linebuf_init(size_t heap_size)
 {
-    rb_linebuf_heap = rb_bh_create(sizeof(buf_line_t), heap_size, "librb_linebuf_heap");
+    static const char *desc[LINEBUF_CLASSES] = {
+        "librb_linebuf_heap_64", "librb_linebuf_heap_128",
+        "librb_linebuf_heap_256", "librb_linebuf_heap"
+    };
+    int i;
+
+    for(i = 0; i < LINEBUF_CLASSES - 1; i++)
+        rb_linebuf_class_size[i] = rb_linebuf_class_blocks[i] - sizeof(buf_line_t);
+    rb_linebuf_class_size[i] = BUF_DATA_SIZE + 2;
+
+    for(i = 0; i < LINEBUF_CLASSES; i++)
+        rb_linebuf_heap[i] = rb_bh_create(sizeof(buf_line_t) + rb_linebuf_class_size[i],
+                                          heap_size, desc[i]);
 }
 
+/*
+ * rb_linebuf_allocate
+ *
+ * Allocate a line with room for at least size bytes of data, from the
+ * smallest heap that fits it.
+ */
 static buf_line_t *
-rb_linebuf_allocate(void)
+rb_linebuf_allocate(size_t size)
 {
     buf_line_t *t;
-    t = rb_bh_alloc(rb_linebuf_heap);
+    int i;
+
+    for(i = 0; i < LINEBUF_CLASSES - 1; i++) {
+        if(size <= rb_linebuf_class_size[i])
+            break;
+    }
+
+    t = rb_bh_alloc(rb_linebuf_heap[i]);
+    t->sizeclass = i;
     return (t);
 
 }
@@ -59,7 +92,7 @@ rb_linebuf_allocate(void)
 static void
 rb_linebuf_free(buf_line_t * p)
 {
-    rb_bh_free(rb_linebuf_heap, p);
+    rb_bh_free(rb_linebuf_heap[p->sizeclass], p);
 }
 
 /*
@@ -69,12 +102,12 @@ rb_linebuf_free(buf_line_t * p)
  * It will be initially empty.
  */
 static buf_line_t *
-rb_linebuf_new_line(buf_head_t * bufhead)
+rb_linebuf_new_line(buf_head_t * bufhead, size_t size)
 {
     buf_line_t *bufline;
     rb_dlink_node *node;
 
-    bufline = rb_linebuf_allocate();
+    bufline = rb_linebuf_allocate(size);
     if(bufline == NULL)
         return NULL;
     ++bufline_count;
@@ -100,7 +133,7 @@ rb_linebuf_new_line(buf_head_t * bufhead)
  * We've finished with the given line, so deallocate it
  */
 static void
-rb_linebuf_done_line(buf_head_t * bufhead, buf_line_t * bufline, rb_dlink_node *node)
+rb_linebuf_unlink_line(buf_head_t * bufhead, buf_line_t * bufline, rb_dlink_node *node)
 {
     /* Remove it from the linked list */
     rb_dlinkDestroy(node, &bufhead->list);
@@ -110,6 +143,12 @@ rb_linebuf_done_line(buf_head_t * bufhead, buf_line_t * bufline, rb_dlink_node *
     bufhead->len -= bufline->len;
     lrb_assert(bufhead->len >= 0);
     bufhead->numlines--;
+}
+
+static void
+rb_linebuf_done_line(buf_head_t * bufhead, buf_line_t * bufline, rb_dlink_node *node)
+{
+    rb_linebuf_unlink_line(bufhead, bufline, node);
 
     bufline->refcount--;
     lrb_assert(bufline->refcount >= 0);
@@ -212,9 +251,8 @@ rb_linebuf_copy_line(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
     if(bufline->terminated == 1)
         return 0;
 
-    clen = cpylen = rb_linebuf_skip_crlf(ch, len);
-    if(clen == -1)
-        return -1;
+    /* len is what rb_linebuf_skip_crlf() found for this line */
+    clen = cpylen = len;
 
     /* This is the ~overflow case..This doesn't happen often.. */
     if(cpylen > (BUF_DATA_SIZE - bufline->len - 1)) {
@@ -281,9 +319,8 @@ rb_linebuf_copy_raw(buf_head_t * bufhead, buf_line_t * bufline, char *data, int
     if(bufline->terminated == 1)
         return 0;
 
-    clen = cpylen = rb_linebuf_skip_crlf(ch, len);
-    if(clen == -1)
-        return -1;
+    /* len is what rb_linebuf_skip_crlf() found for this line */
+    clen = cpylen = len;
 
     /* This is the overflow case..This doesn't happen often.. */
     if(cpylen > (BUF_DATA_SIZE - bufline->len - 1)) {
@@ -338,18 +375,22 @@ int
 rb_linebuf_parse(buf_head_t * bufhead, char *data, int len, int raw)
 {
     buf_line_t *bufline;
-    int cpylen;
+    int cpylen, clen;
     int linecnt = 0;
 
     /* First, if we have a partial buffer, try to squeze data into it */
     if(bufhead->list.tail != NULL) {
         /* Check we're doing the partial buffer thing */
         bufline = bufhead->list.tail->data;
-        /* just try, the worst it could do is *reject* us .. */
-        if(!raw)
-            cpylen = rb_linebuf_copy_line(bufhead, bufline, data, len);
-        else
-            cpylen = rb_linebuf_copy_raw(bufhead, bufline, data, len);
+        if(bufline->terminated)
+            cpylen = 0;
+        else {
+            clen = rb_linebuf_skip_crlf(data, len);
+            if(!raw)
+                cpylen = rb_linebuf_copy_line(bufhead, bufline, data, clen);
+            else
+                cpylen = rb_linebuf_copy_raw(bufhead, bufline, data, clen);
+        }
 
         if(cpylen == -1)
             return -1;
@@ -367,14 +408,22 @@ rb_linebuf_parse(buf_head_t * bufhead, char *data, int len, int raw)
 
     /* Next, the loop */
     while(len > 0) {
-        /* We obviously need a new buffer, so .. */
-        bufline = rb_linebuf_new_line(bufhead);
+        clen = rb_linebuf_skip_crlf(data, len);
+
+        /* We obviously need a new buffer.  A complete line only needs
+         * room for itself and the \0, a partial one has to be able to
+         * take the rest of the line when it arrives.
+         */
+        if(clen < BUF_DATA_SIZE && (data[clen - 1] == '\r' || data[clen - 1] == '\n'))
+            bufline = rb_linebuf_new_line(bufhead, clen + 1);
+        else
+            bufline = rb_linebuf_new_line(bufhead, BUF_DATA_SIZE + 2);
 
         /* And parse */
         if(!raw)
-            cpylen = rb_linebuf_copy_line(bufhead, bufline, data, len);
+            cpylen = rb_linebuf_copy_line(bufhead, bufline, data, clen);
         else
-            cpylen = rb_linebuf_copy_raw(bufhead, bufline, data, len);
+            cpylen = rb_linebuf_copy_raw(bufhead, bufline, data, clen);
 
         if(cpylen == -1)
             return -1;
@@ -451,6 +500,79 @@ rb_linebuf_get(buf_head_t * bufhead, char *buf, int buflen, int partial, int raw
     return cpylen;
 }
 
+/*
+ * rb_linebuf_take
+ *
+ * unlink the next line from our buffer and hand it to the caller, so
+ * it can be parsed in place rather than copied out.  *data is pointed
+ * at the line inside the buf_line_t, with the EOL characters stripped
+ * and NUL terminated unless raw is set.  The line stays valid until it
+ * is given back with rb_linebuf_release(), even if bufhead is freed.
+ */
+buf_line_t *
+rb_linebuf_take(buf_head_t * bufhead, char **data, int *len, int partial, int raw)
+{
+    buf_line_t *bufline;
+    int cpylen;
+    char *start, *ch;
+
+    /* make sure we have a line */
+    if(bufhead->list.head == NULL)
+        return NULL;
+
+    bufline = bufhead->list.head->data;
+
+    /* make sure that the buffer was actually *terminated */
+    if(!(partial || bufline->terminated))
+        return NULL;	/* Wait for more data! */
+
+    start = bufline->buf;
+    cpylen = bufline->len;
+
+    if(bufline->raw && !raw) {
+        /* skip leading EOL characters */
+        while(cpylen && (*start == '\r' || *start == '\n')) {
+            start++;
+            cpylen--;
+        }
+        /* skip trailing EOL characters */
+        ch = &start[cpylen - 1];
+        while(cpylen && (*ch == '\r' || *ch == '\n')) {
+            ch--;
+            cpylen--;
+        }
+    }
+
+    /* convert CR/LF to NULL */
+    if(!raw)
+        start[cpylen] = '\0';
+
+    /* the reference the list held is now the caller's */
+    rb_linebuf_unlink_line(bufhead, bufline, bufhead->list.head);
+
+    *data = start;
+    *len = cpylen;
+    return bufline;
+}
+
+/*
+ * rb_linebuf_release
+ *
+ * give back a line obtained from rb_linebuf_take()
+ */
+void
+rb_linebuf_release(buf_line_t * bufline)
+{
+    bufline->refcount--;
+    lrb_assert(bufline->refcount >= 0);
+
+    if(bufline->refcount == 0) {
+        --bufline_count;
+        lrb_assert(bufline_count >= 0);
+        rb_linebuf_free(bufline);
+    }
+}
+
 /*
  * rb_linebuf_attach
  *
@@ -461,23 +583,55 @@ void
 rb_linebuf_attach(buf_head_t * bufhead, buf_head_t * new)
 {
     rb_dlink_node *ptr;
-    buf_line_t *line;
 
     RB_DLINK_FOREACH(ptr, new->list.head) {
-        line = ptr->data;
-        rb_dlinkAddTailAlloc(line, &bufhead->list);
+        rb_linebuf_attach_line(bufhead, ptr->data);
+    }
+}
+
+/*
+ * rb_linebuf_attach_line
+ *
+ * attach a single line to a buf_head_t without copying it.  This is
+ * the fanout fast path, the line is formatted once and every recipient
+ * only gets a node pointing at it, plus a reference.
+ */
+void
+rb_linebuf_attach_line(buf_head_t * bufhead, buf_line_t * line)
+{
+    lrb_assert(line->terminated);
 
-        /* Update the allocated size */
-        bufhead->alloclen++;
-        bufhead->len += line->len;
-        bufhead->numlines++;
+    rb_dlinkAddTailAlloc(line, &bufhead->list);
 
-        line->refcount++;
-    }
+    /* Update the allocated size */
+    bufhead->alloclen++;
+    bufhead->len += line->len;
+    bufhead->numlines++;
+
+    line->refcount++;
 }
 
 
 
+/*
+ * rb_linebuf_put_stage
+ *
+ * Store the line formatted in rb_linebuf_stage, len bytes plus the
+ * trailing \0, in a new line that is just big enough for it.
+ */
+static void
+rb_linebuf_put_stage(buf_head_t * bufhead, int len)
+{
+    buf_line_t *bufline;
+
+    bufline = rb_linebuf_new_line(bufhead, len + 1);
+    memcpy(bufline->buf, rb_linebuf_stage, len + 1);
+
+    bufline->terminated = 1;
+    bufline->len = len;
+    bufhead->len += len;
+}
+
 /*
  * rb_linebuf_putmsg
  *
@@ -490,111 +644,94 @@ void
 rb_linebuf_putmsg(buf_head_t * bufhead, const char *format, va_list * va_args,
                   const char *prefixfmt, ...)
 {
-    buf_line_t *bufline;
     int len = 0;
     va_list prefix_args;
 
     /* make sure the previous line is terminated */
-#ifndef NDEBUG
-    if(bufhead->list.tail) {
-        bufline = bufhead->list.tail->data;
-        lrb_assert(bufline->terminated);
-    }
-#endif
-    /* Create a new line */
-    bufline = rb_linebuf_new_line(bufhead);
-
+    lrb_assert(bufhead->list.tail == NULL ||
+               ((buf_line_t *) bufhead->list.tail->data)->terminated);
     if(prefixfmt != NULL) {
         va_start(prefix_args, prefixfmt);
-        len = rb_vsnprintf(bufline->buf, BUF_DATA_SIZE, prefixfmt, prefix_args);
+        len = rb_vsnprintf(rb_linebuf_stage, BUF_DATA_SIZE, prefixfmt, prefix_args);
         va_end(prefix_args);
     }
 
     if(va_args != NULL) {
-        len += rb_vsnprintf((bufline->buf + len), (BUF_DATA_SIZE - len), format, *va_args);
+        len += rb_vsnprintf((rb_linebuf_stage + len), (BUF_DATA_SIZE - len), format, *va_args);
     }
 
-    bufline->terminated = 1;
-
     /* Truncate the data if required */
     if(rb_unlikely(len > 510)) {
         len = 510;
-        bufline->buf[len++] = '\r';
-        bufline->buf[len++] = '\n';
+        rb_linebuf_stage[len++] = '\r';
+        rb_linebuf_stage[len++] = '\n';
     } else if(rb_unlikely(len == 0)) {
-        bufline->buf[len++] = '\r';
-        bufline->buf[len++] = '\n';
-        bufline->buf[len] = '\0';
+        rb_linebuf_stage[len++] = '\r';
+        rb_linebuf_stage[len++] = '\n';
+        rb_linebuf_stage[len] = '\0';
     } else {
         /* Chop trailing CRLF's .. */
-        while((bufline->buf[len] == '\r') || (bufline->buf[len] == '\n')
-              || (bufline->buf[len] == '\0')) {
+        while((rb_linebuf_stage[len] == '\r') || (rb_linebuf_stage[len] == '\n')
+              || (rb_linebuf_stage[len] == '\0')) {
             len--;
         }
 
-        bufline->buf[++len] = '\r';
-        bufline->buf[++len] = '\n';
-        bufline->buf[++len] = '\0';
+        rb_linebuf_stage[++len] = '\r';
+        rb_linebuf_stage[++len] = '\n';
+        rb_linebuf_stage[++len] = '\0';
     }
 
-    bufline->len = len;
-    bufhead->len += len;
+    rb_linebuf_put_stage(bufhead, len);
 }
 
 void
 rb_linebuf_putbuf(buf_head_t * bufhead, const char *buffer)
 {
-    buf_line_t *bufline;
     int len = 0;
 
     /* make sure the previous line is terminated */
-#ifndef NDEBUG
-    if(bufhead->list.tail) {
-        bufline = bufhead->list.tail->data;
-        lrb_assert(bufline->terminated);
-    }
-#endif
-    /* Create a new line */
-    bufline = rb_linebuf_new_line(bufhead);
-
+    lrb_assert(bufhead->list.tail == NULL ||
+               ((buf_line_t *) bufhead->list.tail->data)->terminated);
     if(rb_unlikely(buffer != NULL))
-        len = rb_strlcpy(bufline->buf, buffer, BUF_DATA_SIZE);
-
-    bufline->terminated = 1;
+        len = rb_strlcpy(rb_linebuf_stage, buffer, BUF_DATA_SIZE);
 
     /* Truncate the data if required */
     if(rb_unlikely(len > 510)) {
         len = 510;
-        bufline->buf[len++] = '\r';
-        bufline->buf[len++] = '\n';
+        rb_linebuf_stage[len++] = '\r';
+        rb_linebuf_stage[len++] = '\n';
     } else if(rb_unlikely(len == 0)) {
-        bufline->buf[len++] = '\r';
-        bufline->buf[len++] = '\n';
-        bufline->buf[len] = '\0';
+        rb_linebuf_stage[len++] = '\r';
+        rb_linebuf_stage[len++] = '\n';
+        rb_linebuf_stage[len] = '\0';
     } else {
         /* Chop trailing CRLF's .. */
-        while((bufline->buf[len] == '\r') || (bufline->buf[len] == '\n')
-              || (bufline->buf[len] == '\0')) {
+        while((rb_linebuf_stage[len] == '\r') || (rb_linebuf_stage[len] == '\n')
+              || (rb_linebuf_stage[len] == '\0')) {
             len--;
         }
 
-        bufline->buf[++len] = '\r';
-        bufline->buf[++len] = '\n';
-        bufline->buf[++len] = '\0';
+        rb_linebuf_stage[++len] = '\r';
+        rb_linebuf_stage[++len] = '\n';
+        rb_linebuf_stage[++len] = '\0';
     }
 
-    bufline->len = len;
-    bufhead->len += len;
-
-
+    rb_linebuf_put_stage(bufhead, len);
 }
 
+/*
+ * rb_linebuf_putprefix
+ *
+ * Like rb_linebuf_putbuf, but the line is built from a prefix and an
+ * already formatted body of known lengths, using memcpy only.  This lets
+ * send.c reuse a cached source prefix instead of going through the
+ * printf machinery for it on every message.
+ */
 void
-rb_linebuf_put(buf_head_t * bufhead, const char *format, ...)
+rb_linebuf_putprefix(buf_head_t * bufhead, const char *prefix, size_t prefixlen,
+                     const char *buffer, size_t len)
 {
     buf_line_t *bufline;
-    int len = 0;
-    va_list args;
 
     /* make sure the previous line is terminated */
 #ifndef NDEBUG
@@ -603,40 +740,69 @@ rb_linebuf_put(buf_head_t * bufhead, const char *format, ...)
         lrb_assert(bufline->terminated);
     }
 #endif
-    /* Create a new line */
-    bufline = rb_linebuf_new_line(bufhead);
+    /* Truncate the data if required */
+    if(rb_unlikely(prefixlen > 510))
+        prefixlen = 510;
+    if(rb_unlikely(len > 510 - prefixlen))
+        len = 510 - prefixlen;
+
+    /* Create a new line, with room for the CRLF and \0 */
+    bufline = rb_linebuf_new_line(bufhead, prefixlen + len + 3);
+
+    memcpy(bufline->buf, prefix, prefixlen);
+    memcpy(bufline->buf + prefixlen, buffer, len);
+    len += prefixlen;
+
+    /* Chop trailing CRLF's .. */
+    while(len > 0 && (bufline->buf[len - 1] == '\r' || bufline->buf[len - 1] == '\n'))
+        len--;
+
+    bufline->buf[len++] = '\r';
+    bufline->buf[len++] = '\n';
+    bufline->buf[len] = '\0';
 
+    bufline->terminated = 1;
+    bufline->len = len;
+    bufhead->len += len;
+}
+
+void
+rb_linebuf_put(buf_head_t * bufhead, const char *format, ...)
+{
+    int len = 0;
+    va_list args;
+
+    /* make sure the previous line is terminated */
+    lrb_assert(bufhead->list.tail == NULL ||
+               ((buf_line_t *) bufhead->list.tail->data)->terminated);
     if(rb_unlikely(format != NULL)) {
         va_start(args, format);
-        len = rb_vsnprintf(bufline->buf, BUF_DATA_SIZE, format, args);
+        len = rb_vsnprintf(rb_linebuf_stage, BUF_DATA_SIZE, format, args);
         va_end(args);
     }
 
-    bufline->terminated = 1;
-
     /* Truncate the data if required */
     if(rb_unlikely(len > 510)) {
         len = 510;
-        bufline->buf[len++] = '\r';
-        bufline->buf[len++] = '\n';
+        rb_linebuf_stage[len++] = '\r';
+        rb_linebuf_stage[len++] = '\n';
     } else if(rb_unlikely(len == 0)) {
-        bufline->buf[len++] = '\r';
-        bufline->buf[len++] = '\n';
-        bufline->buf[len] = '\0';
+        rb_linebuf_stage[len++] = '\r';
+        rb_linebuf_stage[len++] = '\n';
+        rb_linebuf_stage[len] = '\0';
     } else {
         /* Chop trailing CRLF's .. */
-        while((bufline->buf[len] == '\r') || (bufline->buf[len] == '\n')
-              || (bufline->buf[len] == '\0')) {
+        while((rb_linebuf_stage[len] == '\r') || (rb_linebuf_stage[len] == '\n')
+              || (rb_linebuf_stage[len] == '\0')) {
             len--;
         }
 
-        bufline->buf[++len] = '\r';
-        bufline->buf[++len] = '\n';
-        bufline->buf[++len] = '\0';
+        rb_linebuf_stage[++len] = '\r';
+        rb_linebuf_stage[++len] = '\n';
+        rb_linebuf_stage[++len] = '\0';
     }
 
-    bufline->len = len;
-    bufhead->len += len;
+    rb_linebuf_put_stage(bufhead, len);
 }
 
 
@@ -670,7 +836,6 @@ rb_linebuf_flush(rb_fde_t *F, buf_head_t * bufhead)
         int xret;
         static struct rb_iovec vec[RB_UIO_MAXIOV];
 
-        memset(vec, 0, sizeof(vec));
         /* Check we actually have a first buffer */
         if(bufhead->list.head == NULL) {
             /* nope, so we return none .. */
@@ -781,5 +946,14 @@ rb_linebuf_flush(rb_fde_t *F, buf_head_t * bufhead)
 void
 rb_count_rb_linebuf_memory(size_t *count, size_t *rb_linebuf_memory_used)
 {
-    rb_bh_usage(rb_linebuf_heap, count, NULL, rb_linebuf_memory_used, NULL);
+    size_t heap_count, heap_used;
+    int i;
+
+    *count = *rb_linebuf_memory_used = 0;
+
+    for(i = 0; i < LINEBUF_CLASSES; i++) {
+        rb_bh_usage(rb_linebuf_heap[i], &heap_count, NULL, &heap_used, NULL);
+        *count += heap_count;
+        *rb_linebuf_memory_used += heap_used;
+    }
 }
@@ -129,6 +129,18 @@ rb_supports_ssl(void)
     return 0;
 }
 
+int
+rb_ssl_set_ktls(int enable)
+{
+    return 0;
+}
+
+int
+rb_ssl_detach_ktls(rb_fde_t *F)
+{
+    return 0;
+}
+
 void
 rb_ssl_shutdown(rb_fde_t *F)
 {
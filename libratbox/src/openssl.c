@@ -619,6 +619,58 @@ rb_supports_ssl(void)
     return 1;
 }
 
+/* rb_ssl_set_ktls()
+ *
+ * Have OpenSSL load the session keys of connections accepted from now
+ * on into the kernel, where the kernel supports it.  Returns 0 if this
+ * OpenSSL cannot do that at all.
+ */
+int
+rb_ssl_set_ktls(int enable)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+    if(enable)
+        SSL_CTX_set_options(ssl_server_ctx, SSL_OP_ENABLE_KTLS);
+    else
+        SSL_CTX_clear_options(ssl_server_ctx, SSL_OP_ENABLE_KTLS);
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* rb_ssl_detach_ktls()
+ *
+ * If the kernel is doing the record layer in both directions on an
+ * established connection, drop our TLS state without sending a
+ * close_notify.  From then on F carries plaintext and may be handed to
+ * another process.  Returns 1 if it was detached.
+ */
+int
+rb_ssl_detach_ktls(rb_fde_t *F)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+    SSL *ssl = F->ssl;
+
+    if(ssl == NULL)
+        return 0;
+
+    if(!BIO_get_ktls_send(SSL_get_wbio(ssl)) || !BIO_get_ktls_recv(SSL_get_rbio(ssl)))
+        return 0;
+
+    /* anything already pulled off the socket would be lost */
+    if(SSL_has_pending(ssl))
+        return 0;
+
+    SSL_free(ssl);
+    F->ssl = NULL;
+    F->type &= ~RB_FD_SSL;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
 void
 rb_get_ssl_info(char *buf, size_t len)
 {
@@ -0,0 +1,254 @@
+/*
+ *  logd.c: log file writer for ircd
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ *  The ircd hands us lines of the form
+ *
+ *	O <log> <path>		(re)open a log file
+ *	C <log>			close a log file
+ *	I <seconds>		how often to write out what we hold
+ *	L <log> <text>		a line to append to a log file
+ *
+ *  Lines for each log are held in a buffer and written out together
+ *  every flush interval, when the buffer fills, or when the log is
+ *  closed, so the ircd never waits on the disk.  An interval of 0
+ *  writes out everything as soon as the ircd has sent it.
+ */
+#include "setup.h"
+#include <ratbox_lib.h>
+#include <stdio.h>
+
+#ifndef READBUF_SIZE
+#define READBUF_SIZE 16384
+#endif
+
+#define LOGD_MAX_LOGS	16
+#define LOGD_BUFSIZE	65536
+
+struct logfile {
+    int fd;
+    size_t len;
+    char buf[LOGD_BUFSIZE];
+};
+
+static rb_helper *logd_helper;
+static struct logfile logs[LOGD_MAX_LOGS];
+static struct ev_entry *flush_ev;
+static int flush_interval = -1;
+
+static void
+flush_log(struct logfile *log)
+{
+    size_t done = 0;
+    ssize_t ret;
+
+    while(done < log->len) {
+        ret = write(log->fd, log->buf + done, log->len - done);
+
+        if(ret < 0) {
+            if(errno == EINTR)
+                continue;
+
+            /* nothing sensible to do with it, so drop it */
+            break;
+        }
+
+        done += ret;
+    }
+
+    log->len = 0;
+}
+
+static void
+flush_logs(void *unused)
+{
+    int i;
+
+    for(i = 0; i < LOGD_MAX_LOGS; i++)
+        if(logs[i].fd >= 0 && logs[i].len > 0)
+            flush_log(&logs[i]);
+}
+
+static void
+close_log(struct logfile *log)
+{
+    if(log->fd < 0)
+        return;
+
+    flush_log(log);
+    close(log->fd);
+    log->fd = -1;
+}
+
+static struct logfile *
+parse_log(char **p)
+{
+    char *end;
+    long n;
+
+    n = strtol(*p, &end, 10);
+
+    if(end == *p || n < 0 || n >= LOGD_MAX_LOGS)
+        return NULL;
+
+    *p = (*end == ' ') ? end + 1 : end;
+    return &logs[n];
+}
+
+static void
+set_flush_interval(int interval)
+{
+    if(interval < 0 || interval == flush_interval)
+        return;
+
+    flush_interval = interval;
+
+    if(flush_ev != NULL) {
+        rb_event_delete(flush_ev);
+        flush_ev = NULL;
+    }
+
+    if(interval > 0)
+        flush_ev = rb_event_add("flush_logs", flush_logs, NULL, interval);
+}
+
+static void
+append_log(struct logfile *log, const char *text)
+{
+    size_t len = strlen(text);
+
+    if(log->fd < 0)
+        return;
+
+    if(len + 1 > sizeof(log->buf) - log->len)
+        flush_log(log);
+
+    memcpy(log->buf + log->len, text, len);
+    log->len += len;
+    log->buf[log->len++] = '\n';
+}
+
+static void
+parse_request(rb_helper *helper)
+{
+    static char readbuf[READBUF_SIZE];
+    struct logfile *log;
+    char *p;
+    int len;
+
+    while((len = rb_helper_read(helper, readbuf, sizeof(readbuf))) > 0) {
+        if(readbuf[1] != ' ')
+            continue;
+
+        p = readbuf + 2;
+
+        switch (readbuf[0]) {
+        case 'L':
+            if((log = parse_log(&p)) != NULL)
+                append_log(log, p);
+            break;
+
+        case 'O':
+            if((log = parse_log(&p)) == NULL || *p == '\0')
+                break;
+
+            close_log(log);
+            log->fd = open(p, O_WRONLY | O_APPEND | O_CREAT, 0666);
+            break;
+
+        case 'C':
+            if((log = parse_log(&p)) != NULL)
+                close_log(log);
+            break;
+
+        case 'I':
+            set_flush_interval(atoi(p));
+            break;
+        }
+    }
+
+    if(flush_interval == 0)
+        flush_logs(NULL);
+}
+
+static void
+error_cb(rb_helper *helper)
+{
+    /* the ircd has gone, write out whatever it left us */
+    flush_logs(NULL);
+    exit(1);
+}
+
+#ifndef _WIN32
+static void
+dummy_handler(int sig)
+{
+    return;
+}
+#endif
+
+static void
+setup_signals(void)
+{
+#ifndef _WIN32
+    struct sigaction act;
+
+    act.sa_flags = 0;
+    act.sa_handler = SIG_IGN;
+    sigemptyset(&act.sa_mask);
+    sigaddset(&act.sa_mask, SIGPIPE);
+    sigaddset(&act.sa_mask, SIGALRM);
+    sigaddset(&act.sa_mask, SIGHUP);
+#ifdef SIGTRAP
+    sigaddset(&act.sa_mask, SIGTRAP);
+#endif
+
+#ifdef SIGWINCH
+    sigaddset(&act.sa_mask, SIGWINCH);
+    sigaction(SIGWINCH, &act, 0);
+#endif
+    sigaction(SIGPIPE, &act, 0);
+    /* the ircd reopens our logs for us on a rehash */
+    sigaction(SIGHUP, &act, 0);
+#ifdef SIGTRAP
+    sigaction(SIGTRAP, &act, 0);
+#endif
+
+    act.sa_handler = dummy_handler;
+    sigaction(SIGALRM, &act, 0);
+#endif
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i;
+
+    for(i = 0; i < LOGD_MAX_LOGS; i++)
+        logs[i].fd = -1;
+
+    setup_signals();
+    logd_helper = rb_helper_child(parse_request, error_cb, NULL, NULL, NULL, 256, 256, 256, 256);
+    if(logd_helper == NULL) {
+        fprintf(stderr, "This is ircd logd.  You aren't supposed to run me directly.\n");
+        fprintf(stderr, "Have a nice day\n");
+        exit(1);
+    }
+    rb_helper_loop(logd_helper, 0);
+
+    return 0;
+}
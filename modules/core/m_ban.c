@@ -260,14 +260,10 @@ ms_ban(struct Client *client_p, struct Client *source_p, int parc, const char *p
             add_conf_by_address(aconf->host, CONF_KILL, aconf->user, NULL, aconf);
             if(ConfigFileEntry.kline_delay ||
                (IsServer(source_p) &&
-                !HasSentEob(source_p))) {
-                if(kline_queued == 0) {
-                    rb_event_addonce("check_klines", check_klines_event, NULL,
-                                     ConfigFileEntry.kline_delay);
-                    kline_queued = 1;
-                }
-            } else
-                check_klines();
+                !HasSentEob(source_p)))
+                queue_kline_check(aconf->user, aconf->host);
+            else
+                check_kline(aconf->user, aconf->host);
         }
         break;
     case CONF_XLINE:
@@ -275,6 +271,7 @@ ms_ban(struct Client *client_p, struct Client *source_p, int parc, const char *p
             remove_reject_mask(aconf->host, NULL);
         else {
             rb_dlinkAddAlloc(aconf, &xline_conf_list);
+            xline_conf_changed();
             check_xlines();
         }
         break;
@@ -285,8 +282,10 @@ ms_ban(struct Client *client_p, struct Client *source_p, int parc, const char *p
         }
         break;
     case CONF_RESV_NICK:
-        if (!(aconf->status & CONF_ILLEGAL))
+        if (!(aconf->status & CONF_ILLEGAL)) {
             rb_dlinkAddAlloc(aconf, &resv_conf_list);
+            resv_conf_changed();
+        }
         break;
     }
     sendto_server(client_p, NULL, CAP_BAN|CAP_TS6, NOCAPS,
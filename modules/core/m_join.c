@@ -1016,6 +1016,8 @@ remove_our_modes(struct Channel *chptr, struct Client *source_p)
     for(i = 0; i < MAXMODEPARAMS; i++)
         lpara[i] = NULL;
 
+    invalidate_namescache(chptr);
+
     RB_DLINK_FOREACH(ptr, chptr->members.head) {
         msptr = ptr->data;
 
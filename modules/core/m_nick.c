@@ -690,8 +690,12 @@ change_local_nick(struct Client *client_p, struct Client *source_p,
 
     /* Finally, add to hash */
     del_from_client_hash(source_p->name, source_p);
+    del_from_who_index(source_p);
     strcpy(source_p->name, nick);
+    invalidate_client_prefix(source_p);
+    invalidate_namescache_user(source_p);
     add_to_client_hash(nick, source_p);
+    add_to_who_index(source_p);
 
     if(!samenick)
         monitor_signon(source_p);
@@ -744,13 +748,17 @@ change_remote_nick(struct Client *client_p, struct Client *source_p,
     }
 
     del_from_client_hash(source_p->name, source_p);
+    del_from_who_index(source_p);
 
     /* invalidate nick delay when a remote client uses the nick.. */
     if((nd = irc_dictionary_retrieve(nd_dict, nick)))
         free_nd_entry(nd);
 
     strcpy(source_p->name, nick);
+    invalidate_client_prefix(source_p);
+    invalidate_namescache_user(source_p);
     add_to_client_hash(nick, source_p);
+    add_to_who_index(source_p);
 
     if(!samenick)
         monitor_signon(source_p);
@@ -1002,30 +1010,31 @@ register_client(struct Client *client_p, struct Client *server,
 
     source_p = make_client(client_p);
     user = make_user(source_p);
-    rb_dlinkAddTail(source_p, &source_p->node, &global_client_list);
+    user->serial = ++user_serial;
+    add_client_to_list(source_p);
 
     source_p->hopcount = atoi(parv[2]);
     source_p->tsinfo = newts;
 
     strcpy(source_p->name, nick);
     rb_strlcpy(source_p->username, parv[5], sizeof(source_p->username));
-    rb_strlcpy(source_p->host, parv[6], sizeof(source_p->host));
-    rb_strlcpy(source_p->orighost, source_p->host, sizeof(source_p->orighost));
+    scache_set(&source_p->host, parv[6], HOSTLEN + 1);
+    scache_set(&source_p->orighost, source_p->host, HOSTLEN + 1);
 
     if(parc == 12) {
-        rb_strlcpy(source_p->info, parv[11], sizeof(source_p->info));
+        scache_set(&source_p->info, parv[11], REALLEN + 1);
         rb_strlcpy(source_p->sockhost, parv[7], sizeof(source_p->sockhost));
         rb_strlcpy(source_p->id, parv[8], sizeof(source_p->id));
         add_to_id_hash(source_p->id, source_p);
         if (strcmp(parv[9], "*")) {
-            rb_strlcpy(source_p->orighost, parv[9], sizeof(source_p->orighost));
+            scache_set(&source_p->orighost, parv[9], HOSTLEN + 1);
             if (irccmp(source_p->host, source_p->orighost))
                 SetDynSpoof(source_p);
         }
         if (strcmp(parv[10], "*"))
             rb_strlcpy(source_p->user->suser, parv[10], sizeof(source_p->user->suser));
     } else if(parc == 10) {
-        rb_strlcpy(source_p->info, parv[9], sizeof(source_p->info));
+        scache_set(&source_p->info, parv[9], REALLEN + 1);
         rb_strlcpy(source_p->sockhost, parv[7], sizeof(source_p->sockhost));
         rb_strlcpy(source_p->id, parv[8], sizeof(source_p->id));
         add_to_id_hash(source_p->id, source_p);
@@ -1039,6 +1048,7 @@ register_client(struct Client *client_p, struct Client *server,
 
     add_to_client_hash(nick, source_p);
     add_to_hostname_hash(source_p->orighost, source_p);
+    add_to_who_index(source_p);
     monitor_signon(source_p);
 
     m = &parv[4][1];
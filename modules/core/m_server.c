@@ -439,7 +439,7 @@ ms_server(struct Client *client_p, struct Client *source_p, int parc, const char
 
     SetServer(target_p);
 
-    rb_dlinkAddTail(target_p, &target_p->node, &global_client_list);
+    add_client_to_list(target_p);
     rb_dlinkAddTailAlloc(target_p, &global_serv_list);
     add_to_client_hash(target_p->name, target_p);
     rb_dlinkAdd(target_p, &target_p->lnode, &target_p->servptr->serv->servers);
@@ -590,7 +590,7 @@ ms_sid(struct Client *client_p, struct Client *source_p, int parc, const char *p
     target_p->servptr = source_p;
     SetServer(target_p);
 
-    rb_dlinkAddTail(target_p, &target_p->node, &global_client_list);
+    add_client_to_list(target_p);
     rb_dlinkAddTailAlloc(target_p, &global_serv_list);
     add_to_client_hash(target_p->name, target_p);
     add_to_id_hash(target_p->id, target_p);
@@ -670,13 +670,13 @@ set_server_gecos(struct Client *client_p, const char *info)
 
             /* if there was a trailing space, s could point to \0, so check */
             if(s && (*s != '\0')) {
-                rb_strlcpy(client_p->info, s, sizeof(client_p->info));
+                scache_set(&client_p->info, s, REALLEN + 1);
                 return 1;
             }
         }
     }
 
-    rb_strlcpy(client_p->info, "(Unknown Location)", sizeof(client_p->info));
+    scache_set(&client_p->info, "(Unknown Location)", REALLEN + 1);
 
     return 1;
 }
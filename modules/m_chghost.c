@@ -27,6 +27,7 @@
 #include "modules.h"
 #include "whowas.h"
 #include "monitor.h"
+#include "scache.h"
 
 static int me_realhost(struct Client *, struct Client *, int, const char **);
 static int ms_chghost(struct Client *, struct Client *, int, const char **);
@@ -97,12 +98,14 @@ me_realhost(struct Client *client_p, struct Client *source_p,
         return 0;
 
     del_from_hostname_hash(source_p->orighost, source_p);
-    rb_strlcpy(source_p->orighost, parv[1], sizeof source_p->orighost);
+    del_from_who_index(source_p);
+    scache_set(&source_p->orighost, parv[1], HOSTLEN + 1);
     if (irccmp(source_p->host, source_p->orighost))
         SetDynSpoof(source_p);
     else
         ClearDynSpoof(source_p);
     add_to_hostname_hash(source_p->orighost, source_p);
+    add_to_who_index(source_p);
     return 0;
 }
 
@@ -124,7 +124,7 @@ mo_dline(struct Client *client_p, struct Client *source_p, int parc, const char
 
     apply_dline(source_p, dlhost, tdline_time, reason);
 
-    check_dlines();
+    check_dline(dlhost);
     return 0;
 }
 
@@ -183,7 +183,7 @@ me_dline(struct Client *client_p, struct Client *source_p, int parc, const char
 
     apply_dline(source_p, parv[2], tdline_time, LOCAL_COPY(parv[3]));
 
-    check_dlines();
+    check_dline(parv[2]);
     return 0;
 }
 
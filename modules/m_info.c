@@ -378,6 +378,12 @@ static struct InfoStruct info_table[] = {
         &ConfigFileEntry.nick_delay,
         "Delay nicks are locked for on split",
     },
+    {
+        "whowas_length",
+        OUTPUT_DECIMAL,
+        &ConfigFileEntry.whowas_length,
+        "Number of entries kept for WHOWAS",
+    },
     {
         "no_oper_flood",
         OUTPUT_BOOLEAN,
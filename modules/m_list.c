@@ -288,6 +288,12 @@ static void safelist_client_instantiate(struct Client *client_p, struct ListClie
 
     client_p->localClient->safelist_data = params;
 
+    /* the directory is ordered by member count, so only walk the counts
+     * that can be shown
+     */
+    params->cursor = rb_malloc(sizeof(struct ChannelDirCursor));
+    channel_dir_cursor_start(params->cursor, params->users_min, params->users_max);
+
     sendto_one(client_p, form_str(RPL_LISTSTART), me.name, client_p->name);
 
     /* pop the client onto the queue for processing */
@@ -314,6 +320,8 @@ static void safelist_client_release(struct Client *client_p)
 
     rb_dlinkFindDestroy(client_p, &safelisting_clients);
 
+    channel_dir_cursor_stop(client_p->localClient->safelist_data->cursor);
+    rb_free(client_p->localClient->safelist_data->cursor);
     rb_free(client_p->localClient->safelist_data);
 
     client_p->localClient->safelist_data = NULL;
@@ -354,9 +362,8 @@ static void safelist_channel_named(struct Client *source_p, const char *name)
     }
 
     if (!SecretChannel(chptr) || IsMember(source_p, chptr))
-        sendto_one(source_p, form_str(RPL_LIST), me.name, source_p->name, "",
-                   chptr->chname, rb_dlink_list_length(&chptr->members),
-                   chptr->topic == NULL ? "" : chptr->topic);
+        sendto_one(source_p, ":%s 322 %s %s", me.name, source_p->name,
+                   channel_list_body(chptr));
 
     sendto_one(source_p, form_str(RPL_LISTEND), me.name, source_p->name);
     return;
@@ -395,10 +402,10 @@ static void safelist_one_channel(struct Client *source_p, struct Channel *chptr)
     if (safelist_data->created_max && chptr->channelts > safelist_data->created_max)
         return;
 
-    sendto_one(source_p, form_str(RPL_LIST), me.name, source_p->name,
+    /* RPL_LIST, with the text shared by every client listing */
+    sendto_one(source_p, ":%s 322 %s %s%s", me.name, source_p->name,
                (safelist_data->operspy && SecretChannel(chptr)) ? "!" : "",
-               chptr->chname, rb_dlink_list_length(&chptr->members),
-               chptr->topic == NULL ? "" : chptr->topic);
+               channel_list_body(chptr));
 }
 
 /*
@@ -410,20 +417,17 @@ static void safelist_one_channel(struct Client *source_p, struct Channel *chptr)
  */
 static void safelist_iterate_client(struct Client *source_p)
 {
-    rb_dlink_node *ptr;
-    int iter;
+    struct ChannelDirCursor *cursor = source_p->localClient->safelist_data->cursor;
+    struct Channel *chptr;
 
-    for (iter = source_p->localClient->safelist_data->hash_indice; iter < CH_MAX; iter++) {
-        if (safelist_sendq_exceeded(source_p->from) == YES) {
-            source_p->localClient->safelist_data->hash_indice = iter;
+    while (safelist_sendq_exceeded(source_p->from) == NO) {
+        if ((chptr = channel_dir_cursor_next(cursor)) == NULL) {
+            safelist_client_release(source_p);
             return;
         }
 
-        RB_DLINK_FOREACH(ptr, channelTable[iter].head)
-        safelist_one_channel(source_p, (struct Channel *) ptr->data);
+        safelist_one_channel(source_p, chptr);
     }
-
-    safelist_client_release(source_p);
 }
 
 static void safelist_iterate_clients(void *unused)
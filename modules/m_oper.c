@@ -39,6 +39,7 @@
 #include "modules.h"
 #include "packet.h"
 #include "cache.h"
+#include "cryptdi.h"
 
 static int m_oper(struct Client *, struct Client *, int, const char **);
 
@@ -47,10 +48,27 @@ struct Message oper_msgtab = {
     {mg_unreg, {m_oper, 3}, mg_ignore, mg_ignore, mg_ignore, {m_oper, 3}}
 };
 
+static void _moddeinit(void);
+
 mapi_clist_av1 oper_clist[] = { &oper_msgtab, NULL };
-DECLARE_MODULE_AV1(oper, NULL, NULL, oper_clist, NULL, NULL, "$Revision: 1483 $");
+DECLARE_MODULE_AV1(oper, NULL, _moddeinit, oper_clist, NULL, NULL, "$Revision: 1483 $");
 
 static int match_oper_password(const char *password, struct oper_conf *oper_p);
+static void oper_password_cb(struct Client *, int, void *);
+static void oper_password_checked(struct Client *, struct oper_conf *, const char *, int);
+
+/* an OPER waiting on cryptd, oper_conf may be gone by the time it is done */
+struct oper_check {
+    char *name;
+    char *passwd;
+};
+
+static void
+_moddeinit(void)
+{
+    /* cryptd must not answer into this module once it is gone */
+    crypt_cancel_callback(oper_password_cb);
+}
 
 /*
  * m_oper
@@ -125,13 +143,88 @@ m_oper(struct Client *client_p, struct Client *source_p, int parc, const char *p
         }
     }
 
-    if(match_oper_password(password, oper_p)) {
+    if(IsOperConfEncrypted(oper_p) && !EmptyString(oper_p->passwd) &&
+       !EmptyString(password)) {
+        struct oper_check *check = rb_malloc(sizeof(struct oper_check));
+        int result;
+
+        check->name = rb_strdup(name);
+        check->passwd = rb_strdup(oper_p->passwd);
+
+        result = crypt_verify(source_p, password, oper_p->passwd, oper_password_cb, check);
+
+        if(result == CRYPT_QUEUED)
+            return 0;
+
+        rb_free(check->name);
+        rb_free(check->passwd);
+        rb_free(check);
+
+        if(result == CRYPT_BUSY) {
+            sendto_one_notice(source_p, ":*** Server busy, try OPER again later");
+            return 0;
+        }
+
+        oper_password_checked(source_p, oper_p, name, result == CRYPT_MATCH);
+        return 0;
+    }
+
+    oper_password_checked(source_p, oper_p, name, match_oper_password(password, oper_p));
+    return 0;
+}
+
+/*
+ * oper_password_cb
+ *
+ * inputs       - client, whether cryptd matched the password, the
+ *                oper_check it was asked for
+ * output       - none
+ * side effects - the OPER is finished if the client and its oper block
+ *                are still around
+ */
+static void
+oper_password_cb(struct Client *source_p, int result, void *data)
+{
+    struct oper_check *check = data;
+    struct oper_conf *oper_p;
+
+    if(source_p != NULL && result == CRYPT_BUSY)
+        sendto_one_notice(source_p, ":*** Server busy, try OPER again later");
+    else if(source_p != NULL && !IsOper(source_p)) {
+        oper_p = find_oper_conf(source_p->username, source_p->orighost,
+                                source_p->sockhost, check->name);
+
+        /* a rehash may have changed the block while we waited */
+        if(oper_p == NULL || EmptyString(oper_p->passwd) ||
+           strcmp(oper_p->passwd, check->passwd))
+            sendto_one_numeric(source_p, ERR_NOOPERHOST, form_str(ERR_NOOPERHOST));
+        else
+            oper_password_checked(source_p, oper_p, check->name, result == CRYPT_MATCH);
+    }
+
+    rb_free(check->name);
+    rb_free(check->passwd);
+    rb_free(check);
+}
+
+/*
+ * oper_password_checked
+ *
+ * inputs       - client, oper block, name they gave, whether the
+ *                password matched
+ * output       - none
+ * side effects - the client is opered up, or told it failed
+ */
+static void
+oper_password_checked(struct Client *source_p, struct oper_conf *oper_p,
+                      const char *name, int matched)
+{
+    if(matched) {
         oper_up(source_p, oper_p);
 
         ilog(L_OPERED, "OPER %s by %s!%s@%s (%s)",
              name, source_p->name, source_p->username, source_p->host,
              source_p->sockhost);
-        return 0;
     } else {
         sendto_one_numeric(source_p, ERR_NOOPERHOST, form_str(ERR_NOOPERHOST));
 
@@ -145,8 +238,6 @@ m_oper(struct Client *client_p, struct Client *source_p, int parc, const char *p
                                    source_p->name, source_p->username, source_p->host);
         }
     }
-
-    return 0;
 }
 
 /*
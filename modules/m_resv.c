@@ -346,6 +346,7 @@ parse_resv(struct Client *source_p, const char *name, const char *reason, int te
         }
 
         rb_dlinkAddAlloc(aconf, &resv_conf_list);
+        resv_conf_changed();
     } else
         sendto_one_notice(source_p, ":You have specified an invalid resv: [%s]", name);
 }
@@ -607,6 +608,7 @@ remove_resv(struct Client *source_p, const char *name, int propagated)
         }
         /* already have ptr from the loop above.. */
         rb_dlinkDestroy(ptr, &resv_conf_list);
+        resv_conf_changed();
     }
     free_conf(aconf);
 
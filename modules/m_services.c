@@ -227,8 +227,12 @@ me_rsfnc(struct Client *client_p, struct Client *source_p,
                   use_id(target_p), parv[2], (long) target_p->tsinfo);
 
     del_from_client_hash(target_p->name, target_p);
+    del_from_who_index(target_p);
     strcpy(target_p->name, parv[2]);
+    invalidate_client_prefix(target_p);
+    invalidate_namescache_user(target_p);
     add_to_client_hash(target_p->name, target_p);
+    add_to_who_index(target_p);
 
     monitor_signon(target_p);
 
@@ -47,6 +47,8 @@
 #include "hash.h"
 #include "reject.h"
 #include "whowas.h"
+#include "cryptdi.h"
+#include "logger.h"		/* log_stats */
 
 static int m_stats (struct Client *, struct Client *, int, const char **);
 
@@ -428,6 +430,7 @@ static void
 stats_events (struct Client *source_p)
 {
     rb_dump_events(stats_events_cb, source_p);
+    rb_dump_io_stats(stats_events_cb, source_p);
 }
 
 static void
@@ -891,6 +894,13 @@ stats_tstats (struct Client *source_p)
     sendto_one_numeric(source_p, RPL_STATSDEBUG,
                        "T :sasl successes %u fails %u",
                        sp.is_ssuc, sp.is_sbad);
+    sendto_one_numeric(source_p, RPL_STATSDEBUG,
+                       "T :cryptd checks %u inline %u busy %u pending %u peak %u",
+                       crypt_stats.queued, crypt_stats.inline_checks,
+                       crypt_stats.busy, crypt_stats.pending, crypt_stats.peak);
+    sendto_one_numeric(source_p, RPL_STATSDEBUG,
+                       "T :logd lines %lu inline %lu dropped %lu",
+                       log_stats.queued, log_stats.inline_lines, log_stats.dropped);
     sendto_one_numeric(source_p, RPL_STATSDEBUG, "T :Client Server");
     sendto_one_numeric(source_p, RPL_STATSDEBUG,
                        "T :connected %u %u", sp.is_cl, sp.is_sv);
@@ -1128,6 +1138,17 @@ stats_memory (struct Client *source_p)
     size_t wwm = 0;		/* whowas array memory used */
     size_t conf_memory = 0;	/* memory used by conf lines */
     size_t mem_servers_cached;	/* memory used by scache */
+    size_t strings_cached;	/* distinct interned strings */
+    size_t strings_refs;	/* references to them */
+    size_t mem_strings_cached;	/* memory used by them */
+    size_t mem_strings_unshared;	/* memory they would use unshared */
+    char ratio[32];
+    unsigned int hash_client_slots;	/* client and id hash slots */
+    unsigned int hash_chan_slots;
+    unsigned int hash_host_slots;
+    size_t hash_client_mem;
+    size_t hash_chan_mem;
+    size_t hash_host_mem;
 
     size_t linebuf_count = 0;
     size_t linebuf_memory_used = 0;
@@ -1260,10 +1281,14 @@ stats_memory (struct Client *source_p)
 
     totww = wwm;
 
+    count_hash_memory(&hash_client_slots, &hash_client_mem,
+                      &hash_chan_slots, &hash_chan_mem,
+                      &hash_host_slots, &hash_host_mem);
+
     sendto_one_numeric(source_p, RPL_STATSDEBUG,
                        "z :Hash: client %u(%ld) chan %u(%ld)",
-                       U_MAX, (long)(U_MAX * sizeof(rb_dlink_list)),
-                       CH_MAX, (long)(CH_MAX * sizeof(rb_dlink_list)));
+                       hash_client_slots, (long)hash_client_mem,
+                       hash_chan_slots, (long)hash_chan_mem);
 
     sendto_one_numeric(source_p, RPL_STATSDEBUG,
                        "z :linebuf %ld(%ld)",
@@ -1275,14 +1300,23 @@ stats_memory (struct Client *source_p)
                        "z :scache %ld(%ld)",
                        (long)number_servers_cached, (long)mem_servers_cached);
 
+    count_scache_strings(&strings_cached, &strings_refs,
+                         &mem_strings_cached, &mem_strings_unshared);
+    sprintf(ratio, "%.2f", strings_cached ? (double)strings_refs / strings_cached : 0.0);
+
+    sendto_one_numeric(source_p, RPL_STATSDEBUG,
+                       "z :scache strings %ld(%ld) refs %ld(%ld) ratio %s",
+                       (long)strings_cached, (long)mem_strings_cached,
+                       (long)strings_refs, (long)mem_strings_unshared, ratio);
+
     sendto_one_numeric(source_p, RPL_STATSDEBUG,
-                       "z :hostname hash %d(%ld)",
-                       HOST_MAX, (long)HOST_MAX * sizeof(rb_dlink_list));
+                       "z :hostname hash %u(%ld)",
+                       hash_host_slots, (long)hash_host_mem);
 
     total_memory = totww + total_channel_memory + conf_memory +
                    class_count * sizeof(struct Class);
 
-    total_memory += mem_servers_cached;
+    total_memory += mem_servers_cached + mem_strings_cached;
     sendto_one_numeric(source_p, RPL_STATSDEBUG,
                        "z :Total: whowas %d channel %d conf %d",
                        (int) totww, (int) total_channel_memory,
@@ -1373,6 +1407,18 @@ stats_servlinks (struct Client *source_p)
                    (rb_current_time() > target_p->localClient->lasttime) ?
                    (rb_current_time() - target_p->localClient->lasttime) : 0,
                    IsOper (source_p) ? show_capabilities (target_p) : "TS");
+
+        if(target_p->localClient->burst != NULL) {
+            struct ServerBurst *burst = target_p->localClient->burst;
+
+            sendto_one_numeric(source_p, RPL_STATSDEBUG,
+                               "? :%s bursting: %lu/%lu users, %lu/%lu channels, "
+                               "%lu bytes sent, %d bytes held, %ld seconds",
+                               target_p->name, burst->users, burst->users_total,
+                               burst->channels, burst->channels_total, burst->bytes,
+                               rb_linebuf_len(&burst->hold),
+                               (long) (rb_current_time() - burst->started));
+        }
     }
 
     sendto_one_numeric(source_p, RPL_STATSDEBUG,
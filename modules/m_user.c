@@ -35,6 +35,7 @@
 #include "parse.h"
 #include "modules.h"
 #include "blacklist.h"
+#include "scache.h"
 
 static int mr_user(struct Client *, struct Client *, int, const char **);
 
@@ -93,7 +94,7 @@ do_local_user(struct Client *client_p, struct Client *source_p,
         source_p->flags |= FLAGS_SENTUSER;
     }
 
-    rb_strlcpy(source_p->info, realname, sizeof(source_p->info));
+    scache_set(&source_p->info, realname, REALLEN + 1);
 
     if(!IsGotId(source_p)) {
         /* This is in this location for a reason..If there is no identd
@@ -59,6 +59,20 @@ struct who_format {
     const char *querytype;
 };
 
+/* a WHO mask, set up once per query by who_mask_init() */
+struct who_mask {
+    const char *mask;
+    char anchor[BUFSIZE];	/* literal the mask starts or ends with */
+    int suffix;			/* anchor is the end of the mask */
+    const char *lit;		/* longest literal run in the mask */
+    size_t litlen;
+};
+
+/* users a WHO mask could match, see who_collect() */
+static struct Client **who_cands;
+static int who_ncands;
+static int who_maxcands;
+
 static int m_who(struct Client *, struct Client *, int, const char **);
 
 struct Message who_msgtab = {
@@ -67,7 +81,15 @@ struct Message who_msgtab = {
 };
 
 mapi_clist_av1 who_clist[] = { &who_msgtab, NULL };
-DECLARE_MODULE_AV1(who, NULL, NULL, who_clist, NULL, NULL, "$Revision: 3350 $");
+static void _moddeinit(void);
+
+DECLARE_MODULE_AV1(who, NULL, _moddeinit, who_clist, NULL, NULL, "$Revision: 3350 $");
+
+static void
+_moddeinit(void)
+{
+    rb_free(who_cands);
+}
 
 static void do_who_on_channel(struct Client *source_p, struct Channel *chptr,
                               int server_oper, int member,
@@ -275,10 +297,170 @@ m_who(struct Client *client_p, struct Client *source_p, int parc, const char *pa
     return 0;
 }
 
+/* who_mask_init()
+ *
+ * inputs	- WHO mask to set up, mask
+ * outputs	-
+ * side effects - the anchor is set to the longer of the literal prefix
+ *		  and suffix of the mask, empty when it has neither
+ */
+static void
+who_mask_init(struct who_mask *wm, const char *mask)
+{
+    const char *p, *run = mask;
+    size_t prefixlen;
+
+    wm->mask = mask;
+    wm->lit = mask;
+    wm->litlen = 0;
+
+    prefixlen = strcspn(mask, "*?");
+
+    for(p = mask;; p++) {
+        if(*p != '*' && *p != '?' && *p != '\0')
+            continue;
+
+        if((size_t)(p - run) > wm->litlen) {
+            wm->lit = run;
+            wm->litlen = p - run;
+        }
+
+        if(*p == '\0')
+            break;
+
+        run = p + 1;
+    }
+
+    /* run is now the literal suffix */
+    if((size_t)(p - run) > prefixlen) {
+        wm->suffix = 1;
+        rb_strlcpy(wm->anchor, run, sizeof(wm->anchor));
+    } else {
+        wm->suffix = 0;
+        rb_strlcpy(wm->anchor, mask, IRCD_MIN(prefixlen + 1, sizeof(wm->anchor)));
+    }
+}
+
+/* who_field_match()
+ *
+ * inputs	- WHO mask, string to match
+ * outputs	- 1 if the mask matches the string, 0 otherwise
+ * side effects -
+ */
+static int
+who_field_match(struct who_mask *wm, const char *name)
+{
+    const char *p;
+    size_t i;
+
+    /* anything the mask matches contains its literals, so look for the
+     * longest before running match()
+     */
+    if(wm->litlen > 0) {
+        for(p = name; *p != '\0'; p++) {
+            for(i = 0; i < wm->litlen && ToLower(p[i]) == ToLower(wm->lit[i]); i++)
+                ;
+
+            if(i == wm->litlen)
+                break;
+        }
+
+        if(*p == '\0')
+            return 0;
+    }
+
+    return match(wm->mask, name);
+}
+
+/* who_match()
+ *
+ * inputs	- pointer to client requesting who
+ *		- pointer to client to check
+ *		- WHO mask
+ * output	- 1 if the mask matches the nick, username, host, server,
+ *		  realname or (for opers) original host of the client
+ * side effects -
+ */
+static int
+who_match(struct Client *source_p, struct Client *target_p, struct who_mask *wm)
+{
+    return who_field_match(wm, target_p->name) ||
+           who_field_match(wm, target_p->username) ||
+           who_field_match(wm, target_p->host) ||
+           who_field_match(wm, target_p->servptr->name) ||
+           (IsOper(source_p) && who_field_match(wm, target_p->orighost)) ||
+           who_field_match(wm, target_p->info);
+}
+
+static void
+who_add_cand(struct Client *target_p, void *unused)
+{
+    if(rb_unlikely(who_ncands == who_maxcands)) {
+        who_maxcands = who_maxcands ? who_maxcands * 2 : 1024;
+        who_cands = rb_realloc(who_cands, sizeof(struct Client *) * who_maxcands);
+    }
+
+    who_cands[who_ncands++] = target_p;
+}
+
+static int
+who_cand_cmp(const void *a, const void *b)
+{
+    const struct Client *ca = *(struct Client * const *)a;
+    const struct Client *cb = *(struct Client * const *)b;
+
+    if(ca->listserial != cb->listserial)
+        return ca->listserial < cb->listserial ? -1 : 1;
+
+    return 0;
+}
+
+/* who_collect()
+ *
+ * inputs	- WHO mask with an anchor
+ * outputs	- number of users in who_cands
+ * side effects - who_cands is filled with every user the mask could
+ *		  match, each once and in global_client_list order: those
+ *		  the WHO index has under a value starting (or ending) with
+ *		  the anchor, and those on a server whose name matches
+ */
+static int
+who_collect(struct who_mask *wm)
+{
+    struct Client *server_p;
+    rb_dlink_node *ptr, *uptr;
+    int i, n;
+
+    who_ncands = 0;
+    who_index_walk(wm->anchor, wm->suffix, who_add_cand, NULL);
+
+    RB_DLINK_FOREACH(ptr, global_serv_list.head) {
+        server_p = ptr->data;
+
+        if(!match(wm->mask, server_p->name))
+            continue;
+
+        RB_DLINK_FOREACH(uptr, server_p->serv->users.head)
+            who_add_cand(uptr->data, NULL);
+    }
+
+    if(who_ncands == 0)
+        return 0;
+
+    qsort(who_cands, who_ncands, sizeof(struct Client *), who_cand_cmp);
+
+    for(i = n = 1; i < who_ncands; i++) {
+        if(who_cands[i] != who_cands[n - 1])
+            who_cands[n++] = who_cands[i];
+    }
+
+    return who_ncands = n;
+}
+
 /* who_common_channel
  * inputs	- pointer to client requesting who
  * 		- pointer to channel member chain.
- *		- char * mask to match
+ *		- WHO mask to match
  *		- int if oper on a server or not
  *		- pointer to int maxmatches
  *		- format options
@@ -288,7 +470,7 @@ m_who(struct Client *client_p, struct Client *source_p, int parc, const char *pa
  */
 static void
 who_common_channel(struct Client *source_p, struct Channel *chptr,
-                   const char *mask, int server_oper, int *maxmatches,
+                   struct who_mask *wm, int server_oper, int *maxmatches,
                    struct who_format *fmt)
 {
     struct membership *msptr;
@@ -308,11 +490,7 @@ who_common_channel(struct Client *source_p, struct Channel *chptr,
         SetMark(target_p);
 
         if(*maxmatches > 0) {
-            if((mask == NULL) ||
-               match(mask, target_p->name) || match(mask, target_p->username) ||
-               match(mask, target_p->host) || match(mask, target_p->servptr->name) ||
-               (IsOper(source_p) && match(mask, target_p->orighost)) ||
-               match(mask, target_p->info)) {
+            if(wm == NULL || who_match(source_p, target_p, wm)) {
                 do_who(source_p, target_p, NULL, fmt);
                 --(*maxmatches);
             }
@@ -329,8 +507,10 @@ who_common_channel(struct Client *source_p, struct Channel *chptr,
  *		- int if operspy or not
  *		- format options
  * output	- NONE
- * side effects - do a global scan of all clients looking for match
- *		  this is slightly expensive on EFnet ...
+ * side effects - lists the matching clients.  A mask with a literal
+ *		  prefix or suffix only visits the users who_collect()
+ *		  finds, anything else is a global scan of all clients,
+ *		  which is slightly expensive on EFnet ...
  *		  marks assumed cleared for all clients initially
  *		  and will be left cleared on return
  */
@@ -339,8 +519,15 @@ who_global(struct Client *source_p, const char *mask, int server_oper, int opers
 {
     struct membership *msptr;
     struct Client *target_p;
+    struct who_mask whomask, *wm = NULL;
     rb_dlink_node *lp, *ptr;
     int maxmatches = 500;
+    int i, count;
+
+    if(mask != NULL) {
+        who_mask_init(&whomask, mask);
+        wm = &whomask;
+    }
 
     /* first, list all matching INvisible clients on common channels
      * if this is not an operspy who
@@ -348,39 +535,66 @@ who_global(struct Client *source_p, const char *mask, int server_oper, int opers
     if(!operspy) {
         RB_DLINK_FOREACH(lp, source_p->user->channel.head) {
             msptr = lp->data;
-            who_common_channel(source_p, msptr->chptr, mask, server_oper, &maxmatches, fmt);
+            who_common_channel(source_p, msptr->chptr, wm, server_oper, &maxmatches, fmt);
         }
     } else if (!ConfigFileEntry.operspy_dont_care_user_info)
         report_operspy(source_p, "WHO", mask);
 
-    /* second, list all matching visible clients and clear all marks
-     * on invisible clients
-     * if this is an operspy who, list all matching clients, no need
-     * to clear marks
+    /* second, list the matching visible clients out of those the mask
+     * could match, then clear the marks left on common channels
      */
-    RB_DLINK_FOREACH(ptr, global_client_list.head) {
-        target_p = ptr->data;
-        if(!IsPerson(target_p))
-            continue;
+    if(wm != NULL && wm->anchor[0] != '\0') {
+        count = who_collect(wm);
 
-        if(IsInvisible(target_p) && !operspy) {
-            ClearMark(target_p);
-            continue;
-        }
+        for(i = 0; i < count && maxmatches > 0; i++) {
+            target_p = who_cands[i];
 
-        if(server_oper && !IsOper(target_p))
-            continue;
+            if(!IsPerson(target_p) || (IsInvisible(target_p) && !operspy))
+                continue;
+
+            if(server_oper && !IsOper(target_p))
+                continue;
 
-        if(maxmatches > 0) {
-            if(!mask ||
-               match(mask, target_p->name) || match(mask, target_p->username) ||
-               match(mask, target_p->host) || match(mask, target_p->servptr->name) ||
-               (IsOper(source_p) && match(mask, target_p->orighost)) ||
-               match(mask, target_p->info)) {
+            if(who_match(source_p, target_p, wm)) {
                 do_who(source_p, target_p, NULL, fmt);
                 --maxmatches;
             }
         }
+
+        if(!operspy) {
+            RB_DLINK_FOREACH(lp, source_p->user->channel.head) {
+                msptr = lp->data;
+
+                RB_DLINK_FOREACH(ptr, msptr->chptr->members.head)
+                    ClearMark(((struct membership *)ptr->data)->client_p);
+            }
+        }
+    } else {
+        /* otherwise, list all matching visible clients and clear all marks
+         * on invisible clients
+         * if this is an operspy who, list all matching clients, no need
+         * to clear marks
+         */
+        RB_DLINK_FOREACH(ptr, global_client_list.head) {
+            target_p = ptr->data;
+            if(!IsPerson(target_p))
+                continue;
+
+            if(IsInvisible(target_p) && !operspy) {
+                ClearMark(target_p);
+                continue;
+            }
+
+            if(server_oper && !IsOper(target_p))
+                continue;
+
+            if(maxmatches > 0) {
+                if(wm == NULL || who_match(source_p, target_p, wm)) {
+                    do_who(source_p, target_p, NULL, fmt);
+                    --maxmatches;
+                }
+            }
+        }
     }
 
     if (maxmatches <= 0)
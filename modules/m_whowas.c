@@ -58,6 +58,8 @@ static int
 m_whowas(struct Client *client_p, struct Client *source_p, int parc, const char *parv[])
 {
     struct Whowas *temp;
+    rb_dlink_list *list;
+    rb_dlink_node *ptr;
     int cur = 0;
     int max = -1, found = 0;
     char *p;
@@ -92,10 +94,10 @@ m_whowas(struct Client *client_p, struct Client *source_p, int parc, const char
 
     nick = parv[1];
 
-    temp = WHOWASHASH[hash_whowas_name(nick)];
     found = 0;
-    for (; temp; temp = temp->next) {
-        if(!irccmp(nick, temp->name)) {
+    if((list = whowas_get_list(nick)) != NULL) {
+        RB_DLINK_FOREACH(ptr, list->head) {
+            temp = ptr->data;
             sendto_one(source_p, form_str(RPL_WHOWASUSER),
                        me.name, source_p->name, temp->name,
                        temp->username, temp->hostname, temp->realname);
@@ -119,9 +121,9 @@ m_whowas(struct Client *client_p, struct Client *source_p, int parc, const char
                                rb_ctime(temp->logoff, tbuf, sizeof(tbuf)));
             cur++;
             found++;
+            if(max > 0 && cur >= max)
+                break;
         }
-        if(max > 0 && cur >= max)
-            break;
     }
 
     if(!found)
@@ -326,6 +326,7 @@ apply_xline(struct Client *source_p, const char *name, const char *reason, int t
     }
 
     rb_dlinkAddAlloc(aconf, &xline_conf_list);
+    xline_conf_changed();
     check_xlines();
 }
 
@@ -513,6 +514,7 @@ remove_xline(struct Client *source_p, const char *name, int propagated)
             remove_reject_mask(aconf->host, NULL);
             free_conf(aconf);
             rb_dlinkDestroy(ptr, &xline_conf_list);
+            xline_conf_changed();
             return;
         }
     }
@@ -54,7 +54,16 @@ static char bandb_add_letter[LAST_BANDB_TYPE] = {
 
 rb_dlink_list bandb_pending;
 
+/* bans bandb sent that the bandb_check_*() filters turned away, kept so a
+ * later sync can add them once whatever shadowed them is gone
+ */
+static rb_dlink_list bandb_skipped;
+
 static rb_helper *bandb_helper;
+
+/* where the last listing from bandb left us, see bandb_rehash_bans() */
+static unsigned long bandb_epoch;
+static unsigned long bandb_gen;
 static int start_bandb(void);
 
 static void bandb_parse(rb_helper *);
@@ -249,12 +258,16 @@ static int
 bandb_check_dline(struct ConfItem *aconf)
 {
     struct rb_sockaddr_storage daddr;
-    /* 	struct ConfItem *dconf; */
+    struct ConfItem *dconf;
     int bits;
 
     if(!parse_netmask(aconf->host, (struct sockaddr *)&daddr, &bits))
         return 0;
 
+    dconf = find_exact_conf_by_address(aconf->host, CONF_DLINE, NULL);
+    if(dconf != NULL && !(dconf->flags & CONF_FLAGS_TEMPORARY))
+        return 0;
+
     return 1;
 }
 
@@ -310,66 +323,309 @@ bandb_handle_clear(void)
     }
 }
 
+/* bandb_add_conf()
+ *
+ * inputs	- ban from bandb
+ * outputs	- 1 if it was added, 0 if the filters turned it away
+ * side effects - the ban is added to the matching table
+ */
+static int
+bandb_add_conf(struct ConfItem *aconf)
+{
+    switch (aconf->status) {
+    case CONF_KILL:
+        if(!bandb_check_kline(aconf))
+            return 0;
+
+        add_conf_by_address(aconf->host, CONF_KILL, aconf->user, NULL, aconf);
+        return 1;
+
+    case CONF_DLINE:
+        if(!bandb_check_dline(aconf))
+            return 0;
+
+        add_conf_by_address(aconf->host, CONF_DLINE, aconf->user, NULL, aconf);
+        return 1;
+
+    case CONF_XLINE:
+        if(!bandb_check_xline(aconf))
+            return 0;
+
+        rb_dlinkAddAlloc(aconf, &xline_conf_list);
+        return 1;
+
+    case CONF_RESV_CHANNEL:
+        if(!bandb_check_resv_channel(aconf))
+            return 0;
+
+        add_to_resv_hash(aconf->host, aconf);
+        return 1;
+
+    case CONF_RESV_NICK:
+        if(!bandb_check_resv_nick(aconf))
+            return 0;
+
+        rb_dlinkAddAlloc(aconf, &resv_conf_list);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* bandb_have_ban()
+ *
+ * inputs	- ban from bandb
+ * outputs	- 1 if we already have the same permanent ban, 0 otherwise
+ * side effects -
+ */
+static int
+bandb_have_ban(struct ConfItem *aconf)
+{
+    struct ConfItem *live;
+
+    switch (aconf->status) {
+    case CONF_KILL:
+        live = find_exact_conf_by_address(aconf->host, CONF_KILL, aconf->user);
+        return live != NULL && !(live->flags & CONF_FLAGS_TEMPORARY) && !live->lifetime;
+
+    case CONF_DLINE:
+        live = find_exact_conf_by_address(aconf->host, CONF_DLINE, NULL);
+        return live != NULL && !(live->flags & CONF_FLAGS_TEMPORARY) && !live->lifetime;
+
+    case CONF_XLINE:
+        live = find_xline_mask(aconf->host);
+        return live != NULL && !live->hold && !live->lifetime;
+
+    case CONF_RESV_CHANNEL:
+        live = hash_find_resv(aconf->host);
+        return live != NULL && !live->hold && !live->lifetime;
+
+    case CONF_RESV_NICK:
+        live = find_nick_resv_mask(aconf->host);
+        return live != NULL && !live->hold && !live->lifetime;
+    }
+
+    return 0;
+}
+
+/* bandb_add_pending()
+ *
+ * inputs	-
+ * outputs	- number of bans added
+ * side effects - the bans bandb has sent are added.  Those we have
+ *		  already, such as our own KLINEs sent back to us, are
+ *		  freed, the rest turned away are kept on bandb_skipped
+ */
+static int
+bandb_add_pending(void)
+{
+    rb_dlink_node *ptr, *next_ptr;
+    int added = 0;
+
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, bandb_pending.head) {
+        rb_dlinkDelete(ptr, &bandb_pending);
+
+        if(bandb_add_conf(ptr->data)) {
+            rb_free_rb_dlink_node(ptr);
+            added++;
+        } else if(bandb_have_ban(ptr->data)) {
+            free_conf(ptr->data);
+            rb_free_rb_dlink_node(ptr);
+        } else
+            rb_dlinkAdd(ptr->data, ptr, &bandb_skipped);
+    }
+
+    return added;
+}
+
+/* bandb_add_skipped()
+ *
+ * inputs	-
+ * outputs	- number of bans added
+ * side effects - skipped bans are added if the wider or temporary ban
+ *		  that shadowed them has since gone
+ */
+static int
+bandb_add_skipped(void)
+{
+    rb_dlink_node *ptr, *next_ptr;
+    int added = 0;
+
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, bandb_skipped.head) {
+        if(bandb_add_conf(ptr->data)) {
+            rb_dlinkDestroy(ptr, &bandb_skipped);
+            added++;
+        }
+    }
+
+    return added;
+}
+
+/* bandb_drop_skipped()
+ *
+ * inputs	- conf status, user and host of a ban bandb removed
+ * outputs	-
+ * side effects - any skipped copy of the ban is freed
+ */
 static void
-bandb_handle_finish(void)
+bandb_drop_skipped(int status, const char *user, const char *host)
 {
     struct ConfItem *aconf;
     rb_dlink_node *ptr, *next_ptr;
 
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, bandb_skipped.head) {
+        aconf = ptr->data;
+
+        if(!(aconf->status & status) || irccmp(aconf->host, host))
+            continue;
+
+        if(user != NULL && irccmp(aconf->user, user))
+            continue;
+
+        free_conf(aconf);
+        rb_dlinkDestroy(ptr, &bandb_skipped);
+    }
+}
+
+static void
+bandb_handle_finish(void)
+{
+    rb_dlink_node *ptr, *next_ptr;
+
     clear_out_address_conf_bans();
     clear_s_newconf_bans();
 
-    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, bandb_pending.head) {
-        aconf = ptr->data;
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, bandb_skipped.head) {
+        free_conf(ptr->data);
+        rb_dlinkDestroy(ptr, &bandb_skipped);
+    }
 
-        rb_dlinkDestroy(ptr, &bandb_pending);
+    bandb_add_pending();
+
+    xline_conf_changed();
+    resv_conf_changed();
+
+    check_banned_lines();
+}
+
+/* bandb_handle_unban()
+ *
+ * inputs	- unban line from bandb
+ * outputs	-
+ * side effects - the permanent ban it names, if we have it, is removed
+ */
+static void
+bandb_handle_unban(char *parv[], int parc)
+{
+    struct ConfItem *aconf;
+    rb_dlink_node *ptr;
 
-        switch (aconf->status) {
-        case CONF_KILL:
-            if(bandb_check_kline(aconf))
-                add_conf_by_address(aconf->host, CONF_KILL, aconf->user, NULL, aconf);
-            else
-                free_conf(aconf);
+    if(parc < 2 || (parv[0][0] == 'k' && parc < 3))
+        return;
+
+    switch (parv[0][0]) {
+    case 'k':
+        bandb_drop_skipped(CONF_KILL, parv[1], parv[2]);
 
+        aconf = find_exact_conf_by_address(parv[2], CONF_KILL, parv[1]);
+        if(aconf == NULL || (aconf->flags & CONF_FLAGS_TEMPORARY) || aconf->lifetime)
             break;
 
-        case CONF_DLINE:
-            if(bandb_check_dline(aconf))
-                add_conf_by_address(aconf->host, CONF_DLINE, aconf->user, NULL, aconf);
-            else
-                free_conf(aconf);
+        remove_reject_mask(aconf->user, aconf->host);
+        delete_one_address_conf(aconf->host, aconf);
+        break;
+
+    case 'd':
+        bandb_drop_skipped(CONF_DLINE, NULL, parv[1]);
 
+        aconf = find_exact_conf_by_address(parv[1], CONF_DLINE, NULL);
+        if(aconf == NULL || (aconf->flags & CONF_FLAGS_TEMPORARY) || aconf->lifetime)
             break;
 
-        case CONF_XLINE:
-            if(bandb_check_xline(aconf))
-                rb_dlinkAddAlloc(aconf, &xline_conf_list);
-            else
-                free_conf(aconf);
+        delete_one_address_conf(aconf->host, aconf);
+        break;
+
+    case 'x':
+        bandb_drop_skipped(CONF_XLINE, NULL, parv[1]);
 
+        RB_DLINK_FOREACH(ptr, xline_conf_list.head) {
+            aconf = ptr->data;
+
+            if(aconf->hold || aconf->lifetime || irccmp(aconf->host, parv[1]))
+                continue;
+
+            remove_reject_mask(aconf->host, NULL);
+            free_conf(aconf);
+            rb_dlinkDestroy(ptr, &xline_conf_list);
+            xline_conf_changed();
             break;
+        }
+
+        break;
 
-        case CONF_RESV_CHANNEL:
-            if(bandb_check_resv_channel(aconf))
-                add_to_resv_hash(aconf->host, aconf);
-            else
-                free_conf(aconf);
+    case 'r':
+        bandb_drop_skipped(CONF_RESV_CHANNEL | CONF_RESV_NICK, NULL, parv[1]);
 
+        if(IsChannelName(parv[1])) {
+            aconf = hash_find_resv(parv[1]);
+            if(aconf == NULL || aconf->hold || aconf->lifetime)
+                break;
+
+            del_from_resv_hash(aconf->host, aconf);
+            free_conf(aconf);
             break;
+        }
 
-        case CONF_RESV_NICK:
-            if(bandb_check_resv_nick(aconf))
-                rb_dlinkAddAlloc(aconf, &resv_conf_list);
-            else
-                free_conf(aconf);
+        RB_DLINK_FOREACH(ptr, resv_conf_list.head) {
+            aconf = ptr->data;
 
+            if(aconf->hold || aconf->lifetime || irccmp(aconf->host, parv[1]))
+                continue;
+
+            free_conf(aconf);
+            rb_dlinkDestroy(ptr, &resv_conf_list);
+            resv_conf_changed();
             break;
         }
+
+        break;
     }
+}
+
+/* bandb_handle_update()
+ *
+ * the end of a listing of only what changed, the unbans in it are
+ * already done, so just the new bans are left to add.  Bans skipped
+ * earlier are tried again too, as the unbans or expired temporary bans
+ * may have uncovered them.
+ */
+static void
+bandb_handle_update(void)
+{
+    int added;
+
+    added = bandb_add_pending();
+    added += bandb_add_skipped();
+
+    if(!added)
+        return;
+
+    xline_conf_changed();
+    resv_conf_changed();
 
     check_banned_lines();
 }
 
+static void
+bandb_handle_synced(char *parv[], int parc)
+{
+    if(parc < 3)
+        return;
+
+    bandb_epoch = strtoul(parv[1], NULL, 10);
+    bandb_gen = strtoul(parv[2], NULL, 10);
+}
+
 static void
 bandb_handle_failure(rb_helper *helper, char **parv, int parc)
 {
@@ -405,20 +661,43 @@ bandb_parse(rb_helper *helper)
             bandb_handle_ban(parv, parc);
             break;
 
+        case 'k':
+        case 'd':
+        case 'x':
+        case 'r':
+            bandb_handle_unban(parv, parc);
+            break;
+
         case 'C':
             bandb_handle_clear();
         case 'F':
             bandb_handle_finish();
+            bandb_handle_synced(parv, parc);
+            break;
+
+        case 'S':
+            bandb_handle_clear();
+            break;
+
+        case 'G':
+            bandb_handle_update();
+            bandb_handle_synced(parv, parc);
             break;
         }
     }
 }
 
+/* bandb_rehash_bans()
+ *
+ * asks bandb for the bans changed since our last listing.  bandb sends
+ * all of them instead the first time, or when it cannot tell what has
+ * changed.
+ */
 void
 bandb_rehash_bans(void)
 {
     if(bandb_helper != NULL)
-        rb_helper_write(bandb_helper, "L");
+        rb_helper_write(bandb_helper, "L %lu %lu", bandb_epoch, bandb_gen);
 }
 
 static void
@@ -50,6 +50,12 @@ static rb_bh *ban_heap;
 static rb_bh *topic_heap;
 static rb_bh *member_heap;
 
+rb_dlink_list channel_dir[CHANNEL_DIR_SIZE];
+static rb_dlink_list channel_dir_cursors;
+static unsigned int *channel_dir_free;	/* dir_slots given back */
+static unsigned int channel_dir_nfree, channel_dir_maxfree;
+static unsigned int channel_dir_slots;	/* dir_slots ever handed out */
+
 static int channel_capabs[] = { CAP_EX, CAP_IE,
                                 CAP_SERVICE,
                                 CAP_TS6
@@ -61,6 +67,9 @@ static int channel_capabs[] = { CAP_EX, CAP_IE,
 static struct ChCapCombo chcap_combos[NCHCAP_COMBOS];
 
 static void free_topic(struct Channel *chptr);
+static void del_from_channel_dir(struct Channel *chptr);
+static void free_ban_index(struct Channel *chptr);
+static void namescache_add_member(struct membership *msptr);
 
 static int h_can_join;
 static int h_can_create_channel;
@@ -105,6 +114,7 @@ void
 free_channel(struct Channel *chptr)
 {
     channel_metadata_clear(chptr);
+    free_ban_index(chptr);
     rb_free(chptr->chname);
     rb_free(chptr->mode_lock);
     rb_bh_free(channel_heap, chptr);
@@ -361,6 +371,9 @@ add_user_to_channel(struct Channel *chptr, struct Client *client_p, int flags)
 
     if(MyClient(client_p))
         rb_dlinkAdd(msptr, &msptr->locchannode, &chptr->locmembers);
+
+    update_channel_dir(chptr);
+    namescache_add_member(msptr);
 }
 
 /* remove_user_from_channel()
@@ -389,6 +402,10 @@ remove_user_from_channel(struct membership *msptr)
 
     if(!(chptr->mode.mode & MODE_PERMANENT) && rb_dlink_list_length(&chptr->members) <= 0)
         destroy_channel(chptr);
+    else {
+        update_channel_dir(chptr);
+        invalidate_namescache(chptr);
+    }
 
     rb_bh_free(member_heap, msptr);
 
@@ -423,6 +440,10 @@ remove_user_from_channels(struct Client *client_p)
 
         if(!(chptr->mode.mode & MODE_PERMANENT) && rb_dlink_list_length(&chptr->members) <= 0)
             destroy_channel(chptr);
+        else {
+            update_channel_dir(chptr);
+            invalidate_namescache(chptr);
+        }
 
         rb_bh_free(member_heap, msptr);
     }
@@ -521,11 +542,173 @@ destroy_channel(struct Channel *chptr)
     /* Free the topic */
     free_topic(chptr);
 
+    burst_list_fixup(&chptr->node);
+    del_from_channel_dir(chptr);
+    invalidate_namescache(chptr);
     rb_dlinkDelete(&chptr->node, &global_channel_list);
     del_from_channel_hash(chptr->chname, chptr);
     free_channel(chptr);
 }
 
+static void
+channel_dir_unlink(struct Channel *chptr)
+{
+    struct ChannelDirCursor *cursor;
+    rb_dlink_node *ptr;
+
+    RB_DLINK_FOREACH(ptr, channel_dir_cursors.head) {
+        cursor = ptr->data;
+
+        if(cursor->next == &chptr->dir_node)
+            cursor->next = chptr->dir_node.next;
+    }
+
+    rb_dlinkDelete(&chptr->dir_node, &channel_dir[chptr->dir_bucket]);
+}
+
+/* update_channel_dir()
+ *
+ * input	- channel whose member count has changed
+ * output	-
+ * side effects - channel is filed under its new count in the directory,
+ *		  and its cached RPL_LIST text is dropped
+ */
+void
+update_channel_dir(struct Channel *chptr)
+{
+    unsigned long count = rb_dlink_list_length(&chptr->members);
+    unsigned int bucket = count < CHANNEL_DIR_SIZE ? count : CHANNEL_DIR_SIZE - 1;
+
+    rb_free(chptr->listbody);
+    chptr->listbody = NULL;
+
+    if(chptr->dir_slot == 0) {
+        if(channel_dir_nfree > 0)
+            chptr->dir_slot = channel_dir_free[--channel_dir_nfree];
+        else
+            chptr->dir_slot = ++channel_dir_slots;
+    } else if(chptr->dir_bucket == bucket)
+        return;
+    else
+        channel_dir_unlink(chptr);
+
+    chptr->dir_bucket = bucket;
+    rb_dlinkAddTail(chptr, &chptr->dir_node, &channel_dir[bucket]);
+}
+
+static void
+del_from_channel_dir(struct Channel *chptr)
+{
+    if(chptr->dir_slot == 0)
+        return;
+
+    channel_dir_unlink(chptr);
+
+    if(channel_dir_nfree == channel_dir_maxfree) {
+        channel_dir_maxfree = channel_dir_maxfree ? channel_dir_maxfree * 2 : 64;
+        channel_dir_free = rb_realloc(channel_dir_free,
+                                      sizeof(unsigned int) * channel_dir_maxfree);
+    }
+
+    channel_dir_free[channel_dir_nfree++] = chptr->dir_slot;
+    chptr->dir_slot = 0;
+
+    rb_free(chptr->listbody);
+    chptr->listbody = NULL;
+}
+
+/* channel_dir_cursor_start()
+ *
+ * input	- cursor, range of member counts wanted
+ * output	-
+ * side effects - cursor is set to walk the directory from users_max
+ *		  down to users_min, and kept right as channels move
+ */
+void
+channel_dir_cursor_start(struct ChannelDirCursor *cursor, unsigned int users_min,
+                         unsigned int users_max)
+{
+    cursor->bucket = users_max < CHANNEL_DIR_SIZE ? users_max : CHANNEL_DIR_SIZE - 1;
+    cursor->last = users_min < CHANNEL_DIR_SIZE ? users_min : CHANNEL_DIR_SIZE - 1;
+    cursor->next = channel_dir[cursor->bucket].head;
+    cursor->seenlen = channel_dir_slots / 8 + 1;
+    cursor->seen = rb_malloc(cursor->seenlen);
+
+    rb_dlinkAdd(cursor, &cursor->node, &channel_dir_cursors);
+}
+
+/* channel_dir_cursor_next()
+ *
+ * input	- cursor
+ * output	- next channel, or NULL when the walk is over
+ * side effects - a channel that moved while the walk went on is only
+ *		  given out once
+ */
+struct Channel *
+channel_dir_cursor_next(struct ChannelDirCursor *cursor)
+{
+    struct Channel *chptr;
+    unsigned int byte;
+    unsigned char bit;
+
+    while(cursor->bucket >= cursor->last) {
+        if(cursor->next == NULL) {
+            if(--cursor->bucket >= cursor->last)
+                cursor->next = channel_dir[cursor->bucket].head;
+            continue;
+        }
+
+        chptr = cursor->next->data;
+        cursor->next = cursor->next->next;
+
+        byte = chptr->dir_slot / 8;
+        bit = 1 << (chptr->dir_slot % 8);
+
+        if(byte >= cursor->seenlen) {
+            cursor->seen = rb_realloc(cursor->seen, byte + 1);
+            memset(cursor->seen + cursor->seenlen, 0, byte + 1 - cursor->seenlen);
+            cursor->seenlen = byte + 1;
+        }
+
+        if(cursor->seen[byte] & bit)
+            continue;
+
+        cursor->seen[byte] |= bit;
+        return chptr;
+    }
+
+    return NULL;
+}
+
+void
+channel_dir_cursor_stop(struct ChannelDirCursor *cursor)
+{
+    rb_dlinkDelete(&cursor->node, &channel_dir_cursors);
+    rb_free(cursor->seen);
+    cursor->seen = NULL;
+}
+
+/* channel_list_body()
+ *
+ * input	- channel
+ * output	- "<channel> <members> :<topic>", as RPL_LIST ends
+ * side effects - the text is kept until the count or topic changes
+ */
+const char *
+channel_list_body(struct Channel *chptr)
+{
+    char buf[BUFSIZE];
+
+    if(chptr->listbody == NULL) {
+        rb_snprintf(buf, sizeof(buf), "%s %lu :%s", chptr->chname,
+                    rb_dlink_list_length(&chptr->members),
+                    chptr->topic == NULL ? "" : chptr->topic);
+        chptr->listbody = rb_strdup(buf);
+    }
+
+    return chptr->listbody;
+}
+
 /* channel_pub_or_secret()
  *
  * input	- channel
@@ -542,56 +725,170 @@ channel_pub_or_secret(struct Channel *chptr)
     return ("*");
 }
 
-/* channel_member_names()
- *
- * input	- channel to list, client to list to, show endofnames
- * output	-
- * side effects - client is given list of users on channel
+/*
+ * A channel keeps up to four ready-made lists of its members for
+ * RPL_NAMREPLY: with or without +i users (members see them, others do
+ * not), and with one or all status prefixes (multi-prefix).  Each is a
+ * run of lines ended by '\0', then an empty line, short enough to fit
+ * after the longest possible numeric prefix.  A join adds to the lists
+ * already built; anything else that changes them throws them away.
  */
-void
-channel_member_names(struct Channel *chptr, struct Client *client_p, int show_eon)
+#define NAMES_INVISIBLE	0x1
+#define NAMES_STACKED	0x2
+
+struct NamesCache {
+    char *buf;
+    size_t len;			/* where the final empty line starts */
+    size_t size;
+    size_t lastline;		/* where the last line starts */
+    size_t limit;		/* longest a line may be */
+};
+
+static void
+names_append(struct NamesCache *nc, const char *status, const char *name)
 {
+    size_t slen = strlen(status), nlen = strlen(name);
+    size_t used = nc->len - nc->lastline;
+    size_t pos;
+
+    /* room for a separator, the entry, and both terminators */
+    if(nc->len + slen + nlen + 3 > nc->size) {
+        nc->size = (nc->size + slen + nlen + 3) * 2;
+        nc->buf = rb_realloc(nc->buf, nc->size);
+    }
+
+    if(used > 0 && used + 1 + slen + nlen <= nc->limit) {
+        pos = nc->len;
+        nc->buf[pos++] = ' ';
+    } else {
+        if(used > 0)
+            nc->len++;	/* keep the '\0' ending the last line */
+        nc->lastline = pos = nc->len;
+    }
+
+    memcpy(nc->buf + pos, status, slen);
+    memcpy(nc->buf + pos + slen, name, nlen);
+    pos += slen + nlen;
+    nc->buf[pos] = '\0';
+    nc->buf[pos + 1] = '\0';
+    nc->len = pos;
+}
+
+static struct NamesCache *
+build_namescache(struct Channel *chptr, int which)
+{
+    struct NamesCache *nc;
     struct membership *msptr;
-    struct Client *target_p;
     rb_dlink_node *ptr;
     char lbuf[BUFSIZE];
-    char *t;
     int mlen;
-    int tlen;
-    int cur_len;
-    int is_member;
-    int stack = IsCapable(client_p, CLICAP_MULTI_PREFIX);
 
-    if(ShowChannel(client_p, chptr)) {
-        is_member = IsMember(client_p, chptr);
+    /* the prefix is longest when sent to a nick of NICKLEN */
+    mlen = rb_sprintf(lbuf, form_str(RPL_NAMREPLY), me.name, "", "*", chptr->chname);
 
-        cur_len = mlen = rb_sprintf(lbuf, form_str(RPL_NAMREPLY),
-                                    me.name, client_p->name,
-                                    channel_pub_or_secret(chptr), chptr->chname);
+    nc = rb_malloc(sizeof(struct NamesCache));
+    nc->limit = BUFSIZE - 6 - NICKLEN - mlen;
+    nc->size = 2;
+    nc->buf = rb_malloc(nc->size);
 
-        t = lbuf + cur_len;
+    RB_DLINK_FOREACH(ptr, chptr->members.head) {
+        msptr = ptr->data;
 
-        RB_DLINK_FOREACH(ptr, chptr->members.head) {
-            msptr = ptr->data;
-            target_p = msptr->client_p;
+        if(IsInvisible(msptr->client_p) && !(which & NAMES_INVISIBLE))
+            continue;
 
-            if(IsInvisible(target_p) && !is_member)
-                continue;
+        names_append(nc, find_channel_status(msptr, which & NAMES_STACKED),
+                     msptr->client_p->name);
+    }
 
-            /* space, possible "@+" prefix */
-            if(cur_len + strlen(target_p->name) + 3 >= BUFSIZE - 3) {
-                *(t - 1) = '\0';
-                sendto_one(client_p, "%s", lbuf);
-                cur_len = mlen;
-                t = lbuf + mlen;
-            }
+    return nc;
+}
 
-            tlen = rb_sprintf(t, "%s%s ", find_channel_status(msptr, stack),
-                              target_p->name);
+static void
+namescache_add_member(struct membership *msptr)
+{
+    struct Channel *chptr = msptr->chptr;
+    int which;
 
-            cur_len += tlen;
-            t += tlen;
-        }
+    for(which = 0; which < 4; which++) {
+        if(chptr->names[which] == NULL)
+            continue;
+
+        if(IsInvisible(msptr->client_p) && !(which & NAMES_INVISIBLE))
+            continue;
+
+        names_append(chptr->names[which], find_channel_status(msptr, which & NAMES_STACKED),
+                     msptr->client_p->name);
+    }
+}
+
+/* invalidate_namescache()
+ *
+ * input	- channel whose members, or their nicks or status, changed
+ * output	-
+ * side effects - the channel's cached NAMES lists are dropped
+ */
+void
+invalidate_namescache(struct Channel *chptr)
+{
+    int which;
+
+    for(which = 0; which < 4; which++) {
+        if(chptr->names[which] == NULL)
+            continue;
+
+        rb_free(chptr->names[which]->buf);
+        rb_free(chptr->names[which]);
+        chptr->names[which] = NULL;
+    }
+}
+
+/* invalidate_namescache_user()
+ *
+ * input	- user whose nick or visibility changed
+ * output	-
+ * side effects - the NAMES lists of the user's channels are dropped
+ */
+void
+invalidate_namescache_user(struct Client *client_p)
+{
+    struct membership *msptr;
+    rb_dlink_node *ptr;
+
+    if(client_p == NULL || client_p->user == NULL)
+        return;
+
+    RB_DLINK_FOREACH(ptr, client_p->user->channel.head) {
+        msptr = ptr->data;
+        invalidate_namescache(msptr->chptr);
+    }
+}
+
+/* channel_member_names()
+ *
+ * input	- channel to list, client to list to, show endofnames
+ * output	-
+ * side effects - client is given list of users on channel
+ */
+void
+channel_member_names(struct Channel *chptr, struct Client *client_p, int show_eon)
+{
+    char lbuf[BUFSIZE];
+    const char *t;
+    int which = 0;
+
+    if(ShowChannel(client_p, chptr)) {
+        if(IsMember(client_p, chptr))
+            which |= NAMES_INVISIBLE;
+        if(IsCapable(client_p, CLICAP_MULTI_PREFIX))
+            which |= NAMES_STACKED;
+
+        if(chptr->names[which] == NULL)
+            chptr->names[which] = build_namescache(chptr, which);
+
+        rb_sprintf(lbuf, form_str(RPL_NAMREPLY),
+                   me.name, client_p->name,
+                   channel_pub_or_secret(chptr), chptr->chname);
 
         /* The old behaviour here was to always output our buffer,
          * even if there are no clients we can show.  This happens
@@ -600,10 +897,8 @@ channel_member_names(struct Channel *chptr, struct Client *client_p, int show_eo
          * reason for keeping that behaviour, as it just wastes
          * bandwidth.  --anfl
          */
-        if(cur_len != mlen) {
-            *(t - 1) = '\0';
-            sendto_one(client_p, "%s", lbuf);
-        }
+        for(t = chptr->names[which]->buf; *t != '\0'; t += strlen(t) + 1)
+            sendto_one(client_p, "%s%s", lbuf, t);
     }
 
     if(show_eon)
@@ -624,6 +919,413 @@ del_invite(struct Channel *chptr, struct Client *who)
     rb_dlinkFindDestroy(chptr, &who->user->invited);
 }
 
+/*
+ * Compiled ban lists
+ *
+ * The ban, exception and quiet lists of a channel are compiled into an
+ * index the first time they are checked after they change, which is
+ * tracked through chptr->bants.  Masks are filed by the part of them
+ * that has to appear literally in any nick!user@host they match:
+ *
+ *   nick!user@host	- the whole mask, when it has no wildcards
+ *   *!*@host		- the host part, when it has no wildcards
+ *   *!*@*.domain	- the host suffix starting at a '.'
+ *   *!*@1.2.3.*	- the host prefix ending at a '.' or ':'
+ *   nick!*@*		- the nick, when it has no wildcards
+ *
+ * CIDR masks additionally go into a patricia tree.  Extbans and masks
+ * that fit none of the above are kept in a residual list that is
+ * scanned as before.
+ *
+ * The index only narrows down which masks can possibly match, every
+ * candidate is still confirmed with the same match(), match_cidr() or
+ * match_extban() call the plain list walk would have made.
+ */
+#define BANKEY_LITERAL	0
+#define BANKEY_HOST	1
+#define BANKEY_SUFFIX	2
+#define BANKEY_PREFIX	3
+#define BANKEY_NICK	4
+
+struct ban_entry {
+    struct Ban *banptr;
+    struct ban_entry *next;	/* hash chain, or same patricia node */
+    unsigned int hashv;
+    unsigned int keylen;
+    int type;
+};
+
+struct ban_index {
+    struct ban_entry *entries;
+    int entry_count;
+    struct ban_entry **hash;
+    unsigned int hash_mask;
+    rb_patricia_tree_t *cidr;
+    struct Ban **residual;
+    int residual_count;
+};
+
+struct ChanBanIndex {
+    unsigned long bants;
+    struct ban_index bans;
+    struct ban_index excepts;
+    struct ban_index quiets;
+};
+
+static unsigned int
+ban_key_hash(int type, const char *key, size_t len)
+{
+    unsigned int h = 0x811c9dc5 ^ type;
+
+    while(len--) {
+        h ^= ToLower(*key++);
+        h *= 0x01000193;
+    }
+    return h;
+}
+
+static int
+ban_has_wild(const char *p, size_t len)
+{
+    while(len--) {
+        if(*p == '*' || *p == '?')
+            return 1;
+        p++;
+    }
+    return 0;
+}
+
+static void
+ban_index_add_key(struct ban_index *idx, struct Ban *banptr, int type,
+                  const char *key, size_t len)
+{
+    struct ban_entry *entry = &idx->entries[idx->entry_count++];
+    unsigned int hashv = ban_key_hash(type, key, len);
+
+    entry->banptr = banptr;
+    entry->hashv = hashv;
+    entry->keylen = len;
+    entry->type = type;
+    entry->next = idx->hash[hashv & idx->hash_mask];
+    idx->hash[hashv & idx->hash_mask] = entry;
+}
+
+/* ban_index_add_cidr()
+ *
+ * input	- index, ban, host part of the mask
+ * output	- 0 if the mask may have odd match_cidr() behaviour
+ * side effects - ban is added to the patricia tree when it is a cidr mask
+ */
+static int
+ban_index_add_cidr(struct ban_index *idx, struct Ban *banptr, const char *host)
+{
+    struct rb_sockaddr_storage addr;
+    struct ban_entry *entry;
+    rb_patricia_node_t *pnode;
+    char ip[HOSTLEN + 1];
+    const char *len;
+    int cidrlen, aftype;
+
+    if((len = strrchr(host, '/')) == NULL)
+        return 1;
+
+    /* match_cidr() never matches these */
+    cidrlen = atoi(len + 1);
+    if(cidrlen == 0)
+        return 1;
+
+    if((size_t)(len - host) >= sizeof(ip))
+        return 0;
+    memcpy(ip, host, len - host);
+    ip[len - host] = '\0';
+
+    memset(&addr, 0, sizeof(addr));
+#ifdef RB_IPV6
+    if(strchr(ip, ':')) {
+        aftype = AF_INET6;
+        if(cidrlen < 0 || cidrlen > 128 ||
+           rb_inet_pton(aftype, ip, &((struct sockaddr_in6 *)&addr)->sin6_addr) <= 0)
+            return 0;
+    } else
+#endif
+    {
+        aftype = AF_INET;
+        if(cidrlen < 0 || cidrlen > 32 ||
+           rb_inet_pton(aftype, ip, &((struct sockaddr_in *)&addr)->sin_addr) <= 0)
+            return 0;
+    }
+    SET_SS_FAMILY(&addr, aftype);
+
+    if(idx->cidr == NULL)
+        idx->cidr = rb_new_patricia(PATRICIA_BITS);
+
+    if((pnode = make_and_lookup_ip(idx->cidr, (struct sockaddr *)&addr, cidrlen)) == NULL)
+        return 0;
+
+    entry = &idx->entries[idx->entry_count++];
+    entry->banptr = banptr;
+    entry->next = pnode->data;
+    pnode->data = entry;
+    return 1;
+}
+
+static void
+ban_index_add(struct ban_index *idx, struct Ban *banptr)
+{
+    const char *mask = banptr->banstr;
+    const char *host, *p;
+    size_t hostlen;
+
+    if(*mask == '$')
+        goto residual;
+
+    if((host = strrchr(mask, '@')) != NULL) {
+        host++;
+        if(!ban_index_add_cidr(idx, banptr, host))
+            goto residual;
+    }
+
+    if(!ban_has_wild(mask, strlen(mask))) {
+        ban_index_add_key(idx, banptr, BANKEY_LITERAL, mask, strlen(mask));
+        return;
+    }
+
+    if(host != NULL) {
+        hostlen = strlen(host);
+
+        if(!ban_has_wild(host, hostlen)) {
+            ban_index_add_key(idx, banptr, BANKEY_HOST, host, hostlen);
+            return;
+        }
+
+        if(hostlen > 2 && host[0] == '*' && host[1] == '.' &&
+           !ban_has_wild(host + 1, hostlen - 1)) {
+            ban_index_add_key(idx, banptr, BANKEY_SUFFIX, host + 1, hostlen - 1);
+            return;
+        }
+
+        if(hostlen > 2 && host[hostlen - 1] == '*' &&
+           (host[hostlen - 2] == '.' || host[hostlen - 2] == ':') &&
+           !ban_has_wild(host, hostlen - 1)) {
+            ban_index_add_key(idx, banptr, BANKEY_PREFIX, host, hostlen - 1);
+            return;
+        }
+    }
+
+    if((p = strchr(mask, '!')) != NULL && p != mask && !ban_has_wild(mask, p - mask)) {
+        ban_index_add_key(idx, banptr, BANKEY_NICK, mask, p - mask);
+        return;
+    }
+
+residual:
+    idx->residual[idx->residual_count++] = banptr;
+}
+
+static void
+ban_index_build(struct ban_index *idx, rb_dlink_list *list)
+{
+    rb_dlink_node *ptr;
+    unsigned long count = rb_dlink_list_length(list);
+    unsigned int size = 16;
+
+    memset(idx, 0, sizeof(struct ban_index));
+
+    if(count == 0)
+        return;
+
+    while(size < count * 2)
+        size <<= 1;
+
+    /* a cidr mask takes an entry in the tree and one in the hash */
+    idx->entries = rb_malloc(sizeof(struct ban_entry) * count * 2);
+    idx->hash = rb_malloc(sizeof(struct ban_entry *) * size);
+    idx->hash_mask = size - 1;
+    idx->residual = rb_malloc(sizeof(struct Ban *) * count);
+
+    RB_DLINK_FOREACH(ptr, list->head) {
+        ban_index_add(idx, ptr->data);
+    }
+}
+
+static void
+ban_index_clear(struct ban_index *idx)
+{
+    if(idx->cidr != NULL)
+        rb_destroy_patricia(idx->cidr, NULL);
+    rb_free(idx->entries);
+    rb_free(idx->hash);
+    rb_free(idx->residual);
+}
+
+/* free_ban_index()
+ *
+ * input	- channel
+ * output	-
+ * side effects - compiled ban lists of the channel are released
+ */
+static void
+free_ban_index(struct Channel *chptr)
+{
+    if(chptr->banindex == NULL)
+        return;
+
+    ban_index_clear(&chptr->banindex->bans);
+    ban_index_clear(&chptr->banindex->excepts);
+    ban_index_clear(&chptr->banindex->quiets);
+    rb_free(chptr->banindex);
+    chptr->banindex = NULL;
+}
+
+/* get_ban_index()
+ *
+ * input	- channel
+ * output	- compiled ban lists, up to date with chptr->bants
+ * side effects - lists are recompiled if they changed since last use
+ */
+static struct ChanBanIndex *
+get_ban_index(struct Channel *chptr)
+{
+    struct ChanBanIndex *bidx = chptr->banindex;
+
+    if(bidx != NULL && bidx->bants == chptr->bants)
+        return bidx;
+
+    free_ban_index(chptr);
+
+    bidx = rb_malloc(sizeof(struct ChanBanIndex));
+    bidx->bants = chptr->bants;
+    ban_index_build(&bidx->bans, &chptr->banlist);
+    ban_index_build(&bidx->excepts, &chptr->exceptlist);
+    ban_index_build(&bidx->quiets, &chptr->quietlist);
+
+    chptr->banindex = bidx;
+    return bidx;
+}
+
+static int
+ban_index_lookup(struct ban_index *idx, int type, const char *key, size_t len,
+                 const char *s)
+{
+    struct ban_entry *entry;
+    unsigned int hashv = ban_key_hash(type, key, len);
+
+    for(entry = idx->hash[hashv & idx->hash_mask]; entry != NULL; entry = entry->next) {
+        if(entry->hashv == hashv && entry->type == type && entry->keylen == len &&
+           match(entry->banptr->banstr, s))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int
+ban_index_match_string(struct ban_index *idx, const char *s)
+{
+    const char *host, *p;
+    size_t hostlen;
+
+    if(ban_index_lookup(idx, BANKEY_LITERAL, s, strlen(s), s))
+        return 1;
+
+    if((p = strchr(s, '!')) != NULL &&
+       ban_index_lookup(idx, BANKEY_NICK, s, p - s, s))
+        return 1;
+
+    if((host = strrchr(s, '@')) == NULL)
+        return 0;
+    host++;
+    hostlen = strlen(host);
+
+    if(ban_index_lookup(idx, BANKEY_HOST, host, hostlen, s))
+        return 1;
+
+    for(p = host; *p != '\0'; p++) {
+        if(*p == '.' &&
+           ban_index_lookup(idx, BANKEY_SUFFIX, p, hostlen - (p - host), s))
+            return 1;
+
+        if((*p == '.' || *p == ':') &&
+           ban_index_lookup(idx, BANKEY_PREFIX, host, p - host + 1, s))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int
+ban_index_match_cidr(struct ban_index *idx, const char *s)
+{
+    struct rb_sockaddr_storage addr;
+    rb_patricia_node_t *pnode;
+    struct ban_entry *entry;
+    const char *ip;
+
+    if((ip = strrchr(s, '@')) == NULL)
+        return 0;
+    ip++;
+
+    memset(&addr, 0, sizeof(addr));
+#ifdef RB_IPV6
+    if(strchr(ip, ':')) {
+        if(rb_inet_pton(AF_INET6, ip, &((struct sockaddr_in6 *)&addr)->sin6_addr) <= 0)
+            return 0;
+        SET_SS_FAMILY(&addr, AF_INET6);
+    } else
+#endif
+    {
+        if(rb_inet_pton(AF_INET, ip, &((struct sockaddr_in *)&addr)->sin_addr) <= 0)
+            return 0;
+        SET_SS_FAMILY(&addr, AF_INET);
+    }
+
+    /* every prefix covering the address is on the path to the best one */
+    for(pnode = rb_match_ip(idx->cidr, (struct sockaddr *)&addr); pnode != NULL;
+        pnode = pnode->parent) {
+        for(entry = pnode->data; entry != NULL; entry = entry->next) {
+            if(match_cidr(entry->banptr->banstr, s))
+                return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* ban_index_match()
+ *
+ * input	- compiled list, channel, user, list type, user's
+ *		  nick!user@host, nick!user@ip and optional alternate host
+ * output	- 1 if any mask on the list matches, else 0
+ * side effects -
+ */
+static int
+ban_index_match(struct ban_index *idx, struct Channel *chptr, struct Client *who,
+                long mode_type, const char *s, const char *s2, const char *s3)
+{
+    struct Ban *banptr;
+    int i;
+
+    if(idx->entry_count > 0) {
+        if(ban_index_match_string(idx, s) || ban_index_match_string(idx, s2) ||
+           (s3 != NULL && ban_index_match_string(idx, s3)))
+            return 1;
+
+        if(idx->cidr != NULL && ban_index_match_cidr(idx, s2))
+            return 1;
+    }
+
+    for(i = 0; i < idx->residual_count; i++) {
+        banptr = idx->residual[i];
+        if(match(banptr->banstr, s) ||
+           match(banptr->banstr, s2) ||
+           match_cidr(banptr->banstr, s2) ||
+           match_extban(banptr->banstr, who, chptr, mode_type) ||
+           (s3 != NULL && match(banptr->banstr, s3)))
+            return 1;
+    }
+
+    return 0;
+}
+
 /* is_banned()
  *
  * input	- channel to check bans for, user to check bans against
@@ -639,9 +1341,8 @@ is_banned(struct Channel *chptr, struct Client *who, struct membership *msptr,
     char src_iphost[NICKLEN + USERLEN + HOSTLEN + 6];
     char src_althost[NICKLEN + USERLEN + HOSTLEN + 6];
     char *s3 = NULL;
-    rb_dlink_node *ptr;
-    struct Ban *actualBan = NULL;
-    struct Ban *actualExcept = NULL;
+    struct ChanBanIndex *bidx;
+    int banned;
 
     if(!MyClient(who))
         return 0;
@@ -668,44 +1369,26 @@ is_banned(struct Channel *chptr, struct Client *who, struct membership *msptr,
         }
     }
 
-    RB_DLINK_FOREACH(ptr, chptr->banlist.head) {
-        actualBan = ptr->data;
-        if(match(actualBan->banstr, s) ||
-           match(actualBan->banstr, s2) ||
-           match_cidr(actualBan->banstr, s2) ||
-           match_extban(actualBan->banstr, who, chptr, CHFL_BAN) ||
-           (s3 != NULL && match(actualBan->banstr, s3)))
-            break;
-        else
-            actualBan = NULL;
-    }
-
-    if((actualBan != NULL) && ConfigChannel.use_except) {
-        RB_DLINK_FOREACH(ptr, chptr->exceptlist.head) {
-            actualExcept = ptr->data;
-
-            /* theyre exempted.. */
-            if(match(actualExcept->banstr, s) ||
-               match(actualExcept->banstr, s2) ||
-               match_cidr(actualExcept->banstr, s2) ||
-               match_extban(actualExcept->banstr, who, chptr, CHFL_EXCEPTION) ||
-               (s3 != NULL && match(actualExcept->banstr, s3))) {
-                /* cache the fact theyre not banned */
-                if(msptr != NULL) {
-                    msptr->bants = chptr->bants;
-                    msptr->flags &= ~CHFL_BANNED;
-                }
+    bidx = get_ban_index(chptr);
+    banned = ban_index_match(&bidx->bans, chptr, who, CHFL_BAN, s, s2, s3);
 
-                return CHFL_EXCEPTION;
-            }
+    /* theyre exempted.. */
+    if(banned && ConfigChannel.use_except &&
+       ban_index_match(&bidx->excepts, chptr, who, CHFL_EXCEPTION, s, s2, s3)) {
+        /* cache the fact theyre not banned */
+        if(msptr != NULL) {
+            msptr->bants = chptr->bants;
+            msptr->flags &= ~CHFL_BANNED;
         }
+
+        return CHFL_EXCEPTION;
     }
 
     /* cache the banned/not banned status */
     if(msptr != NULL) {
         msptr->bants = chptr->bants;
 
-        if(actualBan != NULL) {
+        if(banned) {
             msptr->flags |= CHFL_BANNED;
             return CHFL_BAN;
         } else {
@@ -714,7 +1397,7 @@ is_banned(struct Channel *chptr, struct Client *who, struct membership *msptr,
         }
     }
 
-    return ((actualBan ? CHFL_BAN : 0));
+    return (banned ? CHFL_BAN : 0);
 }
 
 /* is_quieted()
@@ -732,9 +1415,8 @@ is_quieted(struct Channel *chptr, struct Client *who, struct membership *msptr,
     char src_iphost[NICKLEN + USERLEN + HOSTLEN + 6];
     char src_althost[NICKLEN + USERLEN + HOSTLEN + 6];
     char *s3 = NULL;
-    rb_dlink_node *ptr;
-    struct Ban *actualBan = NULL;
-    struct Ban *actualExcept = NULL;
+    struct ChanBanIndex *bidx;
+    int banned;
 
     if(!MyClient(who))
         return 0;
@@ -761,44 +1443,26 @@ is_quieted(struct Channel *chptr, struct Client *who, struct membership *msptr,
         }
     }
 
-    RB_DLINK_FOREACH(ptr, chptr->quietlist.head) {
-        actualBan = ptr->data;
-        if(match(actualBan->banstr, s) ||
-           match(actualBan->banstr, s2) ||
-           match_cidr(actualBan->banstr, s2) ||
-           match_extban(actualBan->banstr, who, chptr, CHFL_QUIET) ||
-           (s3 != NULL && match(actualBan->banstr, s3)))
-            break;
-        else
-            actualBan = NULL;
-    }
-
-    if((actualBan != NULL) && ConfigChannel.use_except) {
-        RB_DLINK_FOREACH(ptr, chptr->exceptlist.head) {
-            actualExcept = ptr->data;
-
-            /* theyre exempted.. */
-            if(match(actualExcept->banstr, s) ||
-               match(actualExcept->banstr, s2) ||
-               match_cidr(actualExcept->banstr, s2) ||
-               match_extban(actualExcept->banstr, who, chptr, CHFL_EXCEPTION) ||
-               (s3 != NULL && match(actualExcept->banstr, s3))) {
-                /* cache the fact theyre not banned */
-                if(msptr != NULL) {
-                    msptr->bants = chptr->bants;
-                    msptr->flags &= ~CHFL_BANNED;
-                }
+    bidx = get_ban_index(chptr);
+    banned = ban_index_match(&bidx->quiets, chptr, who, CHFL_QUIET, s, s2, s3);
 
-                return CHFL_EXCEPTION;
-            }
+    /* theyre exempted.. */
+    if(banned && ConfigChannel.use_except &&
+       ban_index_match(&bidx->excepts, chptr, who, CHFL_EXCEPTION, s, s2, s3)) {
+        /* cache the fact theyre not banned */
+        if(msptr != NULL) {
+            msptr->bants = chptr->bants;
+            msptr->flags &= ~CHFL_BANNED;
         }
+
+        return CHFL_EXCEPTION;
     }
 
     /* cache the banned/not banned status */
     if(msptr != NULL) {
         msptr->bants = chptr->bants;
 
-        if(actualBan != NULL) {
+        if(banned) {
             msptr->flags |= CHFL_BANNED;
             return CHFL_BAN;
         } else {
@@ -807,7 +1471,7 @@ is_quieted(struct Channel *chptr, struct Client *who, struct membership *msptr,
         }
     }
 
-    return ((actualBan ? CHFL_BAN : 0));
+    return (banned ? CHFL_BAN : 0);
 }
 
 /* can_join()
@@ -1224,6 +1888,9 @@ free_topic(struct Channel *chptr)
 void
 set_channel_topic(struct Channel *chptr, const char *topic, const char *topic_info, time_t topicts)
 {
+    rb_free(chptr->listbody);
+    chptr->listbody = NULL;
+
     if(strlen(topic) > 0) {
         if(chptr->topic == NULL)
             allocate_topic(chptr);
@@ -2101,6 +2101,8 @@ set_channel_mode(struct Client *client_p, struct Client *source_p,
     if(!mode_count)
         return;
 
+    invalidate_namescache(chptr);
+
     if(IsServer(source_p))
         rb_sprintf(cmdbuf, ":%s MODE %s ", fakesource_p->name, chptr->chname);
     else
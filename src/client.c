@@ -54,13 +54,15 @@
 #include "scache.h"
 #include "irc_dictionary.h"
 #include "sslproc.h"
+#include "cryptdi.h"
 
 #define DEBUG_EXITED_CLIENTS
 
-static void check_pings_list(rb_dlink_list * list);
-static void check_unknowns_list(rb_dlink_list * list);
+static void check_client_timer(void *);
 static void free_exited_clients(void *unused);
 static void exit_aborted_clients(void *unused);
+static void kline_client(struct Client *);
+static void dline_client(struct Client *);
 
 static int exit_remote_client(struct Client *, struct Client *, struct Client *,const char *);
 static int exit_remote_server(struct Client *, struct Client *, struct Client *,const char *);
@@ -69,14 +71,15 @@ static int exit_unknown_client(struct Client *, struct Client *, struct Client *
 static int exit_local_server(struct Client *, struct Client *, struct Client *,const char *);
 static int qs_server(struct Client *, struct Client *, struct Client *, const char *comment);
 
-static EVH check_pings;
-
 static rb_bh *client_heap = NULL;
 static rb_bh *lclient_heap = NULL;
 static rb_bh *pclient_heap = NULL;
 static rb_bh *user_heap = NULL;
 static rb_bh *away_heap = NULL;
 static char current_uid[IDLEN];
+static rb_patricia_tree_t *client_ip_tree;	/* see add_to_client_ip_index() */
+static struct Dictionary *who_key_dict;	/* see add_to_who_index() */
+static struct Dictionary *who_rkey_dict;
 
 struct Dictionary *nd_dict = NULL;
 
@@ -119,12 +122,14 @@ init_client(void)
     user_heap = rb_bh_create(sizeof(struct User), USER_HEAP_SIZE, "user_heap");
     away_heap = rb_bh_create(AWAYLEN, AWAY_HEAP_SIZE, "away_heap");
 
-    rb_event_addish("check_pings", check_pings, NULL, 30);
     rb_event_addish("free_exited_clients", &free_exited_clients, NULL, 4);
     rb_event_addish("exit_aborted_clients", exit_aborted_clients, NULL, 1);
     rb_event_add("flood_recalc", flood_recalc, NULL, 1);
 
     nd_dict = irc_dictionary_create(irccmp);
+    client_ip_tree = rb_new_patricia(PATRICIA_BITS);
+    who_key_dict = irc_dictionary_create(irccmp);
+    who_rkey_dict = irc_dictionary_create(irccmp);
 }
 
 
@@ -161,6 +166,11 @@ make_client(struct Client *from)
 
         /* as good a place as any... */
         rb_dlinkAdd(client_p, &client_p->localClient->tnode, &unknown_list);
+
+        /* nothing can time out before the shortest registration timeout */
+        rb_timer_set(&localClient->check_timer, localClient->firsttime + 1 +
+                     (ConfigFileEntry.connect_timeout < 30 ? ConfigFileEntry.connect_timeout : 30),
+                     check_client_timer, client_p);
     } else {
         /* from is not NULL */
         client_p->localClient = NULL;
@@ -170,6 +180,9 @@ make_client(struct Client *from)
 
     SetUnknown(client_p);
     strcpy(client_p->username, "unknown");
+    client_p->host = scache_intern("");
+    client_p->orighost = scache_intern("");
+    client_p->info = scache_intern("");
 
     return client_p;
 }
@@ -201,6 +214,11 @@ free_local_client(struct Client *client_p)
     if(client_p->localClient == NULL)
         return;
 
+    rb_timer_del(&client_p->localClient->check_timer);
+    crypt_cancel(client_p);
+    del_from_client_ip_index(client_p);
+    del_from_client_host_index(client_p);
+
     /*
      * clean up extra sockets from P-lines which have been discarded.
      */
@@ -254,147 +272,147 @@ free_client(struct Client *client_p)
     free_local_client(client_p);
     free_pre_client(client_p);
     rb_free(client_p->certfp);
+    rb_free(client_p->prefix);
+    scache_release(client_p->host);
+    scache_release(client_p->orighost);
+    scache_release(client_p->info);
     rb_bh_free(client_heap, client_p);
 }
 
 /*
- * check_pings - go through the local client list and check activity
- * kill off stuff that should die
- *
- * inputs       - NOT USED (from event)
- * output       - next time_t when check_pings() should be called again
- * side effects -
- *
- *
- * A PING can be sent to clients as necessary.
+ * check_pings_client
  *
- * Client/Server ping outs are handled.
- */
-
-/*
- * Addon from adrian. We used to call this after nextping seconds,
- * however I've changed it to run once a second. This is only for
- * PING timeouts, not K/etc-line checks (thanks dianora!). Having it
- * run once a second makes life a lot easier - when a new client connects
- * and they need a ping in 4 seconds, if nextping was set to 20 seconds
- * we end up waiting 20 seconds. This is stupid. :-)
- * I will optimise (hah!) check_pings() once I've finished working on
- * tidying up other network IO evilnesses.
- *     -- adrian
- */
-
-static void
-check_pings(void *notused)
-{
-    check_pings_list(&lclient_list);
-    check_pings_list(&serv_list);
-    check_unknowns_list(&unknown_list);
-}
-
-/*
- * Check_pings_list()
- *
- * inputs	- pointer to list to check
+ * inputs	- registered local client or server
  * output	- NONE
- * side effects	-
+ * side effects	- the client is PINGed or exited if it has gone quiet,
+ *		  otherwise its timer is armed for when it next might
  */
 static void
-check_pings_list(rb_dlink_list * list)
+check_pings_client(struct Client *client_p)
 {
     char scratch[32];	/* way too generous but... */
-    struct Client *client_p;	/* current local client_p being examined */
-    int ping = 0;		/* ping time value from client */
-    rb_dlink_node *ptr, *next_ptr;
+    int ping = get_client_ping(client_p);	/* ping time value from client */
+    time_t next;
 
-    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list->head) {
-        client_p = ptr->data;
-
-        if(!MyConnect(client_p) || IsDead(client_p))
-            continue;
-
-        ping = get_client_ping(client_p);
+    if(ping < (rb_current_time() - client_p->localClient->lasttime)) {
+        /*
+         * If the client/server hasnt talked to us in 2*ping seconds
+         * and it has a ping time, then close its connection.
+         */
+        if(((rb_current_time() - client_p->localClient->lasttime) >= (2 * ping)
+            && (client_p->flags & FLAGS_PINGSENT))) {
+            if(IsServer(client_p)) {
+                sendto_realops_snomask(SNO_GENERAL, L_ALL,
+                                       "No response from %s, closing link",
+                                       client_p->name);
+                ilog(L_SERVER,
+                     "No response from %s, closing link",
+                     log_client_name(client_p, HIDE_IP));
+            }
+            (void) rb_snprintf(scratch, sizeof(scratch),
+                               "Ping timeout: %d seconds",
+                               (int) (rb_current_time() - client_p->localClient->lasttime));
 
-        if(ping < (rb_current_time() - client_p->localClient->lasttime)) {
+            exit_client(client_p, client_p, &me, scratch);
+            return;
+        } else if((client_p->flags & FLAGS_PINGSENT) == 0) {
             /*
-             * If the client/server hasnt talked to us in 2*ping seconds
-             * and it has a ping time, then close its connection.
+             * if we havent PINGed the connection and we havent
+             * heard from it in a while, PING it to make sure
+             * it is still alive.
              */
-            if(((rb_current_time() - client_p->localClient->lasttime) >= (2 * ping)
-                && (client_p->flags & FLAGS_PINGSENT))) {
-                if(IsServer(client_p)) {
-                    sendto_realops_snomask(SNO_GENERAL, L_ALL,
-                                           "No response from %s, closing link",
-                                           client_p->name);
-                    ilog(L_SERVER,
-                         "No response from %s, closing link",
-                         log_client_name(client_p, HIDE_IP));
-                }
-                (void) rb_snprintf(scratch, sizeof(scratch),
-                                   "Ping timeout: %d seconds",
-                                   (int) (rb_current_time() - client_p->localClient->lasttime));
-
-                exit_client(client_p, client_p, &me, scratch);
-                continue;
-            } else if((client_p->flags & FLAGS_PINGSENT) == 0) {
-                /*
-                 * if we havent PINGed the connection and we havent
-                 * heard from it in a while, PING it to make sure
-                 * it is still alive.
-                 */
-                client_p->flags |= FLAGS_PINGSENT;
-                /* not nice but does the job */
-                client_p->localClient->lasttime = rb_current_time() - ping;
-                sendto_one(client_p, "PING :%s", me.name);
-            }
+            client_p->flags |= FLAGS_PINGSENT;
+            /* not nice but does the job */
+            client_p->localClient->lasttime = rb_current_time() - ping;
+            sendto_one(client_p, "PING :%s", me.name);
         }
-        /* ping_timeout: */
-
     }
+
+    /*
+     * lasttime only moves forward as the client talks to us, so the
+     * earliest anything can happen is when it would next be idle for
+     * ping seconds, or 2*ping if we are waiting on a PONG.
+     */
+    if(client_p->flags & FLAGS_PINGSENT)
+        next = client_p->localClient->lasttime + 2 * ping;
+    else
+        next = client_p->localClient->lasttime + ping + 1;
+
+    if(next <= rb_current_time())
+        next = rb_current_time() + 1;
+
+    rb_timer_set(&client_p->localClient->check_timer, next, check_client_timer, client_p);
 }
 
 /*
- * check_unknowns_list
+ * check_unknown_client
  *
- * inputs	- pointer to list of unknown clients
+ * inputs	- unregistered local client
  * output	- NONE
  * side effects	- unknown clients get marked for termination after n seconds
  */
 static void
-check_unknowns_list(rb_dlink_list * list)
+check_unknown_client(struct Client *client_p)
 {
-    rb_dlink_node *ptr, *next_ptr;
-    struct Client *client_p;
     int timeout;
 
-    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list->head) {
-        client_p = ptr->data;
-
-        if(IsDead(client_p) || IsClosing(client_p))
-            continue;
-
-        /* still has DNSbls to validate against */
-        if(client_p->preClient != NULL &&
-           rb_dlink_list_length(&client_p->preClient->dnsbl_queries) > 0)
-            continue;
+    /* still has DNSbls to validate against */
+    if(IsClosing(client_p) || (client_p->preClient != NULL &&
+       rb_dlink_list_length(&client_p->preClient->dnsbl_queries) > 0)) {
+        rb_timer_set(&client_p->localClient->check_timer, rb_current_time() + 5,
+                     check_client_timer, client_p);
+        return;
+    }
 
-        /*
-         * Check UNKNOWN connections - if they have been in this state
-         * for > 30s, close them.
-         */
+    /*
+     * Check UNKNOWN connections - if they have been in this state
+     * for > 30s, close them.
+     */
 
-        timeout = IsAnyServer(client_p) ? ConfigFileEntry.connect_timeout : 30;
-        if((rb_current_time() - client_p->localClient->firsttime) > timeout) {
-            if(IsAnyServer(client_p)) {
-                sendto_realops_snomask(SNO_GENERAL, is_remote_connect(client_p) ? L_NETWIDE : L_ALL,
-                                       "No response from %s, closing link",
-                                       client_p->name);
-                ilog(L_SERVER,
-                     "No response from %s, closing link",
-                     log_client_name(client_p, HIDE_IP));
-            }
-            exit_client(client_p, client_p, &me, "Connection timed out");
+    timeout = IsAnyServer(client_p) ? ConfigFileEntry.connect_timeout : 30;
+    if((rb_current_time() - client_p->localClient->firsttime) > timeout) {
+        if(IsAnyServer(client_p)) {
+            sendto_realops_snomask(SNO_GENERAL, is_remote_connect(client_p) ? L_NETWIDE : L_ALL,
+                                   "No response from %s, closing link",
+                                   client_p->name);
+            ilog(L_SERVER,
+                 "No response from %s, closing link",
+                 log_client_name(client_p, HIDE_IP));
         }
+        exit_client(client_p, client_p, &me, "Connection timed out");
+        return;
     }
+
+    rb_timer_set(&client_p->localClient->check_timer,
+                 client_p->localClient->firsttime + timeout + 1,
+                 check_client_timer, client_p);
+}
+
+/*
+ * check_client_timer
+ *
+ * inputs	- local client whose check timer expired
+ * output	- NONE
+ * side effects	- PING and registration timeouts are checked.
+ *
+ * Every local connection carries a single timer, armed for the next
+ * moment its state could call for action, so rather than sweeping the
+ * local lists every 30 seconds we only ever look at connections that
+ * are due.  Ping frequency changes from a rehash are picked up the next
+ * time a client's timer fires.
+ */
+static void
+check_client_timer(void *data)
+{
+    struct Client *client_p = data;
+
+    if(!MyConnect(client_p) || IsDead(client_p))
+        return;
+
+    if(IsClient(client_p) || IsServer(client_p))
+        check_pings_client(client_p);
+    else
+        check_unknown_client(client_p);
 }
 
 static void
@@ -424,6 +442,504 @@ notify_banned_client(struct Client *client_p, struct ConfItem *aconf, int ban)
                 ConfigFileEntry.kline_reason);
 }
 
+/*
+ * Local clients are indexed by address and by host, so a new K-line or
+ * D-line only has to look at the clients it could apply to instead of
+ * running find_kline()/find_dline() over every connection.  Addresses
+ * live in a patricia tree whose nodes hold the clients on that address,
+ * which a CIDR mask covers as one subtree.  Hosts and orighosts live in
+ * a trie of reversed domain labels, so "*.isp.net" covers the subtree
+ * under net -> isp.  Hosts that are just the textual address are left
+ * to the patricia tree.
+ */
+struct ClientHostNode {
+    char *label;
+    struct ClientHostNode *parent;
+    struct Dictionary *children;
+    rb_dlink_list clients;
+};
+
+static struct ClientHostNode client_host_trie;
+static unsigned int ban_check_serial;
+static rb_dlink_list kline_check_queue;	/* "user@host" waiting on kline_delay */
+
+void
+add_to_client_ip_index(struct Client *client_p)
+{
+    struct LocalUser *lclient_p = client_p->localClient;
+    rb_patricia_node_t *pnode;
+    rb_dlink_list *list;
+    int bitlen = 32;
+
+    if(lclient_p->ipnode != NULL)
+        return;
+
+#ifdef RB_IPV6
+    if(lclient_p->ip.ss_family == AF_INET6)
+        bitlen = 128;
+    else
+#endif
+        if(lclient_p->ip.ss_family != AF_INET)
+            return;
+
+    pnode = make_and_lookup_ip(client_ip_tree, (struct sockaddr *)&lclient_p->ip, bitlen);
+    if(pnode == NULL)
+        return;
+
+    if((list = pnode->data) == NULL)
+        pnode->data = list = rb_malloc(sizeof(rb_dlink_list));
+
+    rb_dlinkAdd(client_p, &lclient_p->ipnode_link, list);
+    lclient_p->ipnode = pnode;
+}
+
+void
+del_from_client_ip_index(struct Client *client_p)
+{
+    struct LocalUser *lclient_p = client_p->localClient;
+    rb_dlink_list *list;
+
+    if(lclient_p->ipnode == NULL)
+        return;
+
+    list = lclient_p->ipnode->data;
+    rb_dlinkDelete(&lclient_p->ipnode_link, list);
+
+    if(rb_dlink_list_length(list) == 0) {
+        rb_free(list);
+        rb_patricia_remove(client_ip_tree, lclient_p->ipnode);
+    }
+
+    lclient_p->ipnode = NULL;
+}
+
+static struct ClientHostNode *
+client_host_node_get(const char *host)
+{
+    struct ClientHostNode *node = &client_host_trie, *child;
+    char *h = LOCAL_COPY(host);
+    char *p, *label;
+
+    for(;;) {
+        p = strrchr(h, '.');
+        label = p != NULL ? p + 1 : h;
+
+        if(node->children == NULL)
+            node->children = irc_dictionary_create(irccmp);
+
+        if((child = irc_dictionary_retrieve(node->children, label)) == NULL) {
+            child = rb_malloc(sizeof(struct ClientHostNode));
+            child->label = rb_strdup(label);
+            child->parent = node;
+            irc_dictionary_add(node->children, child->label, child);
+        }
+
+        node = child;
+
+        if(p == NULL)
+            return node;
+
+        *p = '\0';
+    }
+}
+
+void
+add_to_client_host_index(struct Client *client_p)
+{
+    struct LocalUser *lclient_p = client_p->localClient;
+    const char *hosts[2];
+    int i;
+
+    hosts[0] = client_p->host;
+    hosts[1] = irccmp(client_p->host, client_p->orighost) ? client_p->orighost : NULL;
+
+    for(i = 0; i < 2; i++) {
+        if(EmptyString(hosts[i]) || lclient_p->hostnode[i] != NULL ||
+           !irccmp(hosts[i], client_p->sockhost))
+            continue;
+
+        lclient_p->hostnode[i] = client_host_node_get(hosts[i]);
+        rb_dlinkAdd(client_p, &lclient_p->hostnode_link[i],
+                    &lclient_p->hostnode[i]->clients);
+    }
+}
+
+void
+del_from_client_host_index(struct Client *client_p)
+{
+    struct LocalUser *lclient_p = client_p->localClient;
+    struct ClientHostNode *node, *parent;
+    int i;
+
+    for(i = 0; i < 2; i++) {
+        if((node = lclient_p->hostnode[i]) == NULL)
+            continue;
+
+        rb_dlinkDelete(&lclient_p->hostnode_link[i], &node->clients);
+        lclient_p->hostnode[i] = NULL;
+
+        while(node->parent != NULL && rb_dlink_list_length(&node->clients) == 0 &&
+              node->children == NULL) {
+            parent = node->parent;
+            irc_dictionary_delete(parent->children, node->label);
+            if(irc_dictionary_size(parent->children) == 0) {
+                irc_dictionary_destroy(parent->children, NULL, NULL);
+                parent->children = NULL;
+            }
+            rb_free(node->label);
+            rb_free(node);
+            node = parent;
+        }
+    }
+}
+
+/*
+ * The WHO index: each nick, username, host, original host and realname
+ * a WHO mask could match is kept once (ignoring case) as a WhoKey, listing
+ * the users carrying it.  The keys are held in two ordered dictionaries,
+ * by value and by value reversed, so the values starting or ending with
+ * a literal sit together and who_index_walk() finds them without looking
+ * at anyone else.
+ */
+static struct WhoKey *
+who_key_get(const char *name)
+{
+    struct WhoKey *key;
+    size_t len, i;
+
+    if((key = irc_dictionary_retrieve(who_key_dict, name)) != NULL)
+        return key;
+
+    len = strlen(name);
+    key = rb_malloc(sizeof(struct WhoKey));
+    key->name = rb_strdup(name);
+    key->rname = rb_malloc(len + 1);
+
+    for(i = 0; i < len; i++)
+        key->rname[i] = name[len - i - 1];
+
+    irc_dictionary_add(who_key_dict, key->name, key);
+    irc_dictionary_add(who_rkey_dict, key->rname, key);
+    return key;
+}
+
+static void
+who_key_put(struct WhoKey *key)
+{
+    if(rb_dlink_list_length(&key->users) > 0)
+        return;
+
+    irc_dictionary_delete(who_key_dict, key->name);
+    irc_dictionary_delete(who_rkey_dict, key->rname);
+    rb_free(key->name);
+    rb_free(key->rname);
+    rb_free(key);
+}
+
+/* add_to_who_index()
+ *
+ * inputs	- user to add
+ * outputs	-
+ * side effects - the user is listed under its nick, username, host,
+ *		  original host and realname.  Call del_from_who_index()
+ *		  before changing any of them, and this again after.
+ */
+void
+add_to_who_index(struct Client *client_p)
+{
+    struct User *user = client_p->user;
+    struct WhoKey *key;
+    const char *field[WHO_FIELDS];
+    int i, j;
+
+    if(user == NULL || user->who_key[0] != NULL)
+        return;
+
+    field[0] = client_p->name;
+    field[1] = client_p->username;
+    field[2] = client_p->host;
+    field[3] = client_p->orighost;
+    field[4] = client_p->info;
+
+    for(i = 0; i < WHO_FIELDS; i++) {
+        if(EmptyString(field[i]))
+            continue;
+
+        key = who_key_get(field[i]);
+
+        /* once under each value is enough, host and orighost mostly agree */
+        for(j = 0; j < i; j++)
+            if(user->who_key[j] == key)
+                break;
+
+        if(j < i)
+            continue;
+
+        user->who_key[i] = key;
+        rb_dlinkAdd(client_p, &user->who_node[i], &key->users);
+    }
+}
+
+void
+del_from_who_index(struct Client *client_p)
+{
+    struct User *user = client_p->user;
+    int i;
+
+    if(user == NULL)
+        return;
+
+    for(i = 0; i < WHO_FIELDS; i++) {
+        if(user->who_key[i] == NULL)
+            continue;
+
+        rb_dlinkDelete(&user->who_node[i], &user->who_key[i]->users);
+        who_key_put(user->who_key[i]);
+        user->who_key[i] = NULL;
+    }
+}
+
+/* who_index_walk()
+ *
+ * inputs	- literal, 1 if values should end with it rather than start
+ *		  with it, callback and its data
+ * outputs	-
+ * side effects - cb is called for each user listed under a value
+ *		  starting (or ending) with lit, so a user may be passed
+ *		  more than once
+ */
+void
+who_index_walk(const char *lit, int suffix, void (*cb)(struct Client *, void *), void *data)
+{
+    static char rlit[BUFSIZE];
+    struct Dictionary *dict = who_key_dict;
+    struct DictionaryElement *delem;
+    struct WhoKey *key;
+    rb_dlink_node *ptr;
+    size_t full, len, i;
+
+    full = len = strlen(lit);
+
+    if(len == 0)
+        return;
+
+    if(suffix) {
+        if(len >= sizeof(rlit))
+            len = sizeof(rlit) - 1;
+
+        /* the last len characters, last first */
+        for(i = 0; i < len; i++)
+            rlit[i] = lit[full - i - 1];
+
+        rlit[len] = '\0';
+        lit = rlit;
+        dict = who_rkey_dict;
+    }
+
+    for(delem = irc_dictionary_seek(dict, lit); delem != NULL; delem = delem->next) {
+        if(ircncmp(delem->key, lit, len))
+            break;
+
+        key = delem->data;
+
+        RB_DLINK_FOREACH(ptr, key->users.head)
+            cb(ptr->data, data);
+    }
+}
+
+/* ban_check_add()
+ *
+ * inputs	- client, list of clients to check
+ * outputs	-
+ * side effects - the client is put on the list, unless this check
+ *		  already has it
+ */
+static void
+ban_check_add(struct Client *client_p, rb_dlink_list *list)
+{
+    if(client_p->localClient->ban_check_serial == ban_check_serial)
+        return;
+
+    client_p->localClient->ban_check_serial = ban_check_serial;
+    rb_dlinkAddAlloc(client_p, list);
+}
+
+/* collect_ip_clients()
+ *
+ * inputs	- address and mask length of a ban, list to fill
+ * outputs	-
+ * side effects - every local client on an address inside the mask is
+ *		  put on the list
+ */
+static void
+collect_ip_clients(struct sockaddr *addr, int bits, rb_dlink_list *list)
+{
+    rb_patricia_node_t *node, *pnode;
+    rb_dlink_list *clients;
+    rb_dlink_node *ptr;
+    struct Client *client_p;
+    uint8_t *bytes;
+
+#ifdef RB_IPV6
+    if(addr->sa_family == AF_INET6)
+        bytes = (uint8_t *)&((struct sockaddr_in6 *)addr)->sin6_addr;
+    else
+#endif
+        bytes = (uint8_t *)&((struct sockaddr_in *)addr)->sin_addr;
+
+    /* everything below the first node past the mask shares its bits */
+    node = client_ip_tree->head;
+    while(node != NULL && node->bit < (unsigned int)bits) {
+        if(BIT_TEST(bytes[node->bit >> 3], 0x80 >> (node->bit & 0x07)))
+            node = node->r;
+        else
+            node = node->l;
+    }
+
+    if(node == NULL)
+        return;
+
+    RB_PATRICIA_WALK(node, pnode) {
+        clients = pnode->data;
+        client_p = clients->head->data;
+
+        if(client_p->localClient->ip.ss_family == addr->sa_family &&
+           comp_with_mask_sock((struct sockaddr *)&client_p->localClient->ip, addr, bits)) {
+            RB_DLINK_FOREACH(ptr, clients->head)
+                ban_check_add(ptr->data, list);
+        }
+    }
+    RB_PATRICIA_WALK_END;
+}
+
+static void
+collect_host_subtree(struct ClientHostNode *node, rb_dlink_list *list)
+{
+    struct ClientHostNode *child;
+    struct DictionaryIter iter;
+    rb_dlink_node *ptr;
+
+    RB_DLINK_FOREACH(ptr, node->clients.head)
+        ban_check_add(ptr->data, list);
+
+    if(node->children == NULL)
+        return;
+
+    DICTIONARY_FOREACH(child, &iter, node->children) {
+        collect_host_subtree(child, list);
+    }
+}
+
+/* collect_host_clients()
+ *
+ * inputs	- host mask of a ban, list to fill
+ * outputs	- 0 if the index cannot narrow this mask down, else 1
+ * side effects - every local client whose host or orighost could match
+ *		  the mask is put on the list
+ */
+static int
+collect_host_clients(const char *mask, rb_dlink_list *list)
+{
+    struct ClientHostNode *node = &client_host_trie;
+    const char *tail = mask, *s;
+    rb_dlink_node *ptr;
+    char *h, *p, *label;
+    int wild = 0;
+
+    /* the literal tail is what follows the first '.' after the
+     * last wildcard, as in the conf trie in hostmask.c
+     */
+    for(s = mask; *s != '\0'; s++) {
+        if(*s == '*' || *s == '?') {
+            wild = 1;
+            tail = NULL;
+        } else if(*s == '.' && tail == NULL)
+            tail = s + 1;
+    }
+
+    /* wildcards in the last label, or what may be a textual address,
+     * which is matched against sockhost and is not in this index
+     */
+    if(tail == NULL || strchr(mask, ':') != NULL)
+        return 0;
+
+    s = strrchr(tail, '.');
+    if(IsDigit(s != NULL ? s[1] : *tail))
+        return 0;
+
+    h = LOCAL_COPY(tail);
+    while(node->children != NULL) {
+        p = strrchr(h, '.');
+        label = p != NULL ? p + 1 : h;
+
+        if((node = irc_dictionary_retrieve(node->children, label)) == NULL)
+            return 1;
+
+        if(p == NULL) {
+            if(wild)
+                collect_host_subtree(node, list);
+            else
+                RB_DLINK_FOREACH(ptr, node->clients.head)
+                    ban_check_add(ptr->data, list);
+            return 1;
+        }
+
+        *p = '\0';
+    }
+
+    return 1;
+}
+
+/* collect_kline_clients()
+ *
+ * inputs	- host of a kline, list to fill
+ * outputs	- 0 if the indexes cannot narrow the kline down, else 1
+ * side effects - the local clients the kline could apply to are put
+ *		  on the list
+ */
+static int
+collect_kline_clients(const char *host, rb_dlink_list *list)
+{
+    struct rb_sockaddr_storage addr;
+    int bits, type;
+
+    type = parse_netmask(host, (struct sockaddr *)&addr, &bits);
+
+    if(type == HM_IPV4
+#ifdef RB_IPV6
+       || type == HM_IPV6
+#endif
+      ) {
+        collect_ip_clients((struct sockaddr *)&addr, bits, list);
+        return 1;
+    }
+
+    return collect_host_clients(host, list);
+}
+
+/* scan_kline_clients()
+ *
+ * inputs	- user and host of a kline, list to fill
+ * outputs	-
+ * side effects - the local clients the kline matches are put on the
+ *		  list, trying just this kline against every client
+ */
+static void
+scan_kline_clients(const char *user, const char *host, rb_dlink_list *list)
+{
+    struct Client *client_p;
+    rb_dlink_node *ptr;
+
+    RB_DLINK_FOREACH(ptr, lclient_list.head) {
+        client_p = ptr->data;
+
+        if(IsPerson(client_p) && match(user, client_p->username) &&
+           (match(host, client_p->host) || match(host, client_p->orighost) ||
+            match(host, client_p->sockhost)))
+            ban_check_add(client_p, list);
+    }
+}
+
 /*
  * check_banned_lines
  * inputs	- NONE
@@ -443,13 +959,117 @@ check_banned_lines(void)
  *
  * inputs	-
  * outputs	-
- * side effects - check_klines() is called, kline_queued unset
+ * side effects - the klines queued by queue_kline_check() are enforced,
+ *		  kline_queued unset
  */
 void
 check_klines_event(void *unused)
 {
+    rb_dlink_list list = { NULL, NULL, 0 };
+    rb_dlink_node *ptr, *next_ptr;
+    char *user, *host;
+    int scan_all = 0;
+
     kline_queued = 0;
-    check_klines();
+    ban_check_serial++;
+
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, kline_check_queue.head) {
+        user = ptr->data;
+        host = strchr(user, '@');
+        *host++ = '\0';
+
+        /* a single full pass covers every mask the indexes cannot */
+        if(!scan_all && !collect_kline_clients(host, &list))
+            scan_all = 1;
+
+        rb_free(user);
+        rb_dlinkDestroy(ptr, &kline_check_queue);
+    }
+
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list.head) {
+        if(!scan_all)
+            kline_client(ptr->data);
+        rb_dlinkDestroy(ptr, &list);
+    }
+
+    if(scan_all)
+        check_klines();
+}
+
+/* queue_kline_check()
+ *
+ * inputs	- user and host of a new kline
+ * outputs	-
+ * side effects - the kline is enforced by check_klines_event() after
+ *		  kline_delay
+ */
+void
+queue_kline_check(const char *user, const char *host)
+{
+    char buf[USERLEN + HOSTLEN + 2];
+
+    rb_snprintf(buf, sizeof(buf), "%s@%s", user, host);
+    rb_dlinkAddAlloc(rb_strdup(buf), &kline_check_queue);
+
+    if(kline_queued == 0) {
+        rb_event_addonce("check_klines", check_klines_event, NULL,
+                         ConfigFileEntry.kline_delay);
+        kline_queued = 1;
+    }
+}
+
+/* check_kline()
+ *
+ * inputs	- user and host of a new kline
+ * outputs	-
+ * side effects - the local clients the kline could apply to are checked
+ *		  for klines
+ */
+void
+check_kline(const char *user, const char *host)
+{
+    rb_dlink_list list = { NULL, NULL, 0 };
+    rb_dlink_node *ptr, *next_ptr;
+
+    ban_check_serial++;
+    if(!collect_kline_clients(host, &list))
+        scan_kline_clients(user, host, &list);
+
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list.head) {
+        kline_client(ptr->data);
+        rb_dlinkDestroy(ptr, &list);
+    }
+}
+
+/* kline_client()
+ *
+ * inputs	- local client
+ * outputs	-
+ * side effects - the client is exited if a kline applies to it
+ */
+static void
+kline_client(struct Client *client_p)
+{
+    struct ConfItem *aconf;
+
+    if(IsMe(client_p) || !IsPerson(client_p) || IsAnyDead(client_p))
+        return;
+
+    if((aconf = find_kline(client_p)) != NULL) {
+        if(IsExemptKline(client_p)) {
+            sendto_realops_snomask(SNO_GENERAL, L_ALL,
+                                   "KLINE over-ruled for %s, client is kline_exempt [%s@%s]",
+                                   get_client_name(client_p, HIDE_IP),
+                                   aconf->user, aconf->host);
+            return;
+        }
+
+        sendto_realops_snomask(SNO_GENERAL, L_ALL,
+                               "KLINE active for %s",
+                               get_client_name(client_p, HIDE_IP));
+
+        notify_banned_client(client_p, aconf, K_LINED);
+    }
 }
 
 /* check_klines
@@ -461,33 +1081,38 @@ check_klines_event(void *unused)
 void
 check_klines(void)
 {
-    struct Client *client_p;
-    struct ConfItem *aconf;
     rb_dlink_node *ptr;
     rb_dlink_node *next_ptr;
 
     RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head) {
-        client_p = ptr->data;
+        kline_client(ptr->data);
+    }
+}
 
-        if(IsMe(client_p) || !IsPerson(client_p))
-            continue;
+/* dline_client()
+ *
+ * inputs	- local client, registered or not
+ * outputs	-
+ * side effects - the client is exited if a dline applies to it
+ */
+static void
+dline_client(struct Client *client_p)
+{
+    struct ConfItem *aconf;
 
-        if((aconf = find_kline(client_p)) != NULL) {
-            if(IsExemptKline(client_p)) {
-                sendto_realops_snomask(SNO_GENERAL, L_ALL,
-                                       "KLINE over-ruled for %s, client is kline_exempt [%s@%s]",
-                                       get_client_name(client_p, HIDE_IP),
-                                       aconf->user, aconf->host);
-                continue;
-            }
+    if(IsMe(client_p) || IsServer(client_p) || IsAnyDead(client_p))
+        return;
+
+    if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip,client_p->localClient->ip.ss_family)) != NULL) {
+        if(aconf->status & CONF_EXEMPTDLINE)
+            return;
 
+        if(IsPerson(client_p))
             sendto_realops_snomask(SNO_GENERAL, L_ALL,
-                                   "KLINE active for %s",
+                                   "DLINE active for %s",
                                    get_client_name(client_p, HIDE_IP));
 
-            notify_banned_client(client_p, aconf, K_LINED);
-            continue;
-        }
+        notify_banned_client(client_p, aconf, D_LINED);
     }
 }
 
@@ -500,40 +1125,49 @@ check_klines(void)
 void
 check_dlines(void)
 {
-    struct Client *client_p;
-    struct ConfItem *aconf;
     rb_dlink_node *ptr;
     rb_dlink_node *next_ptr;
 
     RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head) {
-        client_p = ptr->data;
-
-        if(IsMe(client_p))
-            continue;
-
-        if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip,client_p->localClient->ip.ss_family)) != NULL) {
-            if(aconf->status & CONF_EXEMPTDLINE)
-                continue;
-
-            sendto_realops_snomask(SNO_GENERAL, L_ALL,
-                                   "DLINE active for %s",
-                                   get_client_name(client_p, HIDE_IP));
-
-            notify_banned_client(client_p, aconf, D_LINED);
-            continue;
-        }
+        dline_client(ptr->data);
     }
 
     /* dlines need to be checked against unknowns too */
     RB_DLINK_FOREACH_SAFE(ptr, next_ptr, unknown_list.head) {
-        client_p = ptr->data;
+        dline_client(ptr->data);
+    }
+}
 
-        if((aconf = find_dline((struct sockaddr *)&client_p->localClient->ip,client_p->localClient->ip.ss_family)) != NULL) {
-            if(aconf->status & CONF_EXEMPTDLINE)
-                continue;
+/* check_dline()
+ *
+ * inputs	- address mask of a new dline
+ * outputs	-
+ * side effects - the local clients inside the mask are checked for
+ *		  dlines
+ */
+void
+check_dline(const char *mask)
+{
+    rb_dlink_list list = { NULL, NULL, 0 };
+    rb_dlink_node *ptr, *next_ptr;
+    struct rb_sockaddr_storage addr;
+    int bits, type;
 
-            notify_banned_client(client_p, aconf, D_LINED);
-        }
+    type = parse_netmask(mask, (struct sockaddr *)&addr, &bits);
+
+    if(type != HM_IPV4
+#ifdef RB_IPV6
+       && type != HM_IPV6
+#endif
+      )
+        return;
+
+    ban_check_serial++;
+    collect_ip_clients((struct sockaddr *)&addr, bits, &list);
+
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, list.head) {
+        dline_client(ptr->data);
+        rb_dlinkDestroy(ptr, &list);
     }
 }
 
@@ -625,6 +1259,23 @@ release_client_state(struct Client *client_p)
     }
 }
 
+/*
+ * add_client_to_list
+ * inputs	- point to client to add
+ * output	- NONE
+ * side effects - the client goes on the end of global_client_list,
+ *		  numbered so who_global() can put WHO index results back
+ *		  into list order
+ */
+void
+add_client_to_list(struct Client *client_p)
+{
+    static unsigned long list_serial;
+
+    client_p->listserial = ++list_serial;
+    rb_dlinkAddTail(client_p, &client_p->node, &global_client_list);
+}
+
 /*
  * remove_client_from_list
  * inputs	- point to client to remove
@@ -649,6 +1300,7 @@ remove_client_from_list(struct Client *client_p)
     if(client_p->node.prev == NULL && client_p->node.next == NULL)
         return;
 
+    burst_list_fixup(&client_p->node);
     rb_dlinkDelete(&client_p->node, &global_client_list);
 
     update_client_exit_stats(client_p);
@@ -718,6 +1370,53 @@ find_chasing(struct Client *source_p, const char *user, int *chasing)
     return who;
 }
 
+/*
+ * get_client_prefix - Return the source prefix used when relaying
+ *      something from this client to local users, ":nick!user@host"
+ *      for users and ":name" for servers, without a trailing space.
+ *
+ * For users the prefix is rendered once and kept on the client, so
+ * whatever changes the nick, username or host must call
+ * invalidate_client_prefix() afterwards.
+ */
+const char *
+get_client_prefix(struct Client *client, size_t *len)
+{
+    static char nbuf[HOSTLEN * 2 + USERLEN + 5];
+    int plen;
+
+    if(IsServer(client) || IsMe(client)) {
+        plen = rb_snprintf(nbuf, sizeof(nbuf), ":%s", client->name);
+        *len = (size_t)plen < sizeof(nbuf) ? (size_t)plen : sizeof(nbuf) - 1;
+        return nbuf;
+    }
+
+    if(!IsPerson(client)) {
+        plen = rb_snprintf(nbuf, sizeof(nbuf), ":%s!%s@%s",
+                           client->name, client->username, client->host);
+        *len = (size_t)plen < sizeof(nbuf) ? (size_t)plen : sizeof(nbuf) - 1;
+        return nbuf;
+    }
+
+    if(client->prefix == NULL) {
+        plen = rb_snprintf(nbuf, sizeof(nbuf), ":%s!%s@%s",
+                           client->name, client->username, client->host);
+        client->prefixlen = (size_t)plen < sizeof(nbuf) ? (size_t)plen : sizeof(nbuf) - 1;
+        client->prefix = rb_malloc(client->prefixlen + 1);
+        memcpy(client->prefix, nbuf, client->prefixlen + 1);
+    }
+
+    *len = client->prefixlen;
+    return client->prefix;
+}
+
+void
+invalidate_client_prefix(struct Client *client)
+{
+    rb_free(client->prefix);
+    client->prefix = NULL;
+}
+
 /*
  * get_client_name -  Return the name of the client
  *    for various tracking and
@@ -1002,6 +1701,11 @@ remove_dependents(struct Client *client_p,
         recurse_send_quits(client_p, source_p, to, comment1, comment);
     }
 
+    /* tell our users about the whole split in one go, rather than
+     * one QUIT fanout per departing user
+     */
+    sendto_netsplit_local(source_p, comment1);
+
     recurse_remove_clients(source_p, comment1);
 }
 
@@ -1087,9 +1791,11 @@ exit_generic_client(struct Client *client_p, struct Client *source_p, struct Cli
     /* get rid of any metadata the user may have */
     user_metadata_clear(source_p);
 
-    sendto_common_channels_local(source_p, NOCAPS, ":%s!%s@%s QUIT :%s",
-                                 source_p->name,
-                                 source_p->username, source_p->host, comment);
+    /* unless sendto_netsplit_local() already told our users */
+    if(!(source_p->flags & FLAGS_SPLITQUIT))
+        sendto_common_channels_local(source_p, NOCAPS, ":%s!%s@%s QUIT :%s",
+                                     source_p->name,
+                                     source_p->username, source_p->host, comment);
 
     remove_user_from_channels(source_p);
 
@@ -1113,6 +1819,7 @@ exit_generic_client(struct Client *client_p, struct Client *source_p, struct Cli
         del_from_id_hash(source_p->id, source_p);
 
     del_from_hostname_hash(source_p->orighost, source_p);
+    del_from_who_index(source_p);
     del_from_client_hash(source_p->name, source_p);
     remove_client_from_list(source_p);
 }
@@ -1264,6 +1971,7 @@ exit_local_server(struct Client *client_p, struct Client *source_p, struct Clien
     static char newcomment[BUFSIZE];
     unsigned int sendk, recvk;
 
+    burst_abort(source_p);
     rb_dlinkDelete(&source_p->localClient->tnode, &serv_list);
     rb_dlinkFindDestroy(source_p, &global_serv_list);
 
@@ -1730,6 +2438,8 @@ close_connection(struct Client *client_p)
     if(!MyConnect(client_p))
         return;
 
+    burst_abort(client_p);
+
     if(IsServer(client_p)) {
         struct server_conf *server_p;
 
@@ -0,0 +1,353 @@
+/* src/cryptdi.c
+ * An interface to the cryptd password hash helpers.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ *  USA
+ *
+ * Checking a password against a SHA-512 or bcrypt hash takes
+ * milliseconds, which is far too long to spend in the event loop when
+ * thousands of clients reconnect at once.  crypt_verify() hands the
+ * check to one of CRYPTD_COUNT helper processes and the answer comes
+ * back through a callback.  Each helper answers in the order it was
+ * asked, so its pending checks are a simple queue.  A client has at
+ * most one check outstanding, which crypt_cancel() drops when the
+ * client is freed.  Modules drop the checks waiting on their callbacks
+ * with crypt_cancel_callback() before they are unloaded.
+ */
+#include "stdinc.h"
+#include "ratbox_lib.h"
+#include "client.h"
+#include "s_conf.h"
+#include "logger.h"
+#include "send.h"
+#include "ircd.h"
+#include "msg.h"	/* XXX: MAXPARA */
+#include "cryptdi.h"
+
+struct CryptRequest {
+    rb_dlink_node node;
+    unsigned int id;
+    struct Client *client_p;
+    char *password;
+    char *hash;
+    CRYPTCB *callback;
+    void *data;
+};
+
+struct CryptStats crypt_stats;
+
+static rb_helper *cryptd_helper[CRYPTD_COUNT];
+static rb_dlink_list cryptd_pending[CRYPTD_COUNT];
+static char *cryptd_path;
+static unsigned int cryptd_id;
+
+static int start_cryptd(int);
+static void cryptd_parse(rb_helper *);
+static void cryptd_restart_cb(rb_helper *);
+
+void
+init_cryptd(void)
+{
+    int i;
+
+    for(i = 0; i < CRYPTD_COUNT; i++) {
+        if(start_cryptd(i)) {
+            ilog(L_MAIN, "Unable to start cryptd helper, checking passwords inline");
+            break;
+        }
+    }
+}
+
+static int
+start_cryptd(int i)
+{
+    char fullpath[PATH_MAX + 1];
+#ifdef _WIN32
+    const char *suffix = ".exe";
+#else
+    const char *suffix = "";
+#endif
+
+    if(cryptd_path == NULL) {
+        rb_snprintf(fullpath, sizeof(fullpath), "%s/cryptd%s", PKGLIBEXECDIR, suffix);
+
+        if(access(fullpath, X_OK) == -1) {
+            rb_snprintf(fullpath, sizeof(fullpath), "%s/bin/cryptd%s",
+                        ConfigFileEntry.dpath, suffix);
+
+            if(access(fullpath, X_OK) == -1) {
+                ilog(L_MAIN,
+                     "Unable to execute cryptd%s in %s or %s/bin",
+                     suffix, PKGLIBEXECDIR, ConfigFileEntry.dpath);
+                return 1;
+            }
+        }
+        cryptd_path = rb_strdup(fullpath);
+    }
+
+    cryptd_helper[i] = rb_helper_start("cryptd", cryptd_path, cryptd_parse, cryptd_restart_cb);
+
+    if(cryptd_helper[i] == NULL) {
+        ilog(L_MAIN, "Unable to start cryptd: %s", strerror(errno));
+        sendto_realops_snomask(SNO_GENERAL, L_ALL, "Unable to start cryptd: %s",
+                               strerror(errno));
+        return 1;
+    }
+
+    rb_helper_run(cryptd_helper[i]);
+    return 0;
+}
+
+static int
+cryptd_index(rb_helper *helper)
+{
+    int i;
+
+    for(i = 0; i < CRYPTD_COUNT; i++)
+        if(cryptd_helper[i] == helper)
+            return i;
+
+    return -1;
+}
+
+static int
+crypt_inline(const char *password, const char *hash)
+{
+    const char *encr;
+
+    crypt_stats.inline_checks++;
+    encr = rb_crypt(password, hash);
+
+    return (encr != NULL && !strcmp(encr, hash)) ? CRYPT_MATCH : CRYPT_NOMATCH;
+}
+
+static void
+free_crypt_request(struct CryptRequest *req)
+{
+    memset(req->password, 0, strlen(req->password));
+    rb_free(req->password);
+    rb_free(req->hash);
+    rb_free(req);
+}
+
+/* crypt_done()
+ *
+ * inputs	- finished check, its helper slot, the result
+ * outputs	-
+ * side effects - the check is taken off its queue, the callback is run
+ *		  unless the check was cancelled
+ */
+static void
+crypt_done(struct CryptRequest *req, int i, int result)
+{
+    struct Client *client_p = req->client_p;
+
+    rb_dlinkDelete(&req->node, &cryptd_pending[i]);
+    crypt_stats.pending--;
+
+    if(req->callback != NULL) {
+        if(client_p != NULL) {
+            client_p->localClient->crypt_req = NULL;
+
+            if(IsAnyDead(client_p))
+                client_p = NULL;
+        }
+
+        req->callback(client_p, result, req->data);
+    }
+
+    free_crypt_request(req);
+}
+
+/* crypt_verify()
+ *
+ * inputs	- local client, password, hash from the conf, callback
+ *		  and its data
+ * outputs	- CRYPT_MATCH or CRYPT_NOMATCH if the check was done here,
+ *		  CRYPT_QUEUED if the callback will be given the result, or
+ *		  CRYPT_BUSY if too many checks are waiting
+ * side effects - the check may be handed to a cryptd helper
+ */
+int
+crypt_verify(struct Client *client_p, const char *password, const char *hash,
+             CRYPTCB *callback, void *data)
+{
+    struct CryptRequest *req;
+    int i, best = -1;
+
+    if(client_p->localClient->crypt_req != NULL ||
+       crypt_stats.pending >= CRYPTD_MAX_PENDING) {
+        crypt_stats.busy++;
+        return CRYPT_BUSY;
+    }
+
+    /* cryptd has to get the whole thing on one helper line */
+    if(strlen(password) + strlen(hash) > 400 || strchr(hash, ' ') != NULL)
+        return crypt_inline(password, hash);
+
+    for(i = 0; i < CRYPTD_COUNT; i++) {
+        if(cryptd_helper[i] == NULL)
+            continue;
+
+        if(best < 0 || rb_dlink_list_length(&cryptd_pending[i]) <
+           rb_dlink_list_length(&cryptd_pending[best]))
+            best = i;
+    }
+
+    if(best < 0)
+        return crypt_inline(password, hash);
+
+    req = rb_malloc(sizeof(struct CryptRequest));
+    req->id = ++cryptd_id;
+    req->client_p = client_p;
+    req->password = rb_strdup(password);
+    req->hash = rb_strdup(hash);
+    req->callback = callback;
+    req->data = data;
+
+    rb_dlinkAddTail(req, &req->node, &cryptd_pending[best]);
+    client_p->localClient->crypt_req = req;
+
+    crypt_stats.queued++;
+    if(++crypt_stats.pending > crypt_stats.peak)
+        crypt_stats.peak = crypt_stats.pending;
+
+    rb_helper_write(cryptd_helper[best], "C %u %s %s", req->id, hash, password);
+    return CRYPT_QUEUED;
+}
+
+/* crypt_cancel()
+ *
+ * inputs	- local client
+ * outputs	-
+ * side effects - the client's outstanding check, if any, is forgotten
+ *		  and its callback told so
+ */
+void
+crypt_cancel(struct Client *client_p)
+{
+    struct CryptRequest *req = client_p->localClient->crypt_req;
+    CRYPTCB *callback;
+
+    if(req == NULL)
+        return;
+
+    client_p->localClient->crypt_req = NULL;
+    req->client_p = NULL;
+
+    /* the reply is still to come, and is dropped then */
+    callback = req->callback;
+    req->callback = NULL;
+    callback(NULL, CRYPT_NOMATCH, req->data);
+}
+
+/* crypt_cancel_callback()
+ *
+ * inputs	- callback that is about to be unloaded
+ * outputs	-
+ * side effects - every outstanding check for the callback is forgotten,
+ *		  and the callback told CRYPT_BUSY for each while it can
+ *		  still be called
+ */
+void
+crypt_cancel_callback(CRYPTCB *callback)
+{
+    struct CryptRequest *req;
+    struct Client *client_p;
+    rb_dlink_node *ptr;
+    int i;
+
+    for(i = 0; i < CRYPTD_COUNT; i++) {
+        RB_DLINK_FOREACH(ptr, cryptd_pending[i].head) {
+            req = ptr->data;
+
+            if(req->callback != callback)
+                continue;
+
+            /* the reply is still to come, and is dropped then */
+            client_p = req->client_p;
+            req->client_p = NULL;
+            req->callback = NULL;
+
+            if(client_p != NULL) {
+                client_p->localClient->crypt_req = NULL;
+
+                if(IsAnyDead(client_p))
+                    client_p = NULL;
+            }
+
+            callback(client_p, CRYPT_BUSY, req->data);
+        }
+    }
+}
+
+static void
+cryptd_parse(rb_helper *helper)
+{
+    static char buf[READBUF_SIZE];
+    char *parv[MAXPARA + 1];
+    struct CryptRequest *req;
+    rb_dlink_node *ptr;
+    unsigned int id;
+    int len, parc, i;
+
+    if((i = cryptd_index(helper)) < 0)
+        return;
+
+    while((len = rb_helper_read(helper, buf, sizeof(buf)))) {
+        parc = rb_string_to_array(buf, parv, MAXPARA);
+
+        if(parc < 3 || parv[0][0] != 'R')
+            continue;
+
+        id = strtoul(parv[1], NULL, 10);
+
+        /* replies come in order, so this is nearly always the head */
+        RB_DLINK_FOREACH(ptr, cryptd_pending[i].head) {
+            req = ptr->data;
+
+            if(req->id == id) {
+                crypt_done(req, i, atoi(parv[2]) ? CRYPT_MATCH : CRYPT_NOMATCH);
+                break;
+            }
+        }
+    }
+}
+
+static void
+cryptd_restart_cb(rb_helper *helper)
+{
+    struct CryptRequest *req;
+    rb_dlink_node *ptr, *next_ptr;
+    int i;
+
+    if((i = cryptd_index(helper)) < 0)
+        return;
+
+    ilog(L_MAIN, "cryptd - cryptd_restart_cb called, cryptd helper died?");
+    sendto_realops_snomask(SNO_GENERAL, L_ALL,
+                           "cryptd - cryptd_restart_cb called, cryptd helper died?");
+
+    rb_helper_close(helper);
+    cryptd_helper[i] = NULL;
+
+    /* nobody is left to answer these, so answer them here */
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, cryptd_pending[i].head) {
+        req = ptr->data;
+        crypt_done(req, i, crypt_inline(req->password, req->hash));
+    }
+
+    start_cryptd(i);
+}
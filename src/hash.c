@@ -40,13 +40,9 @@
 
 #define hash_cli_fd(x)	(x % CLI_FD_MAX)
 
-static rb_dlink_list clientbyfdTable[U_MAX];
+static rb_dlink_list clientbyfdTable[CLI_FD_MAX];
 
-rb_dlink_list *clientTable;
-rb_dlink_list *channelTable;
-rb_dlink_list *idTable;
 rb_dlink_list *resvTable;
-rb_dlink_list *hostTable;
 
 /*
  * look in whowas.c for the missing ...[WW_MAX]; entry
@@ -55,28 +51,24 @@ rb_dlink_list *hostTable;
 /*
  * Hashing.
  *
- *   The server uses a chained hash table to provide quick and efficient
- * hash table maintenance (providing the hash function works evenly over
- * the input range).  The hash table is thus not susceptible to problems
- * of filling all the buckets or the need to rehash.
- *    It is expected that the hash table would look something like this
- * during use:
- *                   +-----+    +-----+    +-----+   +-----+
- *                ---| 224 |----| 225 |----| 226 |---| 227 |---
- *                   +-----+    +-----+    +-----+   +-----+
- *                      |          |          |
- *                   +-----+    +-----+    +-----+
- *                   |  A  |    |  C  |    |  D  |
- *                   +-----+    +-----+    +-----+
- *                      |
- *                   +-----+
- *                   |  B  |
- *                   +-----+
- *
- * A - GOPbot, B - chang, C - hanuaway, D - *.mu.OZ.AU
- *
- * The order shown above is just one instant of the server.
- *
+ *   Clients, ids, channels and hostnames live in open addressing hash
+ * tables.  Each slot holds the full 32 bit hash of its entry along with
+ * a pointer to it, so a probe only has to follow the pointer and compare
+ * names when the hashes already match, and a run of neighbouring slots
+ * is usually a single cache line.  Collisions are resolved by linear
+ * probing, and removal shifts the rest of the run back, so a table never
+ * fills up with deleted markers.
+ *
+ *   The tables start small and double once they are three quarters
+ * full, or halve once they drop below an eighth.  Rather than rehash
+ * everything at once, which would stall a hub with a few hundred
+ * thousand clients, the old slots are kept and moved over a few at a
+ * time by every later add and delete.  Until that is done a lookup that
+ * misses the new slots also looks in the old ones, and a delete there
+ * just leaves a marker behind, since the old slots are going away.
+ *
+ *   The resv table is small and rarely looked at, and is still a plain
+ * chained table.
  *
  * The hash functions currently used are based Fowler/Noll/Vo hashes
  * which work amazingly well and have a extremely low collision rate
@@ -85,6 +77,60 @@ rb_dlink_list *hostTable;
  *
  */
 
+#define HASH_MIN_SIZE		1024	/* slots, always a power of two */
+#define HASH_REHASH_STEP	64	/* old slots moved per add/delete */
+
+#define hash_slot_index(h, mask)	(((h) ^ ((h) >> 16)) & (mask))
+
+struct hash_slot {
+    u_int32_t hashv;
+    void *data;
+};
+
+struct hash_table {
+    const char *name;
+
+    struct hash_slot *slots;
+    unsigned int size;
+    unsigned int count;
+
+    /* slots being moved into the new ones after a resize */
+    struct hash_slot *old;
+    unsigned int old_size;
+    unsigned int rehash_idx;
+
+    unsigned long lookups;
+    unsigned long probes;
+    unsigned long resizes;
+};
+
+typedef int HASH_MATCH(void *data, const void *key);
+
+/* marks an entry deleted from the old slots during a resize */
+static char hash_deleted;
+#define HASH_DELETED	((void *) &hash_deleted)
+
+static struct hash_table client_table;
+static struct hash_table id_table;
+static struct hash_table channel_table;
+static struct hash_table host_table;
+
+/* every client on a hostname, kept under one entry in host_table */
+struct HostHash {
+    rb_dlink_list clients;
+    char host[HOSTLEN + 1];
+};
+
+static rb_bh *hosthash_heap;
+
+static void
+init_hash_table(struct hash_table *table, const char *name)
+{
+    table->name = name;
+    table->size = HASH_MIN_SIZE;
+    table->slots = rb_malloc(sizeof(struct hash_slot) * table->size);
+}
+
 /* init_hash()
  *
  * clears the various hashtables
@@ -92,10 +138,11 @@ rb_dlink_list *hostTable;
 void
 init_hash(void)
 {
-    clientTable = rb_malloc(sizeof(rb_dlink_list) * U_MAX);
-    idTable = rb_malloc(sizeof(rb_dlink_list) * U_MAX);
-    channelTable = rb_malloc(sizeof(rb_dlink_list) * CH_MAX);
-    hostTable = rb_malloc(sizeof(rb_dlink_list) * HOST_MAX);
+    init_hash_table(&client_table, "Client");
+    init_hash_table(&id_table, "ID");
+    init_hash_table(&channel_table, "Channel");
+    init_hash_table(&host_table, "Hostname");
+    hosthash_heap = rb_bh_create(sizeof(struct HostHash), 1024, "hosthash_heap");
     resvTable = rb_malloc(sizeof(rb_dlink_list) * R_MAX);
 }
 
@@ -164,7 +211,7 @@ fnv_hash_upper_len(const unsigned char *s, int bits, int len)
 static u_int32_t
 hash_nick(const char *name)
 {
-    return fnv_hash_upper((const unsigned char *) name, U_MAX_BITS);
+    return fnv_hash_upper((const unsigned char *) name, 32);
 }
 
 /* hash_id()
@@ -174,7 +221,7 @@ hash_nick(const char *name)
 static u_int32_t
 hash_id(const char *name)
 {
-    return fnv_hash((const unsigned char *) name, U_MAX_BITS);
+    return fnv_hash((const unsigned char *) name, 32);
 }
 
 /* hash_channel()
@@ -184,7 +231,7 @@ hash_id(const char *name)
 static u_int32_t
 hash_channel(const char *name)
 {
-    return fnv_hash_upper_len((const unsigned char *) name, CH_MAX_BITS, 30);
+    return fnv_hash_upper_len((const unsigned char *) name, 32, 30);
 }
 
 /* hash_hostname()
@@ -195,7 +242,7 @@ hash_channel(const char *name)
 static u_int32_t
 hash_hostname(const char *name)
 {
-    return fnv_hash_upper_len((const unsigned char *) name, HOST_MAX_BITS, 30);
+    return fnv_hash_upper_len((const unsigned char *) name, 32, 30);
 }
 
 /* hash_resv()
@@ -208,6 +255,232 @@ hash_resv(const char *name)
     return fnv_hash_upper_len((const unsigned char *) name, R_MAX_BITS, 30);
 }
 
+/* hash_probe()
+ *
+ * inputs	- table, slots to look in and their size, hash, match
+ *		  function and the key it is given
+ * outputs	- matching entry, or NULL
+ * side effects - the probe is counted for hash_stats()
+ */
+static void *
+hash_probe(struct hash_table *table, struct hash_slot *slots, unsigned int size,
+           u_int32_t hashv, HASH_MATCH *match, const void *key)
+{
+    unsigned int mask = size - 1;
+    unsigned int i = hash_slot_index(hashv, mask);
+    void *data;
+
+    table->lookups++;
+
+    for(;; i = (i + 1) & mask) {
+        table->probes++;
+        data = slots[i].data;
+
+        if(data == NULL)
+            return NULL;
+
+        if(data != HASH_DELETED && slots[i].hashv == hashv && match(data, key))
+            return data;
+    }
+}
+
+static void *
+hash_find(struct hash_table *table, u_int32_t hashv, HASH_MATCH *match, const void *key)
+{
+    void *data;
+
+    if((data = hash_probe(table, table->slots, table->size, hashv, match, key)) != NULL)
+        return data;
+
+    if(table->old != NULL)
+        return hash_probe(table, table->old, table->old_size, hashv, match, key);
+
+    return NULL;
+}
+
+/* hash_place()
+ *
+ * inputs	- slots, their size, hash and entry
+ * outputs	-
+ * side effects - entry is put in the first free slot from its home
+ */
+static void
+hash_place(struct hash_slot *slots, unsigned int size, u_int32_t hashv, void *data)
+{
+    unsigned int mask = size - 1;
+    unsigned int i = hash_slot_index(hashv, mask);
+
+    while(slots[i].data != NULL)
+        i = (i + 1) & mask;
+
+    slots[i].hashv = hashv;
+    slots[i].data = data;
+}
+
+/* hash_migrate()
+ *
+ * inputs	- table, number of old slots to move
+ * outputs	-
+ * side effects - up to that many old slots are moved into the new ones,
+ *		  and the old slots are freed once they are all moved
+ */
+static void
+hash_migrate(struct hash_table *table, unsigned int steps)
+{
+    struct hash_slot *slot;
+
+    while(table->old != NULL && steps-- > 0) {
+        slot = &table->old[table->rehash_idx];
+
+        /* empty slots stay empty, so old probes still stop there */
+        if(slot->data != NULL && slot->data != HASH_DELETED) {
+            hash_place(table->slots, table->size, slot->hashv, slot->data);
+            slot->data = HASH_DELETED;
+        }
+
+        if(++table->rehash_idx == table->old_size) {
+            rb_free(table->old);
+            table->old = NULL;
+            table->old_size = 0;
+            table->rehash_idx = 0;
+        }
+    }
+}
+
+/* hash_resize()
+ *
+ * inputs	- table
+ * outputs	-
+ * side effects - a table out of its load range starts moving to new
+ *		  slots twice or half the size
+ */
+static void
+hash_resize(struct hash_table *table)
+{
+    unsigned int size;
+
+    if(table->old != NULL)
+        return;
+
+    if(table->count * 4 > table->size * 3)
+        size = table->size * 2;
+    else if(table->size > HASH_MIN_SIZE && table->count * 8 < table->size)
+        size = table->size / 2;
+    else
+        return;
+
+    table->old = table->slots;
+    table->old_size = table->size;
+    table->rehash_idx = 0;
+
+    table->slots = rb_malloc(sizeof(struct hash_slot) * size);
+    table->size = size;
+    table->resizes++;
+
+    hash_migrate(table, HASH_REHASH_STEP);
+}
+
+static void
+hash_add(struct hash_table *table, u_int32_t hashv, void *data)
+{
+    hash_migrate(table, HASH_REHASH_STEP);
+    hash_place(table->slots, table->size, hashv, data);
+    table->count++;
+    hash_resize(table);
+}
+
+/* hash_delete()
+ *
+ * inputs	- table, hash and entry
+ * outputs	-
+ * side effects - entry is removed.  In the new slots the rest of its
+ *		  run is shifted back to close the gap, in the old slots
+ *		  it is just marked deleted.
+ */
+static void
+hash_delete(struct hash_table *table, u_int32_t hashv, void *data)
+{
+    struct hash_slot *slots = table->slots;
+    unsigned int mask = table->size - 1;
+    unsigned int i, j, k;
+
+    for(i = hash_slot_index(hashv, mask); slots[i].data != NULL; i = (i + 1) & mask) {
+        if(slots[i].data != data)
+            continue;
+
+        for(j = i;;) {
+            j = (j + 1) & mask;
+
+            if(slots[j].data == NULL)
+                break;
+
+            k = hash_slot_index(slots[j].hashv, mask);
+
+            /* move it back unless its home lies between the gap and it */
+            if((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+                continue;
+
+            slots[i] = slots[j];
+            i = j;
+        }
+
+        slots[i].data = NULL;
+        goto deleted;
+    }
+
+    if(table->old == NULL)
+        return;
+
+    slots = table->old;
+    mask = table->old_size - 1;
+
+    for(i = hash_slot_index(hashv, mask); slots[i].data != NULL; i = (i + 1) & mask) {
+        if(slots[i].data == data) {
+            slots[i].data = HASH_DELETED;
+            goto deleted;
+        }
+    }
+
+    return;
+
+deleted:
+    table->count--;
+    hash_migrate(table, HASH_REHASH_STEP);
+    hash_resize(table);
+}
+
+static int
+match_client_name(void *data, const void *key)
+{
+    return irccmp(key, ((struct Client *) data)->name) == 0;
+}
+
+static int
+match_server_name(void *data, const void *key)
+{
+    struct Client *target_p = data;
+
+    return (IsServer(target_p) || IsMe(target_p)) && irccmp(key, target_p->name) == 0;
+}
+
+static int
+match_client_id(void *data, const void *key)
+{
+    return strcmp(key, ((struct Client *) data)->id) == 0;
+}
+
+static int
+match_channel_name(void *data, const void *key)
+{
+    return irccmp(key, ((struct Channel *) data)->chname) == 0;
+}
+
+static int
+match_hostname(void *data, const void *key)
+{
+    return irccmp(key, ((struct HostHash *) data)->host) == 0;
+}
+
 /* add_to_id_hash()
  *
  * adds an entry to the id hash table
@@ -215,13 +488,10 @@ hash_resv(const char *name)
 void
 add_to_id_hash(const char *name, struct Client *client_p)
 {
-    unsigned int hashv;
-
     if(EmptyString(name) || (client_p == NULL))
         return;
 
-    hashv = hash_id(name);
-    rb_dlinkAddAlloc(client_p, &idTable[hashv]);
+    hash_add(&id_table, hash_id(name), client_p);
 }
 
 /* add_to_client_hash()
@@ -231,15 +501,12 @@ add_to_id_hash(const char *name, struct Client *client_p)
 void
 add_to_client_hash(const char *name, struct Client *client_p)
 {
-    unsigned int hashv;
-
     s_assert(name != NULL);
     s_assert(client_p != NULL);
     if(EmptyString(name) || (client_p == NULL))
         return;
 
-    hashv = hash_nick(name);
-    rb_dlinkAddAlloc(client_p, &clientTable[hashv]);
+    hash_add(&client_table, hash_nick(name), client_p);
 }
 
 /* add_to_hostname_hash()
@@ -249,7 +516,8 @@ add_to_client_hash(const char *name, struct Client *client_p)
 void
 add_to_hostname_hash(const char *hostname, struct Client *client_p)
 {
-    unsigned int hashv;
+    struct HostHash *hosthash;
+    u_int32_t hashv;
 
     s_assert(hostname != NULL);
     s_assert(client_p != NULL);
@@ -257,7 +525,14 @@ add_to_hostname_hash(const char *hostname, struct Client *client_p)
         return;
 
     hashv = hash_hostname(hostname);
-    rb_dlinkAddAlloc(client_p, &hostTable[hashv]);
+
+    if((hosthash = hash_find(&host_table, hashv, match_hostname, hostname)) == NULL) {
+        hosthash = rb_bh_alloc(hosthash_heap);
+        rb_strlcpy(hosthash->host, hostname, sizeof(hosthash->host));
+        hash_add(&host_table, hashv, hosthash);
+    }
+
+    rb_dlinkAddAlloc(client_p, &hosthash->clients);
 }
 
 /* add_to_resv_hash()
@@ -285,15 +560,12 @@ add_to_resv_hash(const char *name, struct ConfItem *aconf)
 void
 del_from_id_hash(const char *id, struct Client *client_p)
 {
-    unsigned int hashv;
-
     s_assert(id != NULL);
     s_assert(client_p != NULL);
     if(EmptyString(id) || client_p == NULL)
         return;
 
-    hashv = hash_id(id);
-    rb_dlinkFindDestroy(client_p, &idTable[hashv]);
+    hash_delete(&id_table, hash_id(id), client_p);
 }
 
 /* del_from_client_hash()
@@ -303,16 +575,13 @@ del_from_id_hash(const char *id, struct Client *client_p)
 void
 del_from_client_hash(const char *name, struct Client *client_p)
 {
-    unsigned int hashv;
-
     /* no s_asserts, this can happen when removing a client that
      * is unregistered.
      */
     if(EmptyString(name) || client_p == NULL)
         return;
 
-    hashv = hash_nick(name);
-    rb_dlinkFindDestroy(client_p, &clientTable[hashv]);
+    hash_delete(&client_table, hash_nick(name), client_p);
 }
 
 /* del_from_channel_hash()
@@ -322,16 +591,13 @@ del_from_client_hash(const char *name, struct Client *client_p)
 void
 del_from_channel_hash(const char *name, struct Channel *chptr)
 {
-    unsigned int hashv;
-
     s_assert(name != NULL);
     s_assert(chptr != NULL);
 
     if(EmptyString(name) || chptr == NULL)
         return;
 
-    hashv = hash_channel(name);
-    rb_dlinkFindDestroy(chptr, &channelTable[hashv]);
+    hash_delete(&channel_table, hash_channel(name), chptr);
 }
 
 /* del_from_hostname_hash()
@@ -341,14 +607,23 @@ del_from_channel_hash(const char *name, struct Channel *chptr)
 void
 del_from_hostname_hash(const char *hostname, struct Client *client_p)
 {
-    unsigned int hashv;
+    struct HostHash *hosthash;
+    u_int32_t hashv;
 
     if(hostname == NULL || client_p == NULL)
         return;
 
     hashv = hash_hostname(hostname);
 
-    rb_dlinkFindDestroy(client_p, &hostTable[hashv]);
+    if((hosthash = hash_find(&host_table, hashv, match_hostname, hostname)) == NULL)
+        return;
+
+    rb_dlinkFindDestroy(client_p, &hosthash->clients);
+
+    if(rb_dlink_list_length(&hosthash->clients) == 0) {
+        hash_delete(&host_table, hashv, hosthash);
+        rb_bh_free(hosthash_heap, hosthash);
+    }
 }
 
 /* del_from_resv_hash()
@@ -377,23 +652,10 @@ del_from_resv_hash(const char *name, struct ConfItem *aconf)
 struct Client *
 find_id(const char *name)
 {
-    struct Client *target_p;
-    rb_dlink_node *ptr;
-    unsigned int hashv;
-
     if(EmptyString(name))
         return NULL;
 
-    hashv = hash_id(name);
-
-    RB_DLINK_FOREACH(ptr, idTable[hashv].head) {
-        target_p = ptr->data;
-
-        if(strcmp(name, target_p->id) == 0)
-            return target_p;
-    }
-
-    return NULL;
+    return hash_find(&id_table, hash_id(name), match_client_id, name);
 }
 
 /* find_client()
@@ -403,10 +665,6 @@ find_id(const char *name)
 struct Client *
 find_client(const char *name)
 {
-    struct Client *target_p;
-    rb_dlink_node *ptr;
-    unsigned int hashv;
-
     s_assert(name != NULL);
     if(EmptyString(name))
         return NULL;
@@ -415,16 +673,7 @@ find_client(const char *name)
     if(IsDigit(*name))
         return (find_id(name));
 
-    hashv = hash_nick(name);
-
-    RB_DLINK_FOREACH(ptr, clientTable[hashv].head) {
-        target_p = ptr->data;
-
-        if(irccmp(name, target_p->name) == 0)
-            return target_p;
-    }
-
-    return NULL;
+    return hash_find(&client_table, hash_nick(name), match_client_name, name);
 }
 
 /* find_named_client()
@@ -434,24 +683,11 @@ find_client(const char *name)
 struct Client *
 find_named_client(const char *name)
 {
-    struct Client *target_p;
-    rb_dlink_node *ptr;
-    unsigned int hashv;
-
     s_assert(name != NULL);
     if(EmptyString(name))
         return NULL;
 
-    hashv = hash_nick(name);
-
-    RB_DLINK_FOREACH(ptr, clientTable[hashv].head) {
-        target_p = ptr->data;
-
-        if(irccmp(name, target_p->name) == 0)
-            return target_p;
-    }
-
-    return NULL;
+    return hash_find(&client_table, hash_nick(name), match_client_name, name);
 }
 
 /* find_server()
@@ -462,8 +698,6 @@ struct Client *
 find_server(struct Client *source_p, const char *name)
 {
     struct Client *target_p;
-    rb_dlink_node *ptr;
-    unsigned int hashv;
 
     if(EmptyString(name))
         return NULL;
@@ -474,17 +708,7 @@ find_server(struct Client *source_p, const char *name)
         return(target_p);
     }
 
-    hashv = hash_nick(name);
-
-    RB_DLINK_FOREACH(ptr, clientTable[hashv].head) {
-        target_p = ptr->data;
-
-        if((IsServer(target_p) || IsMe(target_p)) &&
-           irccmp(name, target_p->name) == 0)
-            return target_p;
-    }
-
-    return NULL;
+    return hash_find(&client_table, hash_nick(name), match_server_name, name);
 }
 
 /* find_hostname()
@@ -496,14 +720,14 @@ find_server(struct Client *source_p, const char *name)
 rb_dlink_node *
 find_hostname(const char *hostname)
 {
-    unsigned int hashv;
+    struct HostHash *hosthash;
 
     if(EmptyString(hostname))
         return NULL;
 
-    hashv = hash_hostname(hostname);
+    hosthash = hash_find(&host_table, hash_hostname(hostname), match_hostname, hostname);
 
-    return hostTable[hashv].head;
+    return hosthash != NULL ? hosthash->clients.head : NULL;
 }
 
 /* find_channel()
@@ -513,24 +737,11 @@ find_hostname(const char *hostname)
 struct Channel *
 find_channel(const char *name)
 {
-    struct Channel *chptr;
-    rb_dlink_node *ptr;
-    unsigned int hashv;
-
     s_assert(name != NULL);
     if(EmptyString(name))
         return NULL;
 
-    hashv = hash_channel(name);
-
-    RB_DLINK_FOREACH(ptr, channelTable[hashv].head) {
-        chptr = ptr->data;
-
-        if(irccmp(name, chptr->chname) == 0)
-            return chptr;
-    }
-
-    return NULL;
+    return hash_find(&channel_table, hash_channel(name), match_channel_name, name);
 }
 
 /*
@@ -548,8 +759,7 @@ struct Channel *
 get_or_create_channel(struct Client *client_p, const char *chname, int *isnew)
 {
     struct Channel *chptr;
-    rb_dlink_node *ptr;
-    unsigned int hashv;
+    u_int32_t hashv;
     int len;
     const char *s = chname;
 
@@ -572,14 +782,10 @@ get_or_create_channel(struct Client *client_p, const char *chname, int *isnew)
 
     hashv = hash_channel(s);
 
-    RB_DLINK_FOREACH(ptr, channelTable[hashv].head) {
-        chptr = ptr->data;
-
-        if(irccmp(s, chptr->chname) == 0) {
-            if(isnew != NULL)
-                *isnew = 0;
-            return chptr;
-        }
+    if((chptr = hash_find(&channel_table, hashv, match_channel_name, s)) != NULL) {
+        if(isnew != NULL)
+            *isnew = 0;
+        return chptr;
     }
 
     if(isnew != NULL)
@@ -591,7 +797,8 @@ get_or_create_channel(struct Client *client_p, const char *chname, int *isnew)
 
     chptr->channelts = rb_current_time();	/* doesn't hurt to set it here */
 
-    rb_dlinkAddAlloc(chptr, &channelTable[hashv]);
+    hash_add(&channel_table, hashv, chptr);
+    update_channel_dir(chptr);
 
     return chptr;
 }
@@ -676,74 +883,94 @@ find_cli_fd_hash(int fd)
     return  NULL;
 }
 
+/* count_hash()
+ *
+ * inputs	- client asking, table
+ * outputs	-
+ * side effects - the table's size, load and how far its entries sit
+ *		  from their home slots is sent to the client
+ */
 static void
-output_hash(struct Client *source_p, const char *name, int length, int *counts, int deepest)
+count_hash(struct Client *source_p, struct hash_table *table)
 {
-    unsigned long total = 0;
-    int i;
-    char buf[128];
+    unsigned int counts[11];
+    unsigned int mask = table->size - 1;
+    unsigned int deepest = 0;
+    unsigned int dist;
+    unsigned int i;
 
-    sendto_one_numeric(source_p, RPL_STATSDEBUG,
-                       "B :%s Hash Statistics", name);
+    memset(counts, 0, sizeof(counts));
 
-    snprintf(buf, sizeof buf, "%.3f%%",
-             (float) ((counts[0]*100) / (float) length));
-    sendto_one_numeric(source_p, RPL_STATSDEBUG,
-                       "B :Size: %d Empty: %d (%s)",
-                       length, counts[0], buf);
+    for(i = 0; i < table->size; i++) {
+        if(table->slots[i].data == NULL)
+            continue;
 
-    for(i = 1; i < 11; i++) {
-        total += (counts[i] * i);
-    }
+        dist = (i - hash_slot_index(table->slots[i].hashv, mask)) & mask;
 
-    /* dont want to divide by 0! --fl */
-    if(counts[0] != length) {
-        snprintf(buf, sizeof buf, "%.3f/%.3f",
-                 (float) (total / (length - counts[0])),
-                 (float) (total / length));
-        sendto_one_numeric(source_p, RPL_STATSDEBUG,
-                           "B :Average depth: %s Highest depth: %d",
-                           buf, deepest);
-    }
+        counts[dist < 10 ? dist : 10]++;
 
-    for(i = 0; i < 11; i++) {
-        sendto_one_numeric(source_p, RPL_STATSDEBUG,
-                           "B :Nodes with %d entries: %d",
-                           i, counts[i]);
+        if(dist > deepest)
+            deepest = dist;
     }
-}
 
+    sendto_one_numeric(source_p, RPL_STATSDEBUG,
+                       "B :%s Hash Statistics", table->name);
 
-static void
-count_hash(struct Client *source_p, rb_dlink_list *table, int length, const char *name)
-{
-    int counts[11];
-    int deepest = 0;
-    int i;
+    sendto_one_numeric(source_p, RPL_STATSDEBUG,
+                       "B :Size: %u Entries: %u Load: %.3f%% Resizes: %lu",
+                       table->size, table->count,
+                       (float) table->count * 100 / table->size, table->resizes);
 
-    memset(counts, 0, sizeof(counts));
+    if(table->old != NULL)
+        sendto_one_numeric(source_p, RPL_STATSDEBUG,
+                           "B :Moving from %u slots, %u left",
+                           table->old_size, table->old_size - table->rehash_idx);
 
-    for(i = 0; i < length; i++) {
-        if(rb_dlink_list_length(&table[i]) >= 10)
-            counts[10]++;
-        else
-            counts[rb_dlink_list_length(&table[i])]++;
+    if(table->lookups > 0)
+        sendto_one_numeric(source_p, RPL_STATSDEBUG,
+                           "B :Lookups: %lu Average probes: %.3f Longest probe: %u",
+                           table->lookups,
+                           (float) table->probes / table->lookups, deepest + 1);
 
-        if(rb_dlink_list_length(&table[i]) > deepest)
-            deepest = rb_dlink_list_length(&table[i]);
+    for(i = 0; i < 11; i++) {
+        sendto_one_numeric(source_p, RPL_STATSDEBUG,
+                           "B :Entries %s%u slots from home: %u",
+                           i == 10 ? ">= " : "", i, counts[i]);
     }
-
-    output_hash(source_p, name, length, counts, deepest);
 }
 
 void
 hash_stats(struct Client *source_p)
 {
-    count_hash(source_p, channelTable, CH_MAX, "Channel");
+    count_hash(source_p, &channel_table);
     sendto_one_numeric(source_p, RPL_STATSDEBUG, "B :--");
-    count_hash(source_p, clientTable, U_MAX, "Client");
+    count_hash(source_p, &client_table);
     sendto_one_numeric(source_p, RPL_STATSDEBUG, "B :--");
-    count_hash(source_p, idTable, U_MAX, "ID");
+    count_hash(source_p, &id_table);
     sendto_one_numeric(source_p, RPL_STATSDEBUG, "B :--");
-    count_hash(source_p, hostTable, HOST_MAX, "Hostname");
+    count_hash(source_p, &host_table);
+}
+
+/* count_hash_memory()
+ *
+ * inputs	- pointers to the slot counts and memory of the client and
+ *		  id tables, the channel table and the hostname table
+ * outputs	-
+ * side effects - used by /stats z
+ */
+void
+count_hash_memory(unsigned int *client_slots, size_t *client_mem,
+                  unsigned int *chan_slots, size_t *chan_mem,
+                  unsigned int *host_slots, size_t *host_mem)
+{
+    *client_slots = client_table.size + client_table.old_size +
+                    id_table.size + id_table.old_size;
+    *client_mem = *client_slots * sizeof(struct hash_slot);
+
+    *chan_slots = channel_table.size + channel_table.old_size;
+    *chan_mem = *chan_slots * sizeof(struct hash_slot);
+
+    *host_slots = host_table.size + host_table.old_size;
+    *host_mem = *host_slots * sizeof(struct hash_slot) +
+                host_table.count * sizeof(struct HostHash);
 }
@@ -31,6 +31,7 @@
 #include "numeric.h"
 #include "send.h"
 #include "match.h"
+#include "irc_dictionary.h"
 
 #ifdef RB_IPV6
 static unsigned long hash_ipv6(struct sockaddr *, int);
@@ -101,12 +102,274 @@ parse_netmask(const char *text, struct sockaddr  *naddr, int *nb)
 /* Hashtable stuff...now external as its used in m_stats.c */
 struct AddressRec *atable[ATABLE_SIZE];
 
+/*
+ * Host masks are also indexed by a trie of reversed domain labels, one
+ * per kind of conf, so a lookup only looks at masks whose literal tail
+ * is a suffix of the host, however many there are elsewhere.  A mask's
+ * tail is what follows the first '.' after its last wildcard, so
+ * "*.isp.net" lives under net -> isp, and a mask without wildcards is
+ * stored at its full name.  Masks with a wildcard in their last label
+ * live on the root, where masks of just "*" (user@* bans) are further
+ * keyed by username.  Every list is kept in precedence order, so the
+ * first record that matches in a list is the best one in it.
+ *
+ * atable still holds every record, for exact lookups and reporting.
+ */
+struct HostNode {
+    char *label;
+    struct HostNode *parent;
+    struct Dictionary *children;
+    struct Dictionary *users;	/* root only, host "*" by literal username */
+    rb_dlink_list exact;	/* the mask is this suffix */
+    rb_dlink_list subtree;	/* "*.suffix", matches any host below us */
+    rb_dlink_list glob;	/* other masks ending in ".suffix" */
+    unsigned int refs;	/* records and children */
+};
+
+struct HostUser {
+    rb_dlink_list recs;	/* must be first, it is what hlist points at */
+    char *name;
+};
+
+static struct HostNode host_trie[3];
+
 void
 init_host_hash(void)
 {
     memset(&atable, 0, sizeof(atable));
 }
 
+static struct HostNode *
+host_trie_root(int type)
+{
+    switch(type & ~0x1) {
+    case CONF_CLIENT:
+        return &host_trie[0];
+    case CONF_KILL:
+        return &host_trie[1];
+    default:
+        return &host_trie[2];
+    }
+}
+
+/* struct HostNode *host_node_get(struct HostNode *, const char *)
+ * Input: Trie root, the literal tail of a mask.
+ * Output: The node for the tail, created if need be.
+ * Side effects: None
+ */
+static struct HostNode *
+host_node_get(struct HostNode *root, const char *suffix)
+{
+    struct HostNode *node = root, *child;
+    char *s = LOCAL_COPY(suffix);
+    char *p, *label;
+
+    for(;;) {
+        p = strrchr(s, '.');
+        label = p != NULL ? p + 1 : s;
+
+        if(node->children == NULL)
+            node->children = irc_dictionary_create(irccmp);
+
+        if((child = irc_dictionary_retrieve(node->children, label)) == NULL) {
+            child = rb_malloc(sizeof(struct HostNode));
+            child->label = rb_strdup(label);
+            child->parent = node;
+            irc_dictionary_add(node->children, child->label, child);
+            node->refs++;
+        }
+
+        node = child;
+        if(p == NULL)
+            return node;
+        *p = '\0';
+    }
+}
+
+/* void host_trie_add(struct AddressRec *)
+ * Input: A host mask record.
+ * Output: None
+ * Side effects: The record is added to the host mask trie.
+ */
+static void
+host_trie_add(struct AddressRec *arec)
+{
+    struct HostNode *root = host_trie_root(arec->type);
+    struct HostNode *node;
+    struct HostUser *hu;
+    const char *mask = arec->Mask.hostname;
+    const char *w = NULL, *d, *p;
+    rb_dlink_list *list;
+    size_t stars = strspn(mask, "*");
+
+    for(p = mask; *p != '\0'; p++) {
+        if(*p == '*' || *p == '?')
+            w = p;
+    }
+
+    if(w == NULL) {
+        node = host_node_get(root, mask);
+        list = &node->exact;
+    } else if((d = strchr(w, '.')) != NULL) {
+        node = host_node_get(root, d + 1);
+        list = stars == (size_t) (d - mask) ? &node->subtree : &node->glob;
+    } else if(mask[stars] != '\0') {
+        node = root;
+        list = &root->glob;
+    } else if(arec->username != NULL && strpbrk(arec->username, "*?") == NULL) {
+        node = root;
+        if(root->users == NULL)
+            root->users = irc_dictionary_create(irccmp);
+
+        if((hu = irc_dictionary_retrieve(root->users, arec->username)) == NULL) {
+            hu = rb_malloc(sizeof(struct HostUser));
+            hu->name = rb_strdup(arec->username);
+            irc_dictionary_add(root->users, hu->name, hu);
+        }
+        list = &hu->recs;
+    } else {
+        node = root;
+        list = &root->subtree;
+    }
+
+    /* precedence only ever goes down, so the tail keeps the order */
+    rb_dlinkAddTail(arec, &arec->hnode, list);
+    arec->hlist = list;
+    arec->hnode_owner = node;
+    node->refs++;
+}
+
+/* void host_trie_del(struct AddressRec *)
+ * Input: A record.
+ * Output: None
+ * Side effects: The record is removed from the host mask trie if it is
+ *               on it, and nodes left empty are freed.
+ */
+static void
+host_trie_del(struct AddressRec *arec)
+{
+    struct HostNode *node = arec->hnode_owner, *parent;
+    struct HostUser *hu;
+
+    if(node == NULL)
+        return;
+
+    rb_dlinkDelete(&arec->hnode, arec->hlist);
+
+    if(arec->hlist != &node->exact && arec->hlist != &node->subtree &&
+       arec->hlist != &node->glob && rb_dlink_list_length(arec->hlist) == 0) {
+        hu = (struct HostUser *) arec->hlist;
+        irc_dictionary_delete(node->users, hu->name);
+        rb_free(hu->name);
+        rb_free(hu);
+    }
+
+    arec->hnode_owner = NULL;
+    arec->hlist = NULL;
+
+    node->refs--;
+    while(node->parent != NULL && node->refs == 0) {
+        parent = node->parent;
+        irc_dictionary_delete(parent->children, node->label);
+        if(irc_dictionary_size(parent->children) == 0) {
+            irc_dictionary_destroy(parent->children, NULL, NULL);
+            parent->children = NULL;
+        }
+        rb_free(node->label);
+        rb_free(node);
+
+        parent->refs--;
+        node = parent;
+    }
+}
+
+/* void host_list_find(rb_dlink_list *, ...)
+ * Input: A trie list, the host and sockhost to match masks against, or
+ *        NULL if every mask on the list is known to match, the type,
+ *        username and auth_user, and the best match so far.
+ * Output: None
+ * Side effects: The best match is updated if the list has a better one.
+ */
+static void
+host_list_find(rb_dlink_list *list, const char *host, const char *sockhost,
+               int type, const char *username, const char *auth_user,
+               unsigned long *hprecv, struct ConfItem **hprec)
+{
+    rb_dlink_node *ptr;
+    struct AddressRec *arec;
+
+    RB_DLINK_FOREACH(ptr, list->head) {
+        arec = ptr->data;
+
+        if(arec->precedence <= *hprecv)
+            return;
+
+        if(arec->type == (type & ~0x1) &&
+           (host == NULL || match(arec->Mask.hostname, host) ||
+            (sockhost && match(arec->Mask.hostname, sockhost))) &&
+           (type != CONF_CLIENT || !arec->auth_user ||
+            (auth_user && match(arec->auth_user, auth_user))) &&
+           (type & 0x1 || match(arec->username, username))) {
+            *hprecv = arec->precedence;
+            *hprec = arec->aconf;
+            return;
+        }
+    }
+}
+
+/* void find_host_conf(const char *, const char *, ...)
+ * Input: The host, the sockhost to also try root masks against, the
+ *        type, username and auth_user, and the best match so far.
+ * Output: None
+ * Side effects: The best match is updated if a host mask beats it.
+ */
+static void
+find_host_conf(const char *host, const char *sockhost, int type,
+               const char *username, const char *auth_user,
+               unsigned long *hprecv, struct ConfItem **hprec)
+{
+    struct HostNode *node = host_trie_root(type);
+    struct HostUser *hu;
+    struct DictionaryIter iter;
+    char *h, *p, *label;
+
+    host_list_find(&node->subtree, NULL, NULL, type, username, auth_user, hprecv, hprec);
+
+    if(node->users != NULL) {
+        if(type & 0x1) {
+            DICTIONARY_FOREACH(hu, &iter, node->users) {
+                host_list_find(&hu->recs, NULL, NULL, type, username, auth_user,
+                               hprecv, hprec);
+            }
+        } else if((hu = irc_dictionary_retrieve(node->users, username)) != NULL)
+            host_list_find(&hu->recs, NULL, NULL, type, username, auth_user,
+                           hprecv, hprec);
+    }
+
+    host_list_find(&node->glob, host, sockhost, type, username, auth_user, hprecv, hprec);
+
+    h = LOCAL_COPY(host);
+    while(node->children != NULL) {
+        p = strrchr(h, '.');
+        label = p != NULL ? p + 1 : h;
+
+        if((node = irc_dictionary_retrieve(node->children, label)) == NULL)
+            return;
+
+        if(p == NULL) {
+            host_list_find(&node->exact, NULL, NULL, type, username, auth_user,
+                           hprecv, hprec);
+            return;
+        }
+
+        host_list_find(&node->subtree, NULL, NULL, type, username, auth_user,
+                       hprecv, hprec);
+        host_list_find(&node->glob, host, NULL, type, username, auth_user,
+                       hprecv, hprec);
+        *p = '\0';
+    }
+}
+
 /* unsigned long hash_ipv4(struct rb_sockaddr_storage*)
  * Input: An IP address.
  * Output: A hash value of the IP address.
@@ -248,79 +511,12 @@ find_conf_by_address(const char *name, const char *sockhost,
             }
     }
 
-    if(orighost != NULL) {
-        const char *p;
-
-        for (p = orighost; p != NULL;) {
-            for (arec = atable[hash_text(p)]; arec; arec = arec->next)
-
-                if((arec->type == (type & ~0x1)) &&
-                   (arec->masktype == HM_HOST) &&
-                   arec->precedence > hprecv &&
-                   match(arec->Mask.hostname, orighost) &&
-                   (type != CONF_CLIENT || !arec->auth_user ||
-                    (auth_user && match(arec->auth_user, auth_user))) &&
-                   (type & 0x1 || match(arec->username, username))) {
-                    hprecv = arec->precedence;
-                    hprec = arec->aconf;
-                }
-            p = strchr(p, '.');
-            if(p != NULL)
-                p++;
-            else
-                break;
-        }
-        for (arec = atable[0]; arec; arec = arec->next) {
-            if(arec->type == (type & ~0x1) &&
-               arec->masktype == HM_HOST &&
-               arec->precedence > hprecv &&
-               (match(arec->Mask.hostname, orighost) ||
-                (sockhost && match(arec->Mask.hostname, sockhost))) &&
-               (type != CONF_CLIENT || !arec->auth_user ||
-                (auth_user && match(arec->auth_user, auth_user))) &&
-               (type & 0x1 || match(arec->username, username))) {
-                hprecv = arec->precedence;
-                hprec = arec->aconf;
-            }
-        }
-    }
+    if(orighost != NULL)
+        find_host_conf(orighost, sockhost, type, username, auth_user, &hprecv, &hprec);
+
+    if(name != NULL)
+        find_host_conf(name, sockhost, type, username, auth_user, &hprecv, &hprec);
 
-    if(name != NULL) {
-        const char *p;
-        /* And yes - we have to check p after strchr and p after increment for
-         * NULL -kre */
-        for (p = name; p != NULL;) {
-            for (arec = atable[hash_text(p)]; arec; arec = arec->next)
-                if((arec->type == (type & ~0x1)) &&
-                   (arec->masktype == HM_HOST) &&
-                   arec->precedence > hprecv &&
-                   match(arec->Mask.hostname, name) &&
-                   (type != CONF_CLIENT || !arec->auth_user ||
-                    (auth_user && match(arec->auth_user, auth_user))) &&
-                   (type & 0x1 || match(arec->username, username))) {
-                    hprecv = arec->precedence;
-                    hprec = arec->aconf;
-                }
-            p = strchr(p, '.');
-            if(p != NULL)
-                p++;
-            else
-                break;
-        }
-        for (arec = atable[0]; arec; arec = arec->next) {
-            if(arec->type == (type & ~0x1) &&
-               arec->masktype == HM_HOST &&
-               arec->precedence > hprecv &&
-               (match(arec->Mask.hostname, name) ||
-                (sockhost && match(arec->Mask.hostname, sockhost))) &&
-               (type != CONF_CLIENT || !arec->auth_user ||
-                (auth_user && match(arec->auth_user, auth_user))) &&
-               (type & 0x1 || match(arec->username, username))) {
-                hprecv = arec->precedence;
-                hprec = arec->aconf;
-            }
-        }
-    }
     return hprec;
 }
 
@@ -488,6 +684,9 @@ add_conf_by_address(const char *address, int type, const char *username, const c
     arec->aconf = aconf;
     arec->precedence = prec_value--;
     arec->type = type;
+
+    if(masktype == HM_HOST)
+        host_trie_add(arec);
 }
 
 /* void delete_one_address(const char*, struct ConfItem*)
@@ -523,6 +722,7 @@ delete_one_address_conf(const char *address, struct ConfItem *aconf)
                 arecl->next = arec->next;
             else
                 atable[hv] = arec->next;
+            host_trie_del(arec);
             aconf->status |= CONF_ILLEGAL;
             if(!aconf->clients)
                 free_conf(aconf);
@@ -558,6 +758,7 @@ clear_out_address_conf(void)
                 *store_next = arec;
                 store_next = &arec->next;
             } else {
+                host_trie_del(arec);
                 arec->aconf->status |= CONF_ILLEGAL;
                 if(!arec->aconf->clients)
                     free_conf(arec->aconf);
@@ -586,6 +787,7 @@ clear_out_address_conf_bans(void)
                 *store_next = arec;
                 store_next = &arec->next;
             } else {
+                host_trie_del(arec);
                 arec->aconf->status |= CONF_ILLEGAL;
                 if(!arec->aconf->clients)
                     free_conf(arec->aconf);
@@ -662,6 +662,44 @@ struct DictionaryElement *irc_dictionary_find(struct Dictionary *dict, const cha
     return NULL;
 }
 
+/*
+ * irc_dictionary_seek(struct Dictionary *dtree, const char *key)
+ *
+ * Looks up the first DTree node whose key does not sort before key.
+ *
+ * Inputs:
+ *     - dictionary tree object
+ *     - key to seek to
+ *
+ * Outputs:
+ *     - on success, the first node with a key >= key
+ *     - on failure, NULL
+ *
+ * Side Effects:
+ *     - none
+ *
+ * Notes:
+ *     - a failed search ends next to where key would be, so after the
+ *       retune the root is either that node or the one before it.
+ */
+struct DictionaryElement *irc_dictionary_seek(struct Dictionary *dict, const char *key)
+{
+    struct DictionaryElement *delem;
+
+    s_assert(dict != NULL);
+    s_assert(key != NULL);
+
+    irc_dictionary_retune(dict, key);
+
+    if ((delem = dict->root) == NULL)
+        return NULL;
+
+    if (dict->compare_cb(key, delem->key) > 0)
+        delem = delem->next;
+
+    return delem;
+}
+
 /*
  * irc_dictionary_add(struct Dictionary *dtree, const char *key, void *data)
  *
@@ -68,6 +68,7 @@
 #include "chmode.h"
 #include "privilege.h"
 #include "bandbi.h"
+#include "cryptdi.h"
 
 /* /quote set variables */
 struct SetOptions GlobalSetOptions;
@@ -560,6 +561,9 @@ main(int argc, char *argv[])
     memset(&me, 0, sizeof(me));
     memset(&meLocalUser, 0, sizeof(meLocalUser));
     me.localClient = &meLocalUser;
+    me.host = scache_intern("");
+    me.orighost = scache_intern("");
+    me.info = scache_intern("");
 
     /* Make sure all lists are zeroed */
     memset(&unknown_list, 0, sizeof(unknown_list));
@@ -569,7 +573,7 @@ main(int argc, char *argv[])
     memset(&local_oper_list, 0, sizeof(local_oper_list));
     memset(&oper_list, 0, sizeof(oper_list));
 
-    rb_dlinkAddTail(&me, &me.node, &global_client_list);
+    add_client_to_list(&me);
 
     memset(&Count, 0, sizeof(Count));
     memset(&ServerInfo, 0, sizeof(ServerInfo));
@@ -660,6 +664,8 @@ main(int argc, char *argv[])
 #endif
 
     init_bandb();
+    init_cryptd();
+    init_logd();
     init_ssld();
 
     rehash_bans(0);
@@ -685,7 +691,7 @@ main(int argc, char *argv[])
         ierror("no server description specified in serverinfo block.");
         return -3;
     }
-    rb_strlcpy(me.info, ServerInfo.description, sizeof(me.info));
+    scache_set(&me.info, ServerInfo.description, REALLEN + 1);
 
     if(ServerInfo.ssl_cert != NULL && ServerInfo.ssl_private_key != NULL) {
         /* just do the rb_setup_ssl_server to validate the config */
@@ -730,6 +736,7 @@ main(int argc, char *argv[])
     rb_event_addish("try_connections", try_connections, NULL, STARTUP_CONNECTIONS_TIME);
     rb_event_addonce("try_connections_startup", try_connections, NULL, 2);
     rb_event_add("check_rehash", check_rehash, NULL, 3);
+    rb_event_add("burst_continue_all", burst_continue_all, NULL, 1);
     rb_event_addish("reseed_srand", seed_random, NULL, 300); /* reseed every 10 minutes */
 
     if(splitmode)
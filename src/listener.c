@@ -41,6 +41,7 @@
 #include "hostmask.h"
 #include "sslproc.h"
 #include "hash.h"
+#include "scache.h"
 
 #ifndef INADDR_NONE
 #define INADDR_NONE ((unsigned int) 0xffffffff)
@@ -417,6 +418,7 @@ add_connection(struct Listener *listener, rb_fde_t *F, struct sockaddr *sai, str
 
     memcpy(&new_client->localClient->ip, sai, sizeof(struct rb_sockaddr_storage));
     memcpy(&new_client->preClient->lip, lai, sizeof(struct rb_sockaddr_storage));
+    add_to_client_ip_index(new_client);
 
     /*
      * copy address to 'sockhost' as a string, copy it to host too
@@ -426,7 +428,7 @@ add_connection(struct Listener *listener, rb_fde_t *F, struct sockaddr *sai, str
                       sizeof(new_client->sockhost));
 
 
-    rb_strlcpy(new_client->host, new_client->sockhost, sizeof(new_client->host));
+    scache_set(&new_client->host, new_client->sockhost, HOSTLEN + 1);
 
     new_client->localClient->F = F;
     add_to_cli_fd_hash(new_client);
@@ -55,8 +55,17 @@ static FILE *log_ioerror;
 struct log_struct {
     char **name;
     FILE **logfile;
+    int logd;	/* open in logd rather than here */
+    unsigned long dropped;	/* lines logd had no room for */
 };
 
+struct LogStats log_stats;
+
+static rb_helper *logd_helper;
+static char *logd_path;
+
+static int start_logd(void);
+
 static struct log_struct log_table[LAST_LOGFILE] = {
     { NULL, 				&log_main	},
     { &ConfigFileEntry.fname_userlog,	&log_user	},
@@ -117,6 +126,126 @@ init_main_logfile(void)
     }
 }
 
+/*
+ * logd.
+ *
+ * Once the ircd is up, log lines are handed to the logd helper, which
+ * holds them and writes them out in batches, so a flood of user, kill
+ * or kline logging never leaves the event loop waiting on the disk.
+ * If logd can't keep up and LOGD_MAX_BACKLOG bytes are waiting for it,
+ * further lines are dropped and counted, and the count is logged once
+ * there is room again.  Before logd is running, or while it is being
+ * restarted, lines are written here as they always were.
+ */
+void
+init_logd(void)
+{
+    if(start_logd())
+        ilog(L_MAIN, "Unable to start logd helper, writing logs inline");
+}
+
+static void
+logd_restart_cb(rb_helper *helper)
+{
+    int i;
+
+    rb_helper_close(helper);
+    logd_helper = NULL;
+
+    for(i = 0; i < LAST_LOGFILE; i++)
+        log_table[i].logd = 0;
+
+    /* carry on writing inline until the new logd is up */
+    open_logfiles();
+
+    ilog(L_MAIN, "logd - logd_restart_cb called, logd helper died?");
+    sendto_realops_snomask(SNO_GENERAL, L_ALL,
+                           "logd - logd_restart_cb called, logd helper died?");
+
+    if(start_logd() == 0)
+        open_logfiles();
+}
+
+static void
+logd_parse(rb_helper *helper)
+{
+    /* logd never answers */
+}
+
+static int
+start_logd(void)
+{
+    char fullpath[PATH_MAX + 1];
+#ifdef _WIN32
+    const char *suffix = ".exe";
+#else
+    const char *suffix = "";
+#endif
+
+    if(logd_path == NULL) {
+        rb_snprintf(fullpath, sizeof(fullpath), "%s/logd%s", PKGLIBEXECDIR, suffix);
+
+        if(access(fullpath, X_OK) == -1) {
+            rb_snprintf(fullpath, sizeof(fullpath), "%s/bin/logd%s",
+                        ConfigFileEntry.dpath, suffix);
+
+            if(access(fullpath, X_OK) == -1) {
+                ilog(L_MAIN,
+                     "Unable to execute logd%s in %s or %s/bin",
+                     suffix, PKGLIBEXECDIR, ConfigFileEntry.dpath);
+                return 1;
+            }
+        }
+        logd_path = rb_strdup(fullpath);
+    }
+
+    logd_helper = rb_helper_start("logd", logd_path, logd_parse, logd_restart_cb);
+
+    if(logd_helper == NULL) {
+        ilog(L_MAIN, "Unable to start logd: %s", strerror(errno));
+        return 1;
+    }
+
+    rb_helper_run(logd_helper);
+    return 0;
+}
+
+/* logd_write()
+ *
+ * inputs	- log to write to, line without its newline
+ * outputs	-
+ * side effects - line is queued for logd, or dropped and counted if
+ *		  logd is too far behind
+ */
+static void
+logd_write(ilogfile dest, const char *line)
+{
+    int i;
+
+    if(rb_helper_sendq_len(logd_helper) > LOGD_MAX_BACKLOG) {
+        log_table[dest].dropped++;
+        log_stats.dropped++;
+        return;
+    }
+
+    if(rb_unlikely(log_stats.dropped_unlogged != log_stats.dropped)) {
+        for(i = 0; i < LAST_LOGFILE; i++) {
+            if(log_table[i].dropped == 0 || !log_table[i].logd)
+                continue;
+
+            rb_helper_write_queue(logd_helper, "L %d %s logd: %lu lines dropped",
+                                  i, smalldate(rb_current_time()),
+                                  log_table[i].dropped);
+            log_table[i].dropped = 0;
+        }
+
+        log_stats.dropped_unlogged = log_stats.dropped;
+    }
+
+    rb_helper_write(logd_helper, "L %d %s", (int) dest, line);
+    log_stats.queued++;
+}
+
 void
 open_logfiles(void)
 {
@@ -124,6 +253,24 @@ open_logfiles(void)
 
     close_logfiles();
 
+    if(logd_helper != NULL) {
+        rb_helper_write_queue(logd_helper, "I %d", ConfigFileEntry.log_flush_interval);
+        rb_helper_write_queue(logd_helper, "O %d %s", L_MAIN, logFileName);
+        log_table[L_MAIN].logd = 1;
+
+        for(i = 1; i < LAST_LOGFILE; i++) {
+            if(EmptyString(*log_table[i].name))
+                continue;
+
+            verify_logfile_access(*log_table[i].name);
+            rb_helper_write_queue(logd_helper, "O %d %s", i, *log_table[i].name);
+            log_table[i].logd = 1;
+        }
+
+        rb_helper_write_flush(logd_helper);
+        return;
+    }
+
     log_main = fopen(logFileName, "a");
 
     /* log_main is handled above, so just do the rest */
@@ -141,8 +288,10 @@ close_logfiles(void)
 {
     int i;
 
-    if(log_main != NULL)
+    if(log_main != NULL) {
         fclose(log_main);
+        log_main = NULL;
+    }
 
     /* log_main is handled above, so just do the rest */
     for(i = 1; i < LAST_LOGFILE; i++) {
@@ -151,6 +300,17 @@ close_logfiles(void)
             *log_table[i].logfile = NULL;
         }
     }
+
+    /* logd writes out what it holds as it closes them */
+    for(i = 0; i < LAST_LOGFILE; i++) {
+        if(log_table[i].logd) {
+            rb_helper_write_queue(logd_helper, "C %d", i);
+            log_table[i].logd = 0;
+        }
+    }
+
+    if(logd_helper != NULL)
+        rb_helper_write_flush(logd_helper);
 }
 
 void
@@ -161,16 +321,25 @@ ilog(ilogfile dest, const char *format, ...)
     char buf2[BUFSIZE];
     va_list args;
 
-    if(logfile == NULL)
+    if(logfile == NULL && !log_table[dest].logd)
         return;
 
     va_start(args, format);
     rb_vsnprintf(buf, sizeof(buf), format, args);
     va_end(args);
 
+    if(log_table[dest].logd) {
+        rb_snprintf(buf2, sizeof(buf2), "%s %s",
+                    smalldate(rb_current_time()), buf);
+        logd_write(dest, buf2);
+        return;
+    }
+
     rb_snprintf(buf2, sizeof(buf2), "%s %s\n",
                 smalldate(rb_current_time()), buf);
 
+    log_stats.inline_lines++;
+
     if(fputs(buf2, logfile) < 0) {
         fclose(logfile);
         *log_table[dest].logfile = NULL;
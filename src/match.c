@@ -283,6 +283,299 @@ match_esc(const char *mask, const char *name)
     return 0;
 }
 
+/*
+ * A set of match_esc() masks compiled for matching many at once.
+ *
+ * Whatever else a mask says, a name it matches has to contain each run
+ * of plain characters in it.  The longest such run of every mask goes
+ * into an Aho-Corasick automaton, so one pass over the name finds the
+ * few masks that could match it; only those (and any mask with no plain
+ * characters at all) are then given to match_esc() itself.  Masks are
+ * tried in the order they were given, and the first one that matches
+ * is returned, exactly as a walk of the list would find it.
+ */
+struct EscMaskState {
+    unsigned int child;		/* first child, 0 if none */
+    unsigned int sibling;	/* next child of our parent */
+    unsigned int fail;		/* longest proper suffix that is a state */
+    unsigned int output;	/* next state on the fail chain with masks */
+    unsigned int masks;		/* first mask ending here, plus one */
+    unsigned char c;
+};
+
+struct EscMaskSet {
+    struct EscMaskState *states;
+    unsigned int nstates;
+    unsigned int maxstates;
+
+    unsigned int count;
+    const char **masks;
+    void **data;
+    unsigned int *next_mask;	/* masks ending at the same state */
+
+    unsigned int *always;	/* masks with nothing to look for */
+    unsigned int nalways;
+
+    unsigned int *seen;
+    unsigned int serial;
+    unsigned int *cand;
+};
+
+/* escmask_literal()
+ *
+ * inputs	- mask, buffer of at least strlen(mask) + 1 bytes
+ * outputs	- length of the longest run of plain characters in mask,
+ *		  lowercased into buf
+ * side effects -
+ */
+static size_t
+escmask_literal(const char *mask, char *buf)
+{
+    const unsigned char *p = (const unsigned char *)mask;
+    char *run = buf + strlen(mask) + 1;
+    size_t len = 0, best = 0;
+
+    /* run is the second half of buf */
+    for(;;) {
+        if(*p == '\\') {
+            if(!*++p)
+                break;
+            run[len++] = *p == 's' ? ' ' : ToLower(*p);
+        } else if(*p == '*' || *p == '?' || *p == '#' || *p == '@' || !*p) {
+            if(len > best) {
+                memcpy(buf, run, len);
+                best = len;
+            }
+            len = 0;
+
+            if(!*p)
+                break;
+        } else
+            run[len++] = ToLower(*p);
+
+        p++;
+    }
+
+    if(len > best) {
+        memcpy(buf, run, len);
+        best = len;
+    }
+
+    return best;
+}
+
+static unsigned int
+escmask_child(struct EscMaskSet *set, unsigned int state, unsigned char c)
+{
+    unsigned int child;
+
+    for(child = set->states[state].child; child; child = set->states[child].sibling)
+        if(set->states[child].c == c)
+            return child;
+
+    return 0;
+}
+
+static unsigned int
+escmask_add_state(struct EscMaskSet *set, unsigned int parent, unsigned char c)
+{
+    struct EscMaskState *state;
+
+    if(set->nstates == set->maxstates) {
+        set->maxstates *= 2;
+        set->states = rb_realloc(set->states, sizeof(struct EscMaskState) * set->maxstates);
+    }
+
+    state = &set->states[set->nstates];
+    memset(state, 0, sizeof(struct EscMaskState));
+    state->c = c;
+    state->sibling = set->states[parent].child;
+    set->states[parent].child = set->nstates;
+
+    return set->nstates++;
+}
+
+/* escmask_build()
+ *
+ * inputs	- list of items, function giving the mask of an item
+ * outputs	- the masks of the list, compiled
+ * side effects - the masks are not copied, so the set must be rebuilt
+ *		  before any of them change or go away
+ */
+struct EscMaskSet *
+escmask_build(rb_dlink_list *list, const char *(*mask_of)(void *))
+{
+    struct EscMaskSet *set;
+    rb_dlink_node *ptr;
+    unsigned int *queue;
+    unsigned int i, state, child, fail, head, tail;
+    char *buf;
+    size_t buflen = 0, len, j;
+
+    set = rb_malloc(sizeof(struct EscMaskSet));
+    set->count = rb_dlink_list_length(list);
+    set->masks = rb_malloc(sizeof(char *) * (set->count + 1));
+    set->data = rb_malloc(sizeof(void *) * (set->count + 1));
+    set->next_mask = rb_malloc(sizeof(unsigned int) * (set->count + 1));
+    set->always = rb_malloc(sizeof(unsigned int) * (set->count + 1));
+    set->seen = rb_malloc(sizeof(unsigned int) * (set->count + 1));
+    set->cand = rb_malloc(sizeof(unsigned int) * (set->count + 1));
+
+    set->maxstates = 64;
+    set->states = rb_malloc(sizeof(struct EscMaskState) * set->maxstates);
+    set->nstates = 1;
+
+    i = 0;
+    RB_DLINK_FOREACH(ptr, list->head) {
+        set->data[i] = ptr->data;
+        set->masks[i] = mask_of(ptr->data);
+
+        if((len = strlen(set->masks[i])) > buflen)
+            buflen = len;
+
+        i++;
+    }
+
+    buf = rb_malloc(buflen * 2 + 2);
+
+    for(i = 0; i < set->count; i++) {
+        len = escmask_literal(set->masks[i], buf);
+
+        if(len == 0) {
+            set->always[set->nalways++] = i;
+            continue;
+        }
+
+        for(state = 0, j = 0; j < len; j++) {
+            if((child = escmask_child(set, state, buf[j])) == 0)
+                child = escmask_add_state(set, state, buf[j]);
+            state = child;
+        }
+
+        set->next_mask[i] = set->states[state].masks;
+        set->states[state].masks = i + 1;
+    }
+
+    rb_free(buf);
+
+    /* fill in the fail and output links, breadth first */
+    queue = rb_malloc(sizeof(unsigned int) * set->nstates);
+    head = tail = 0;
+
+    for(child = set->states[0].child; child; child = set->states[child].sibling)
+        queue[tail++] = child;
+
+    while(head < tail) {
+        state = queue[head++];
+
+        for(child = set->states[state].child; child; child = set->states[child].sibling) {
+            queue[tail++] = child;
+
+            for(fail = set->states[state].fail;; fail = set->states[fail].fail) {
+                if((i = escmask_child(set, fail, set->states[child].c)) != 0) {
+                    set->states[child].fail = i;
+                    break;
+                }
+
+                if(fail == 0)
+                    break;
+            }
+
+            fail = set->states[child].fail;
+            set->states[child].output = set->states[fail].masks ?
+                                        fail : set->states[fail].output;
+        }
+    }
+
+    rb_free(queue);
+    return set;
+}
+
+void
+escmask_free(struct EscMaskSet *set)
+{
+    if(set == NULL)
+        return;
+
+    rb_free(set->states);
+    rb_free(set->masks);
+    rb_free(set->data);
+    rb_free(set->next_mask);
+    rb_free(set->always);
+    rb_free(set->seen);
+    rb_free(set->cand);
+    rb_free(set);
+}
+
+unsigned int
+escmask_count(struct EscMaskSet *set)
+{
+    return set->count;
+}
+
+static int
+escmask_cmp(const void *a, const void *b)
+{
+    unsigned int x = *(const unsigned int *)a;
+    unsigned int y = *(const unsigned int *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* escmask_find()
+ *
+ * inputs	- compiled set, name
+ * outputs	- the item of the first mask in the set matching name,
+ *		  or NULL
+ * side effects -
+ */
+void *
+escmask_find(struct EscMaskSet *set, const char *name)
+{
+    const unsigned char *p;
+    unsigned int state = 0, out, m, ncand = 0, a = 0, c = 0, i;
+
+    if(++set->serial == 0) {
+        memset(set->seen, 0, sizeof(unsigned int) * (set->count + 1));
+        set->serial = 1;
+    }
+
+    for(p = (const unsigned char *)name; *p; p++) {
+        unsigned char ch = ToLower(*p);
+
+        while((i = escmask_child(set, state, ch)) == 0 && state)
+            state = set->states[state].fail;
+
+        state = i;
+
+        for(out = state; out; out = set->states[out].output) {
+            for(m = set->states[out].masks; m; m = set->next_mask[m - 1]) {
+                if(set->seen[m - 1] == set->serial)
+                    continue;
+
+                set->seen[m - 1] = set->serial;
+                set->cand[ncand++] = m - 1;
+            }
+        }
+    }
+
+    if(ncand > 1)
+        qsort(set->cand, ncand, sizeof(unsigned int), escmask_cmp);
+
+    /* try the candidates and the masks we can't rule out, in order */
+    while(c < ncand || a < set->nalways) {
+        if(a == set->nalways || (c < ncand && set->cand[c] < set->always[a]))
+            i = set->cand[c++];
+        else
+            i = set->always[a++];
+
+        if(match_esc(set->masks[i], name))
+            return set->data[i];
+    }
+
+    return NULL;
+}
+
 int comp_with_mask(void *addr, void *dest, u_int mask)
 {
     if (memcmp(addr, dest, mask / 8) == 0) {
@@ -2028,6 +2028,7 @@ static struct ConfEntry conf_serverinfo_table[] = {
     { "ssl_cert",           CF_QSTRING, NULL, 0, &ServerInfo.ssl_cert },
     { "ssl_dh_params",      CF_QSTRING, NULL, 0, &ServerInfo.ssl_dh_params },
     { "ssld_count",		CF_INT,	    NULL, 0, &ServerInfo.ssld_count },
+    { "ssl_ktls",		CF_YESNO,   NULL, 0, &ServerInfo.ssl_ktls },
 
     { "default_max_clients",CF_INT,     NULL, 0, &ServerInfo.default_max_clients },
 
@@ -2051,6 +2052,7 @@ static struct ConfEntry conf_log_table[] = {
     { "fname_klinelog", 	CF_QSTRING, NULL, MAXPATHLEN, &ConfigFileEntry.fname_klinelog	},
     { "fname_operspylog", 	CF_QSTRING, NULL, MAXPATHLEN, &ConfigFileEntry.fname_operspylog	},
     { "fname_ioerrorlog", 	CF_QSTRING, NULL, MAXPATHLEN, &ConfigFileEntry.fname_ioerrorlog },
+    { "flush_interval",	CF_TIME,    NULL, 0,          &ConfigFileEntry.log_flush_interval },
     { "\0",			0,	    NULL, 0,          NULL }
 };
 
@@ -2202,6 +2204,7 @@ static struct ConfEntry conf_general_table[] = {
     { "use_propagated_bans",CF_YESNO, NULL, 0, &ConfigFileEntry.use_propagated_bans	},
     { "expire_override_time",	CF_TIME, NULL, 0, &ConfigFileEntry.expire_override_time},
     { "away_interval",    CF_INT,   NULL, 0, &ConfigFileEntry.away_interval    },
+    { "whowas_length",	CF_INT,   NULL, 0, &ConfigFileEntry.whowas_length	},
     { "\0", 		0, 	  NULL, 0, NULL }
 };
 
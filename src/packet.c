@@ -37,6 +37,33 @@
 static char readBuf[READBUF_SIZE];
 static void client_dopacket(struct Client *client_p, char *buffer, size_t length);
 
+/*
+ * parse_client_line - parse the next complete line in a client's recvq
+ *
+ * The line is unlinked from the recvq and parsed where it sits in the
+ * linebuf, rather than being copied out into readBuf first.  Holding
+ * the line ourselves keeps it valid should the client be exited while
+ * it is being parsed.  Returns the length of the line, 0 if there was
+ * none.
+ */
+static int
+parse_client_line(struct Client *client_p)
+{
+    buf_line_t *line;
+    char *data;
+    int len;
+
+    line = rb_linebuf_take(&client_p->localClient->buf_recvq, &data, &len,
+                           LINEBUF_COMPLETE, LINEBUF_PARSED);
+    if(line == NULL)
+        return 0;
+
+    if(len > 0)
+        client_dopacket(client_p, data, len);
+
+    rb_linebuf_release(line);
+    return len;
+}
 
 /*
  * parse_client_queued - parse client queued messages
@@ -55,14 +82,14 @@ parse_client_queued(struct Client *client_p)
             if(client_p->localClient->sent_parsed >= client_p->localClient->allow_read)
                 break;
 
-            dolen = rb_linebuf_get(&client_p->localClient->
-                                   buf_recvq, readBuf, READBUF_SIZE,
-                                   LINEBUF_COMPLETE, LINEBUF_PARSED);
+            if(IsDead(client_p))
+                break;
 
-            if(dolen <= 0 || IsDead(client_p))
+            dolen = parse_client_line(client_p);
+
+            if(dolen <= 0)
                 break;
 
-            client_dopacket(client_p, readBuf, dolen);
             client_p->localClient->sent_parsed++;
 
             /* He's dead cap'n */
@@ -83,11 +110,8 @@ parse_client_queued(struct Client *client_p)
     }
 
     if(IsAnyServer(client_p) || IsExemptFlood(client_p)) {
-        while (!IsAnyDead(client_p) && (dolen = rb_linebuf_get(&client_p->localClient->buf_recvq,
-                                                readBuf, READBUF_SIZE, LINEBUF_COMPLETE,
-                                                LINEBUF_PARSED)) > 0) {
-            client_dopacket(client_p, readBuf, dolen);
-        }
+        while (!IsAnyDead(client_p) && parse_client_line(client_p) > 0)
+            ;
     } else if(IsClient(client_p)) {
 
         if(IsOper(client_p) && ConfigFileEntry.no_oper_flood) {
@@ -126,14 +150,11 @@ parse_client_queued(struct Client *client_p)
             else if(client_p->localClient->sent_parsed >= (4 * client_p->localClient->allow_read) && checkflood != -1)
                 break;
 
-            dolen = rb_linebuf_get(&client_p->localClient->
-                                   buf_recvq, readBuf, READBUF_SIZE,
-                                   LINEBUF_COMPLETE, LINEBUF_PARSED);
+            dolen = parse_client_line(client_p);
 
             if(!dolen)
                 break;
 
-            client_dopacket(client_p, readBuf, dolen);
             if(IsAnyDead(client_p))
                 return;
             client_p->localClient->sent_parsed++;
@@ -44,6 +44,23 @@
 static struct Dictionary *cmd_dict = NULL;
 struct Dictionary *alias_dict = NULL;
 
+/* dispatch table for parse(), kept in step with cmd_dict as commands
+ * are added and removed.  keys are kept uppercased, so incoming
+ * commands only need folding once, while they are being hashed.
+ */
+struct cmd_slot {
+    unsigned int hashv;
+    unsigned int len;
+    char *key;
+    struct Message *msg;
+};
+
+#define CMD_FOLDLEN	32
+
+static struct cmd_slot *cmd_table;
+static unsigned int cmd_table_mask;
+static unsigned int cmd_table_count;
+
 /* parv[0] is not used, and parv[LAST] == NULL */
 static char *para[MAXPARA + 2];
 
@@ -57,6 +74,159 @@ static int handle_command(struct Message *, struct Client *, struct Client *, in
 
 static char buffer[1024];
 
+/* find_command()
+ *
+ * inputs	- command name, as received
+ * output	- struct Message for it, or NULL
+ * side effects -
+ */
+static struct Message *
+find_command(const char *name)
+{
+    struct cmd_slot *slot;
+    char folded[CMD_FOLDLEN];
+    unsigned int hashv = 0x811c9dc5;
+    unsigned int len = 0, i;
+    char c;
+
+    for(; *name != '\0'; name++) {
+        /* longer than any sane command, let the dictionary decide */
+        if(len == sizeof(folded) - 1)
+            return irc_dictionary_retrieve(cmd_dict, name - len);
+
+        c = *name;
+        if(c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        folded[len++] = c;
+        hashv = (hashv ^ (unsigned char) c) * 0x01000193;
+    }
+
+    for(i = hashv & cmd_table_mask;; i = (i + 1) & cmd_table_mask) {
+        slot = &cmd_table[i];
+        if(slot->msg == NULL)
+            return NULL;
+        if(slot->hashv == hashv && slot->len == len && !memcmp(slot->key, folded, len))
+            return slot->msg;
+    }
+}
+
+/* cmd_table_place()
+ *
+ * inputs	- filled in slot
+ * output	-
+ * side effects - slot is copied into the first free slot of its chain
+ */
+static void
+cmd_table_place(struct cmd_slot *slot)
+{
+    unsigned int i;
+
+    for(i = slot->hashv & cmd_table_mask; cmd_table[i].msg != NULL; i = (i + 1) & cmd_table_mask)
+        ;
+
+    cmd_table[i] = *slot;
+}
+
+/* grow_cmd_table()
+ *
+ * inputs	-
+ * output	-
+ * side effects - dispatch table is doubled in size and rehashed
+ */
+static void
+grow_cmd_table(void)
+{
+    struct cmd_slot *old = cmd_table;
+    unsigned int old_size = old != NULL ? cmd_table_mask + 1 : 0;
+    unsigned int i;
+
+    cmd_table_mask = old != NULL ? old_size * 2 - 1 : 63;
+    cmd_table = rb_malloc(sizeof(struct cmd_slot) * (cmd_table_mask + 1));
+
+    for(i = 0; i < old_size; i++) {
+        if(old[i].msg != NULL)
+            cmd_table_place(&old[i]);
+    }
+
+    rb_free(old);
+}
+
+/* cmd_table_add()
+ *
+ * inputs	- command to add
+ * output	-
+ * side effects - command is added to the dispatch table
+ */
+static void
+cmd_table_add(struct Message *msg)
+{
+    struct cmd_slot slot;
+    char *p;
+
+    /* keep the table at most half full */
+    if((cmd_table_count + 1) * 2 > cmd_table_mask + 1)
+        grow_cmd_table();
+
+    slot.hashv = 0x811c9dc5;
+    slot.key = rb_strdup(msg->cmd);
+    slot.msg = msg;
+
+    for(p = slot.key; *p != '\0'; p++) {
+        if(*p >= 'a' && *p <= 'z')
+            *p -= 'a' - 'A';
+        slot.hashv = (slot.hashv ^ (unsigned char) *p) * 0x01000193;
+    }
+    slot.len = p - slot.key;
+
+    cmd_table_place(&slot);
+    cmd_table_count++;
+}
+
+/* cmd_table_del()
+ *
+ * inputs	- command to remove
+ * output	-
+ * side effects - command is removed from the dispatch table, and the
+ *		  rest of its chain shifted back over the hole
+ */
+static void
+cmd_table_del(struct Message *msg)
+{
+    unsigned int hashv = 0x811c9dc5;
+    unsigned int i, j, home;
+    const char *p;
+    char c;
+
+    for(p = msg->cmd; *p != '\0'; p++) {
+        c = *p;
+        if(c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        hashv = (hashv ^ (unsigned char) c) * 0x01000193;
+    }
+
+    for(i = hashv & cmd_table_mask; cmd_table[i].msg != msg; i = (i + 1) & cmd_table_mask) {
+        if(cmd_table[i].msg == NULL)
+            return;
+    }
+
+    rb_free(cmd_table[i].key);
+    cmd_table_count--;
+
+    for(j = (i + 1) & cmd_table_mask; cmd_table[j].msg != NULL; j = (j + 1) & cmd_table_mask) {
+        home = cmd_table[j].hashv & cmd_table_mask;
+
+        /* an entry can only move back if the hole lies between its home
+         * slot and where it sits now
+         */
+        if(((j - home) & cmd_table_mask) >= ((j - i) & cmd_table_mask)) {
+            cmd_table[i] = cmd_table[j];
+            i = j;
+        }
+    }
+
+    memset(&cmd_table[i], 0, sizeof(struct cmd_slot));
+}
+
 /* turn a string into a parc/parv pair */
 
 
@@ -194,7 +364,7 @@ parse(struct Client *client_p, char *pbuffer, char *bufend)
         if((s = strchr(ch, ' ')))
             *s++ = '\0';
 
-        mptr = irc_dictionary_retrieve(cmd_dict, ch);
+        mptr = find_command(ch);
 
         /* no command or its encap only, error */
         if(!mptr || !mptr->cmd) {
@@ -351,7 +521,7 @@ handle_encap(struct Client *client_p, struct Client *source_p,
 
     parv[0] = source_p->name;
 
-    mptr = irc_dictionary_retrieve(cmd_dict, command);
+    mptr = find_command(command);
 
     if(mptr == NULL || mptr->cmd == NULL)
         return;
@@ -379,6 +549,7 @@ void
 clear_hash_parse()
 {
     cmd_dict = irc_dictionary_create(strcasecmp);
+    grow_cmd_table();
 }
 
 /* mod_add_cmd
@@ -405,6 +576,7 @@ mod_add_cmd(struct Message *msg)
     msg->bytes = 0;
 
     irc_dictionary_add(cmd_dict, msg->cmd, msg);
+    cmd_table_add(msg);
 }
 
 /* mod_del_cmd
@@ -420,7 +592,9 @@ mod_del_cmd(struct Message *msg)
     if(msg == NULL)
         return;
 
-    irc_dictionary_delete(cmd_dict, msg->cmd);
+    if(irc_dictionary_delete(cmd_dict, msg->cmd) == NULL)
+        return;
+    cmd_table_del(msg);
 }
 
 /*
@@ -21,6 +21,12 @@
  * removed, various robustness fixes
  *
  * 2006 --jilles and nenolod
+ *
+ * Answers are cached for their TTL, NXDOMAIN and empty answers for the
+ * SOA minimum (RFC 2308), and a question already on the wire is not
+ * asked again: later askers just wait on the first.  Cached answers are
+ * handed out from the event loop, never from inside gethost_by*(), as
+ * callers set up their state after asking.
  */
 
 #include "stdinc.h"
@@ -32,6 +38,8 @@
 #include "match.h"
 #include "numeric.h"
 #include "client.h" /* SNO_* */
+#include "irc_dictionary.h"
+#include "send.h"
 
 #if (CHAR_BIT != 8)
 #error this code needs to be able to address individual octets
@@ -43,6 +51,8 @@ static PF res_readreply;
 #define RES_MAXALIASES 35	/* maximum aliases allowed */
 #define RES_MAXADDRS   35	/* maximum addresses allowed */
 #define AR_TTL         600	/* TTL in seconds for dns cache entries */
+#define RES_CACHE_MAX  8192	/* maximum number of cached answers */
+#define RES_KEYLEN     (IRCD_RES_HOSTLEN + 8)
 
 /* RFC 1104/1105 wasn't very helpful about what these fields
  * should be named, so for now, we'll just name them this way.
@@ -60,6 +70,7 @@ struct reslist {
     time_t ttl;
     char type;
     char queryname[IRCD_RES_HOSTLEN + 1]; /* name currently being queried */
+    char key[RES_KEYLEN];	/* type and queryname, see res_make_key() */
     char retries;		/* retry counter */
     char sends;		/* number of sends (>1 means resent) */
     time_t sentat;
@@ -67,15 +78,53 @@ struct reslist {
     unsigned int lastns;	/* index of last server sent to */
     struct rb_sockaddr_storage addr;
     char *name;
-    struct DNSQuery *query;	/* query callback for this request */
+    rb_dlink_list waiters;	/* struct reswaiter, one per DNSQuery */
+};
+
+/* a DNSQuery waiting on a request, or holding its answer until the
+ * callback is run
+ */
+struct reswaiter {
+    rb_dlink_node node;
+    struct DNSQuery *query;
+    int found;
+    struct DNSReply reply;
+    char name[IRCD_RES_HOSTLEN + 1];
+};
+
+struct rescache {
+    rb_dlink_node node;	/* res_cache_list, oldest first */
+    char key[RES_KEYLEN];
+    time_t expires;
+    char *name;		/* NULL for a negative answer */
+    struct rb_sockaddr_storage addr;
 };
 
 static rb_fde_t *res_fd;
 static rb_dlink_list request_list = { NULL, NULL, 0 };
 static int ns_timeout_count[IRCD_MAXNS];
 
+static struct Dictionary *res_pending_dict;
+static struct Dictionary *res_cache_dict;
+static rb_dlink_list res_cache_list;
+static rb_dlink_list res_deliver_list;
+static rb_fde_t *res_wake_r, *res_wake_w;
+static int res_wake_pending;
+
+static struct {
+    unsigned long hits;
+    unsigned long negative_hits;
+    unsigned long misses;
+    unsigned long coalesced;
+} res_stats;
+
 static void rem_request(struct reslist *request);
-static struct reslist *make_request(struct DNSQuery *query);
+static void res_answer(struct reslist *request, const char *name,
+                       const struct rb_sockaddr_storage *addr);
+static void res_wake_cb(rb_fde_t *F, void *data);
+static void res_cache_expire(void *unused);
+static void res_cache_flush(void);
+static struct reslist *make_request(struct DNSQuery *query, const char *key);
 static void do_query_name(struct DNSQuery *query, const char *name, struct reslist *request, int);
 static void do_query_number(struct DNSQuery *query, const struct rb_sockaddr_storage *,
                             struct reslist *request);
@@ -85,7 +134,7 @@ static void resend_query(struct reslist *request);
 static int check_question(struct reslist *request, HEADER * header, char *buf, char *eob);
 static int proc_answer(struct reslist *request, HEADER * header, char *, char *);
 static struct reslist *find_id(int id);
-static struct DNSReply *make_dnsreply(struct reslist *request);
+static void res_deliver(void);
 
 /*
  * int
@@ -167,7 +216,7 @@ static time_t timeout_query_list(time_t now)
 
         if (now >= timeout) {
             if (--request->retries <= 0) {
-                (*request->query->callback) (request->query->ptr, NULL);
+                res_answer(request, NULL, NULL);
                 rem_request(request);
                 continue;
             } else {
@@ -192,6 +241,7 @@ static time_t timeout_query_list(time_t now)
 static void timeout_resolver(void *notused)
 {
     timeout_query_list(rb_current_time());
+    res_deliver();
 }
 
 static struct ev_entry *timeout_resolver_ev = NULL;
@@ -217,6 +267,16 @@ static void start_resolver(void)
         rb_setselect(res_fd, RB_SELECT_READ, res_readreply, NULL);
         timeout_resolver_ev = rb_event_add("timeout_resolver", timeout_resolver, NULL, 1);
     }
+
+    if (res_pending_dict == NULL) {
+        res_pending_dict = irc_dictionary_create(strcasecmp);
+        res_cache_dict = irc_dictionary_create(strcasecmp);
+        rb_event_addish("res_cache_expire", res_cache_expire, NULL, 60);
+
+        /* without it, cached answers wait for timeout_resolver() */
+        if (rb_pipe(&res_wake_r, &res_wake_w, "resolver wakeup pipe") == 0)
+            rb_setselect(res_wake_r, RB_SELECT_READ, res_wake_cb, NULL);
+    }
 }
 
 /*
@@ -238,6 +298,7 @@ void restart_resolver(void)
     rb_close(res_fd);
     res_fd = NULL;
     rb_event_delete(timeout_resolver_ev);	/* -ddosen */
+    res_cache_flush();
     start_resolver();
 }
 
@@ -267,42 +328,257 @@ void add_local_domain(char *hname, size_t size)
  */
 static void rem_request(struct reslist *request)
 {
+    rb_dlink_node *ptr;
+    rb_dlink_node *next_ptr;
+
     rb_dlinkDelete(&request->node, &request_list);
+    irc_dictionary_delete(res_pending_dict, request->key);
+
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, request->waiters.head)
+        rb_free(ptr->data);
+
     rb_free(request->name);
     rb_free(request);
 }
 
+static struct reswaiter *make_waiter(struct DNSQuery *query)
+{
+    struct reswaiter *waiter = rb_malloc(sizeof(struct reswaiter));
+
+    waiter->query = query;
+    return waiter;
+}
+
 /*
  * make_request - Create a DNS request record for the server.
  */
-static struct reslist *make_request(struct DNSQuery *query)
+static struct reslist *make_request(struct DNSQuery *query, const char *key)
 {
     struct reslist *request = rb_malloc(sizeof(struct reslist));
+    struct reswaiter *waiter;
 
     request->sentat = rb_current_time();
     request->retries = 3;
     request->timeout = 4;	/* start at 4 and exponential inc. */
-    request->query = query;
+
+    rb_strlcpy(request->key, key, sizeof(request->key));
+    irc_dictionary_add(res_pending_dict, request->key, request);
+
+    waiter = make_waiter(query);
+    rb_dlinkAddTail(waiter, &waiter->node, &request->waiters);
 
     rb_dlinkAdd(request, &request->node, &request_list);
+    res_stats.misses++;
 
     return request;
 }
 
+/*
+ * res_make_key - key a question by type and name, for the cache
+ * and to find the same question already on the wire
+ */
+static void res_make_key(char *key, int type, const char *queryname)
+{
+    rb_snprintf(key, RES_KEYLEN, "%d %s", type, queryname);
+}
+
+/*
+ * res_join - wait on the same question if it has already been asked
+ */
+static int res_join(struct DNSQuery *query, const char *key)
+{
+    struct reslist *request;
+    struct reswaiter *waiter;
+
+    if ((request = irc_dictionary_retrieve(res_pending_dict, key)) == NULL)
+        return 0;
+
+    waiter = make_waiter(query);
+    rb_dlinkAddTail(waiter, &waiter->node, &request->waiters);
+    res_stats.coalesced++;
+    return 1;
+}
+
+/*
+ * res_queue_answer - keep an answer, or NULL, until res_deliver()
+ */
+static void res_queue_answer(struct reswaiter *waiter, const char *name,
+                             const struct rb_sockaddr_storage *addr)
+{
+    if (name != NULL) {
+        waiter->found = 1;
+        rb_strlcpy(waiter->name, name, sizeof(waiter->name));
+        waiter->reply.h_name = waiter->name;
+        if (addr != NULL)
+            memcpy(&waiter->reply.addr, addr, sizeof(waiter->reply.addr));
+    }
+
+    rb_dlinkAddTail(waiter, &waiter->node, &res_deliver_list);
+}
+
+/*
+ * res_answer - pass a request's answer on to everyone waiting on it
+ */
+static void res_answer(struct reslist *request, const char *name,
+                       const struct rb_sockaddr_storage *addr)
+{
+    rb_dlink_node *ptr;
+    rb_dlink_node *next_ptr;
+
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, request->waiters.head) {
+        rb_dlinkDelete(ptr, &request->waiters);
+        res_queue_answer(ptr->data, name, addr);
+    }
+}
+
+/*
+ * res_deliver - run the callbacks for answers we have.
+ * A callback may delete other queries, so each waiter is taken off
+ * the list before its callback runs.
+ */
+static void res_deliver(void)
+{
+    struct reswaiter *waiter;
+
+    while (res_deliver_list.head != NULL) {
+        waiter = res_deliver_list.head->data;
+        rb_dlinkDelete(&waiter->node, &res_deliver_list);
+
+        (*waiter->query->callback) (waiter->query->ptr, waiter->found ? &waiter->reply : NULL);
+        rb_free(waiter);
+    }
+}
+
+static void res_wakeup(void)
+{
+    if (res_wake_pending || res_wake_w == NULL)
+        return;
+
+    res_wake_pending = 1;
+    rb_write(res_wake_w, "0", 1);
+}
+
+static void res_wake_cb(rb_fde_t *F, void *data)
+{
+    char buf[64];
+
+    while (rb_read(F, buf, sizeof(buf)) > 0)
+        ;
+
+    res_wake_pending = 0;
+    res_deliver();
+    rb_setselect(F, RB_SELECT_READ, res_wake_cb, NULL);
+}
+
+static void res_cache_free(struct rescache *entry)
+{
+    irc_dictionary_delete(res_cache_dict, entry->key);
+    rb_dlinkDelete(&entry->node, &res_cache_list);
+    rb_free(entry->name);
+    rb_free(entry);
+}
+
+/*
+ * res_cache_add - remember an answer, or with name NULL that there
+ * is none, for ttl seconds.  The oldest entry makes room if needed.
+ */
+static void res_cache_add(const char *key, const char *name,
+                          const struct rb_sockaddr_storage *addr, time_t ttl)
+{
+    struct rescache *entry;
+
+    if (ttl <= 0)
+        return;
+
+    if ((entry = irc_dictionary_retrieve(res_cache_dict, key)) != NULL)
+        res_cache_free(entry);
+    else if (rb_dlink_list_length(&res_cache_list) >= RES_CACHE_MAX)
+        res_cache_free(res_cache_list.head->data);
+
+    entry = rb_malloc(sizeof(struct rescache));
+    rb_strlcpy(entry->key, key, sizeof(entry->key));
+    entry->expires = rb_current_time() + ttl;
+    if (name != NULL)
+        entry->name = rb_strdup(name);
+    if (addr != NULL)
+        memcpy(&entry->addr, addr, sizeof(entry->addr));
+
+    irc_dictionary_add(res_cache_dict, entry->key, entry);
+    rb_dlinkAddTail(entry, &entry->node, &res_cache_list);
+}
+
+static struct rescache *res_cache_find(const char *key)
+{
+    struct rescache *entry;
+
+    if ((entry = irc_dictionary_retrieve(res_cache_dict, key)) == NULL)
+        return NULL;
+
+    if (entry->expires <= rb_current_time()) {
+        res_cache_free(entry);
+        return NULL;
+    }
+
+    res_stats.hits++;
+    if (entry->name == NULL)
+        res_stats.negative_hits++;
+
+    return entry;
+}
+
+static void res_cache_expire(void *unused)
+{
+    rb_dlink_node *ptr;
+    rb_dlink_node *next_ptr;
+    struct rescache *entry;
+
+    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, res_cache_list.head) {
+        entry = ptr->data;
+
+        if (entry->expires <= rb_current_time())
+            res_cache_free(entry);
+    }
+}
+
+static void res_cache_flush(void)
+{
+    while (res_cache_list.head != NULL)
+        res_cache_free(res_cache_list.head->data);
+}
+
 /*
  * delete_resolver_queries - cleanup outstanding queries
  * for which there no longer exist clients or conf lines.
+ * The question itself stays on the wire, its answer is still
+ * worth caching.
  */
 void delete_resolver_queries(const struct DNSQuery *query)
 {
     rb_dlink_node *ptr;
+    rb_dlink_node *wptr;
     rb_dlink_node *next_ptr;
     struct reslist *request;
+    struct reswaiter *waiter;
 
-    RB_DLINK_FOREACH_SAFE(ptr, next_ptr, request_list.head) {
-        if ((request = ptr->data) != NULL) {
-            if (query == request->query)
-                rem_request(request);
+    RB_DLINK_FOREACH(ptr, request_list.head) {
+        request = ptr->data;
+
+        RB_DLINK_FOREACH_SAFE(wptr, next_ptr, request->waiters.head) {
+            waiter = wptr->data;
+
+            if (waiter->query == query) {
+                rb_dlinkDelete(wptr, &request->waiters);
+                rb_free(waiter);
+            }
+        }
+    }
+
+    RB_DLINK_FOREACH_SAFE(wptr, next_ptr, res_deliver_list.head) {
+        waiter = wptr->data;
+
+        if (waiter->query == query) {
+            rb_dlinkDelete(wptr, &res_deliver_list);
+            rb_free(waiter);
         }
     }
 }
@@ -411,12 +687,25 @@ static void do_query_name(struct DNSQuery *query, const char *name, struct resli
                           int type)
 {
     char host_name[IRCD_RES_HOSTLEN + 1];
+    char key[RES_KEYLEN];
+    struct rescache *entry;
 
     rb_strlcpy(host_name, name, IRCD_RES_HOSTLEN + 1);
     add_local_domain(host_name, IRCD_RES_HOSTLEN);
 
     if (request == NULL) {
-        request = make_request(query);
+        res_make_key(key, type, host_name);
+
+        if ((entry = res_cache_find(key)) != NULL) {
+            res_queue_answer(make_waiter(query), entry->name, &entry->addr);
+            res_wakeup();
+            return;
+        }
+
+        if (res_join(query, key))
+            return;
+
+        request = make_request(query, key);
         request->name = (char *)rb_malloc(strlen(host_name) + 1);
         strcpy(request->name, host_name);
     }
@@ -432,19 +721,16 @@ static void do_query_name(struct DNSQuery *query, const char *name, struct resli
 static void do_query_number(struct DNSQuery *query, const struct rb_sockaddr_storage *addr,
                             struct reslist *request)
 {
+    char queryname[IRCD_RES_HOSTLEN + 1];
+    char key[RES_KEYLEN];
+    struct rescache *entry;
     const unsigned char *cp;
 
-    if (request == NULL) {
-        request = make_request(query);
-        memcpy(&request->addr, addr, sizeof(struct rb_sockaddr_storage));
-        request->name = (char *)rb_malloc(IRCD_RES_HOSTLEN + 1);
-    }
-
     if (addr->ss_family == AF_INET) {
         const struct sockaddr_in *v4 = (const struct sockaddr_in *)addr;
         cp = (const unsigned char *)&v4->sin_addr.s_addr;
 
-        rb_sprintf(request->queryname, "%u.%u.%u.%u.in-addr.arpa", (unsigned int)(cp[3]),
+        rb_sprintf(queryname, "%u.%u.%u.%u.in-addr.arpa", (unsigned int)(cp[3]),
                    (unsigned int)(cp[2]), (unsigned int)(cp[1]), (unsigned int)(cp[0]));
     }
 #ifdef RB_IPV6
@@ -452,7 +738,7 @@ static void do_query_number(struct DNSQuery *query, const struct rb_sockaddr_sto
         const struct sockaddr_in6 *v6 = (const struct sockaddr_in6 *)addr;
         cp = (const unsigned char *)&v6->sin6_addr.s6_addr;
 
-        (void)sprintf(request->queryname, "%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x."
+        (void)sprintf(queryname, "%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x."
                       "%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.%x.ip6.arpa",
                       (unsigned int)(cp[15] & 0xf), (unsigned int)(cp[15] >> 4),
                       (unsigned int)(cp[14] & 0xf), (unsigned int)(cp[14] >> 4),
@@ -472,7 +758,35 @@ static void do_query_number(struct DNSQuery *query, const struct rb_sockaddr_sto
                       (unsigned int)(cp[0] & 0xf), (unsigned int)(cp[0] >> 4));
     }
 #endif
+    else
+        return;
+
+    if (request == NULL) {
+        res_make_key(key, T_PTR, queryname);
+
+        if ((entry = res_cache_find(key)) != NULL) {
+            if (entry->name == NULL) {
+                res_queue_answer(make_waiter(query), NULL, NULL);
+                res_wakeup();
+            }
+#ifdef RB_IPV6
+            else if (addr->ss_family == AF_INET6)
+                do_query_name(query, entry->name, NULL, T_AAAA);
+#endif
+            else
+                do_query_name(query, entry->name, NULL, T_A);
+            return;
+        }
+
+        if (res_join(query, key))
+            return;
+
+        request = make_request(query, key);
+        memcpy(&request->addr, addr, sizeof(struct rb_sockaddr_storage));
+        request->name = (char *)rb_malloc(IRCD_RES_HOSTLEN + 1);
+    }
 
+    rb_strlcpy(request->queryname, queryname, sizeof(request->queryname));
     request->type = T_PTR;
     query_name(request);
 }
@@ -572,12 +886,16 @@ static int proc_answer(struct reslist *request, HEADER * header, char *buf, char
     int type;		/* answer type */
     int n;			/* temp count */
     int rd_length;
+    unsigned long ttl;
     struct sockaddr_in *v4;	/* conversion */
 #ifdef RB_IPV6
     struct sockaddr_in6 *v6;
 #endif
     current = (unsigned char *)buf + sizeof(HEADER);
 
+    /* the answer is good for as long as every record leading to it */
+    request->ttl = AR_TTL;
+
     for (; header->qdcount > 0; --header->qdcount) {
         if ((n = irc_dn_skipname(current, (unsigned char *)eob)) < 0)
             return 0;
@@ -623,7 +941,9 @@ static int proc_answer(struct reslist *request, HEADER * header, char *buf, char
         query_class = irc_ns_get16(current);
         current += CLASS_SIZE;
 
-        request->ttl = irc_ns_get32(current);
+        ttl = irc_ns_get32(current);
+        if (ttl < (unsigned long)request->ttl)
+            request->ttl = ttl;
         current += TTL_SIZE;
 
         rd_length = irc_ns_get16(current);
@@ -693,6 +1013,68 @@ static int proc_answer(struct reslist *request, HEADER * header, char *buf, char
     return (1);
 }
 
+/*
+ * res_negative_ttl - how long a reply without answers may be cached:
+ * the smaller of the SOA's TTL and its minimum field, if the server
+ * sent the SOA along (RFC 2308), else not at all.
+ */
+static time_t res_negative_ttl(HEADER * header, char *buf, char *eob)
+{
+    unsigned char *current;	/* current position in buf */
+    unsigned char *rdata;
+    unsigned long ttl, minimum;
+    int type, rd_length, n, i;
+
+    current = (unsigned char *)buf + sizeof(HEADER);
+
+    for (i = 0; i < header->qdcount; i++) {
+        if ((n = irc_dn_skipname(current, (unsigned char *)eob)) < 0)
+            return 0;
+        current += (size_t) n + QFIXEDSZ;
+    }
+
+    for (i = 0; i < header->ancount + header->nscount; i++) {
+        if ((n = irc_dn_skipname(current, (unsigned char *)eob)) < 0)
+            return 0;
+        current += (size_t) n;
+
+        if ((char *)current + ANSWER_FIXED_SIZE > eob)
+            return 0;
+
+        type = irc_ns_get16(current);
+        current += TYPE_SIZE + CLASS_SIZE;
+        ttl = irc_ns_get32(current);
+        current += TTL_SIZE;
+        rd_length = irc_ns_get16(current);
+        current += RDLENGTH_SIZE;
+
+        if ((char *)current + rd_length > eob)
+            return 0;
+
+        if (i >= header->ancount && type == T_SOA) {
+            /* mname, rname, then serial, refresh, retry, expire, minimum */
+            rdata = current;
+            if ((n = irc_dn_skipname(rdata, (unsigned char *)eob)) < 0)
+                return 0;
+            rdata += n;
+            if ((n = irc_dn_skipname(rdata, (unsigned char *)eob)) < 0)
+                return 0;
+            rdata += n;
+            if ((char *)rdata + 20 > eob)
+                return 0;
+
+            minimum = irc_ns_get32(rdata + 16);
+            if (minimum < ttl)
+                ttl = minimum;
+            return ttl < AR_TTL ? (time_t)ttl : AR_TTL;
+        }
+
+        current += rd_length;
+    }
+
+    return 0;
+}
+
 /*
  * res_read_single_reply - read a dns reply from the nameserver and process it.
  * Return value: 1 if a packet was read, 0 otherwise
@@ -710,7 +1092,9 @@ static int res_read_single_reply(rb_fde_t *F, void *data)
     ;
     HEADER *header;
     struct reslist *request = NULL;
-    struct DNSReply *reply = NULL;
+    rb_dlink_node *ptr;
+    rb_dlink_node *next_ptr;
+    struct reswaiter *waiter;
     int rc;
     int answer_count;
     socklen_t len = sizeof(struct rb_sockaddr_storage);
@@ -752,17 +1136,16 @@ static int res_read_single_reply(rb_fde_t *F, void *data)
         return 1;
 
     if ((header->rcode != NO_ERRORS) || (header->ancount == 0)) {
-        if (NXDOMAIN == header->rcode) {
-            (*request->query->callback) (request->query->ptr, NULL);
-            rem_request(request);
-        } else {
-            /*
-             * If a bad error was returned, we stop here and dont send
-             * send any more (no retries granted).
-             */
-            (*request->query->callback) (request->query->ptr, NULL);
-            rem_request(request);
-        }
+        /*
+         * The name doesn't exist, or has nothing of this type, and
+         * that can be cached.  Any other error we stop here and dont
+         * send any more (no retries granted), but ask afresh next time.
+         */
+        if (header->rcode == NXDOMAIN || header->rcode == NO_ERRORS)
+            res_cache_add(request->key, NULL, NULL, res_negative_ttl(header, buf, buf + rc));
+
+        res_answer(request, NULL, NULL);
+        rem_request(request);
         return 1;
     }
     /*
@@ -773,40 +1156,46 @@ static int res_read_single_reply(rb_fde_t *F, void *data)
 
     if (answer_count) {
         if (request->type == T_PTR) {
-            if (request->name == NULL) {
+            if (request->name == NULL || request->name[0] == '\0') {
                 /*
                  * got a PTR response with no name, something bogus is happening
                  * don't bother trying again, the client address doesn't resolve
                  */
-                (*request->query->callback) (request->query->ptr, reply);
+                res_answer(request, NULL, NULL);
                 rem_request(request);
                 return 1;
             }
 
+            res_cache_add(request->key, request->name, NULL, request->ttl);
+
             /*
              * Lookup the 'authoritative' name that we were given for the
-             * ip#.
+             * ip#, for everyone who asked.
              *
              */
+            RB_DLINK_FOREACH_SAFE(ptr, next_ptr, request->waiters.head) {
+                waiter = ptr->data;
 #ifdef RB_IPV6
-            if (request->addr.ss_family == AF_INET6)
-                gethost_byname_type(request->name, request->query, T_AAAA);
-            else
+                if (request->addr.ss_family == AF_INET6)
+                    gethost_byname_type(request->name, waiter->query, T_AAAA);
+                else
 #endif
-                gethost_byname_type(request->name, request->query, T_A);
+                    gethost_byname_type(request->name, waiter->query, T_A);
+            }
             rem_request(request);
         } else {
             /*
              * got a name and address response, client resolved
              */
-            reply = make_dnsreply(request);
-            (*request->query->callback) (request->query->ptr, reply);
-            rb_free(reply);
+            if (request->addr.ss_family != 0)
+                res_cache_add(request->key, request->name, &request->addr, request->ttl);
+
+            res_answer(request, request->name, &request->addr);
             rem_request(request);
         }
     } else {
         /* couldn't decode, give up -- jilles */
-        (*request->query->callback) (request->query->ptr, NULL);
+        res_answer(request, NULL, NULL);
         rem_request(request);
     }
     return 1;
@@ -816,21 +1205,10 @@ static void res_readreply(rb_fde_t *F, void *data)
 {
     while (res_read_single_reply(F, data))
         ;
+    res_deliver();
     rb_setselect(F, RB_SELECT_READ, res_readreply, NULL);
 }
 
-static struct DNSReply *make_dnsreply(struct reslist *request)
-{
-    struct DNSReply *cp;
-    s_assert(request != 0);
-
-    cp = (struct DNSReply *)rb_malloc(sizeof(struct DNSReply));
-
-    cp->h_name = request->name;
-    memcpy(&cp->addr, &request->addr, sizeof(cp->addr));
-    return (cp);
-}
-
 void report_dns_servers(struct Client *source_p)
 {
     int i;
@@ -843,4 +1221,10 @@ void report_dns_servers(struct Client *source_p)
         sendto_one_numeric(source_p, RPL_STATSDEBUG,
                            "A %s %d", ipaddr, ns_timeout_count[i]);
     }
+
+    sendto_one_numeric(source_p, RPL_STATSDEBUG,
+                       "A cache %lu/%d hits %lu (%lu negative) misses %lu joined %lu",
+                       rb_dlink_list_length(&res_cache_list), RES_CACHE_MAX,
+                       res_stats.hits, res_stats.negative_hits,
+                       res_stats.misses, res_stats.coalesced);
 }
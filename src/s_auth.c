@@ -48,6 +48,7 @@
 #include "send.h"
 #include "hook.h"
 #include "blacklist.h"
+#include "scache.h"
 
 struct AuthRequest {
     rb_dlink_node node;
@@ -182,7 +183,7 @@ release_auth_client(struct AuthRequest *auth)
      *     -- adrian
      */
     client->localClient->allow_read = MAX_FLOOD;
-    rb_dlinkAddTail(client, &client->node, &global_client_list);
+    add_client_to_list(client);
     read_packet(client->localClient->F, client);
 }
 
@@ -244,7 +245,7 @@ auth_dns_callback(void *vptr, struct DNSReply *reply)
         }
 
         if(good && strlen(reply->h_name) <= HOSTLEN) {
-            rb_strlcpy(auth->client->host, reply->h_name, sizeof(auth->client->host));
+            scache_set(&auth->client->host, reply->h_name, HOSTLEN + 1);
             sendheader(auth->client, REPORT_FIN_DNS);
         } else if (strlen(reply->h_name) > HOSTLEN)
             sendheader(auth->client, REPORT_HOST_TOOLONG);
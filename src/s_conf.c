@@ -52,6 +52,8 @@
 #include "bandbi.h"
 #include "operhash.h"
 #include "chmode.h"
+#include "whowas.h"
+#include "scache.h"
 
 struct config_server_hide ConfigServerHide;
 
@@ -364,11 +366,10 @@ verify_access(struct Client *client_p, const char *username)
 
                 rb_strlcpy(client_p->username, aconf->info.name,
                            sizeof(client_p->username));
-                rb_strlcpy(client_p->host, host,
-                           sizeof(client_p->host));
+                scache_set(&client_p->host, host, HOSTLEN + 1);
                 *p = '@';
             } else
-                rb_strlcpy(client_p->host, aconf->info.name, sizeof(client_p->host));
+                scache_set(&client_p->host, aconf->info.name, HOSTLEN + 1);
         }
         return (attach_iline(client_p, aconf));
     } else if(aconf->status & CONF_KILL) {
@@ -608,9 +609,9 @@ rehash(int sig)
     read_conf_files(NO);
 
     if(ServerInfo.description != NULL)
-        rb_strlcpy(me.info, ServerInfo.description, sizeof(me.info));
+        scache_set(&me.info, ServerInfo.description, REALLEN + 1);
     else
-        rb_strlcpy(me.info, "unknown", sizeof(me.info));
+        scache_set(&me.info, "unknown", REALLEN + 1);
 
     open_logfiles();
     return (0);
@@ -677,6 +678,7 @@ set_default_conf(void)
     ConfigFileEntry.max_accept = 20;
     ConfigFileEntry.max_monitor = 60;
     ConfigFileEntry.nick_delay = 900;	/* 15 minutes */
+    ConfigFileEntry.whowas_length = NICKNAMEHISTORYLENGTH;
     ConfigFileEntry.target_change = YES;
     ConfigFileEntry.anti_spam_exit_message_time = 0;
     ConfigFileEntry.use_part_messages = YES;
@@ -712,6 +714,7 @@ set_default_conf(void)
     ConfigFileEntry.fname_klinelog = NULL;
     ConfigFileEntry.fname_operspylog = NULL;
     ConfigFileEntry.fname_ioerrorlog = NULL;
+    ConfigFileEntry.log_flush_interval = 1;
     ConfigFileEntry.use_egd = NO;
     ConfigFileEntry.hide_spoof_ips = YES;
     ConfigFileEntry.hide_error_messages = 1;
@@ -861,6 +864,10 @@ validate_conf(void)
        (ConfigFileEntry.client_flood > CLIENT_FLOOD_MAX))
         ConfigFileEntry.client_flood = CLIENT_FLOOD_MAX;
 
+    if(ConfigFileEntry.whowas_length < 1)
+        ConfigFileEntry.whowas_length = NICKNAMEHISTORYLENGTH;
+    whowas_set_size(ConfigFileEntry.whowas_length);
+
     if(!split_users || !split_servers ||
        (!ConfigChannel.no_create_on_split && !ConfigChannel.no_join_on_split)) {
         rb_event_delete(check_splitmode_ev);
@@ -1163,9 +1170,11 @@ deactivate_conf(struct ConfItem *aconf, rb_dlink_node *ptr)
         break;
     case CONF_XLINE:
         rb_dlinkFindDestroy(aconf, &xline_conf_list);
+        xline_conf_changed();
         break;
     case CONF_RESV_NICK:
         rb_dlinkFindDestroy(aconf, &resv_conf_list);
+        resv_conf_changed();
         break;
     case CONF_RESV_CHANNEL:
         del_from_resv_hash(aconf->host, aconf);
@@ -1513,6 +1522,7 @@ clear_out_old_conf(void)
     ServerInfo.helpurl = NULL;
 
     ServerInfo.ssld_count = 1;
+    ServerInfo.ssl_ktls = 0;
 
     /* clean out AdminInfo */
     rb_free(AdminInfo.name);
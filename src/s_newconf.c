@@ -58,6 +58,10 @@ rb_patricia_tree_t *tgchange_tree;
 
 static rb_bh *nd_heap = NULL;
 
+/* compiled from xline_conf_list and resv_conf_list on demand */
+static struct EscMaskSet *xline_masks;
+static struct EscMaskSet *resv_masks;
+
 static void expire_temp_rxlines(void *unused);
 static void expire_nd_entries(void *unused);
 
@@ -118,6 +122,9 @@ clear_s_newconf_bans(void)
     struct ConfItem *aconf;
     rb_dlink_node *ptr, *next_ptr;
 
+    xline_conf_changed();
+    resv_conf_changed();
+
     RB_DLINK_FOREACH_SAFE(ptr, next_ptr, xline_conf_list.head) {
         aconf = ptr->data;
 
@@ -451,23 +458,49 @@ disable_server_conf_autoconn(const char *name)
     }
 }
 
+static const char *
+conf_mask(void *data)
+{
+    return ((struct ConfItem *)data)->host;
+}
+
+/* xline_conf_changed()
+ *
+ * inputs	-
+ * outputs	-
+ * side effects - the compiled X-line masks are thrown away, to be rebuilt
+ *		  from xline_conf_list when next needed
+ */
+void
+xline_conf_changed(void)
+{
+    escmask_free(xline_masks);
+    xline_masks = NULL;
+}
+
+void
+resv_conf_changed(void)
+{
+    escmask_free(resv_masks);
+    resv_masks = NULL;
+}
+
 struct ConfItem *
 find_xline(const char *gecos, int counter)
 {
     struct ConfItem *aconf;
-    rb_dlink_node *ptr;
 
-    RB_DLINK_FOREACH(ptr, xline_conf_list.head) {
-        aconf = ptr->data;
+    if(xline_masks != NULL &&
+       escmask_count(xline_masks) != rb_dlink_list_length(&xline_conf_list))
+        xline_conf_changed();
 
-        if(match_esc(aconf->host, gecos)) {
-            if(counter)
-                aconf->port++;
-            return aconf;
-        }
-    }
+    if(xline_masks == NULL)
+        xline_masks = escmask_build(&xline_conf_list, conf_mask);
 
-    return NULL;
+    if((aconf = escmask_find(xline_masks, gecos)) != NULL && counter)
+        aconf->port++;
+
+    return aconf;
 }
 
 struct ConfItem *
@@ -490,18 +523,18 @@ struct ConfItem *
 find_nick_resv(const char *name)
 {
     struct ConfItem *aconf;
-    rb_dlink_node *ptr;
 
-    RB_DLINK_FOREACH(ptr, resv_conf_list.head) {
-        aconf = ptr->data;
+    if(resv_masks != NULL &&
+       escmask_count(resv_masks) != rb_dlink_list_length(&resv_conf_list))
+        resv_conf_changed();
 
-        if(match_esc(aconf->host, name)) {
-            aconf->port++;
-            return aconf;
-        }
-    }
+    if(resv_masks == NULL)
+        resv_masks = escmask_build(&resv_conf_list, conf_mask);
 
-    return NULL;
+    if((aconf = escmask_find(resv_masks, name)) != NULL)
+        aconf->port++;
+
+    return aconf;
 }
 
 struct ConfItem *
@@ -647,6 +680,7 @@ expire_temp_rxlines(void *unused)
                 sendto_realops_snomask(SNO_GENERAL, L_ALL,
                                        "Temporary RESV for [%s] expired",
                                        aconf->host);
+            resv_conf_changed();
             free_conf(aconf);
             rb_dlinkDestroy(ptr, &resv_conf_list);
         }
@@ -662,6 +696,7 @@ expire_temp_rxlines(void *unused)
                 sendto_realops_snomask(SNO_GENERAL, L_ALL,
                                        "Temporary X-line for [%s] expired",
                                        aconf->host);
+            xline_conf_changed();
             free_conf(aconf);
             rb_dlinkDestroy(ptr, &xline_conf_list);
         }
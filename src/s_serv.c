@@ -63,6 +63,9 @@ int MaxConnectionCount = 1;
 int MaxClientCount = 1;
 int refresh_user_links = 0;
 
+rb_dlink_list burst_list;
+unsigned long user_serial;
+
 static char buf[BUFSIZE];
 
 /*
@@ -336,7 +339,7 @@ check_server(const char *name, struct Client *client_p)
     if(server_p == NULL)
         return error;
 
-    if(ServerConfSSL(server_p) && client_p->localClient->ssl_ctl == NULL) {
+    if(ServerConfSSL(server_p) && !IsSSL(client_p)) {
         return -5;
     }
 
@@ -507,177 +510,397 @@ burst_modes_TS6(struct Client *client_p, struct Channel *chptr,
 }
 
 /*
- * burst_TS6
+ * burst_client_TS6
  *
- * inputs	- client (server) to send nick towards
- * 		- client to send nick for
+ * inputs	- server to burst to, client to introduce
  * output	- NONE
- * side effects	- NICK message is sent towards given client_p
+ * side effects	- UID/EUID and the rest of target_p's state is sent to
+ *		  client_p
  */
 static void
-burst_TS6(struct Client *client_p)
+burst_client_TS6(struct Client *client_p, struct Client *target_p)
 {
     static char ubuf[BUFSIZE];
-    struct Client *target_p;
-    struct Channel *chptr;
-    struct membership *msptr;
     hook_data_client hclientinfo;
+    struct Metadata *md;
+    struct DictionaryIter iter;
+
+    send_umode(NULL, target_p, 0, 0, ubuf);
+    if(!*ubuf) {
+        ubuf[0] = '+';
+        ubuf[1] = '\0';
+    }
+
+    if(IsCapable(client_p, CAP_EUID))
+        sendto_one(client_p, ":%s EUID %s %d %ld %s %s %s %s %s %s %s :%s",
+                   target_p->servptr->id, target_p->name,
+                   target_p->hopcount + 1,
+                   (long) target_p->tsinfo, ubuf,
+                   target_p->username, target_p->host,
+                   IsIPSpoof(target_p) ? "0" : target_p->sockhost,
+                   target_p->id,
+                   IsDynSpoof(target_p) ? target_p->orighost : "*",
+                   EmptyString(target_p->user->suser) ? "*" : target_p->user->suser,
+                   target_p->info);
+    else
+        sendto_one(client_p, ":%s UID %s %d %ld %s %s %s %s %s :%s",
+                   target_p->servptr->id, target_p->name,
+                   target_p->hopcount + 1,
+                   (long) target_p->tsinfo, ubuf,
+                   target_p->username, target_p->host,
+                   IsIPSpoof(target_p) ? "0" : target_p->sockhost,
+                   target_p->id, target_p->info);
+
+    if(!EmptyString(target_p->certfp))
+        sendto_one(client_p, ":%s ENCAP * CERTFP :%s",
+                   use_id(target_p), target_p->certfp);
+
+    if(!IsCapable(client_p, CAP_EUID)) {
+        if(IsDynSpoof(target_p))
+            sendto_one(client_p, ":%s ENCAP * REALHOST %s",
+                       use_id(target_p), target_p->orighost);
+        if(!EmptyString(target_p->user->suser))
+            sendto_one(client_p, ":%s ENCAP * LOGIN %s",
+                       use_id(target_p), target_p->user->suser);
+    }
+
+    DICTIONARY_FOREACH(md, &iter, target_p->user->metadata) {
+        sendto_one(client_p, ":%s ENCAP * METADATA SET %s %s :%s",
+                   use_id(&me), use_id(target_p), md->name, md->value);
+    }
+
+    if(ConfigFileEntry.burst_away && !EmptyString(target_p->user->away))
+        sendto_one(client_p, ":%s AWAY :%s",
+                   use_id(target_p),
+                   target_p->user->away);
+
+    hclientinfo.client = client_p;
+    hclientinfo.target = target_p;
+    call_hook(h_burst_client, &hclientinfo);
+}
+
+/*
+ * burst_channel_TS6
+ *
+ * inputs	- server to burst to, channel to burst
+ * output	- NONE
+ * side effects	- SJOIN, ban lists, topic and mlock for chptr are sent
+ *		  to client_p
+ */
+static void
+burst_channel_TS6(struct Client *client_p, struct Channel *chptr)
+{
+    struct membership *msptr;
     hook_data_channel hchaninfo;
-    rb_dlink_node *ptr;
     rb_dlink_node *uptr;
+    const char *status, *id;
     char *t;
-    int tlen, mlen;
+    size_t slen, idlen;
+    int mlen;
     int cur_len = 0;
     struct Metadata *md;
     struct DictionaryIter iter;
 
-    hclientinfo.client = hchaninfo.client = client_p;
+    cur_len = mlen = rb_sprintf(buf, ":%s SJOIN %ld %s %s :", me.id,
+                                (long) chptr->channelts, chptr->chname,
+                                channel_modes(chptr, client_p));
 
-    RB_DLINK_FOREACH(ptr, global_client_list.head) {
-        target_p = ptr->data;
+    t = buf + mlen;
+
+    /* members are copied straight into the line, one pass each */
+    RB_DLINK_FOREACH(uptr, chptr->members.head) {
+        msptr = uptr->data;
 
-        if(!IsPerson(target_p))
+        /* they were introduced after the burst began, so their UID is
+         * still held back, and so is their join
+         */
+        if(msptr->client_p->user->serial > client_p->localClient->burst->serial)
             continue;
 
-        send_umode(NULL, target_p, 0, 0, ubuf);
-        if(!*ubuf) {
-            ubuf[0] = '+';
-            ubuf[1] = '\0';
-        }
+        status = find_channel_status(msptr, 1);
+        id = use_id(msptr->client_p);
+        slen = strlen(status);
+        idlen = strlen(id);
 
-        if(IsCapable(client_p, CAP_EUID))
-            sendto_one(client_p, ":%s EUID %s %d %ld %s %s %s %s %s %s %s :%s",
-                       target_p->servptr->id, target_p->name,
-                       target_p->hopcount + 1,
-                       (long) target_p->tsinfo, ubuf,
-                       target_p->username, target_p->host,
-                       IsIPSpoof(target_p) ? "0" : target_p->sockhost,
-                       target_p->id,
-                       IsDynSpoof(target_p) ? target_p->orighost : "*",
-                       EmptyString(target_p->user->suser) ? "*" : target_p->user->suser,
-                       target_p->info);
-        else
-            sendto_one(client_p, ":%s UID %s %d %ld %s %s %s %s %s :%s",
-                       target_p->servptr->id, target_p->name,
-                       target_p->hopcount + 1,
-                       (long) target_p->tsinfo, ubuf,
-                       target_p->username, target_p->host,
-                       IsIPSpoof(target_p) ? "0" : target_p->sockhost,
-                       target_p->id, target_p->info);
-
-        if(!EmptyString(target_p->certfp))
-            sendto_one(client_p, ":%s ENCAP * CERTFP :%s",
-                       use_id(target_p), target_p->certfp);
-
-        if(!IsCapable(client_p, CAP_EUID)) {
-            if(IsDynSpoof(target_p))
-                sendto_one(client_p, ":%s ENCAP * REALHOST %s",
-                           use_id(target_p), target_p->orighost);
-            if(!EmptyString(target_p->user->suser))
-                sendto_one(client_p, ":%s ENCAP * LOGIN %s",
-                           use_id(target_p), target_p->user->suser);
+        if(cur_len + slen + idlen + 1 >= BUFSIZE - 3) {
+            *(t-1) = '\0';
+            sendto_one(client_p, "%s", buf);
+            cur_len = mlen;
+            t = buf + mlen;
         }
 
-        DICTIONARY_FOREACH(md, &iter, target_p->user->metadata) {
-            sendto_one(client_p, ":%s ENCAP * METADATA SET %s %s :%s",
-                       use_id(&me), use_id(target_p), md->name, md->value);
-        }
+        memcpy(t, status, slen);
+        t += slen;
+        memcpy(t, id, idlen);
+        t += idlen;
+        *t++ = ' ';
+        cur_len += slen + idlen + 1;
+    }
 
-        if(ConfigFileEntry.burst_away && !EmptyString(target_p->user->away))
-            sendto_one(client_p, ":%s AWAY :%s",
-                       use_id(target_p),
-                       target_p->user->away);
+    if(cur_len > mlen) {
+        /* remove trailing space */
+        *(t-1) = '\0';
+    } else
+        *t = '\0';
+    sendto_one(client_p, "%s", buf);
 
-        hclientinfo.target = target_p;
-        call_hook(h_burst_client, &hclientinfo);
+    DICTIONARY_FOREACH(md, &iter, chptr->metadata) {
+        /* don't bother bursting +J metadata */
+        if(!(md->name[0] == 'K'))
+            sendto_one(client_p, ":%s ENCAP * METADATA SET %s %s :%s",
+                       use_id(&me), chptr->chname, md->name, md->value);
     }
 
-    RB_DLINK_FOREACH(ptr, global_channel_list.head) {
-        chptr = ptr->data;
+    if(rb_dlink_list_length(&chptr->banlist) > 0)
+        burst_modes_TS6(client_p, chptr, &chptr->banlist, 'b');
 
-        if(*chptr->chname != '#')
-            continue;
+    if(IsCapable(client_p, CAP_EX) &&
+       rb_dlink_list_length(&chptr->exceptlist) > 0)
+        burst_modes_TS6(client_p, chptr, &chptr->exceptlist, 'e');
 
-        cur_len = mlen = rb_sprintf(buf, ":%s SJOIN %ld %s %s :", me.id,
-                                    (long) chptr->channelts, chptr->chname,
-                                    channel_modes(chptr, client_p));
-
-        t = buf + mlen;
-
-        RB_DLINK_FOREACH(uptr, chptr->members.head) {
-            msptr = uptr->data;
-
-            tlen = strlen(use_id(msptr->client_p)) + 1;
-            if(is_owner(msptr))
-                tlen++;
-            if(is_admin(msptr))
-                tlen++;
-            if(is_chanop(msptr))
-                tlen++;
-            if(is_halfop(msptr))
-                tlen++;
-            if(is_voiced(msptr))
-                tlen++;
-
-            if(cur_len + tlen >= BUFSIZE - 3) {
-                *(t-1) = '\0';
-                sendto_one(client_p, "%s", buf);
-                cur_len = mlen;
-                t = buf + mlen;
-            }
+    if(IsCapable(client_p, CAP_IE) &&
+       rb_dlink_list_length(&chptr->invexlist) > 0)
+        burst_modes_TS6(client_p, chptr, &chptr->invexlist, 'I');
 
-            rb_sprintf(t, "%s%s ", find_channel_status(msptr, 1),
-                       use_id(msptr->client_p));
+    if(rb_dlink_list_length(&chptr->quietlist) > 0)
+        burst_modes_TS6(client_p, chptr, &chptr->quietlist, 'q');
 
-            cur_len += tlen;
-            t += tlen;
-        }
+    if(IsCapable(client_p, CAP_TB) && chptr->topic != NULL)
+        sendto_one(client_p, ":%s TB %s %ld %s%s:%s",
+                   me.id, chptr->chname, (long) chptr->topic_time,
+                   ConfigChannel.burst_topicwho ? chptr->topic_info : "",
+                   ConfigChannel.burst_topicwho ? " " : "",
+                   chptr->topic);
 
-        if (rb_dlink_list_length(&chptr->members) > 0) {
-            /* remove trailing space */
-            *(t-1) = '\0';
-        }
-        sendto_one(client_p, "%s", buf);
+    if(IsCapable(client_p, CAP_MLOCK))
+        sendto_one(client_p, ":%s MLOCK %ld %s :%s",
+                   me.id, (long) chptr->channelts, chptr->chname,
+                   EmptyString(chptr->mode_lock) ? "" : chptr->mode_lock);
+
+    hchaninfo.client = client_p;
+    hchaninfo.chptr = chptr;
+    call_hook(h_burst_channel, &hchaninfo);
+}
+
+/*
+ * burst_start
+ *
+ * inputs	- server to burst to
+ * output	- NONE
+ * side effects	- the burst state is set up and the first chunk is sent.
+ *
+ * The burst covers the users and channels that exist right now.  Those
+ * introduced or created later reach the link through the hold queue like
+ * any other live traffic, so users introduced after burst->serial are
+ * skipped, both in the user walk and in SJOIN member lists, and the
+ * channel walk starts at the current head of global_channel_list as new
+ * channels are added in front of it.
+ */
+static void
+burst_start(struct Client *client_p)
+{
+    struct ServerBurst *burst;
+
+    burst = rb_malloc(sizeof(struct ServerBurst));
+    burst->client_p = client_p;
+    burst->user_cursor = global_client_list.head;
+    burst->user_fence = global_client_list.tail;
+    burst->chan_cursor = global_channel_list.head;
+    burst->serial = user_serial;
+    burst->users_total = Count.total;
+    burst->channels_total = rb_dlink_list_length(&global_channel_list);
+    burst->started = rb_current_time();
+    rb_linebuf_newbuf(&burst->hold);
+
+    client_p->localClient->burst = burst;
+    rb_dlinkAdd(burst, &burst->node, &burst_list);
+
+    burst_continue(client_p);
+}
 
-        DICTIONARY_FOREACH(md, &iter, chptr->metadata) {
-            /* don't bother bursting +J metadata */
-            if(!(md->name[0] == 'K'))
-                sendto_one(client_p, ":%s ENCAP * METADATA SET %s %s :%s",
-                           use_id(&me), chptr->chname, md->name, md->value);
+/*
+ * burst_free
+ *
+ * inputs	- server being burst to
+ * output	- NONE
+ * side effects	- the burst state is released, held lines go with it
+ */
+static void
+burst_free(struct Client *client_p)
+{
+    struct ServerBurst *burst = client_p->localClient->burst;
+
+    client_p->localClient->burst = NULL;
+    rb_dlinkDelete(&burst->node, &burst_list);
+    rb_linebuf_donebuf(&burst->hold);
+    rb_free(burst);
+}
+
+/*
+ * burst_finish
+ *
+ * inputs	- server being burst to
+ * output	- NONE
+ * side effects	- held traffic is released to the link, and the end of
+ *		  burst PING is sent.
+ */
+static void
+burst_finish(struct Client *client_p)
+{
+    struct ServerBurst *burst = client_p->localClient->burst;
+    hook_data_client hclientinfo;
+
+    hclientinfo.client = client_p;
+    hclientinfo.target = NULL;
+    call_hook(h_burst_finished, &hclientinfo);
+
+    ilog(L_SERVER, "Burst to %s complete: %lu users, %lu channels, %lu bytes, %lu held, %ld seconds",
+         client_p->name, burst->users, burst->channels, burst->bytes,
+         (unsigned long) rb_linebuf_len(&burst->hold),
+         (long) (rb_current_time() - burst->started));
+
+    rb_linebuf_attach(&client_p->localClient->buf_sendq, &burst->hold);
+    burst_free(client_p);
+
+    /* Always send a PING after connect burst is done */
+    sendto_one(client_p, "PING :%s", get_id(&me, client_p));
+}
+
+/*
+ * burst_continue
+ *
+ * inputs	- server being burst to
+ * output	- NONE
+ * side effects	- more of the burst is queued, a chunk at a time for as
+ *		  long as the sendq keeps draining below BURST_CHUNK, up to
+ *		  BURST_CHUNKS chunks.
+ *
+ * This is called when the link's sendq has been written out, and once a
+ * second from burst_continue_all() as the link may have taken all we gave
+ * it without ever leaving anything to wait for write readiness on.  The
+ * sendq never holds much more than a chunk of burst at a time, however
+ * large the network.
+ */
+void
+burst_continue(struct Client *client_p)
+{
+    struct ServerBurst *burst = client_p->localClient->burst;
+    struct Client *target_p;
+    rb_dlink_node *ptr;
+    unsigned long start;
+    int chunks;
+
+    if(burst == NULL || burst->emitting)
+        return;
+
+    for(chunks = 0; chunks < BURST_CHUNKS; chunks++) {
+        if(IsAnyDead(client_p) ||
+           rb_linebuf_len(&client_p->localClient->buf_sendq) >= BURST_CHUNK)
+            return;
+
+        burst->emitting = 1;
+        start = burst->bytes;
+
+        while(burst->user_cursor != NULL && burst->bytes - start < BURST_CHUNK) {
+            ptr = burst->user_cursor;
+            burst->user_cursor = (ptr == burst->user_fence) ? NULL : ptr->next;
+            target_p = ptr->data;
+
+            if(!IsPerson(target_p) || target_p->user->serial > burst->serial)
+                continue;
+
+            burst_client_TS6(client_p, target_p);
+            burst->users++;
         }
 
-        if(rb_dlink_list_length(&chptr->banlist) > 0)
-            burst_modes_TS6(client_p, chptr, &chptr->banlist, 'b');
+        while(burst->user_cursor == NULL && burst->chan_cursor != NULL &&
+              burst->bytes - start < BURST_CHUNK) {
+            ptr = burst->chan_cursor;
+            burst->chan_cursor = ptr->next;
 
-        if(IsCapable(client_p, CAP_EX) &&
-           rb_dlink_list_length(&chptr->exceptlist) > 0)
-            burst_modes_TS6(client_p, chptr, &chptr->exceptlist, 'e');
+            if(*((struct Channel *) ptr->data)->chname != '#')
+                continue;
 
-        if(IsCapable(client_p, CAP_IE) &&
-           rb_dlink_list_length(&chptr->invexlist) > 0)
-            burst_modes_TS6(client_p, chptr, &chptr->invexlist, 'I');
+            burst_channel_TS6(client_p, ptr->data);
+            burst->channels++;
+        }
 
-        if(rb_dlink_list_length(&chptr->quietlist) > 0)
-            burst_modes_TS6(client_p, chptr, &chptr->quietlist, 'q');
+        if(burst->user_cursor == NULL && burst->chan_cursor == NULL) {
+            burst_finish(client_p);
+            send_pop_queue(client_p);
+            return;
+        }
 
-        if(IsCapable(client_p, CAP_TB) && chptr->topic != NULL)
-            sendto_one(client_p, ":%s TB %s %ld %s%s:%s",
-                       me.id, chptr->chname, (long) chptr->topic_time,
-                       ConfigChannel.burst_topicwho ? chptr->topic_info : "",
-                       ConfigChannel.burst_topicwho ? " " : "",
-                       chptr->topic);
+        burst->emitting = 0;
+        send_pop_queue(client_p);
+    }
+}
 
-        if(IsCapable(client_p, CAP_MLOCK))
-            sendto_one(client_p, ":%s MLOCK %ld %s :%s",
-                       me.id, (long) chptr->channelts, chptr->chname,
-                       EmptyString(chptr->mode_lock) ? "" : chptr->mode_lock);
+/*
+ * burst_continue_all
+ *
+ * inputs	- NONE
+ * output	- NONE
+ * side effects	- every burst in progress is given a chance to continue
+ */
+void
+burst_continue_all(void *unused)
+{
+    struct ServerBurst *burst;
+    rb_dlink_node *ptr, *next;
 
-        hchaninfo.chptr = chptr;
-        call_hook(h_burst_channel, &hchaninfo);
+    RB_DLINK_FOREACH_SAFE(ptr, next, burst_list.head) {
+        burst = ptr->data;
+        burst_continue(burst->client_p);
     }
+}
 
-    hclientinfo.target = NULL;
-    call_hook(h_burst_finished, &hclientinfo);
+/*
+ * burst_abort
+ *
+ * inputs	- server that is going away
+ * output	- NONE
+ * side effects	- an unfinished burst is dropped along with its held
+ *		  lines, so anything sent to the link from here on (SQUIT,
+ *		  ERROR) goes straight to its sendq.
+ */
+void
+burst_abort(struct Client *client_p)
+{
+    if(!MyConnect(client_p) || client_p->localClient->burst == NULL)
+        return;
+
+    burst_free(client_p);
+}
+
+/*
+ * burst_list_fixup
+ *
+ * inputs	- node about to leave global_client_list or
+ *		  global_channel_list
+ * output	- NONE
+ * side effects	- burst cursors pointing at it are moved on
+ */
+void
+burst_list_fixup(rb_dlink_node *ptr)
+{
+    struct ServerBurst *burst;
+    rb_dlink_node *bptr;
+
+    RB_DLINK_FOREACH(bptr, burst_list.head) {
+        burst = bptr->data;
+
+        if(burst->user_fence == ptr) {
+            if(burst->user_cursor == ptr)
+                burst->user_cursor = burst->user_fence = NULL;
+            else
+                burst->user_fence = ptr->prev;
+        } else if(burst->user_cursor == ptr)
+            burst->user_cursor = ptr->next;
+
+        if(burst->chan_cursor == ptr)
+            burst->chan_cursor = ptr->next;
+    }
 }
 
 /*
@@ -921,10 +1144,7 @@ server_estab(struct Client *client_p)
     if(IsCapable(client_p, CAP_BAN))
         burst_ban(client_p);
 
-    burst_TS6(client_p);
-
-    /* Always send a PING after connect burst is done */
-    sendto_one(client_p, "PING :%s", get_id(&me, client_p));
+    burst_start(client_p);
 
     free_pre_client(client_p);
 
@@ -1118,7 +1338,7 @@ serv_connect(struct server_conf *server_p, struct Client *by)
      * -- jilles
      */
     rb_strlcpy(client_p->name, server_p->name, sizeof(client_p->name));
-    rb_strlcpy(client_p->host, server_p->host, sizeof(client_p->host));
+    scache_set(&client_p->host, server_p->host, HOSTLEN + 1);
     rb_strlcpy(client_p->sockhost, server_p->host, sizeof(client_p->sockhost));
     client_p->localClient->F = F;
     add_to_cli_fd_hash(client_p);
@@ -1160,7 +1380,7 @@ serv_connect(struct server_conf *server_p, struct Client *by)
         client_p->serv->user = NULL;
     }
     SetConnecting(client_p);
-    rb_dlinkAddTail(client_p, &client_p->node, &global_client_list);
+    add_client_to_list(client_p);
 
     if (rb_inet_pton_sock(server_p->host, (struct sockaddr *)&theiripnum) > 0) {
         memcpy(&client_p->localClient->ip, &theiripnum, sizeof(client_p->localClient->ip));
@@ -53,8 +53,11 @@
 #include "blacklist.h"
 #include "substitution.h"
 #include "chmode.h"
+#include "cryptdi.h"
 
 static void report_and_set_user_flags(struct Client *, struct ConfItem *);
+static int register_local_user_finish(struct Client *, struct Client *);
+static void register_password_cb(struct Client *, int, void *);
 void user_welcome(struct Client *source_p);
 
 char umodebuf[128];
@@ -217,10 +220,8 @@ show_lusers(struct Client *source_p)
 int
 register_local_user(struct Client *client_p, struct Client *source_p, const char *username)
 {
-    struct ConfItem *aconf, *xconf;
+    struct ConfItem *aconf;
     struct User *user = source_p->user;
-    char tmpstr2[IRCD_BUFSIZE];
-    char ipaddr[HOSTIPLEN];
     char myusername[USERLEN+1];
     int status;
 
@@ -234,6 +235,10 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
     if(IsAnyDead(source_p))
         return -1;
 
+    /* still waiting on cryptd for a password or WEBIRC check */
+    if(source_p->localClient->crypt_req != NULL)
+        return -1;
+
     /* Allocate a UID if it was not previously allocated.
      * If this already occured, it was probably during SASL auth...
      */
@@ -302,7 +307,7 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
     if(!valid_hostname(source_p->host)) {
         sendto_one_notice(source_p, ":*** Notice -- You have an illegal character in your hostname");
 
-        rb_strlcpy(source_p->host, source_p->sockhost, sizeof(source_p->host));
+        scache_set(&source_p->host, source_p->sockhost, HOSTLEN + 1);
     }
 
 
@@ -365,12 +370,26 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
     /* password check */
     if(!EmptyString(aconf->passwd)) {
         const char *encr;
+        int result;
 
         if(EmptyString(source_p->localClient->passwd))
             encr = "";
-        else if(IsConfEncrypted(aconf))
-            encr = rb_crypt(source_p->localClient->passwd, aconf->passwd);
-        else
+        else if(IsConfEncrypted(aconf)) {
+            result = crypt_verify(source_p, source_p->localClient->passwd,
+                                  aconf->passwd, register_password_cb, NULL);
+
+            /* register_password_cb() carries on from here */
+            if(result == CRYPT_QUEUED)
+                return -1;
+
+            if(result == CRYPT_BUSY) {
+                ServerStats.is_ref++;
+                exit_client(client_p, source_p, &me, "Server busy - try later");
+                return (CLIENT_EXITED);
+            }
+
+            encr = result == CRYPT_MATCH ? aconf->passwd : "";
+        } else
             encr = source_p->localClient->passwd;
 
         if(strcmp(encr, aconf->passwd)) {
@@ -389,6 +408,52 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
         }
     }
 
+    return register_local_user_finish(client_p, source_p);
+}
+
+/* register_password_cb()
+ *
+ * inputs	- client, whether cryptd matched its password
+ * outputs	-
+ * side effects - registration carries on past the password check, or
+ *		  the client is exited
+ */
+static void
+register_password_cb(struct Client *source_p, int result, void *unused)
+{
+    if(source_p == NULL)
+        return;
+
+    if(result != CRYPT_MATCH) {
+        ServerStats.is_ref++;
+        sendto_one(source_p, form_str(ERR_PASSWDMISMATCH), me.name, source_p->name);
+        exit_client(source_p, source_p, &me, "Bad Password");
+        return;
+    }
+
+    memset(source_p->localClient->passwd, 0, strlen(source_p->localClient->passwd));
+    rb_free(source_p->localClient->passwd);
+    source_p->localClient->passwd = NULL;
+
+    register_local_user_finish(source_p, source_p);
+}
+
+/* register_local_user_finish()
+ *
+ * inputs	- client that has passed the password check
+ * outputs	- CLIENT_EXITED if the client was exited, else as
+ *		  introduce_client()
+ * side effects - the rest of register_local_user()
+ */
+static int
+register_local_user_finish(struct Client *client_p, struct Client *source_p)
+{
+    struct ConfItem *aconf = source_p->localClient->att_conf;
+    struct ConfItem *xconf;
+    struct User *user = source_p->user;
+    char tmpstr2[IRCD_BUFSIZE];
+    char ipaddr[HOSTIPLEN];
+
     /* report if user has &^>= etc. and set flags as needed in source_p */
     report_and_set_user_flags(source_p, aconf);
 
@@ -477,13 +542,13 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
     /* end of valid user name check */
 
     /* Store original hostname -- jilles */
-    rb_strlcpy(source_p->orighost, source_p->host, HOSTLEN + 1);
+    scache_set(&source_p->orighost, source_p->host, HOSTLEN + 1);
 
     /* Spoof user@host */
     if(*source_p->preClient->spoofuser)
         rb_strlcpy(source_p->username, source_p->preClient->spoofuser, USERLEN + 1);
     if(*source_p->preClient->spoofhost) {
-        rb_strlcpy(source_p->host, source_p->preClient->spoofhost, HOSTLEN + 1);
+        scache_set(&source_p->host, source_p->preClient->spoofhost, HOSTLEN + 1);
         if (irccmp(source_p->host, source_p->orighost))
             SetDynSpoof(source_p);
     }
@@ -518,6 +583,8 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
                            source_p->info);
 
     add_to_hostname_hash(source_p->orighost, source_p);
+    add_to_client_host_index(source_p);
+    add_to_who_index(source_p);
 
     if (IsSSL(source_p))
         source_p->umodes |= UMODE_SSLCLIENT;
@@ -527,6 +594,9 @@ register_local_user(struct Client *client_p, struct Client *source_p, const char
 
     s_assert(!IsClient(source_p));
     rb_dlinkMoveNode(&source_p->localClient->tnode, &unknown_list, &lclient_list);
+
+    /* a burst in progress leaves us to the hold queue from here on */
+    source_p->user->serial = ++user_serial;
     SetClient(source_p);
 
     source_p->servptr = &me;
@@ -1192,6 +1262,9 @@ send_umode_out(struct Client *client_p, struct Client *source_p, int old)
 
     send_umode(NULL, source_p, old, 0, buf);
 
+    if((old ^ source_p->umodes) & UMODE_INVISIBLE)
+        invalidate_namescache_user(source_p);
+
     RB_DLINK_FOREACH(ptr, serv_list.head) {
         target_p = ptr->data;
 
@@ -1493,15 +1566,27 @@ change_nick_user_host(struct Client *target_p,	const char *nick, const char *use
                                             target_p->name, target_p->username, host, target_p->user->away);
     }
 
+    if(MyConnect(target_p))
+        del_from_client_host_index(target_p);
+
+    del_from_who_index(target_p);
     rb_strlcpy(target_p->username, user, sizeof target_p->username);
-    rb_strlcpy(target_p->host, host, sizeof target_p->host);
+    scache_set(&target_p->host, host, HOSTLEN + 1);
+    invalidate_client_prefix(target_p);
+
+    if(MyConnect(target_p))
+        add_to_client_host_index(target_p);
 
     if (changed)
         add_history(target_p, 1);
 
     del_from_client_hash(target_p->name, target_p);
+    if(strcmp(target_p->name, nick))
+        invalidate_namescache_user(target_p);
     rb_strlcpy(target_p->name, nick, NICKLEN);
+    invalidate_client_prefix(target_p);
     add_to_client_hash(target_p->name, target_p);
+    add_to_who_index(target_p);
 
     if(changed) {
         monitor_signon(target_p);
@@ -31,6 +31,7 @@
 #include "numeric.h"
 #include "send.h"
 #include "scache.h"
+#include "hash.h"
 #include "s_conf.h"
 
 
@@ -230,3 +231,156 @@ count_scache(size_t * number_servers_cached, size_t * mem_servers_cached)
         }
     }
 }
+
+/*
+ * The same trick works for other strings that are copied about a lot,
+ * like the hosts and realnames of every client and those kept in
+ * whowas.  scache_intern() hands out one shared, refcounted copy of
+ * each distinct string (case matters here), which is given back with
+ * scache_release().
+ */
+struct scache_string {
+    struct scache_string *next;
+    u_int32_t hashv;
+    unsigned int refcnt;
+    char str[1];
+};
+
+static struct scache_string **string_hash;
+static unsigned int string_hash_size;	/* a power of two */
+static unsigned int string_count;
+static size_t string_refs;
+static size_t string_mem;	/* bytes in the distinct strings */
+static size_t string_ref_mem;	/* bytes they would take unshared */
+
+static void
+grow_string_hash(void)
+{
+    struct scache_string **old = string_hash, *ptr, *next;
+    unsigned int oldsize = string_hash_size, i;
+
+    string_hash_size = oldsize ? oldsize * 2 : 1024;
+    string_hash = rb_malloc(sizeof(struct scache_string *) * string_hash_size);
+
+    for(i = 0; i < oldsize; i++) {
+        for(ptr = old[i]; ptr != NULL; ptr = next) {
+            next = ptr->next;
+            ptr->next = string_hash[ptr->hashv & (string_hash_size - 1)];
+            string_hash[ptr->hashv & (string_hash_size - 1)] = ptr;
+        }
+    }
+
+    rb_free(old);
+}
+
+const char *
+scache_intern(const char *str)
+{
+    struct scache_string *ptr;
+    u_int32_t hashv = fnv_hash((const unsigned char *)str, 32);
+    size_t len;
+
+    if(string_hash_size == 0)
+        grow_string_hash();
+
+    for(ptr = string_hash[hashv & (string_hash_size - 1)]; ptr != NULL; ptr = ptr->next) {
+        if(ptr->hashv == hashv && !strcmp(ptr->str, str)) {
+            ptr->refcnt++;
+            string_refs++;
+            string_ref_mem += strlen(str) + 1;
+            return ptr->str;
+        }
+    }
+
+    if(string_count >= string_hash_size * 2)
+        grow_string_hash();
+
+    len = strlen(str);
+    ptr = rb_malloc(sizeof(struct scache_string) + len);
+    memcpy(ptr->str, str, len + 1);
+    ptr->hashv = hashv;
+    ptr->refcnt = 1;
+    ptr->next = string_hash[hashv & (string_hash_size - 1)];
+    string_hash[hashv & (string_hash_size - 1)] = ptr;
+    string_count++;
+    string_refs++;
+    string_mem += len + 1;
+    string_ref_mem += len + 1;
+
+    return ptr->str;
+}
+
+/* scache_set()
+ *
+ * inputs	- interned string to replace, new value, and the buffer size
+ *		  it would have been copied into
+ * outputs	-
+ * side effects - *field is set to an interned copy of str, cut short
+ *		  like rb_strlcpy() would, and the old value is released
+ */
+void
+scache_set(const char **field, const char *str, size_t size)
+{
+    char buf[BUFSIZE];
+    const char *old = *field;
+
+    if(size > sizeof(buf))
+        size = sizeof(buf);
+
+    if(strlen(str) >= size) {
+        rb_strlcpy(buf, str, size);
+        str = buf;
+    }
+
+    *field = scache_intern(str);
+    scache_release(old);
+}
+
+void
+scache_release(const char *str)
+{
+    struct scache_string *ptr, **prev;
+
+    if(str == NULL)
+        return;
+
+    ptr = (struct scache_string *)(str - offsetof(struct scache_string, str));
+
+    string_refs--;
+    string_ref_mem -= strlen(str) + 1;
+
+    if(--ptr->refcnt > 0)
+        return;
+
+    string_mem -= strlen(str) + 1;
+
+    for(prev = &string_hash[ptr->hashv & (string_hash_size - 1)]; *prev != NULL;
+        prev = &(*prev)->next) {
+        if(*prev == ptr) {
+            *prev = ptr->next;
+            break;
+        }
+    }
+
+    string_count--;
+    rb_free(ptr);
+}
+
+/*
+ * count_scache_strings
+ * inputs	- pointers to where to leave the number of distinct strings,
+ *		  the number of references to them, the memory they use
+ *		  and the memory they would use if each reference had its
+ *		  own copy
+ * output	- NONE
+ * side effects	-
+ */
+void
+count_scache_strings(size_t * count, size_t * refs, size_t * mem, size_t * ref_mem)
+{
+    *count = string_count;
+    *refs = string_refs;
+    *mem = string_count * sizeof(struct scache_string) + string_mem +
+           string_hash_size * sizeof(struct scache_string *);
+    *ref_mem = string_ref_mem;
+}
@@ -50,6 +50,38 @@ unsigned long current_serial = 0L;
 
 struct Client *remote_rehash_oper_p;
 
+/* send_sendq_exceeded()
+ *
+ * inputs	- client about to have data queued
+ * outputs	- 1 if the sendq is over its limit and the client was
+ *		  marked dead, 0 otherwise
+ * side effects -
+ */
+static int
+send_sendq_exceeded(struct Client *to)
+{
+    unsigned int len = rb_linebuf_len(&to->localClient->buf_sendq);
+
+    /* lines held behind a burst count against the sendq too */
+    if(rb_unlikely(to->localClient->burst != NULL))
+        len += rb_linebuf_len(&to->localClient->burst->hold);
+
+    if(len <= get_sendq(to))
+        return 0;
+
+    if(IsServer(to)) {
+        sendto_realops_snomask(SNO_GENERAL, L_ALL,
+                               "Max SendQ limit exceeded for %s: %u > %lu",
+                               to->name, len, get_sendq(to));
+
+        ilog(L_SERVER, "Max SendQ limit exceeded for %s: %u > %lu",
+             log_client_name(to, SHOW_IP), len, get_sendq(to));
+    }
+
+    dead_link(to, 1);
+    return 1;
+}
+
 /* send_linebuf()
  *
  * inputs	- client to send to, linebuf to attach
@@ -67,29 +99,30 @@ _send_linebuf(struct Client *to, buf_head_t *linebuf)
     if(!MyConnect(to) || IsIOError(to))
         return 0;
 
-    if(rb_linebuf_len(&to->localClient->buf_sendq) > get_sendq(to)) {
-        if(IsServer(to)) {
-            sendto_realops_snomask(SNO_GENERAL, L_ALL,
-                                   "Max SendQ limit exceeded for %s: %u > %lu",
-                                   to->name,
-                                   rb_linebuf_len(&to->localClient->buf_sendq),
-                                   get_sendq(to));
-
-            ilog(L_SERVER, "Max SendQ limit exceeded for %s: %u > %lu",
-                 log_client_name(to, SHOW_IP),
-                 rb_linebuf_len(&to->localClient->buf_sendq),
-                 get_sendq(to));
+    if(send_sendq_exceeded(to))
+        return -1;
+
+    /* a link we are bursting to gets everything but the burst
+     * itself held back until the burst is done
+     */
+    if(rb_unlikely(to->localClient->burst != NULL)) {
+        struct ServerBurst *burst = to->localClient->burst;
+
+        if(!burst->emitting) {
+            rb_linebuf_attach(&burst->hold, linebuf);
+            to->localClient->sendM += 1;
+            me.localClient->sendM += 1;
+            return 0;
         }
 
-        dead_link(to, 1);
-        return -1;
-    } else {
-        /* just attach the linebuf to the sendq instead of
-         * generating a new one
-         */
-        rb_linebuf_attach(&to->localClient->buf_sendq, linebuf);
+        burst->bytes += rb_linebuf_len(linebuf);
     }
 
+    /* just attach the linebuf to the sendq instead of
+     * generating a new one
+     */
+    rb_linebuf_attach(&to->localClient->buf_sendq, linebuf);
+
     /*
      ** Update statistics. The following is slightly incorrect
      ** because it counts messages even if queued, but bytes
@@ -102,6 +135,132 @@ _send_linebuf(struct Client *to, buf_head_t *linebuf)
     return 0;
 }
 
+/*
+ * Channel fanout.
+ *
+ * A message going to a channel is formatted exactly once into a single
+ * line, and every local recipient just gets a reference to that line
+ * pushed onto its sendq.  The writes are deferred until the whole member
+ * list has been walked, so the member loop itself stays a tight
+ * pointer push, and flushing is done in one pass afterwards.
+ */
+static struct Client **fanout_clients;
+static int fanout_count;
+static int fanout_max;
+
+/* send_fanout_line()
+ *
+ * inputs	- local client to send to, shared line
+ * outputs	-
+ * side effects - line is attached to the client's sendq, and the client
+ *		  is queued for send_fanout_flush()
+ */
+static int
+send_fanout_attach(struct Client *to, buf_line_t *line)
+{
+    if(line == NULL || !MyConnect(to) || IsIOError(to))
+        return 0;
+
+    if(send_sendq_exceeded(to))
+        return 0;
+
+    rb_linebuf_attach_line(&to->localClient->buf_sendq, line);
+
+    to->localClient->sendM += 1;
+    me.localClient->sendM += 1;
+    return 1;
+}
+
+static void
+send_fanout_queue(struct Client *to)
+{
+    if(rb_unlikely(fanout_count == fanout_max)) {
+        fanout_max = fanout_max ? fanout_max * 2 : 256;
+        fanout_clients = rb_realloc(fanout_clients, sizeof(struct Client *) * fanout_max);
+    }
+
+    fanout_clients[fanout_count++] = to;
+}
+
+static void
+send_fanout_line(struct Client *to, buf_line_t *line)
+{
+    if(send_fanout_attach(to, line))
+        send_fanout_queue(to);
+}
+
+/* send_fanout_flush()
+ *
+ * inputs	-
+ * outputs	-
+ * side effects - every client queued by send_fanout_line() gets its
+ *		  sendq flushed
+ */
+static void
+send_fanout_flush(void)
+{
+    while(fanout_count > 0)
+        send_queued(fanout_clients[--fanout_count]);
+}
+
+/* format_body()
+ *
+ * inputs	- buffer, its size, pattern and args
+ * outputs	- length of the formatted body
+ * side effects - pattern is formatted into buf with a leading space, so
+ *		  it can be appended to a source prefix as is
+ */
+static size_t
+format_body(char *buf, size_t size, const char *pattern, va_list *args)
+{
+    int len;
+
+    buf[0] = ' ';
+    len = rb_vsnprintf(buf + 1, size - 1, pattern, *args) + 1;
+
+    return (size_t)len < size ? (size_t)len : size - 1;
+}
+
+/* linebuf_put_prefix()
+ *
+ * inputs	- linebuf, source, body from format_body()
+ * outputs	-
+ * side effects - ":nick!user@host body" is added to the linebuf, using
+ *		  the prefix cached on the source
+ */
+static void
+linebuf_put_prefix(buf_head_t *linebuf, struct Client *source_p,
+                   const char *buf, size_t len)
+{
+    const char *prefix;
+    size_t prefixlen;
+
+    prefix = get_client_prefix(source_p, &prefixlen);
+    rb_linebuf_putprefix(linebuf, prefix, prefixlen, buf, len);
+}
+
+/* linebuf_put_id_prefix()
+ *
+ * inputs	- linebuf, source, body from format_body()
+ * outputs	-
+ * side effects - ":UID body" is added to the linebuf
+ */
+static void
+linebuf_put_id_prefix(buf_head_t *linebuf, struct Client *source_p,
+                      const char *buf, size_t len)
+{
+    char idbuf[HOSTLEN + 2];
+    const char *id = use_id(source_p);
+    size_t idlen = strlen(id);
+
+    if(idlen > HOSTLEN)
+        idlen = HOSTLEN;
+
+    idbuf[0] = ':';
+    memcpy(idbuf + 1, id, idlen);
+    rb_linebuf_putprefix(linebuf, idbuf, idlen + 1, buf, len);
+}
+
 /* send_linebuf_remote()
  *
  * inputs	- client to attach to, sender, linebuf
@@ -221,6 +380,9 @@ send_queued_write(rb_fde_t *F, void *data)
     struct Client *to = data;
     ClearFlush(to);
     send_queued(to);
+
+    if(to->localClient->burst != NULL)
+        burst_continue(to);
 }
 
 /* sendto_one()
@@ -447,6 +609,7 @@ sendto_channel_flags(struct Client *one, int type, struct Client *source_p,
 {
     static char buf[BUFSIZE];
     va_list args;
+    size_t len;
     buf_head_t rb_linebuf_local;
     buf_head_t rb_linebuf_id;
     struct Client *target_p;
@@ -460,19 +623,11 @@ sendto_channel_flags(struct Client *one, int type, struct Client *source_p,
     current_serial++;
 
     va_start(args, pattern);
-    rb_vsnprintf(buf, sizeof(buf), pattern, args);
+    len = format_body(buf, sizeof(buf), pattern, &args);
     va_end(args);
 
-    if(IsServer(source_p))
-        rb_linebuf_putmsg(&rb_linebuf_local, NULL, NULL,
-                          ":%s %s", source_p->name, buf);
-    else
-        rb_linebuf_putmsg(&rb_linebuf_local, NULL, NULL,
-                          ":%s!%s@%s %s",
-                          source_p->name, source_p->username,
-                          source_p->host, buf);
-
-    rb_linebuf_putmsg(&rb_linebuf_id, NULL, NULL, ":%s %s", use_id(source_p), buf);
+    linebuf_put_prefix(&rb_linebuf_local, source_p, buf, len);
+    linebuf_put_id_prefix(&rb_linebuf_id, source_p, buf, len);
 
     RB_DLINK_FOREACH_SAFE(ptr, next_ptr, chptr->members.head) {
         msptr = ptr->data;
@@ -499,9 +654,11 @@ sendto_channel_flags(struct Client *one, int type, struct Client *source_p,
                 target_p->from->serial = current_serial;
             }
         } else
-            _send_linebuf(target_p, &rb_linebuf_local);
+            send_fanout_line(target_p, rb_linebuf_first(&rb_linebuf_local));
     }
 
+    send_fanout_flush();
+
     rb_linebuf_donebuf(&rb_linebuf_local);
     rb_linebuf_donebuf(&rb_linebuf_id);
 }
@@ -517,6 +674,8 @@ sendto_channel_opmod(struct Client *one, struct Client *source_p,
                      struct Channel *chptr, const char *command,
                      const char *text)
 {
+    static char buf[BUFSIZE];
+    size_t len;
     buf_head_t rb_linebuf_local;
     buf_head_t rb_linebuf_old;
     buf_head_t rb_linebuf_new;
@@ -531,15 +690,10 @@ sendto_channel_opmod(struct Client *one, struct Client *source_p,
 
     current_serial++;
 
-    if(IsServer(source_p))
-        rb_linebuf_putmsg(&rb_linebuf_local, NULL, NULL,
-                          ":%s %s %s :%s",
-                          source_p->name, command, chptr->chname, text);
-    else
-        rb_linebuf_putmsg(&rb_linebuf_local, NULL, NULL,
-                          ":%s!%s@%s %s %s :%s",
-                          source_p->name, source_p->username,
-                          source_p->host, command, chptr->chname, text);
+    len = rb_snprintf(buf, sizeof(buf), " %s %s :%s", command, chptr->chname, text);
+    if(len >= sizeof(buf))
+        len = sizeof(buf) - 1;
+    linebuf_put_prefix(&rb_linebuf_local, source_p, buf, len);
 
     if (chptr->mode.mode & MODE_MODERATED)
         rb_linebuf_putmsg(&rb_linebuf_old, NULL, NULL,
@@ -582,9 +736,11 @@ sendto_channel_opmod(struct Client *one, struct Client *source_p,
                 target_p->from->serial = current_serial;
             }
         } else
-            _send_linebuf(target_p, &rb_linebuf_local);
+            send_fanout_line(target_p, rb_linebuf_first(&rb_linebuf_local));
     }
 
+    send_fanout_flush();
+
     rb_linebuf_donebuf(&rb_linebuf_local);
     rb_linebuf_donebuf(&rb_linebuf_old);
     rb_linebuf_donebuf(&rb_linebuf_new);
@@ -625,9 +781,11 @@ sendto_channel_local(int type, struct Channel *chptr, const char *pattern, ...)
         } else if(type && ((msptr->flags & type) == 0))
             continue;
 
-        _send_linebuf(target_p, &linebuf);
+        send_fanout_line(target_p, rb_linebuf_first(&linebuf));
     }
 
+    send_fanout_flush();
+
     rb_linebuf_donebuf(&linebuf);
 }
 
@@ -667,9 +825,11 @@ sendto_channel_local_butone(struct Client *one, int type, struct Channel *chptr,
         if(type && ((msptr->flags & type) == 0))
             continue;
 
-        _send_linebuf(target_p, &linebuf);
+        send_fanout_line(target_p, rb_linebuf_first(&linebuf));
     }
 
+    send_fanout_flush();
+
     rb_linebuf_donebuf(&linebuf);
 }
 
@@ -706,9 +866,11 @@ _sendto_channel_local_with_capability_butone(struct Client *one, int type, int c
         if(type && ((msptr->flags & type) == 0))
             continue;
 
-        _send_linebuf(target_p, &linebuf);
+        send_fanout_line(target_p, rb_linebuf_first(&linebuf));
     }
 
+    send_fanout_flush();
+
     rb_linebuf_donebuf(&linebuf);
 }
 
@@ -792,7 +954,7 @@ sendto_common_channels_local(struct Client *user, int cap, const char *pattern,
                 continue;
 
             target_p->serial = current_serial;
-            send_linebuf(target_p, &linebuf);
+            send_fanout_line(target_p, rb_linebuf_first(&linebuf));
         }
     }
 
@@ -800,8 +962,9 @@ sendto_common_channels_local(struct Client *user, int cap, const char *pattern,
      * need to send them the data, ie a nick change
      */
     if(MyConnect(user) && (user->serial != current_serial))
-        send_linebuf(user, &linebuf);
+        send_fanout_line(user, rb_linebuf_first(&linebuf));
 
+    send_fanout_flush();
     rb_linebuf_donebuf(&linebuf);
 }
 
@@ -852,13 +1015,191 @@ sendto_common_channels_local_butone(struct Client *user, int cap, const char *pa
                 continue;
 
             target_p->serial = current_serial;
-            send_linebuf(target_p, &linebuf);
+            send_fanout_line(target_p, rb_linebuf_first(&linebuf));
         }
     }
 
+    send_fanout_flush();
     rb_linebuf_donebuf(&linebuf);
 }
 
+/*
+ * Netsplit QUITs.
+ *
+ * When a server splits, everyone behind it quits at once.  Letting each
+ * exit fan its own QUIT out formats it once per exit, and flushes every
+ * local recipient once per departing user.  Instead the departing users
+ * are collected first and their channels walked in a single pass: each
+ * QUIT is formatted once and attached to its recipients as they are
+ * found, a recipient's batch is opened the first time it turns up, and
+ * every recipient is flushed once its whole set is queued.  Clients with
+ * the batch capability get the set wrapped in a netsplit BATCH.
+ */
+static struct Client **netsplit_users;
+static int netsplit_count;
+static int netsplit_max;
+static unsigned long netsplit_batch_id;
+
+/* collect_netsplit_users()
+ *
+ * inputs	- server being split off
+ * outputs	-
+ * side effects - every user behind the server still to be exited is
+ *		  added to netsplit_users and marked FLAGS_SPLITQUIT
+ */
+static void
+collect_netsplit_users(struct Client *server_p)
+{
+    struct Client *target_p;
+    rb_dlink_node *ptr;
+
+    if(server_p->serv == NULL)
+        return;
+
+    RB_DLINK_FOREACH(ptr, server_p->serv->users.head) {
+        target_p = ptr->data;
+
+        if(IsDead(target_p) || IsClosing(target_p) || target_p->user == NULL)
+            continue;
+
+        if(rb_unlikely(netsplit_count == netsplit_max)) {
+            netsplit_max = netsplit_max ? netsplit_max * 2 : 1024;
+            netsplit_users = rb_realloc(netsplit_users, sizeof(struct Client *) * netsplit_max);
+        }
+
+        /* exit_generic_client() must not send it again */
+        target_p->flags |= FLAGS_SPLITQUIT;
+        netsplit_users[netsplit_count++] = target_p;
+    }
+
+    RB_DLINK_FOREACH(ptr, server_p->serv->servers.head)
+        collect_netsplit_users(ptr->data);
+}
+
+/* send_netsplit_line()
+ *
+ * inputs	- local recipient, shared line
+ * outputs	-
+ * side effects - line is queued, and the recipient flushed early if its
+ *		  set has grown to half its sendq, so a big split doesn't
+ *		  push it over the limit before the final flush
+ */
+static void
+send_netsplit_line(struct Client *to, buf_line_t *line)
+{
+    if(!send_fanout_attach(to, line))
+        return;
+
+    if(rb_linebuf_len(&to->localClient->buf_sendq) > get_sendq(to) / 2)
+        send_queued(to);
+}
+
+/*
+ * sendto_netsplit_local()
+ *
+ * inputs	- server being split off, quit comment
+ * output	- NONE
+ * side effects	- every local client sharing a channel with a user behind
+ *		  the server is sent that user's QUIT.  The caller is
+ *		  expected to exit those users without sending it again.
+ */
+void
+sendto_netsplit_local(struct Client *server_p, const char *comment)
+{
+    rb_dlink_node *ptr, *uptr;
+    struct Client *source_p;
+    struct Client *target_p;
+    struct membership *msptr;
+    struct membership *mscptr;
+    buf_head_t linebuf;
+    buf_head_t batchbuf;
+    buf_head_t openbuf;
+    char ref[16];
+    int batched = 0, batchline;
+    int i;
+
+    netsplit_count = 0;
+    collect_netsplit_users(server_p);
+
+    if(netsplit_count == 0)
+        return;
+
+    /* the comment is "<uplink> <server>", or the hidden names */
+    rb_snprintf(ref, sizeof(ref), "%lx", ++netsplit_batch_id);
+    rb_linebuf_newbuf(&openbuf);
+    rb_linebuf_putmsg(&openbuf, NULL, NULL, ":%s BATCH +%s netsplit %s",
+                      me.name, ref, comment);
+
+    for(i = 0; i < netsplit_count; i++) {
+        source_p = netsplit_users[i];
+
+        rb_linebuf_newbuf(&linebuf);
+        rb_linebuf_putmsg(&linebuf, NULL, NULL, ":%s!%s@%s QUIT :%s",
+                          source_p->name, source_p->username, source_p->host, comment);
+        rb_linebuf_newbuf(&batchbuf);
+        batchline = 0;
+
+        ++current_serial;
+
+        RB_DLINK_FOREACH(ptr, source_p->user->channel.head) {
+            mscptr = ptr->data;
+
+            RB_DLINK_FOREACH(uptr, mscptr->chptr->locmembers.head) {
+                msptr = uptr->data;
+                target_p = msptr->client_p;
+
+                if(IsIOError(target_p) || target_p->serial == current_serial)
+                    continue;
+
+                target_p->serial = current_serial;
+
+                /* their first QUIT of the split, open their batch */
+                if(target_p->localClient->netsplit_id != netsplit_batch_id) {
+                    target_p->localClient->netsplit_id = netsplit_batch_id;
+                    send_fanout_queue(target_p);
+
+                    if(IsCapable(target_p, CLICAP_BATCH)) {
+                        send_fanout_attach(target_p, rb_linebuf_first(&openbuf));
+                        batched++;
+                    }
+                }
+
+                if(IsCapable(target_p, CLICAP_BATCH)) {
+                    if(!batchline) {
+                        rb_linebuf_putmsg(&batchbuf, NULL, NULL, "@batch=%s :%s!%s@%s QUIT :%s",
+                                          ref, source_p->name, source_p->username,
+                                          source_p->host, comment);
+                        batchline = 1;
+                    }
+
+                    send_netsplit_line(target_p, rb_linebuf_first(&batchbuf));
+                } else
+                    send_netsplit_line(target_p, rb_linebuf_first(&linebuf));
+            }
+        }
+
+        rb_linebuf_donebuf(&linebuf);
+        rb_linebuf_donebuf(&batchbuf);
+    }
+
+    rb_linebuf_donebuf(&openbuf);
+
+    if(batched) {
+        rb_linebuf_newbuf(&batchbuf);
+        rb_linebuf_putmsg(&batchbuf, NULL, NULL, ":%s BATCH -%s", me.name, ref);
+
+        for(i = 0; i < fanout_count; i++) {
+            if(IsCapable(fanout_clients[i], CLICAP_BATCH))
+                send_fanout_attach(fanout_clients[i], rb_linebuf_first(&batchbuf));
+        }
+
+        rb_linebuf_donebuf(&batchbuf);
+    }
+
+    send_fanout_flush();
+    netsplit_count = 0;
+}
+
 /* sendto_match_butone()
  *
  * inputs	- server not to send to, source, mask, type of mask, va_args
@@ -871,6 +1212,7 @@ sendto_match_butone(struct Client *one, struct Client *source_p,
 {
     static char buf[BUFSIZE];
     va_list args;
+    size_t len;
     struct Client *target_p;
     rb_dlink_node *ptr;
     rb_dlink_node *next_ptr;
@@ -881,19 +1223,11 @@ sendto_match_butone(struct Client *one, struct Client *source_p,
     rb_linebuf_newbuf(&rb_linebuf_id);
 
     va_start(args, pattern);
-    rb_vsnprintf(buf, sizeof(buf), pattern, args);
+    len = format_body(buf, sizeof(buf), pattern, &args);
     va_end(args);
 
-    if(IsServer(source_p))
-        rb_linebuf_putmsg(&rb_linebuf_local, NULL, NULL,
-                          ":%s %s", source_p->name, buf);
-    else
-        rb_linebuf_putmsg(&rb_linebuf_local, NULL, NULL,
-                          ":%s!%s@%s %s",
-                          source_p->name, source_p->username,
-                          source_p->host, buf);
-
-    rb_linebuf_putmsg(&rb_linebuf_id, NULL, NULL, ":%s %s", use_id(source_p), buf);
+    linebuf_put_prefix(&rb_linebuf_local, source_p, buf, len);
+    linebuf_put_id_prefix(&rb_linebuf_id, source_p, buf, len);
 
     if(what == MATCH_HOST) {
         RB_DLINK_FOREACH_SAFE(ptr, next_ptr, lclient_list.head) {
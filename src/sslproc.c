@@ -70,6 +70,7 @@ struct _ssl_ctl {
 static void send_new_ssl_certs_one(ssl_ctl_t * ctl, const char *ssl_cert,
                                    const char *ssl_private_key, const char *ssl_dh_params);
 static void send_init_prng(ssl_ctl_t * ctl, prng_seed_t seedtype, const char *path);
+static void send_ktls_one(ssl_ctl_t * ctl);
 
 
 static rb_dlink_list ssl_daemons;
@@ -313,9 +314,11 @@ start_ssldaemon(int count, const char *ssl_cert, const char *ssl_private_key, co
             else
                 send_init_prng(ctl, RB_PRNG_DEFAULT, NULL);
         }
-        if(ssl_ok && ssl_cert != NULL && ssl_private_key != NULL)
+        if(ssl_ok && ssl_cert != NULL && ssl_private_key != NULL) {
             send_new_ssl_certs_one(ctl, ssl_cert, ssl_private_key,
                                    ssl_dh_params != NULL ? ssl_dh_params : "");
+            send_ktls_one(ctl);
+        }
         ssl_read_ctl(ctl->F, ctl);
         ssl_do_pipe(P2, ctl);
 
@@ -409,6 +412,99 @@ ssl_process_certfp(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
     client_p->certfp = certfp_string;
 }
 
+/* ssl_process_ktls_start()
+ *
+ * inputs	- ssld's 'T' message: the kernel now does TLS for this client
+ * outputs	-
+ * side effects - the client's sendq is held and ssld is told, by
+ *		  shutting down our end, that nothing more is coming.
+ *		  Incoming server links are handed off too.
+ */
+static void
+ssl_process_ktls_start(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
+{
+    struct Client *client_p;
+    int32_t fd;
+
+    if(ctl_buf->buflen != 5)
+        return;		/* bogus message..drop it.. XXX should warn here */
+
+    fd = buf_to_int32(&ctl_buf->buf[1]);
+    client_p = find_cli_fd_hash(fd);
+    if(client_p == NULL || IsAnyDead(client_p) || IsKTLSWait(client_p) ||
+       client_p->localClient->ssl_ctl != ctl)
+        return;
+
+    /* only a client marked here may take the socket in 'H' */
+    SetKTLSWait(client_p);
+
+    /* send_queued() leaves a flushing client alone, and with the write
+     * callback gone nothing clears it until the socket comes back
+     */
+    SetFlush(client_p);
+    rb_setselect(client_p->localClient->F, RB_SELECT_WRITE, NULL, NULL);
+    shutdown(rb_get_fd(client_p->localClient->F), SHUT_WR);
+}
+
+/* ssl_process_ktls_handoff()
+ *
+ * inputs	- ssld's 'H' message, carrying the client's socket and
+ *		  ssld's end of the socketpair
+ * outputs	-
+ * side effects - the client now reads and writes its socket directly,
+ *		  and whatever was held in its sendq is sent
+ */
+static void
+ssl_process_ktls_handoff(ssl_ctl_t * ctl, ssl_ctl_buf_t * ctl_buf)
+{
+    struct Client *client_p;
+    rb_fde_t *F;
+    int32_t fd;
+    int x;
+
+    if(ctl_buf->buflen != 5 || ctl_buf->nfds != 2) {
+        for(x = 0; x < ctl_buf->nfds; x++)
+            rb_close(ctl_buf->F[x]);
+        return;
+    }
+
+    F = ctl_buf->F[0];
+    rb_close(ctl_buf->F[1]);
+
+    fd = buf_to_int32(&ctl_buf->buf[1]);
+    client_p = find_cli_fd_hash(fd);
+    /* the fd may have gone to a new client since ssld's 'T' */
+    if(client_p == NULL || IsAnyDead(client_p) || !IsKTLSWait(client_p) ||
+       !IsFlush(client_p) || client_p->localClient->ssl_ctl != ctl) {
+        rb_close(F);
+        return;
+    }
+
+    ClearKTLSWait(client_p);
+
+    if(rb_get_type(F) & RB_FD_UNKNOWN)
+        rb_set_type(F, RB_FD_SOCKET);
+    rb_set_nb(F);
+
+    del_from_cli_fd_hash(client_p);
+    rb_close(client_p->localClient->F);
+    client_p->localClient->F = F;
+    add_to_cli_fd_hash(client_p);
+
+    client_p->localClient->ssl_ctl = NULL;
+    ssld_decrement_clicount(ctl);
+
+    /* still in auth, release_auth_client() starts reading */
+    if(client_p->localClient->auth_request == NULL)
+        read_packet(F, client_p);
+
+    if(IsAnyDead(client_p))
+        return;
+
+    ClearFlush(client_p);
+    send_queued(client_p);
+}
+
 static void
 ssl_process_cmd_recv(ssl_ctl_t * ctl)
 {
@@ -433,6 +529,12 @@ ssl_process_cmd_recv(ssl_ctl_t * ctl)
         case 'S':
             ssl_process_zipstats(ctl, ctl_buf);
             break;
+        case 'T':
+            ssl_process_ktls_start(ctl, ctl_buf);
+            break;
+        case 'H':
+            ssl_process_ktls_handoff(ctl, ctl_buf);
+            break;
         case 'I':
             ssl_ok = 0;
             ilog(L_MAIN, cannot_setup_ssl);
@@ -465,20 +567,24 @@ ssl_read_ctl(rb_fde_t * F, void *data)
 {
     ssl_ctl_buf_t *ctl_buf;
     ssl_ctl_t *ctl = data;
-    int retlen;
+    int retlen, i;
 
     if(ctl->dead)
         return;
     do {
         ctl_buf = rb_malloc(sizeof(ssl_ctl_buf_t));
         ctl_buf->buf = rb_malloc(READSIZE);
-        retlen = rb_recv_fd_buf(ctl->F, ctl_buf->buf, READSIZE, ctl_buf->F, 4);
+        retlen = rb_recv_fd_buf(ctl->F, ctl_buf->buf, READSIZE, ctl_buf->F, MAXPASSFD);
         ctl_buf->buflen = retlen;
         if(retlen <= 0) {
             rb_free(ctl_buf->buf);
             rb_free(ctl_buf);
-        } else
+        } else {
+            for(i = 0; i < MAXPASSFD && ctl_buf->F[i] != NULL; i++)
+                ;
+            ctl_buf->nfds = i;
             rb_dlinkAddTail(ctl_buf, &ctl_buf->node, &ctl->readq);
+        }
     } while(retlen > 0);
 
     if(retlen == 0 || (retlen < 0 && !rb_ignore_errno(errno))) {
@@ -612,6 +718,16 @@ send_init_prng(ssl_ctl_t * ctl, prng_seed_t seedtype, const char *path)
     ssl_cmd_write_queue(ctl, NULL, 0, tmpbuf, len);
 }
 
+static void
+send_ktls_one(ssl_ctl_t * ctl)
+{
+    char buf[2];
+
+    buf[0] = 'L';
+    buf[1] = ServerInfo.ssl_ktls ? '1' : '0';
+    ssl_cmd_write_queue(ctl, NULL, 0, buf, sizeof(buf));
+}
+
 void
 send_new_ssl_certs(const char *ssl_cert, const char *ssl_private_key, const char *ssl_dh_params)
 {
@@ -623,6 +739,7 @@ send_new_ssl_certs(const char *ssl_cert, const char *ssl_private_key, const char
     RB_DLINK_FOREACH(ptr, ssl_daemons.head) {
         ssl_ctl_t *ctl = ptr->data;
         send_new_ssl_certs_one(ctl, ssl_cert, ssl_private_key, ssl_dh_params);
+        send_ktls_one(ctl);
     }
 }
 
@@ -743,7 +860,7 @@ start_zlib_session(void *data)
         return;
     }
 
-    if(IsSSL(server)) {
+    if(IsSSL(server) && server->localClient->ssl_ctl != NULL) {
         /* tell ssld the new connid for the ssl part*/
         buf2[0] = 'Y';
         int32_to_buf(&buf2[1], rb_get_fd(server->localClient->F));
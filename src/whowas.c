@@ -38,52 +38,73 @@
 #include "send.h"
 #include "s_conf.h"
 #include "scache.h"
+#include "irc_dictionary.h"
 
 /* internally defined function */
 static void add_whowas_to_clist(struct Whowas **, struct Whowas *);
 static void del_whowas_from_clist(struct Whowas **, struct Whowas *);
-static void add_whowas_to_list(struct Whowas **, struct Whowas *);
-static void del_whowas_from_list(struct Whowas **, struct Whowas *);
 
-struct Whowas WHOWAS[NICKNAMEHISTORYLENGTH];
-struct Whowas *WHOWASHASH[WW_MAX];
+/*
+ * The history is a ring of whowas_size entries, the oldest of which is
+ * reused by add_history().  Entries for one nick hang off a whowas_top,
+ * found through whowas_dict, so a lookup sees only that nick's entries.
+ */
+struct whowas_top {
+    char *name;
+    rb_dlink_list list;
+};
 
+static struct Whowas **whowas_ring;
+static int whowas_size;
 static int whowas_next = 0;
+static struct Dictionary *whowas_dict;
 
-unsigned int hash_whowas_name(const char *name)
+static void
+whowas_unlink(struct Whowas *who)
 {
-    return fnv_hash_upper((const unsigned char *) name, WW_MAX_BITS);
+    struct whowas_top *wtop = who->wtop;
+
+    if(who->online)
+        del_whowas_from_clist(&(who->online->whowas), who);
+
+    rb_dlinkDelete(&who->wnode, &wtop->list);
+    if(rb_dlink_list_length(&wtop->list) == 0) {
+        irc_dictionary_delete(whowas_dict, wtop->name);
+        rb_free(wtop->name);
+        rb_free(wtop);
+    }
+
+    scache_release(who->username);
+    scache_release(who->hostname);
+    scache_release(who->sockhost);
+    scache_release(who->realname);
 }
 
 void add_history(struct Client *client_p, int online)
 {
-    struct Whowas *who = &WHOWAS[whowas_next];
+    struct Whowas *who = whowas_ring[whowas_next];
+    struct whowas_top *wtop;
 
     s_assert(NULL != client_p);
 
     if(client_p == NULL)
         return;
 
-    if(who->hashv != -1) {
-        if(who->online)
-            del_whowas_from_clist(&(who->online->whowas), who);
-        del_whowas_from_list(&WHOWASHASH[who->hashv], who);
-    }
-    who->hashv = hash_whowas_name(client_p->name);
+    if(who != NULL)
+        whowas_unlink(who);
+    else
+        who = whowas_ring[whowas_next] = rb_malloc(sizeof(struct Whowas));
+
     who->logoff = rb_current_time();
-    /*
-     * NOTE: strcpy ok here, the sizes in the client struct MUST
-     * match the sizes in the whowas struct
-     */
     rb_strlcpy(who->name, client_p->name, sizeof(who->name));
-    strcpy(who->username, client_p->username);
-    strcpy(who->hostname, client_p->host);
-    strcpy(who->realname, client_p->info);
-    strcpy(who->suser, client_p->user->suser);
+    rb_strlcpy(who->suser, client_p->user->suser, sizeof(who->suser));
+    who->username = scache_intern(client_p->username);
+    who->hostname = scache_intern(client_p->host);
+    who->realname = scache_intern(client_p->info);
     if (!EmptyString(client_p->sockhost) && strcmp(client_p->sockhost, "0") && show_ip(NULL, client_p))
-        strcpy(who->sockhost, client_p->sockhost);
+        who->sockhost = scache_intern(client_p->sockhost);
     else
-        who->sockhost[0] = '\0';
+        who->sockhost = scache_intern("");
 
     who->servername = scache_get_name(client_p->servptr->serv->nameinfo);
 
@@ -92,9 +113,17 @@ void add_history(struct Client *client_p, int online)
         add_whowas_to_clist(&(client_p->whowas), who);
     } else
         who->online = NULL;
-    add_whowas_to_list(&WHOWASHASH[who->hashv], who);
+
+    if((wtop = irc_dictionary_retrieve(whowas_dict, who->name)) == NULL) {
+        wtop = rb_malloc(sizeof(struct whowas_top));
+        wtop->name = rb_strdup(who->name);
+        irc_dictionary_add(whowas_dict, wtop->name, wtop);
+    }
+    who->wtop = wtop;
+    rb_dlinkAdd(who, &who->wnode, &wtop->list);
+
     whowas_next++;
-    if(whowas_next == NICKNAMEHISTORYLENGTH)
+    if(whowas_next == whowas_size)
         whowas_next = 0;
 }
 
@@ -111,15 +140,16 @@ void off_history(struct Client *client_p)
 
 struct Client *get_history(const char *nick, time_t timelimit)
 {
+    struct whowas_top *wtop;
     struct Whowas *temp;
-    int blah;
+    rb_dlink_node *ptr;
+
+    if((wtop = irc_dictionary_retrieve(whowas_dict, nick)) == NULL)
+        return NULL;
 
     timelimit = rb_current_time() - timelimit;
-    blah = hash_whowas_name(nick);
-    temp = WHOWASHASH[blah];
-    for (; temp; temp = temp->next) {
-        if(irccmp(nick, temp->name))
-            continue;
+    RB_DLINK_FOREACH(ptr, wtop->list.head) {
+        temp = ptr->data;
         if(temp->logoff < timelimit)
             continue;
         return temp->online;
@@ -127,23 +157,80 @@ struct Client *get_history(const char *nick, time_t timelimit)
     return NULL;
 }
 
+rb_dlink_list *
+whowas_get_list(const char *nick)
+{
+    struct whowas_top *wtop;
+
+    if((wtop = irc_dictionary_retrieve(whowas_dict, nick)) == NULL)
+        return NULL;
+
+    return &wtop->list;
+}
+
 void count_whowas_memory(size_t * wwu, size_t * wwum)
 {
-    *wwu = NICKNAMEHISTORYLENGTH;
-    *wwum = NICKNAMEHISTORYLENGTH * sizeof(struct Whowas);
+    size_t count = 0;
+    int i;
+
+    for (i = 0; i < whowas_size; i++)
+        if(whowas_ring[i] != NULL)
+            count++;
+
+    *wwu = count;
+    *wwum = count * sizeof(struct Whowas) +
+            irc_dictionary_size(whowas_dict) * sizeof(struct whowas_top) +
+            whowas_size * sizeof(struct Whowas *);
 }
 
+/* whowas_set_size()
+ *
+ * inputs	- new number of entries
+ * outputs	-
+ * side effects - the ring is reallocated, keeping the newest entries
+ *		  that fit and forgetting the rest
+ */
 void
-initwhowas()
+whowas_set_size(int size)
 {
-    int i;
+    struct Whowas **ring, *who;
+    int i, used = 0, drop, n = 0;
+
+    if(size < 1 || size == whowas_size)
+        return;
+
+    for (i = 0; i < whowas_size; i++)
+        if(whowas_ring[i] != NULL)
+            used++;
+
+    drop = used > size ? used - size : 0;
+    ring = rb_malloc(sizeof(struct Whowas *) * size);
 
-    for (i = 0; i < NICKNAMEHISTORYLENGTH; i++) {
-        memset((void *) &WHOWAS[i], 0, sizeof(struct Whowas));
-        WHOWAS[i].hashv = -1;
+    /* oldest first, starting from the slot add_history() reuses next */
+    for (i = 0; i < whowas_size; i++) {
+        who = whowas_ring[(whowas_next + i) % whowas_size];
+        if(who == NULL)
+            continue;
+
+        if(drop > 0) {
+            whowas_unlink(who);
+            rb_free(who);
+            drop--;
+        } else
+            ring[n++] = who;
     }
-    for (i = 0; i < WW_MAX; i++)
-        WHOWASHASH[i] = NULL;
+
+    rb_free(whowas_ring);
+    whowas_ring = ring;
+    whowas_size = size;
+    whowas_next = n % size;
+}
+
+void
+initwhowas()
+{
+    whowas_dict = irc_dictionary_create(irccmp);
+    whowas_set_size(NICKNAMEHISTORYLENGTH);
 }
 
 
@@ -166,23 +253,3 @@ del_whowas_from_clist(struct Whowas **bucket, struct Whowas *whowas)
     if(whowas->cnext)
         whowas->cnext->cprev = whowas->cprev;
 }
-
-static void
-add_whowas_to_list(struct Whowas **bucket, struct Whowas *whowas)
-{
-    whowas->prev = NULL;
-    if((whowas->next = *bucket) != NULL)
-        whowas->next->prev = whowas;
-    *bucket = whowas;
-}
-
-static void
-del_whowas_from_list(struct Whowas **bucket, struct Whowas *whowas)
-{
-    if(whowas->prev)
-        whowas->prev->next = whowas->next;
-    else
-        *bucket = whowas->next;
-    if(whowas->next)
-        whowas->next->prev = whowas->prev;
-}
@@ -124,6 +124,7 @@ typedef struct _conn {
 #define FLAG_SSL_W_WANTS_R 0x10	/* output needs to wait until input possible */
 #define FLAG_SSL_R_WANTS_W 0x20	/* input needs to wait until output possible */
 #define FLAG_ZIPSSL	0x40
+#define FLAG_KTLS	0x80	/* kernel does TLS, waiting to hand the socket back */
 
 #define IsSSL(x) ((x)->flags & FLAG_SSL)
 #define IsZip(x) ((x)->flags & FLAG_ZIP)
@@ -132,6 +133,7 @@ typedef struct _conn {
 #define IsSSLWWantsR(x) ((x)->flags & FLAG_SSL_W_WANTS_R)
 #define IsSSLRWantsW(x) ((x)->flags & FLAG_SSL_R_WANTS_W)
 #define IsZipSSL(x)	((x)->flags & FLAG_ZIPSSL)
+#define IsKTLS(x)	((x)->flags & FLAG_KTLS)
 
 #define SetSSL(x) ((x)->flags |= FLAG_SSL)
 #define SetZip(x) ((x)->flags |= FLAG_ZIP)
@@ -140,6 +142,7 @@ typedef struct _conn {
 #define SetSSLWWantsR(x) ((x)->flags |= FLAG_SSL_W_WANTS_R)
 #define SetSSLRWantsW(x) ((x)->flags |= FLAG_SSL_R_WANTS_W)
 #define SetZipSSL(x)	((x)->flags |= FLAG_ZIPSSL)
+#define SetKTLS(x)	((x)->flags |= FLAG_KTLS)
 
 #define ClearSSL(x) ((x)->flags &= ~FLAG_SSL)
 #define ClearZip(x) ((x)->flags &= ~FLAG_ZIP)
@@ -171,6 +174,7 @@ static void conn_plain_read_shutdown_cb(rb_fde_t *fd, void *data);
 static void mod_cmd_write_queue(mod_ctl_t * ctl, const void *data, size_t len);
 static const char *remote_closed = "Remote host closed the connection";
 static int ssl_ok;
+static int ktls_ok;
 #ifdef HAVE_LIBZ
 static int zlib_ok = 1;
 #else
@@ -473,6 +477,48 @@ plain_check_cork(conn_t * conn)
 }
 
 
+/* conn_ktls_handoff()
+ *
+ * inputs	- connection whose TLS socket the kernel now encrypts, after
+ *		  the ircd has stopped writing to plain_fd
+ * outputs	-
+ * side effects - once everything the ircd sent has gone out, both
+ *		  sockets are passed back to the ircd and the conn is done
+ */
+static void
+conn_ktls_handoff(conn_t * conn)
+{
+    mod_ctl_buf_t *ctl_buf;
+
+    if(rb_rawbuf_length(conn->modbuf_out) > 0) {
+        /* come back through conn_plain_read_cb() once it has drained */
+        SetCork(conn);
+        rb_setselect(conn->plain_fd, RB_SELECT_READ, NULL, NULL);
+        conn_mod_write_sendq(conn->mod_fd, conn);
+        return;
+    }
+
+    rb_setselect(conn->mod_fd, RB_SELECT_READ | RB_SELECT_WRITE, NULL, NULL);
+    rb_setselect(conn->plain_fd, RB_SELECT_READ | RB_SELECT_WRITE, NULL, NULL);
+
+    /* plain_fd goes back too, so the ircd never sees it close first */
+    ctl_buf = rb_malloc(sizeof(mod_ctl_buf_t));
+    ctl_buf->buf = rb_malloc(5);
+    ctl_buf->buflen = 5;
+    ctl_buf->buf[0] = 'H';
+    int32_to_buf(&ctl_buf->buf[1], conn->id);
+    ctl_buf->F[0] = conn->mod_fd;
+    ctl_buf->F[1] = conn->plain_fd;
+    ctl_buf->nfds = 2;
+
+    SetDead(conn);
+    rb_dlinkDelete(&conn->node, connid_hash(conn->id));
+    rb_dlinkAdd(conn, &conn->node, &dead_list);
+
+    rb_dlinkAddTail(ctl_buf, &ctl_buf->node, &conn->ctl->writeq);
+    mod_write_ctl(conn->ctl->F, conn->ctl);
+}
+
 static void
 conn_plain_read_cb(rb_fde_t *fd, void *data)
 {
@@ -493,6 +539,11 @@ conn_plain_read_cb(rb_fde_t *fd, void *data)
 
         length = rb_read(conn->plain_fd, inbuf, sizeof(inbuf));
 
+        if(length == 0 && IsKTLS(conn)) {
+            conn_ktls_handoff(conn);
+            return;
+        }
+
         if(length == 0 || (length < 0 && !rb_ignore_errno(errno))) {
             close_conn(conn, NO_WAIT, NULL);
             return;
@@ -650,6 +701,21 @@ ssl_process_accept_cb(rb_fde_t *F, int status, struct sockaddr *addr, rb_socklen
             int32_to_buf(&buf[1], conn->id);
             mod_cmd_write_queue(conn->ctl, buf, sizeof buf);
         }
+
+        /* nothing has been decrypted for the ircd yet, so once the kernel
+         * has the keys only what the ircd already wrote is left to pass
+         * on.  Once told, it stops writing and shuts down its end.
+         */
+        if(ktls_ok && conn->id >= 0 && rb_ssl_detach_ktls(F)) {
+            ClearSSL(conn);
+            SetKTLS(conn);
+            buf[0] = 'T';
+            int32_to_buf(&buf[1], conn->id);
+            mod_cmd_write_queue(conn->ctl, buf, 5);
+            conn_plain_read_cb(conn->plain_fd, conn);
+            return;
+        }
+
         conn_mod_read_cb(conn->mod_fd, conn);
         conn_plain_read_cb(conn->plain_fd, conn);
         return;
@@ -871,6 +937,14 @@ ssl_new_keys(mod_ctl_t * ctl, mod_ctl_buf_t * ctl_buf)
     }
 }
 
+static void
+ssl_set_ktls(mod_ctl_t * ctl, mod_ctl_buf_t * ctl_buf)
+{
+    int enable = ctl_buf->buf[1] == '1';
+
+    ktls_ok = rb_ssl_set_ktls(enable) && enable;
+}
+
 static void
 send_nossl_support(mod_ctl_t * ctl, mod_ctl_buf_t * ctlb)
 {
@@ -958,6 +1032,12 @@ mod_process_cmd_recv(mod_ctl_t * ctl)
             ssl_new_keys(ctl, ctl_buf);
             break;
         }
+        case 'L': {
+            if(!ssl_ok || ctl_buf->buflen != 2)
+                break;
+            ssl_set_ktls(ctl, ctl_buf);
+            break;
+        }
         case 'I':
             init_prng(ctl, ctl_buf);
             break;